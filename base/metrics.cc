@@ -0,0 +1,265 @@
+#include "base/metrics.h"
+#include "base/singleton.h"
+#include "base/string_printf.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glog/logging.h>
+
+namespace base {
+
+namespace {
+
+void AtomicAdd(std::atomic<double>* target, double delta) {
+  double current = target->load(std::memory_order_relaxed);
+  while (!target->compare_exchange_weak(current, current + delta,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+// Label values may hold anything; backslash, quote and newline are escaped.
+void AppendEscaped(const std::string& value, std::string* out) {
+  for (char c : value) {
+    switch (c) {
+      case '\\': out->append("\\\\"); break;
+      case '"':  out->append("\\\""); break;
+      case '\n': out->append("\\n"); break;
+      default:   out->push_back(c);
+    }
+  }
+}
+
+// {a="1",b="2"}, or "" without labels. |extra| is appended last, e.g. the
+// le label of a histogram bucket.
+std::string FormatLabels(const MetricLabels& labels,
+                         const std::string& extra = std::string()) {
+  if (labels.empty() && extra.empty()) {
+    return std::string();
+  }
+  std::string out = "{";
+  for (const auto& label : labels) {
+    if (out.size() > 1) {
+      out.push_back(',');
+    }
+    out.append(label.first);
+    out.append("=\"");
+    AppendEscaped(label.second, &out);
+    out.push_back('"');
+  }
+  if (!extra.empty()) {
+    if (out.size() > 1) {
+      out.push_back(',');
+    }
+    out.append(extra);
+  }
+  out.push_back('}');
+  return out;
+}
+
+std::string FormatValue(double value) {
+  if (std::isnan(value)) {
+    return "NaN";
+  }
+  if (std::isinf(value)) {
+    return value > 0 ? "+Inf" : "-Inf";
+  }
+  if (value == std::floor(value) && std::fabs(value) < 1e15) {
+    return StringPrintf("%lld", static_cast<long long>(value));
+  }
+  return StringPrintf("%.9g", value);
+}
+
+const char* TypeName(MetricsRegistry::Type type) {
+  switch (type) {
+    case MetricsRegistry::COUNTER:   return "counter";
+    case MetricsRegistry::GAUGE:     return "gauge";
+    case MetricsRegistry::HISTOGRAM: return "histogram";
+  }
+  return "untyped";
+}
+
+} // namespace
+
+void Gauge::Add(double delta) {
+  AtomicAdd(&value_, delta);
+}
+
+Histogram::Histogram(const std::vector<double>& bounds)
+    : bounds_(bounds),
+      buckets_(new std::atomic<uint64_t>[bounds.size() + 1]),
+      count_(0),
+      sum_(0) {
+  DCHECK(std::is_sorted(bounds_.begin(), bounds_.end()));
+  for (size_t i = 0; i <= bounds_.size(); ++i) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void Histogram::Observe(double value) {
+  size_t index = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+  buckets_[index].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  AtomicAdd(&sum_, value);
+}
+
+uint64_t Histogram::BucketCount(size_t index) const {
+  return index <= bounds_.size() ? buckets_[index].load(std::memory_order_relaxed) : 0;
+}
+
+// static
+std::vector<double> Histogram::LatencyBounds() {
+  return std::vector<double>{0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+                             0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300};
+}
+
+// Every metric sharing one name, keyed by their formatted labels.
+struct MetricsRegistry::Family {
+  struct Callback {
+    std::string labels;
+    std::function<double()> sample;
+  };
+
+  Family(const std::string& help, Type type) : help(help), type(type) {}
+
+  const std::string help;
+  const Type type;
+  std::map<std::string, std::unique_ptr<Counter>> counters;
+  std::map<std::string, std::unique_ptr<Gauge>> gauges;
+  std::map<std::string, std::pair<MetricLabels, std::unique_ptr<Histogram>>> histograms;
+  std::map<int, Callback> callbacks;
+};
+
+MetricsRegistry::MetricsRegistry() : next_callback_id_(1) {}
+
+MetricsRegistry::~MetricsRegistry() {}
+
+// static
+MetricsRegistry* MetricsRegistry::GetInstance() {
+  return Singleton<MetricsRegistry>::GetInstance();
+}
+
+MetricsRegistry::Family* MetricsRegistry::GetFamily(const std::string& name,
+                                                    const std::string& help,
+                                                    Type type) {
+  std::unique_ptr<Family>& family = families_[name];
+  if (!family) {
+    family.reset(new Family(help, type));
+  }
+  CHECK(family->type == type) << "metric " << name << " registered as "
+                              << TypeName(family->type) << ", used as "
+                              << TypeName(type);
+  return family.get();
+}
+
+Counter* MetricsRegistry::GetCounter(const std::string& name,
+                                     const std::string& help,
+                                     const MetricLabels& labels) {
+  std::lock_guard<std::mutex> l(lock_);
+  std::unique_ptr<Counter>& counter =
+      GetFamily(name, help, COUNTER)->counters[FormatLabels(labels)];
+  if (!counter) {
+    counter.reset(new Counter());
+  }
+  return counter.get();
+}
+
+Gauge* MetricsRegistry::GetGauge(const std::string& name,
+                                 const std::string& help,
+                                 const MetricLabels& labels) {
+  std::lock_guard<std::mutex> l(lock_);
+  std::unique_ptr<Gauge>& gauge = GetFamily(name, help, GAUGE)->gauges[FormatLabels(labels)];
+  if (!gauge) {
+    gauge.reset(new Gauge());
+  }
+  return gauge.get();
+}
+
+Histogram* MetricsRegistry::GetHistogram(const std::string& name,
+                                         const std::string& help,
+                                         const MetricLabels& labels,
+                                         const std::vector<double>& bounds) {
+  std::lock_guard<std::mutex> l(lock_);
+  auto& histogram = GetFamily(name, help, HISTOGRAM)->histograms[FormatLabels(labels)];
+  if (!histogram.second) {
+    histogram.first = labels;
+    histogram.second.reset(new Histogram(bounds));
+  }
+  return histogram.second.get();
+}
+
+int MetricsRegistry::AddCallback(Type type,
+                                 const std::string& name,
+                                 const std::string& help,
+                                 const MetricLabels& labels,
+                                 const std::function<double()>& sample) {
+  CHECK(type != HISTOGRAM) << "callback metric " << name << " must be a counter or a gauge";
+  std::lock_guard<std::mutex> l(lock_);
+  int id = next_callback_id_++;
+  Family::Callback& callback = GetFamily(name, help, type)->callbacks[id];
+  callback.labels = FormatLabels(labels);
+  callback.sample = sample;
+  callbacks_[id] = name;
+  return id;
+}
+
+void MetricsRegistry::RemoveCallback(int id) {
+  std::lock_guard<std::mutex> l(lock_);
+  auto it = callbacks_.find(id);
+  if (it == callbacks_.end()) {
+    return;
+  }
+  families_[it->second]->callbacks.erase(id);
+  callbacks_.erase(it);
+}
+
+std::string MetricsRegistry::ExportText() const {
+  std::string out;
+  std::lock_guard<std::mutex> l(lock_);
+  for (const auto& entry : families_) {
+    const std::string& name = entry.first;
+    const Family& family = *entry.second;
+    if (family.counters.empty() && family.gauges.empty() &&
+        family.histograms.empty() && family.callbacks.empty()) {
+      continue;
+    }
+    StringAppendF(&out, "# HELP %s %s\n", name.c_str(), family.help.c_str());
+    StringAppendF(&out, "# TYPE %s %s\n", name.c_str(), TypeName(family.type));
+
+    for (const auto& counter : family.counters) {
+      StringAppendF(&out, "%s%s %llu\n", name.c_str(), counter.first.c_str(),
+                    static_cast<unsigned long long>(counter.second->value()));
+    }
+    for (const auto& gauge : family.gauges) {
+      StringAppendF(&out, "%s%s %s\n", name.c_str(), gauge.first.c_str(),
+                    FormatValue(gauge.second->value()).c_str());
+    }
+    for (const auto& callback : family.callbacks) {
+      StringAppendF(&out, "%s%s %s\n", name.c_str(), callback.second.labels.c_str(),
+                    FormatValue(callback.second.sample()).c_str());
+    }
+    for (const auto& entry : family.histograms) {
+      const MetricLabels& labels = entry.second.first;
+      const Histogram& histogram = *entry.second.second;
+      // Buckets are read one by one while Observe() goes on; the count
+      // printed is their sum so the +Inf bucket always matches it.
+      uint64_t cumulative = 0;
+      for (size_t i = 0; i <= histogram.bounds().size(); ++i) {
+        cumulative += histogram.BucketCount(i);
+        std::string le = i < histogram.bounds().size()
+                             ? FormatValue(histogram.bounds()[i])
+                             : std::string("+Inf");
+        StringAppendF(&out, "%s_bucket%s %llu\n", name.c_str(),
+                      FormatLabels(labels, "le=\"" + le + "\"").c_str(),
+                      static_cast<unsigned long long>(cumulative));
+      }
+      StringAppendF(&out, "%s_sum%s %s\n", name.c_str(), entry.first.c_str(),
+                    FormatValue(histogram.sum()).c_str());
+      StringAppendF(&out, "%s_count%s %llu\n", name.c_str(), entry.first.c_str(),
+                    static_cast<unsigned long long>(cumulative));
+    }
+  }
+  return out;
+}
+
+}  // namespace base
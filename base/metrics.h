@@ -0,0 +1,146 @@
+#ifndef BASE_METRICS_H_
+#define BASE_METRICS_H_
+
+// Process-wide counters, gauges and histograms, exported in the Prometheus
+// text format.
+//
+// Metrics are created once, usually at startup, through MetricsRegistry and
+// then updated through the returned pointers, which stay valid as long as
+// the registry. Updates are lock-free; only creation and export take the
+// registry lock.
+//
+//   base::Counter* acks = base::MetricsRegistry::GetInstance()->GetCounter(
+//       "mq_acks_total", "Deliveries acknowledged.", {{"queue", name}});
+//   acks->Increment();
+
+#include "base/macros.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace base {
+
+typedef std::map<std::string, std::string> MetricLabels;
+
+// Monotonically increasing count.
+class Counter {
+ public:
+  Counter() : value_(0) {}
+
+  void Increment(uint64_t n = 1) {
+    value_.fetch_add(n, std::memory_order_relaxed);
+  }
+  uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> value_;
+
+  DISALLOW_COPY_AND_ASSIGN(Counter);
+};
+
+// A value that goes up and down. Add() lets several owners share one
+// gauge, e.g. pools for the same database.
+class Gauge {
+ public:
+  Gauge() : value_(0) {}
+
+  void Set(double value) { value_.store(value, std::memory_order_relaxed); }
+  void Add(double delta);
+  double value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<double> value_;
+
+  DISALLOW_COPY_AND_ASSIGN(Gauge);
+};
+
+// Counts observations in fixed buckets, each holding the values at or
+// below its upper bound, as Prometheus histograms do.
+class Histogram {
+ public:
+  // |bounds| must be sorted; a +Inf bucket is always added.
+  explicit Histogram(const std::vector<double>& bounds);
+
+  void Observe(double value);
+
+  const std::vector<double>& bounds() const { return bounds_; }
+  // Observations in bucket |index| alone (not cumulative); index
+  // bounds().size() is the +Inf bucket.
+  uint64_t BucketCount(size_t index) const;
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  double sum() const { return sum_.load(std::memory_order_relaxed); }
+
+  // 0.5ms to 5 minutes, for latencies in seconds.
+  static std::vector<double> LatencyBounds();
+
+ private:
+  const std::vector<double> bounds_;
+  std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+  std::atomic<uint64_t> count_;
+  std::atomic<double> sum_;
+
+  DISALLOW_COPY_AND_ASSIGN(Histogram);
+};
+
+class MetricsRegistry {
+ public:
+  enum Type { COUNTER, GAUGE, HISTOGRAM };
+
+  MetricsRegistry();
+  ~MetricsRegistry();
+
+  static MetricsRegistry* GetInstance();
+
+  // Return the metric called |name| with |labels|, creating it on first
+  // use; the same name and labels always give the same object. |help| is
+  // taken from the first call. A name must keep one type.
+  Counter* GetCounter(const std::string& name,
+                      const std::string& help,
+                      const MetricLabels& labels = MetricLabels());
+  Gauge* GetGauge(const std::string& name,
+                  const std::string& help,
+                  const MetricLabels& labels = MetricLabels());
+  Histogram* GetHistogram(const std::string& name,
+                          const std::string& help,
+                          const MetricLabels& labels = MetricLabels(),
+                          const std::vector<double>& bounds = Histogram::LatencyBounds());
+
+  // Adds a COUNTER or GAUGE whose value is read from |sample| at export
+  // time, for state that already lives elsewhere (queue lengths, pool
+  // sizes). |sample| runs under the registry lock and must not call back
+  // into the registry. Returns an id for RemoveCallback(); once it has
+  // returned, |sample| is no longer running nor called again.
+  int AddCallback(Type type,
+                  const std::string& name,
+                  const std::string& help,
+                  const MetricLabels& labels,
+                  const std::function<double()>& sample);
+  void RemoveCallback(int id);
+
+  // Every metric in the Prometheus text exposition format (version 0.0.4).
+  std::string ExportText() const;
+
+ private:
+  struct Family;
+
+  Family* GetFamily(const std::string& name, const std::string& help, Type type);
+
+  mutable std::mutex lock_;
+  std::map<std::string, std::unique_ptr<Family>> families_;
+  // Callback id -> name of its family.
+  std::map<int, std::string> callbacks_;
+  int next_callback_id_;
+
+  DISALLOW_COPY_AND_ASSIGN(MetricsRegistry);
+};
+
+}  // namespace base
+
+#endif  // BASE_METRICS_H_
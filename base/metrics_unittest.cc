@@ -0,0 +1,79 @@
+#include "base/metrics.h"
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+bool Contains(const std::string& text, const std::string& line) {
+  return text.find(line) != std::string::npos;
+}
+
+} // namespace
+
+TEST(MetricsRegistryTest, Same_Name_And_Labels_Same_Metric) {
+  base::MetricsRegistry registry;
+  base::Counter* a = registry.GetCounter("requests_total", "Requests.", {{"queue", "a"}});
+  base::Counter* b = registry.GetCounter("requests_total", "Requests.", {{"queue", "b"}});
+  EXPECT_NE(a, b);
+  EXPECT_EQ(a, registry.GetCounter("requests_total", "Requests.", {{"queue", "a"}}));
+}
+
+TEST(MetricsRegistryTest, Export_Text) {
+  base::MetricsRegistry registry;
+  registry.GetCounter("acks_total", "Acks.", {{"queue", "q\"1"}})->Increment(3);
+  base::Gauge* gauge = registry.GetGauge("in_flight", "In flight.");
+  gauge->Add(2);
+  gauge->Add(-0.5);
+  int id = registry.AddCallback(base::MetricsRegistry::GAUGE, "idle_workers", "Idle.",
+                                {{"pool", "w"}}, [] { return 7.0; });
+
+  std::string text = registry.ExportText();
+  EXPECT_TRUE(Contains(text, "# HELP acks_total Acks.\n# TYPE acks_total counter\n"));
+  EXPECT_TRUE(Contains(text, "acks_total{queue=\"q\\\"1\"} 3\n"));
+  EXPECT_TRUE(Contains(text, "# TYPE in_flight gauge\nin_flight 1.5\n"));
+  EXPECT_TRUE(Contains(text, "idle_workers{pool=\"w\"} 7\n"));
+
+  registry.RemoveCallback(id);
+  EXPECT_FALSE(Contains(registry.ExportText(), "idle_workers"));
+}
+
+TEST(MetricsRegistryTest, Histogram_Buckets_Are_Cumulative) {
+  base::MetricsRegistry registry;
+  base::Histogram* histogram = registry.GetHistogram(
+      "latency_seconds", "Latency.", {{"queue", "q"}}, {0.1, 1});
+  histogram->Observe(0.05);
+  histogram->Observe(0.1);  // Bounds are inclusive.
+  histogram->Observe(0.5);
+  histogram->Observe(3);
+
+  std::string text = registry.ExportText();
+  EXPECT_TRUE(Contains(text, "latency_seconds_bucket{queue=\"q\",le=\"0.1\"} 2\n"));
+  EXPECT_TRUE(Contains(text, "latency_seconds_bucket{queue=\"q\",le=\"1\"} 3\n"));
+  EXPECT_TRUE(Contains(text, "latency_seconds_bucket{queue=\"q\",le=\"+Inf\"} 4\n"));
+  EXPECT_TRUE(Contains(text, "latency_seconds_sum{queue=\"q\"} 3.65\n"));
+  EXPECT_TRUE(Contains(text, "latency_seconds_count{queue=\"q\"} 4\n"));
+}
+
+TEST(MetricsRegistryTest, Concurrent_Updates) {
+  base::MetricsRegistry registry;
+  base::Counter* counter = registry.GetCounter("events_total", "Events.");
+  base::Histogram* histogram = registry.GetHistogram("value", "Values.");
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([counter, histogram] {
+      for (int i = 0; i < 100000; ++i) {
+        counter->Increment();
+        histogram->Observe(0.001);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(400000u, counter->value());
+  EXPECT_EQ(400000u, histogram->count());
+  EXPECT_NEAR(400.0, histogram->sum(), 1e-6);
+}
@@ -35,6 +35,9 @@ void DBConnection::Dispose(DBConnection* self) {
   if (pool && self->recyclable()) {
     pool->Put(self);
   } else {
+    if (pool) {
+      pool->Discard();
+    }
     self->ClearCache();
     delete self;
     //TODO
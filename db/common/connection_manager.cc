@@ -46,8 +46,8 @@ ConnectionManager::Open(const ConnectionInfo& info) {
     scoped_ref_ptr<ConnectionPool>& ref = connections_[info.connection_string];
     if (!ref) {
       ref = ConnectionPool::Create(info);
-      pool = ref;
     }
+    pool = ref;
   }
   return pool->Open();
 }
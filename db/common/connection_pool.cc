@@ -1,5 +1,6 @@
 #include "db/common/connection_pool.h"
 #include "db/backend/connector_interface.h"
+#include "threading/time_util.h"
 
 #include <stdlib.h>
 
@@ -24,22 +25,48 @@ ConnectionPool::ConnectionPool(const ConnectionInfo& info)
       size_(0) {
   limit_ = info.Get("@pool_size", 16);
   life_time_ = base::TimeDelta::FromSeconds(info.Get("@pool_max_idle", 600));
+
+  // Pools of the same database share their series.
+  base::MetricsRegistry* registry = base::MetricsRegistry::GetInstance();
+  const base::MetricLabels labels = {
+    {"pool", info.Get("host", "localhost") + "/" + info.Get("database", "")}
+  };
+  idle_ = registry->GetGauge("db_pool_idle_connections",
+      "Connections kept in the pool.", labels);
+  active_ = registry->GetGauge("db_pool_active_connections",
+      "Connections opened from the pool and not returned yet.", labels);
+  waits_ = registry->GetCounter("db_pool_waits_total",
+      "Open() calls that found no idle connection and connected.", labels);
+  wait_seconds_ = registry->GetHistogram("db_pool_wait_seconds",
+      "Time Open() spent connecting when no connection was idle.", labels);
 }
 
-ConnectionPool::~ConnectionPool() {}
+ConnectionPool::~ConnectionPool() {
+  idle_->Add(-static_cast<double>(size_));
+}
 
 scoped_ref_ptr<DBConnection> ConnectionPool::Open() {
   std::unique_ptr<db::ConnectorInterface> connector;
   if (limit_ == 0) {
+    // Not kept, but counted as active until Put() drops it.
     db::NewConnector(connection_info_, &connector);
-    return connector->Connect();
+    scoped_ref_ptr<DBConnection> connection = connector->Connect();
+    if (connection) {
+      active_->Add(1);
+      connection->set_connection_pool(this);
+    }
+    return connection;
   }
 
   db::NewConnector(connection_info_, &connector);
   scoped_ref_ptr<DBConnection> connection = get();
   if (!connection) {
+    waits_->Increment();
+    int64_t start = threading::TimeUtil::MonotonicTimeUsec();
     connection = connector->Connect();
+    wait_seconds_->Observe((threading::TimeUtil::MonotonicTimeUsec() - start) / 1e6);
   }
+  active_->Add(1);
   connection->set_connection_pool(this);
   return connection;
 }
@@ -51,8 +78,10 @@ scoped_ref_ptr<DBConnection> ConnectionPool::get() {
   scoped_ref_ptr<DBConnection> connection = nullptr;
   ConnectionPoolType garbage;
   base::Time now = base::Time::Now();
+  size_t taken = 0;
   {
     threading::Guard l(lock_);
+    size_t size = size_;
     ConnectionPoolType::iterator it = connection_pool_.begin();
     ConnectionPoolType::iterator tmp;
     while (it != connection_pool_.end()) {
@@ -72,19 +101,26 @@ scoped_ref_ptr<DBConnection> ConnectionPool::get() {
       connection_pool_.pop_back();
       size_--;
     }
+    taken = size - size_;
   }
+  idle_->Add(-static_cast<double>(taken));
   return connection;
 }
 
 void ConnectionPool::Put(DBConnection* connection_in) {
   std::unique_ptr<DBConnection> connection(connection_in);
+  if (connection.get()) {
+    active_->Add(-1);
+  }
   if (limit_ == 0) {
     return;
   }
   ConnectionPoolType garbage;
   base::Time now = base::Time::Now();
+  double added = 0;
   {
     threading::Guard l(lock_);
+    size_t size = size_;
 
     if (connection.get()) {
       connection_pool_.push_back(Entry());
@@ -112,7 +148,13 @@ void ConnectionPool::Put(DBConnection* connection_in) {
 		     connection_pool_.begin());
       size_--;
     }
+    added = static_cast<double>(size_) - static_cast<double>(size);
   }
+  idle_->Add(added);
+}
+
+void ConnectionPool::Discard() {
+  active_->Add(-1);
 }
 
 void ConnectionPool::GC() {
@@ -121,11 +163,14 @@ void ConnectionPool::GC() {
 
 void ConnectionPool::Clear() {
   ConnectionPoolType garbage;
+  size_t size = 0;
   {
     threading::Guard l(lock_);
     garbage.swap(connection_pool_);
+    size = size_;
     size_ = 0;
   }
+  idle_->Add(-static_cast<double>(size));
 }
 
 } // namespace
@@ -1,6 +1,7 @@
 #ifndef DB_COMMON_CONNECTION_POOL_H_
 #define DB_COMMON_CONNECTION_POOL_H_
 
+#include "base/metrics.h"
 #include "base/ref_counted.h"
 #include "threading/mutex.h"
 #include "db/common/connection_info.h"
@@ -14,6 +15,11 @@ namespace db {
 
 class DBConnection;
 
+// Keeps up to @pool_size idle connections for @pool_max_idle seconds.
+//
+// Exported to the base::MetricsRegistry, labelled pool=<host>/<database>:
+// idle and active (opened, not returned yet) connections, and the Open()
+// calls that found no idle connection and waited for a new one.
 class ConnectionPool : public base::RefCountedThreadSafe<ConnectionPool> {
  public:
   typedef scoped_ref_ptr<ConnectionPool> pointer;
@@ -25,6 +31,8 @@ class ConnectionPool : public base::RefCountedThreadSafe<ConnectionPool> {
   void GC();
   void Clear();
   void Put(DBConnection* connection);
+  // A connection taken by Open() was closed instead of Put() back.
+  void Discard();
 
  private:
   ConnectionPool();
@@ -43,10 +51,15 @@ class ConnectionPool : public base::RefCountedThreadSafe<ConnectionPool> {
   base::TimeDelta life_time_;
   ConnectionInfo connection_info_;
 
-  threading::Mutex lock_;
+  threading::FutexMutex lock_;
   size_t size_;
   ConnectionPoolType connection_pool_;
 
+  base::Gauge* idle_;
+  base::Gauge* active_;
+  base::Counter* waits_;
+  base::Histogram* wait_seconds_;
+
   DISALLOW_COPY_AND_ASSIGN(ConnectionPool);
  private:
   friend base::RefCountedThreadSafe<ConnectionPool>;
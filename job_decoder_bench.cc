@@ -0,0 +1,256 @@
+// Benchmark of the job decoding: the typed SAX decoder and the protobuf
+// wire format against the DOM parse the handlers used to do
+// (rapidjson::Document + GetString copies):
+//
+//   job_decoder_bench --iterations=1000000
+//   job_decoder_bench --type=transcode --payload_file=video_rpc_queue.txt
+//
+// The payloads are the mq_loadgen presets with distinct ids, or messages
+// captured from a queue, one per line. Each decoder runs over all of them
+// `iterations` times in total, single-threaded; the report is the time
+// and heap allocations per message. The protobuf payloads are the JSON ones
+// re-encoded, so their sizes are compared too.
+#include "base/file_path.h"
+#include "base/file_util.h"
+#include "base/status.h"
+#include "base/string_printf.h"
+#include "service/job_decoder.h"
+
+#include "third_party/rapidjson/include/rapidjson/document.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+DEFINE_string(type, "epub_info", "job type: epub_info or transcode");
+DEFINE_string(payload_file, "", "messages to decode, one per line; "
+                                "defaults to the mq_loadgen preset");
+DEFINE_int32(payloads, 1000, "distinct preset messages without --payload_file");
+DEFINE_int64(iterations, 1000000, "messages decoded per decoder");
+
+namespace {
+
+std::atomic<uint64_t> allocations(0);
+
+} // namespace
+
+// Counts heap allocations, operator new and rapidjson's CrtAllocator alike,
+// so the report shows what the buffer reuse saves. glibc only.
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_realloc(void* p, size_t size);
+
+void* malloc(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* realloc(void* p, size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(p, size);
+}
+
+} // extern "C"
+
+namespace {
+
+// Same shapes as mq_loadgen's --preset templates.
+std::string EpubInfoPayload(int64_t id) {
+  return base::StringPrintf(
+      "{\"book_id\":\"%lld\", \"book_path\":\"/tmp/%lld.epub\"}",
+      static_cast<long long>(id), static_cast<long long>(id));
+}
+
+std::string TranscodePayload(int64_t id) {
+  const long long seq = static_cast<long long>(id);
+  return base::StringPrintf(
+      "{\"video_source_path\":\"/data/note/201603181703265628/%lld/orig/isli_video_%lld.mp4\","
+      "\"video_target_path\":\"/data/note/201603181703265628/%lld/ld/orig/\","
+      "\"target_id\":\"%lld\",\"sample\":\"48000\",\"frame_size\":\"320x240\","
+      "\"frame_aspect\":\"4:3\",\"frame_rate\":\"25\",\"rate_bit\":\"350k\",\"time\":\"10\","
+      "\"url_prefix\":\"http://172.16.2.103/data/note/201603181703265628/%lld/ld/orig/\","
+      "\"m3u8_name\":\"my.m3u8\"}",
+      seq, seq, seq, seq, seq);
+}
+
+base::Status LoadPayloads(std::vector<std::string>* payloads) {
+  if (FLAGS_payload_file.empty()) {
+    for (int i = 0; i < FLAGS_payloads; ++i) {
+      payloads->push_back(FLAGS_type == "transcode" ? TranscodePayload(1000000 + i)
+                                                    : EpubInfoPayload(1000000 + i));
+    }
+    return base::Status::OK();
+  }
+  std::string text;
+  if (!base::ReadFileToString(base::FilePath(FLAGS_payload_file), &text)) {
+    return base::Status(base::Code::NOT_FOUND, "Can't read " + FLAGS_payload_file);
+  }
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t end = text.find('\n', pos);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    if (end > pos) {
+      payloads->push_back(text.substr(pos, end - pos));
+    }
+    pos = end + 1;
+  }
+  if (payloads->empty()) {
+    return base::Status(base::Code::INVALID_ARGUMENT, FLAGS_payload_file + " is empty");
+  }
+  return base::Status::OK();
+}
+
+// The handlers' code before the typed decoder.
+base::Status DomDecodeEpubInfo(const std::string& message, server::EpubInfoJob* job) {
+  rapidjson::Document d;
+  if (d.Parse(message.c_str()).HasParseError()) {
+    return base::Status(base::Code::INVALID_ARGUMENT, "Can't parse json: " + message);
+  }
+  std::string book_id = d["book_id"].GetString();
+  std::string book_path = d["book_path"].GetString();
+  job->book_id = ::strtoll(book_id.c_str(), nullptr, 10);
+  job->book_path = book_path;
+  return base::Status::OK();
+}
+
+base::Status DomDecodeTranscode(const std::string& message, server::TranscodeJob* job) {
+  rapidjson::Document d;
+  if (d.Parse(message.c_str()).HasParseError()) {
+    return base::Status(base::Code::INVALID_ARGUMENT, "Can't parse json: " + message);
+  }
+  std::string video_source_path = d["video_source_path"].GetString();
+  std::string video_target_path = d["video_target_path"].GetString();
+  std::string target_id = d["target_id"].GetString();
+  std::string sample = d["sample"].GetString();
+  std::string frame_size = d["frame_size"].GetString();
+  std::string frame_aspect = d["frame_aspect"].GetString();
+  std::string frame_rate = d["frame_rate"].GetString();
+  std::string rate_bit = d["rate_bit"].GetString();
+  std::string time = d["time"].GetString();
+  std::string url_prefix = d["url_prefix"].GetString();
+  std::string m3u8_name = d["m3u8_name"].GetString();
+  job->video_source_path = video_source_path;
+  job->video_target_path = video_target_path;
+  job->target_id = ::strtoll(target_id.c_str(), nullptr, 10);
+  job->sample = sample;
+  job->frame_size = frame_size;
+  job->frame_aspect = frame_aspect;
+  job->frame_rate = frame_rate;
+  job->rate_bit = rate_bit;
+  job->time = time;
+  job->url_prefix = url_prefix;
+  job->m3u8_name = m3u8_name;
+  return base::Status::OK();
+}
+
+// Built once, as a delivery's content type would be.
+const std::string protobuf_content_type(server::kProtobufContentType);
+
+base::Status PbDecodeEpubInfo(const std::string& message, server::EpubInfoJob* job) {
+  return server::DecodeEpubInfoJob(protobuf_content_type, message, job);
+}
+
+base::Status PbDecodeTranscode(const std::string& message, server::TranscodeJob* job) {
+  return server::DecodeTranscodeJob(protobuf_content_type, message, job);
+}
+
+// The JSON payloads in their protobuf encoding.
+std::vector<std::string> EncodePayloads(const std::vector<std::string>& payloads) {
+  std::vector<std::string> encoded(payloads.size());
+  for (size_t i = 0; i < payloads.size(); ++i) {
+    if (FLAGS_type == "transcode") {
+      server::TranscodeJob job;
+      CHECK(server::DecodeTranscodeJob(payloads[i], &job).ok());
+      server::EncodeTranscodeJob(job, &encoded[i]);
+    } else {
+      server::EpubInfoJob job;
+      CHECK(server::DecodeEpubInfoJob(payloads[i], &job).ok());
+      server::EncodeEpubInfoJob(job, &encoded[i]);
+    }
+  }
+  return encoded;
+}
+
+double AverageSize(const std::vector<std::string>& payloads) {
+  size_t bytes = 0;
+  for (const std::string& payload : payloads) {
+    bytes += payload.size();
+  }
+  return static_cast<double>(bytes) / payloads.size();
+}
+
+template <typename Job>
+void Run(const char* name, const std::vector<std::string>& payloads,
+         base::Status (*decode)(const std::string&, Job*)) {
+  Job job;
+  size_t bytes = 0;
+  // Warm up the thread-local buffers and the job's strings.
+  for (const std::string& payload : payloads) {
+    base::Status status = decode(payload, &job);
+    CHECK(status.ok()) << name << ": " << status.error_message();
+  }
+
+  uint64_t allocations_before = allocations.load();
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < FLAGS_iterations; ++i) {
+    const std::string& payload = payloads[i % payloads.size()];
+    decode(payload, &job);
+    bytes += payload.size();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  uint64_t allocated = allocations.load() - allocations_before;
+
+  std::cout << base::StringPrintf(
+      "%-10s %10.1f ns/msg %10.1f MB/s %8.2f allocs/msg\n", name,
+      elapsed.count() * 1e9 / FLAGS_iterations, bytes / elapsed.count() / 1e6,
+      static_cast<double>(allocated) / FLAGS_iterations);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (FLAGS_type != "epub_info" && FLAGS_type != "transcode") {
+    LOG(ERROR) << "unknown --type " << FLAGS_type;
+    return 1;
+  }
+  if (FLAGS_iterations <= 0) {
+    LOG(ERROR) << "--iterations must be positive";
+    return 1;
+  }
+  std::vector<std::string> payloads;
+  base::Status status = LoadPayloads(&payloads);
+  if (!status.ok()) {
+    LOG(ERROR) << status.ToString();
+    return 1;
+  }
+
+  // Also rejects payloads the DOM code would crash on.
+  std::vector<std::string> pb_payloads = EncodePayloads(payloads);
+
+  std::cout << FLAGS_type << ": " << payloads.size() << " payloads, "
+            << FLAGS_iterations << " iterations, "
+            << base::StringPrintf("%.1f bytes as JSON, %.1f as protobuf\n",
+                                  AverageSize(payloads), AverageSize(pb_payloads));
+  if (FLAGS_type == "transcode") {
+    Run<server::TranscodeJob>("sax", payloads, server::DecodeTranscodeJob);
+    Run<server::TranscodeJob>("dom", payloads, DomDecodeTranscode);
+    Run<server::TranscodeJob>("protobuf", pb_payloads, PbDecodeTranscode);
+  } else {
+    Run<server::EpubInfoJob>("sax", payloads, server::DecodeEpubInfoJob);
+    Run<server::EpubInfoJob>("dom", payloads, DomDecodeEpubInfo);
+    Run<server::EpubInfoJob>("protobuf", pb_payloads, PbDecodeEpubInfo);
+  }
+  return 0;
+}
@@ -0,0 +1,259 @@
+// A reference SymmetricService for CbcEncryptFiles: the files of every
+// stream are encrypted on one shared worker pool, so a job's segments are
+// encrypted in parallel over a single call. Only CreateSymmetricKey,
+// CbcEncryptFile and CbcEncryptFiles are implemented.
+//
+// Keys and IVs are hex, as CreateSymmetricKey returns them; a 16 byte key
+// means AES-128-CBC, 32 bytes AES-256-CBC, and an empty IV is all zeros.
+// Output is PKCS#7 padded.
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <grpc++/grpc++.h>
+#include "protos/crypto_server.grpc.pb.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include "base/eintr_wrapper.h"
+#include "base/scoped_file.h"
+#include "base/string_encode.h"
+#include "threading/function_runner.h"
+#include "threading/thread_factory.h"
+#include "threading/thread_manager.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+DEFINE_string(address, "0.0.0.0:50052", "Address to listen on.");
+DEFINE_int32(workers, 0, "Threads encrypting files, 0 = one per CPU.");
+DEFINE_int32(max_pending, 0,
+             "Files queued for the workers before streams stop reading, "
+             "0 = twice --workers.");
+
+using grpc::ServerBuilder;
+using grpc::ServerContext;
+using grpc::Status;
+
+namespace {
+
+const size_t kChunkSize = 64 * 1024;
+
+struct CipherContextDeleter {
+  void operator()(EVP_CIPHER_CTX* ctx) const { EVP_CIPHER_CTX_free(ctx); }
+};
+
+bool WriteAll(int fd, const unsigned char* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = HANDLE_EINTR(::write(fd, data, size));
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+Status EncryptFileCbc(const std::string& hex_key, const std::string& hex_iv,
+                      const std::string& source_path, const std::string& target_path) {
+  const std::string key = base::HexDecode(hex_key);
+  const EVP_CIPHER* cipher;
+  if (key.size() == 16) {
+    cipher = EVP_aes_128_cbc();
+  } else if (key.size() == 32) {
+    cipher = EVP_aes_256_cbc();
+  } else {
+    return Status(grpc::StatusCode::INVALID_ARGUMENT, "key is neither 128 nor 256 bits");
+  }
+  std::string iv = base::HexDecode(hex_iv);
+  if (iv.empty()) {
+    iv.assign(16, '\0');
+  } else if (iv.size() != 16) {
+    return Status(grpc::StatusCode::INVALID_ARGUMENT, "iv is not 128 bits");
+  }
+
+  base::ScopedFD source(HANDLE_EINTR(::open(source_path.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (!source.is_valid()) {
+    return Status(grpc::StatusCode::NOT_FOUND, "can't open " + source_path);
+  }
+  base::ScopedFD target(HANDLE_EINTR(::open(target_path.c_str(),
+                                            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                            0644)));
+  if (!target.is_valid()) {
+    return Status(grpc::StatusCode::PERMISSION_DENIED, "can't create " + target_path);
+  }
+
+  std::unique_ptr<EVP_CIPHER_CTX, CipherContextDeleter> ctx(EVP_CIPHER_CTX_new());
+  if (!ctx || EVP_EncryptInit_ex(ctx.get(), cipher, nullptr,
+                                 reinterpret_cast<const unsigned char*>(key.data()),
+                                 reinterpret_cast<const unsigned char*>(iv.data())) != 1) {
+    return Status(grpc::StatusCode::INTERNAL, "EVP_EncryptInit_ex failed");
+  }
+  std::unique_ptr<unsigned char[]> in(new unsigned char[kChunkSize]);
+  std::unique_ptr<unsigned char[]> out(new unsigned char[kChunkSize + EVP_MAX_BLOCK_LENGTH]);
+  int out_size;
+  for (;;) {
+    ssize_t n = HANDLE_EINTR(::read(source.get(), in.get(), kChunkSize));
+    if (n < 0) {
+      return Status(grpc::StatusCode::INTERNAL, "can't read " + source_path);
+    }
+    if (n == 0) {
+      break;
+    }
+    if (EVP_EncryptUpdate(ctx.get(), out.get(), &out_size, in.get(), static_cast<int>(n)) != 1 ||
+        !WriteAll(target.get(), out.get(), out_size)) {
+      return Status(grpc::StatusCode::INTERNAL, "can't encrypt to " + target_path);
+    }
+  }
+  if (EVP_EncryptFinal_ex(ctx.get(), out.get(), &out_size) != 1 ||
+      !WriteAll(target.get(), out.get(), out_size)) {
+    return Status(grpc::StatusCode::INTERNAL, "can't encrypt to " + target_path);
+  }
+  return Status::OK;
+}
+
+// The files of one CbcEncryptFiles call being encrypted.
+class StreamFiles {
+ public:
+  typedef grpc::ServerReaderWriter<crypto::CbcEncryptFilesResponse,
+                                   crypto::CbcEncryptFilesRequest> Stream;
+
+  explicit StreamFiles(Stream* stream) : stream_(stream), pending_(0), broken_(false) {}
+
+  void Started() {
+    std::lock_guard<std::mutex> l(lock_);
+    pending_++;
+  }
+
+  // Responses are written from the workers; gRPC allows one Write() at a
+  // time.
+  void Finished(const crypto::CbcEncryptFilesResponse& response) {
+    std::lock_guard<std::mutex> l(lock_);
+    if (!broken_ && !stream_->Write(response)) {
+      broken_ = true;
+    }
+    if (--pending_ == 0) {
+      done_.notify_all();
+    }
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> l(lock_);
+    done_.wait(l, [this] { return pending_ == 0; });
+  }
+
+  bool broken() {
+    std::lock_guard<std::mutex> l(lock_);
+    return broken_;
+  }
+
+ private:
+  Stream* const stream_;
+  std::mutex lock_;
+  std::condition_variable done_;
+  int pending_;   // guarded by lock_
+  bool broken_;   // guarded by lock_
+};
+
+class SymmetricServiceImpl final : public crypto::SymmetricService::Service {
+ public:
+  explicit SymmetricServiceImpl(std::shared_ptr<threading::ThreadManager> workers)
+      : workers_(workers) {}
+
+  Status CreateSymmetricKey(ServerContext* /* context */,
+                            const crypto::CreateSymmetricKeyRequest* request,
+                            crypto::CreateSymmetricKeyResponse* response) override {
+    int bytes = request->key_bits() == crypto::SymmetricKey256Bits ? 32 : 16;
+    unsigned char key[32];
+    if (RAND_bytes(key, bytes) != 1) {
+      return Status(grpc::StatusCode::INTERNAL, "RAND_bytes failed");
+    }
+    response->set_key(base::HexEncode(reinterpret_cast<const char*>(key), bytes));
+    OPENSSL_cleanse(key, sizeof(key));
+    return Status::OK;
+  }
+
+  Status CbcEncryptFile(ServerContext* /* context */,
+                        const crypto::CbcEncryptFileRequest* request,
+                        crypto::CbcEncryptFileResponse* /* response */) override {
+    return EncryptFileCbc(request->key(), request->iv(),
+                          request->file_source_path(), request->file_target_path());
+  }
+
+  // Reads requests as long as the workers keep up (Add() blocks on a full
+  // queue) and answers each file as it is done. The key and iv of the
+  // first request serve the whole stream.
+  Status CbcEncryptFiles(ServerContext* context, StreamFiles::Stream* stream) override {
+    StreamFiles files(stream);
+    std::string key;
+    std::string iv;
+    bool first = true;
+    auto request = std::make_shared<crypto::CbcEncryptFilesRequest>();
+    while (!context->IsCancelled() && !files.broken() && stream->Read(request.get())) {
+      if (first) {
+        key.swap(*request->mutable_key());
+        iv.swap(*request->mutable_iv());
+        first = false;
+      }
+      files.Started();
+      // files.Wait() below outlives the workers' use of key and iv.
+      workers_->Add(threading::FunctionRunner::Create([&files, &key, &iv, request] {
+        crypto::CbcEncryptFilesResponse response;
+        response.set_index(request->index());
+        Status status = EncryptFileCbc(key, iv,
+                                       request->file_source_path(),
+                                       request->file_target_path());
+        if (!status.ok()) {
+          LOG(ERROR) << request->file_source_path() << ": " << status.error_message();
+          response.set_error_code(status.error_code());
+          response.set_error_message(status.error_message());
+        }
+        files.Finished(response);
+      }));
+      request = std::make_shared<crypto::CbcEncryptFilesRequest>();
+    }
+    files.Wait();
+    if (!key.empty()) {
+      OPENSSL_cleanse(&key[0], key.size());
+    }
+    if (context->IsCancelled() || files.broken()) {
+      return Status(grpc::StatusCode::CANCELLED, "stream closed by the client");
+    }
+    return Status::OK;
+  }
+
+ private:
+  std::shared_ptr<threading::ThreadManager> workers_;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  int workers = FLAGS_workers > 0 ? FLAGS_workers
+                                  : std::max(1u, std::thread::hardware_concurrency());
+  int max_pending = FLAGS_max_pending > 0 ? FLAGS_max_pending : 2 * workers;
+  std::shared_ptr<threading::ThreadManager> thread_manager =
+      threading::ThreadManager::NewSimpleThreadManager(workers, max_pending);
+  thread_manager->SetThreadFactory(std::make_shared<threading::PosixThreadFactory>());
+  thread_manager->Start();
+
+  SymmetricServiceImpl symmetric_service(thread_manager);
+  ServerBuilder builder;
+  builder.AddListeningPort(FLAGS_address, grpc::InsecureServerCredentials());
+  builder.RegisterService(&symmetric_service);
+  std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+  LOG(INFO) << "Server listening on " << FLAGS_address << " with " << workers << " workers";
+  server->Wait();
+  thread_manager->Stop();
+  return 0;
+}
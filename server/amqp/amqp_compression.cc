@@ -0,0 +1,104 @@
+#include "server/amqp/amqp_compression.h"
+#include "base/macros.h"
+#include "base/string_printf.h"
+
+#include <zstd.h>
+
+namespace server {
+
+const char kZstdContentEncoding[] = "zstd";
+
+namespace {
+
+// Larger payloads are refused rather than allocated for.
+const unsigned long long kMaxPayloadSize = 64 << 20;
+
+struct ZstdContext {
+  ZstdContext() : cctx(ZSTD_createCCtx()), dctx(ZSTD_createDCtx()) {}
+  ~ZstdContext() {
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+  }
+
+  ZSTD_CCtx* const cctx;
+  ZSTD_DCtx* const dctx;
+  // DecodePayload()'s output and CompressPayload()'s scratch space, kept
+  // apart since handlers may publish while reading a payload.
+  std::string payload;
+  std::string compressed;
+
+  DISALLOW_COPY_AND_ASSIGN(ZstdContext);
+};
+
+thread_local ZstdContext zstd_context;
+
+base::Status InvalidPayload(const std::string& message) {
+  return base::Status(base::Code::INVALID_ARGUMENT, message);
+}
+
+bool IsIdentity(const std::string& content_encoding) {
+  return content_encoding.empty() || content_encoding == "identity";
+}
+
+} // namespace
+
+bool CompressPayload(const std::string& body, const CompressionOptions& options,
+                     std::string* out) {
+  if (options.min_size == 0 || body.size() < options.min_size) {
+    return false;
+  }
+  ZstdContext& context = zstd_context;
+  std::string& compressed = context.compressed;
+  compressed.resize(ZSTD_compressBound(body.size()));
+  size_t size = ZSTD_compressCCtx(context.cctx, &compressed[0], compressed.size(),
+                                  body.data(), body.size(), options.level);
+  if (ZSTD_isError(size) || size >= body.size()) {
+    return false;
+  }
+  out->assign(compressed.data(), size);
+  return true;
+}
+
+base::Status DecompressPayload(const std::string& content_encoding,
+                               const char* data, size_t size, std::string* out) {
+  if (IsIdentity(content_encoding)) {
+    out->assign(data, size);
+    return base::Status::OK();
+  }
+  if (content_encoding != kZstdContentEncoding) {
+    return InvalidPayload("unsupported content encoding " + content_encoding);
+  }
+  unsigned long long content_size = ZSTD_getFrameContentSize(data, size);
+  if (content_size == ZSTD_CONTENTSIZE_ERROR || content_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+    return InvalidPayload("not a zstd frame with a content size");
+  }
+  if (content_size > kMaxPayloadSize) {
+    return InvalidPayload(base::StringPrintf("zstd payload of %llu bytes is too large",
+                                             content_size));
+  }
+  out->resize(content_size);
+  size_t decompressed = ZSTD_decompressDCtx(zstd_context.dctx, &(*out)[0], out->size(),
+                                            data, size);
+  if (ZSTD_isError(decompressed) || decompressed != content_size) {
+    out->clear();
+    return InvalidPayload(std::string("corrupt zstd payload: ") +
+                          (ZSTD_isError(decompressed) ? ZSTD_getErrorName(decompressed)
+                                                      : "short frame"));
+  }
+  return base::Status::OK();
+}
+
+base::Status DecodePayload(const std::string& content_encoding,
+                           const std::string& body,
+                           const std::string** payload) {
+  if (IsIdentity(content_encoding)) {
+    *payload = &body;
+    return base::Status::OK();
+  }
+  std::string& buffer = zstd_context.payload;
+  RETURN_IF_ERROR(DecompressPayload(content_encoding, body.data(), body.size(), &buffer));
+  *payload = &buffer;
+  return base::Status::OK();
+}
+
+} // namespace server
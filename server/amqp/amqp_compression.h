@@ -0,0 +1,55 @@
+#ifndef SERVER_AMQP_COMPRESSION_H_
+#define SERVER_AMQP_COMPRESSION_H_
+#include "base/status.h"
+
+#include <stddef.h>
+
+#include <string>
+
+namespace server {
+
+/**
+ * zstd compression of message bodies, announced in the AMQP
+ * content_encoding property so that receivers tell compressed bodies from
+ * plain ones without any negotiation.
+ *
+ * Both sides keep their zstd contexts per thread; the consumer side also
+ * decompresses into a per-thread buffer, so a warm thread handles
+ * compressed messages without allocating.
+ */
+extern const char kZstdContentEncoding[];  // "zstd"
+
+struct CompressionOptions {
+  CompressionOptions() : min_size(0), level(3) {}
+
+  size_t min_size;  // compress bodies of at least this many bytes, 0 = never
+  int level;        // zstd level, 1 (fastest) to 19
+};
+
+/**
+ * Sets `out` to `body` compressed and returns true if `options` ask for it
+ * and the result is smaller; `out` is then sent with kZstdContentEncoding.
+ * Returns false, leaving `out` alone, otherwise.
+ */
+bool CompressPayload(const std::string& body, const CompressionOptions& options,
+                     std::string* out);
+
+/**
+ * Decompresses `data` sent with `content_encoding` into `out`. "" and
+ * "identity" are copied as they are, other encodings are INVALID_ARGUMENT,
+ * like corrupt data and payloads over 64 MB.
+ */
+base::Status DecompressPayload(const std::string& content_encoding,
+                               const char* data, size_t size, std::string* out);
+
+/**
+ * The body of a message as its handler should see it: `body` itself when
+ * it isn't compressed, or else its decompressed payload in a buffer of the
+ * calling thread that stays valid until the thread's next call.
+ */
+base::Status DecodePayload(const std::string& content_encoding,
+                           const std::string& body,
+                           const std::string** payload);
+
+} // namespace server
+#endif // SERVER_AMQP_COMPRESSION_H_
@@ -0,0 +1,78 @@
+#include "server/amqp/amqp_compression.h"
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+std::string CatalogReply() {
+  std::string reply = "{\"catalog\":[";
+  for (int i = 0; i < 500; ++i) {
+    reply += "{\"title\":\"Chapter " + std::to_string(i) + "\",\"href\":\"OEBPS/ch" +
+             std::to_string(i) + ".xhtml\"},";
+  }
+  reply += "{}]}";
+  return reply;
+}
+
+} // namespace
+
+TEST(AmqpCompressionTest, Round_Trips_Large_Bodies) {
+  const std::string body = CatalogReply();
+  server::CompressionOptions options;
+  options.min_size = 1024;
+  std::string compressed;
+  ASSERT_TRUE(server::CompressPayload(body, options, &compressed));
+  EXPECT_LT(compressed.size(), body.size() / 4);
+
+  const std::string* payload = nullptr;
+  ASSERT_TRUE(server::DecodePayload(server::kZstdContentEncoding, compressed, &payload).ok());
+  EXPECT_EQ(body, *payload);
+  // The buffer is reused by the next message of the thread.
+  const std::string* first = payload;
+  ASSERT_TRUE(server::DecodePayload("zstd", compressed, &payload).ok());
+  EXPECT_EQ(first, payload);
+
+  std::string decompressed;
+  ASSERT_TRUE(server::DecompressPayload("zstd", compressed.data(), compressed.size(),
+                                        &decompressed).ok());
+  EXPECT_EQ(body, decompressed);
+}
+
+TEST(AmqpCompressionTest, Leaves_Small_And_Plain_Bodies_Alone) {
+  server::CompressionOptions options;
+  std::string out = "untouched";
+  EXPECT_FALSE(server::CompressPayload(CatalogReply(), options, &out));
+  options.min_size = 64;
+  EXPECT_FALSE(server::CompressPayload("{\"book_id\":1}", options, &out));
+  // Incompressible.
+  std::string noise;
+  for (int i = 0; i < 256; ++i) {
+    noise += static_cast<char>((i * 7919) ^ (i >> 3));
+  }
+  EXPECT_FALSE(server::CompressPayload(noise, options, &out));
+  EXPECT_EQ("untouched", out);
+
+  const std::string body = "{\"book_id\":1}";
+  const std::string* payload = nullptr;
+  ASSERT_TRUE(server::DecodePayload("", body, &payload).ok());
+  EXPECT_EQ(&body, payload);
+  ASSERT_TRUE(server::DecodePayload("identity", body, &payload).ok());
+  EXPECT_EQ(&body, payload);
+}
+
+TEST(AmqpCompressionTest, Rejects_Bad_Payloads) {
+  const std::string* payload = nullptr;
+  base::Status status = server::DecodePayload("gzip", "abc", &payload);
+  EXPECT_EQ(base::Code::INVALID_ARGUMENT, status.code());
+  EXPECT_EQ("unsupported content encoding gzip", status.error_message());
+  EXPECT_FALSE(server::DecodePayload("zstd", "not zstd", &payload).ok());
+
+  server::CompressionOptions options;
+  options.min_size = 1;
+  std::string compressed;
+  ASSERT_TRUE(server::CompressPayload(CatalogReply(), options, &compressed));
+  compressed.resize(compressed.size() / 2);
+  EXPECT_FALSE(server::DecodePayload("zstd", compressed, &payload).ok());
+}
@@ -0,0 +1,301 @@
+#include "server/amqp/amqp_connection_hub.h"
+#include "threading/exception.h"
+#include "threading/mutex.h"
+#include "threading/thread_factory.h"
+
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <glog/logging.h>
+
+namespace server {
+
+namespace {
+
+const int kReconnectDelayMs = 1000;
+const int kCloseTimeoutMs = 2000;
+
+} // namespace
+
+/////////////////////////// AmqpEventLoop
+
+class AmqpEventLoop::Handler : public AMQP::LibEventHandler {
+ public:
+  explicit Handler(AmqpEventLoop* loop)
+      : AMQP::LibEventHandler(loop->event_base()), loop_(loop) {}
+
+  void onError(AMQP::TcpConnection* /* connection */, const char* message) override {
+    loop_->OnConnectionLost(message);
+  }
+
+  void onClosed(AMQP::TcpConnection* /* connection */) override {
+    loop_->OnConnectionLost("connection closed");
+  }
+
+ private:
+  AmqpEventLoop* loop_;
+};
+
+AmqpEventLoop::AmqpEventLoop(const std::string& address)
+    : address_(address),
+      event_base_(::event_base_new()),
+      wakeup_fd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      wakeup_event_(nullptr),
+      loop_running_(false),
+      connected_(false),
+      stopping_(false),
+      user_count_(0),
+      finished_(false) {
+  if (event_base_ == nullptr || wakeup_fd_ < 0) {
+    throw threading::SystemResourceException("AmqpEventLoop: event_base/eventfd");
+  }
+  wakeup_event_ = ::event_new(event_base_, wakeup_fd_, EV_READ | EV_PERSIST,
+                              &AmqpEventLoop::OnWakeup, this);
+  ::event_add(wakeup_event_, nullptr);
+}
+
+AmqpEventLoop::~AmqpEventLoop() {
+  connection_.reset();
+  handler_.reset();
+  ::event_free(wakeup_event_);
+  ::close(wakeup_fd_);
+  ::event_base_free(event_base_);
+}
+
+void AmqpEventLoop::Run() {
+  loop_thread_ = ::pthread_self();
+  loop_running_ = true;
+
+  handler_.reset(new Handler(this));
+  Connect();
+  DrainTasks();
+  ::event_base_dispatch(event_base_);
+
+  loop_running_ = false;
+  connected_ = false;
+  for (AmqpChannelUser* user : users_) {
+    user->OnDisconnected();
+  }
+  users_.clear();
+  user_count_ = 0;
+  connection_.reset();
+  handler_.reset();
+
+  // Tasks posted before the loop stopped still run, disconnected; later
+  // ones are dropped (see Post()).
+  std::vector<std::function<void()>> tasks;
+  {
+    threading::Guard g(tasks_lock_);
+    finished_ = true;
+    tasks.swap(tasks_);
+  }
+  for (const auto& task : tasks) {
+    task();
+  }
+}
+
+bool AmqpEventLoop::InLoopThread() const {
+  return loop_running_.load() && ::pthread_equal(loop_thread_, ::pthread_self());
+}
+
+void AmqpEventLoop::RunInLoop(const std::function<void()>& func) {
+  Post(func);
+}
+
+bool AmqpEventLoop::Post(const std::function<void()>& func) {
+  if (InLoopThread()) {
+    func();
+    return true;
+  }
+  bool was_empty;
+  {
+    threading::Guard g(tasks_lock_);
+    if (finished_) {
+      return false;
+    }
+    was_empty = tasks_.empty();
+    tasks_.push_back(func);
+  }
+  if (was_empty) {
+    uint64_t one = 1;
+    ssize_t ret = ::write(wakeup_fd_, &one, sizeof(one));
+    (void) ret;  // EAGAIN only means the counter is already non-zero.
+  }
+  return true;
+}
+
+void AmqpEventLoop::Attach(AmqpChannelUser* user) {
+  user_count_++;
+  RunInLoop([this, user] {
+    users_.push_back(user);
+    if (connected_) {
+      user->OnConnected(connection_.get());
+    }
+  });
+}
+
+void AmqpEventLoop::Detach(AmqpChannelUser* user,
+                           const std::function<void()>& detached) {
+  bool posted = Post([this, user, detached] {
+    auto it = std::find(users_.begin(), users_.end(), user);
+    if (it != users_.end()) {
+      users_.erase(it);
+      user_count_--;
+      user->OnDisconnected();
+    }
+    if (detached) {
+      detached();
+    }
+  });
+  // Otherwise the loop has stopped, and with it disconnected `user`; a
+  // Stop() waiting for `detached` would wait forever.
+  if (!posted && detached) {
+    detached();
+  }
+}
+
+void AmqpEventLoop::Stop() {
+  RunInLoop([this] {
+    if (stopping_) {
+      return;
+    }
+    stopping_ = true;
+    for (AmqpChannelUser* user : users_) {
+      user->OnDisconnected();
+    }
+    users_.clear();
+    user_count_ = 0;
+    if (connected_) {
+      // onClosed() breaks the loop once the broker acknowledged the close;
+      // the timeout covers a broker that never answers.
+      connection_->close();
+      struct timeval tv = { kCloseTimeoutMs / 1000, 0 };
+      ::event_base_loopexit(event_base_, &tv);
+    } else {
+      ::event_base_loopbreak(event_base_);
+    }
+  });
+}
+
+void AmqpEventLoop::Connect() {
+  connection_.reset(new AMQP::TcpConnection(handler_.get(), AMQP::Address(address_)));
+  connected_ = true;
+  // AMQP-CPP buffers channel frames until the login completes, so users
+  // may open their channels right away.
+  for (AmqpChannelUser* user : users_) {
+    user->OnConnected(connection_.get());
+  }
+}
+
+void AmqpEventLoop::OnConnectionLost(const char* reason) {
+  if (!connected_) {
+    return;  // onError() and onClosed() may both report the same loss.
+  }
+  connected_ = false;
+  if (stopping_) {
+    ::event_base_loopbreak(event_base_);
+    return;
+  }
+  LOG(ERROR) << "AMQP connection to " << address_ << " lost: " << reason
+             << ", reconnecting in " << kReconnectDelayMs << "ms";
+  for (AmqpChannelUser* user : users_) {
+    user->OnDisconnected();
+  }
+  // The connection is still on the stack here; it is replaced from the
+  // reconnect timer.
+  struct timeval tv = { kReconnectDelayMs / 1000, (kReconnectDelayMs % 1000) * 1000 };
+  ::event_base_once(event_base_, -1, EV_TIMEOUT, &AmqpEventLoop::OnReconnect, this, &tv);
+}
+
+// static
+void AmqpEventLoop::OnReconnect(evutil_socket_t /* fd */, short /* what */, void* arg) {
+  AmqpEventLoop* loop = static_cast<AmqpEventLoop*>(arg);
+  if (loop->stopping_) {
+    return;
+  }
+  loop->Connect();
+}
+
+void AmqpEventLoop::DrainTasks() {
+  std::vector<std::function<void()>> tasks;
+  {
+    threading::Guard g(tasks_lock_);
+    tasks.swap(tasks_);
+  }
+  for (const auto& task : tasks) {
+    task();
+  }
+}
+
+// static
+void AmqpEventLoop::OnWakeup(evutil_socket_t fd, short /* what */, void* arg) {
+  uint64_t value;
+  ssize_t ret = ::read(fd, &value, sizeof(value));
+  (void) ret;
+  static_cast<AmqpEventLoop*>(arg)->DrainTasks();
+}
+
+/////////////////////////// AmqpConnectionHub
+
+AmqpConnectionHub::AmqpConnectionHub(const std::string& address, size_t loop_count)
+    : address_(address),
+      started_(false) {
+  if (loop_count == 0) {
+    long cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+    loop_count = cpus > 0 ? static_cast<size_t>(cpus) : 1;
+  }
+  for (size_t i = 0; i < loop_count; ++i) {
+    loops_.push_back(std::make_shared<AmqpEventLoop>(address_));
+  }
+}
+
+AmqpConnectionHub::~AmqpConnectionHub() {
+  Stop();
+}
+
+base::Status AmqpConnectionHub::Start() {
+  if (started_) {
+    return base::Status::OK();
+  }
+  threading::PosixThreadFactory factory(threading::ThreadFactory::ATTACHED);
+  try {
+    for (size_t i = 0; i < loops_.size(); ++i) {
+      std::shared_ptr<threading::Thread> thread = factory.NewThread(loops_[i]);
+      thread->SetName("amqp_loop_" + std::to_string(i));
+      thread->Start();
+      threads_.push_back(thread);
+    }
+  } catch (const base::TLibraryException& e) {
+    Stop();
+    return base::Status(base::Code::RESOURCE_EXHAUSTED, e.what());
+  }
+  started_ = true;
+  LOG(INFO) << "AmqpConnectionHub started " << loops_.size()
+            << " loops for " << address_;
+  return base::Status::OK();
+}
+
+void AmqpConnectionHub::Stop() {
+  for (const auto& loop : loops_) {
+    loop->Stop();
+  }
+  for (const auto& thread : threads_) {
+    thread->Join();
+  }
+  threads_.clear();
+  started_ = false;
+}
+
+AmqpEventLoop* AmqpConnectionHub::PickLoop() {
+  AmqpEventLoop* best = loops_.front().get();
+  for (const auto& loop : loops_) {
+    if (loop->user_count() < best->user_count()) {
+      best = loop.get();
+    }
+  }
+  return best;
+}
+
+} // namespace server
@@ -0,0 +1,150 @@
+#ifndef SERVER_AMQP_CONNECTION_HUB_H_
+#define SERVER_AMQP_CONNECTION_HUB_H_
+#include "base/macros.h"
+#include "base/status.h"
+#include "threading/futex_mutex.h"
+#include "threading/thread.h"
+
+#include <pthread.h>
+#include <event2/event.h>
+#include <amqpcpp.h>
+#include <amqpcpp/libevent.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace server {
+
+/**
+ * Something that opens channels on the connection of an AmqpEventLoop.
+ * Both callbacks run on the loop thread.
+ */
+class AmqpChannelUser {
+ public:
+  virtual ~AmqpChannelUser() {}
+
+  // Open channels on `connection` here. Called again after a reconnect.
+  virtual void OnConnected(AMQP::TcpConnection* connection) = 0;
+  // The connection went away; every channel opened on it is dead and must
+  // be released.
+  virtual void OnDisconnected() = 0;
+};
+
+/**
+ * One event-loop thread owning one broker connection.
+ *
+ * AMQP-CPP is not thread-safe, so the connection and all its channels are
+ * only touched on the loop thread; other threads hand work over through
+ * RunInLoop(). A broken connection is re-established after a short delay
+ * and the attached users are asked to open their channels again.
+ */
+class AmqpEventLoop : public threading::Runnable {
+ public:
+  explicit AmqpEventLoop(const std::string& address);
+  ~AmqpEventLoop() override;
+
+  // threading::Runnable
+  void Run() override;
+
+  /**
+   * Runs `func` on the loop thread. Thread-safe. Once Run() has returned,
+   * `func` is dropped.
+   */
+  void RunInLoop(const std::function<void()>& func);
+
+  /**
+   * Adds `user`; its OnConnected() runs on the loop thread as soon as the
+   * connection exists. Thread-safe.
+   */
+  void Attach(AmqpChannelUser* user);
+
+  /**
+   * Removes `user` after calling its OnDisconnected(), then runs `detached`
+   * (may be empty). Both happen on the loop thread, or right here if Run()
+   * has returned, which disconnected every user already. Thread-safe.
+   */
+  void Detach(AmqpChannelUser* user, const std::function<void()>& detached);
+
+  /**
+   * Closes the connection and makes Run() return. Thread-safe.
+   */
+  void Stop();
+
+  size_t user_count() const { return user_count_.load(); }
+
+  bool InLoopThread() const;
+
+  struct event_base* event_base() const { return event_base_; }
+
+ private:
+  class Handler;
+
+  void Connect();
+  void OnConnectionLost(const char* reason);
+  void DrainTasks();
+  // RunInLoop(), returning false instead once Run() has returned.
+  bool Post(const std::function<void()>& func);
+
+  static void OnWakeup(evutil_socket_t fd, short what, void* arg);
+  static void OnReconnect(evutil_socket_t fd, short what, void* arg);
+
+  const std::string address_;
+  struct event_base* event_base_;
+  int wakeup_fd_;
+  struct event* wakeup_event_;
+  pthread_t loop_thread_;
+  std::atomic<bool> loop_running_;
+
+  // Loop thread only.
+  std::unique_ptr<Handler> handler_;
+  std::unique_ptr<AMQP::TcpConnection> connection_;
+  std::vector<AmqpChannelUser*> users_;
+  bool connected_;
+  bool stopping_;
+
+  std::atomic<size_t> user_count_;
+
+  threading::FutexMutex tasks_lock_;
+  std::vector<std::function<void()>> tasks_;
+  bool finished_;  // Run() returned, guarded by tasks_lock_
+
+  DISALLOW_COPY_AND_ASSIGN(AmqpEventLoop);
+};
+
+/**
+ * A fixed set of AmqpEventLoops, by default one per core, shared by all
+ * the consumer services of a process. Services attach to the least loaded
+ * loop and multiplex their channels over its single connection instead of
+ * each owning a thread, an event_base and a TCP connection.
+ */
+class AmqpConnectionHub {
+ public:
+  // loop_count == 0 means one loop per online CPU.
+  explicit AmqpConnectionHub(const std::string& address, size_t loop_count = 0);
+  ~AmqpConnectionHub();
+
+  base::Status Start();
+  void Stop();
+
+  /**
+   * The loop with the fewest attached users.
+   */
+  AmqpEventLoop* PickLoop();
+
+  const std::string& address() const { return address_; }
+  size_t loop_count() const { return loops_.size(); }
+
+ private:
+  const std::string address_;
+  std::vector<std::shared_ptr<AmqpEventLoop>> loops_;
+  std::vector<std::shared_ptr<threading::Thread>> threads_;
+  bool started_;
+
+  DISALLOW_COPY_AND_ASSIGN(AmqpConnectionHub);
+};
+
+} // namespace server
+#endif // SERVER_AMQP_CONNECTION_HUB_H_
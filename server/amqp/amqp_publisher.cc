@@ -0,0 +1,322 @@
+#include "server/amqp/amqp_publisher.h"
+#include "threading/monitor.h"
+#include "threading/thread_factory.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace server {
+
+void SetEnvelopeProperties(const AmqpMessage& message, AMQP::Envelope* envelope) {
+  if (!message.content_type.empty()) {
+    envelope->setContentType(message.content_type);
+  }
+  if (!message.content_encoding.empty()) {
+    envelope->setContentEncoding(message.content_encoding);
+  }
+  if (!message.correlation_id.empty()) {
+    envelope->setCorrelationID(message.correlation_id);
+  }
+  if (!message.reply_to.empty()) {
+    envelope->setReplyTo(message.reply_to);
+  }
+  if (!message.message_id.empty()) {
+    envelope->setMessageID(message.message_id);
+  }
+  if (message.priority >= 0) {
+    envelope->setPriority(static_cast<uint8_t>(message.priority));
+  }
+  envelope->setPersistent(message.persistent);
+}
+
+AMQP::Table QueueArguments(int max_priority) {
+  AMQP::Table arguments;
+  if (max_priority > 0) {
+    arguments.set("x-max-priority", static_cast<int64_t>(max_priority));
+  }
+  return arguments;
+}
+
+AmqpPublisher::AmqpPublisher(std::shared_ptr<AmqpConnectionHub> hub,
+                             const Options& options)
+    : options_(options),
+      hub_(hub),
+      loop_(hub->PickLoop()),
+      queued_(0),
+      drain_scheduled_(false),
+      stopped_(false),
+      confirming_(false),
+      next_delivery_tag_(0) {
+  Start();
+}
+
+AmqpPublisher::AmqpPublisher(const std::string& address, const Options& options)
+    : options_(options),
+      own_loop_(std::make_shared<AmqpEventLoop>(address)),
+      loop_(own_loop_.get()),
+      queued_(0),
+      drain_scheduled_(false),
+      stopped_(false),
+      confirming_(false),
+      next_delivery_tag_(0) {
+  threading::PosixThreadFactory factory(threading::ThreadFactory::ATTACHED);
+  own_thread_ = factory.NewThread(own_loop_);
+  own_thread_->SetName("amqp_publisher");
+  own_thread_->Start();
+  Start();
+}
+
+AmqpPublisher::~AmqpPublisher() {
+  Stop();
+}
+
+void AmqpPublisher::Start() {
+  loop_->Attach(this);
+}
+
+threading::Future<void> AmqpPublisher::Publish(const AmqpMessage& message) {
+  std::unique_ptr<Pending> pending(new Pending);
+  pending->message = message;
+  if (message.content_encoding.empty() &&
+      CompressPayload(message.body, options_.compression, &pending->message.body)) {
+    pending->message.content_encoding = kZstdContentEncoding;
+  }
+  pending->attempts = 0;
+  threading::Future<void> future = pending->promise.GetFuture();
+
+  bool schedule = false;
+  {
+    threading::Synchronized s(monitor_);
+    // The loop thread must never block on itself; replies published from
+    // handlers running there may overshoot max_queued instead.
+    if (!loop_->InLoopThread()) {
+      while (!stopped_ && queued_ >= options_.max_queued) {
+        monitor_.WaitForever();
+      }
+    }
+    if (!stopped_) {
+      queue_.push_back(std::move(pending));
+      queued_++;
+      schedule = !drain_scheduled_;
+      drain_scheduled_ = true;
+    }
+  }
+  if (pending) {
+    pending->promise.SetException(std::make_exception_ptr(
+        PublishException("AmqpPublisher: publish after Stop()")));
+    return future;
+  }
+  if (schedule) {
+    loop_->RunInLoop([this] { Drain(); });
+  }
+  return future;
+}
+
+void AmqpPublisher::Flush() {
+  threading::Synchronized s(monitor_);
+  while (queued_ > 0) {
+    monitor_.WaitForever();
+  }
+}
+
+void AmqpPublisher::Stop() {
+  {
+    threading::Synchronized s(monitor_);
+    if (stopped_) {
+      return;
+    }
+    stopped_ = true;
+    monitor_.NotifyAll();  // Producers blocked on max_queued.
+  }
+
+  // The loop owns the in-flight map, so the leftovers are failed there.
+  std::shared_ptr<threading::Promise<void>> detached =
+      std::make_shared<threading::Promise<void>>();
+  threading::Future<void> done = detached->GetFuture();
+  loop_->Detach(this, [this, detached] {
+    FailAll("AmqpPublisher stopped");
+    detached->SetValue();
+  });
+  done.Wait();
+
+  if (own_loop_) {
+    own_loop_->Stop();
+    own_thread_->Join();
+  }
+}
+
+size_t AmqpPublisher::QueuedCount() const {
+  threading::Synchronized s(monitor_);
+  return queued_;
+}
+
+void AmqpPublisher::OnConnected(AMQP::TcpConnection* connection) {
+  channel_.reset(new AMQP::TcpChannel(connection));
+  confirming_ = false;
+  next_delivery_tag_ = 0;  // Delivery tags are per channel.
+
+  channel_->onError([](const char* message) {
+    LOG(ERROR) << "AmqpPublisher channel error: " << message;
+  });
+  for (const std::string& queue : options_.declare_queues) {
+    channel_->declareQueue(queue, 0, QueueArguments(options_.max_priority));
+  }
+  channel_->confirmSelect()
+      .onSuccess([this] {
+        confirming_ = true;
+        Drain();
+      })
+      .onAck([this](uint64_t delivery_tag, bool multiple) {
+        OnAck(delivery_tag, multiple);
+      })
+      .onNack([this](uint64_t delivery_tag, bool multiple, bool /* requeue */) {
+        OnNack(delivery_tag, multiple);
+      });
+}
+
+void AmqpPublisher::OnDisconnected() {
+  channel_.reset();
+  confirming_ = false;
+  if (in_flight_.empty()) {
+    return;
+  }
+  // The broker may or may not have taken these; publish them again, ahead
+  // of anything newer, once a channel is back.
+  threading::Synchronized s(monitor_);
+  for (auto it = in_flight_.rbegin(); it != in_flight_.rend(); ++it) {
+    queue_.push_front(std::move(it->second));
+  }
+  in_flight_.clear();
+}
+
+void AmqpPublisher::Drain() {
+  {
+    threading::Synchronized s(monitor_);
+    drain_scheduled_ = false;
+  }
+  if (!channel_ || !confirming_) {
+    return;  // confirmSelect().onSuccess() drains once the channel is ready.
+  }
+
+  // Moves up to batch_size messages per lock acquisition; AMQP-CPP buffers
+  // the frames and writes the whole batch when the socket is writable.
+  std::vector<std::unique_ptr<Pending>> batch;
+  while (in_flight_.size() < options_.max_in_flight) {
+    {
+      threading::Synchronized s(monitor_);
+      size_t room = options_.max_in_flight - in_flight_.size();
+      size_t count = std::min(std::min(room, options_.batch_size), queue_.size());
+      for (size_t i = 0; i < count; ++i) {
+        batch.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+      }
+    }
+    if (batch.empty()) {
+      return;
+    }
+    for (size_t i = 0; i < batch.size(); ++i) {
+      const AmqpMessage& message = batch[i]->message;
+      AMQP::Envelope envelope(message.body.data(), message.body.size());
+      SetEnvelopeProperties(message, &envelope);
+      if (!channel_->publish(message.exchange, message.routing_key, envelope)) {
+        // The channel broke under us; OnDisconnected() follows, keep the
+        // rest in order for the next channel.
+        threading::Synchronized s(monitor_);
+        for (size_t j = batch.size(); j > i; --j) {
+          queue_.push_front(std::move(batch[j - 1]));
+        }
+        return;
+      }
+      in_flight_[++next_delivery_tag_] = std::move(batch[i]);
+    }
+    batch.clear();
+  }
+}
+
+void AmqpPublisher::OnAck(uint64_t delivery_tag, bool multiple) {
+  auto begin = multiple ? in_flight_.begin() : in_flight_.find(delivery_tag);
+  auto end = in_flight_.upper_bound(delivery_tag);
+  if (begin == in_flight_.end() || begin->first > delivery_tag) {
+    return;  // Already settled, or from a channel since replaced.
+  }
+  std::vector<std::unique_ptr<Pending>> acked;
+  for (auto it = begin; it != end; ++it) {
+    acked.push_back(std::move(it->second));
+  }
+  in_flight_.erase(begin, end);
+  for (auto& pending : acked) {
+    Finish(std::move(pending), true);
+  }
+  Drain();
+}
+
+void AmqpPublisher::OnNack(uint64_t delivery_tag, bool multiple) {
+  auto begin = multiple ? in_flight_.begin() : in_flight_.find(delivery_tag);
+  auto end = in_flight_.upper_bound(delivery_tag);
+  if (begin == in_flight_.end() || begin->first > delivery_tag) {
+    return;  // Already settled, or from a channel since replaced.
+  }
+  std::vector<std::unique_ptr<Pending>> retry;
+  std::vector<std::unique_ptr<Pending>> failed;
+  for (auto it = begin; it != end; ++it) {
+    if (++it->second->attempts > options_.max_retries) {
+      failed.push_back(std::move(it->second));
+    } else {
+      retry.push_back(std::move(it->second));
+    }
+  }
+  in_flight_.erase(begin, end);
+  if (!retry.empty()) {
+    LOG(WARNING) << "AmqpPublisher: broker nacked " << retry.size()
+                 << " messages, publishing them again";
+    threading::Synchronized s(monitor_);
+    for (size_t i = retry.size(); i > 0; --i) {
+      queue_.push_front(std::move(retry[i - 1]));
+    }
+  }
+  for (auto& pending : failed) {
+    Finish(std::move(pending), false);
+  }
+  Drain();
+}
+
+void AmqpPublisher::Finish(std::unique_ptr<Pending> pending, bool ok) {
+  {
+    threading::Synchronized s(monitor_);
+    queued_--;
+    monitor_.NotifyAll();
+  }
+  // Continuations may run inline, so the promise is fulfilled unlocked.
+  if (ok) {
+    pending->promise.SetValue();
+  } else {
+    pending->promise.SetException(std::make_exception_ptr(PublishException(
+        "AmqpPublisher: broker nacked the message " +
+        std::to_string(pending->attempts) + " times")));
+  }
+}
+
+void AmqpPublisher::FailAll(const std::string& reason) {
+  std::vector<std::unique_ptr<Pending>> failed;
+  for (auto& entry : in_flight_) {
+    failed.push_back(std::move(entry.second));
+  }
+  in_flight_.clear();
+  {
+    threading::Synchronized s(monitor_);
+    for (auto& pending : queue_) {
+      failed.push_back(std::move(pending));
+    }
+    queue_.clear();
+    queued_ -= failed.size();
+    monitor_.NotifyAll();
+  }
+  for (auto& pending : failed) {
+    pending->promise.SetException(std::make_exception_ptr(PublishException(reason)));
+  }
+}
+
+} // namespace server
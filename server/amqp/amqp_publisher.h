@@ -0,0 +1,179 @@
+#ifndef SERVER_AMQP_PUBLISHER_H_
+#define SERVER_AMQP_PUBLISHER_H_
+#include "base/macros.h"
+#include "base/exception.h"
+#include "server/amqp/amqp_compression.h"
+#include "server/amqp/amqp_connection_hub.h"
+#include "threading/futex_monitor.h"
+#include "threading/future.h"
+#include "threading/thread.h"
+
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace server {
+
+/**
+ * A message and the properties AmqpPublisher sets on it.
+ */
+struct AmqpMessage {
+  AmqpMessage() : priority(-1), persistent(true) {}
+  AmqpMessage(const std::string& exchange,
+              const std::string& routing_key,
+              const std::string& body)
+      : exchange(exchange),
+        routing_key(routing_key),
+        body(body),
+        priority(-1),
+        persistent(true) {}
+
+  std::string exchange;
+  std::string routing_key;
+  std::string body;
+
+  // Left unset when empty (or negative, for priority).
+  std::string content_type;
+  std::string content_encoding;
+  std::string correlation_id;
+  std::string reply_to;
+  std::string message_id;
+  int priority;
+  bool persistent;
+};
+
+/**
+ * Copies the properties of `message` onto `envelope`.
+ */
+void SetEnvelopeProperties(const AmqpMessage& message, AMQP::Envelope* envelope);
+
+/**
+ * The arguments a queue is declared with: x-max-priority when
+ * `max_priority` > 0. Producers and consumers of a queue must agree on
+ * them, the broker refuses to redeclare a queue differently.
+ */
+AMQP::Table QueueArguments(int max_priority);
+
+/**
+ * Why a publish failed: the broker nacked it more than max_retries times,
+ * or the publisher stopped before it was confirmed.
+ */
+class PublishException : public base::TLibraryException {
+ public:
+  explicit PublishException(const std::string& message)
+      : TLibraryException(message) {}
+};
+
+/**
+ * Publishes over one long-lived channel in publisher-confirm mode.
+ *
+ * Publish() is thread-safe and returns a future that becomes ready when
+ * the broker confirms the message. Messages are queued and written by the
+ * loop thread in batches, at most `max_in_flight` of them unconfirmed at
+ * a time. Nacked messages are published again up to `max_retries` times;
+ * messages unconfirmed when the connection drops are republished after
+ * the reconnect, so delivery is at-least-once. Publish() blocks while
+ * `max_queued` messages are waiting, which pushes back on producers that
+ * outrun the broker.
+ *
+ * Bodies of at least `compression.min_size` bytes are zstd-compressed by
+ * Publish(), on the caller's thread, unless the message already has a
+ * content encoding.
+ */
+class AmqpPublisher : public AmqpChannelUser {
+ public:
+  struct Options {
+    Options()
+        : max_in_flight(1024),
+          max_queued(8192),
+          batch_size(128),
+          max_retries(3),
+          max_priority(0) {}
+
+    size_t max_in_flight;  // published but unconfirmed
+    size_t max_queued;     // waiting to be published, plus in flight
+    size_t batch_size;     // messages written per loop iteration
+    int max_retries;       // publishes again after a nack
+
+    // Declared on every new channel, with the consumers' (default) flags
+    // and x-max-priority if max_priority > 0.
+    std::vector<std::string> declare_queues;
+    int max_priority;
+
+    CompressionOptions compression;
+  };
+
+  // Publishes over a loop of `hub`, sharing its connection.
+  explicit AmqpPublisher(std::shared_ptr<AmqpConnectionHub> hub,
+                         const Options& options = Options());
+  // Publishes over a connection and loop thread of its own.
+  explicit AmqpPublisher(const std::string& address,
+                         const Options& options = Options());
+  ~AmqpPublisher() override;
+
+  threading::Future<void> Publish(const AmqpMessage& message);
+  threading::Future<void> Publish(const std::string& exchange,
+                                  const std::string& routing_key,
+                                  const std::string& body) {
+    return Publish(AmqpMessage(exchange, routing_key, body));
+  }
+
+  /**
+   * Blocks until every message published so far is confirmed or failed.
+   */
+  void Flush();
+
+  /**
+   * Fails whatever is still queued or unconfirmed and detaches from the
+   * loop. Called by the destructor.
+   */
+  void Stop();
+
+  size_t QueuedCount() const;
+
+  // AmqpChannelUser, on the loop thread.
+  void OnConnected(AMQP::TcpConnection* connection) override;
+  void OnDisconnected() override;
+
+ private:
+  struct Pending {
+    AmqpMessage message;
+    threading::Promise<void> promise;
+    int attempts;
+  };
+
+  void Start();
+  void Drain();
+  void OnAck(uint64_t delivery_tag, bool multiple);
+  void OnNack(uint64_t delivery_tag, bool multiple);
+  void Finish(std::unique_ptr<Pending> pending, bool ok);
+  void FailAll(const std::string& reason);
+
+  const Options options_;
+  std::shared_ptr<AmqpConnectionHub> hub_;
+  std::shared_ptr<AmqpEventLoop> own_loop_;
+  std::shared_ptr<threading::Thread> own_thread_;
+  AmqpEventLoop* loop_;
+
+  // Guards queue_, queued_, drain_scheduled_ and stopped_.
+  threading::FutexMonitor monitor_;
+  std::deque<std::unique_ptr<Pending>> queue_;
+  size_t queued_;  // queue_ plus in_flight_
+  bool drain_scheduled_;
+  bool stopped_;
+
+  // Loop thread only.
+  std::unique_ptr<AMQP::TcpChannel> channel_;
+  bool confirming_;
+  uint64_t next_delivery_tag_;
+  std::map<uint64_t, std::unique_ptr<Pending>> in_flight_;
+
+  DISALLOW_COPY_AND_ASSIGN(AmqpPublisher);
+};
+
+} // namespace server
+#endif // SERVER_AMQP_PUBLISHER_H_
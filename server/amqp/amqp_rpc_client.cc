@@ -0,0 +1,263 @@
+#include "server/amqp/amqp_rpc_client.h"
+#include "threading/thread_factory.h"
+
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace server {
+
+const char kAmqpDirectReplyTo[] = "amq.rabbitmq.reply-to";
+const char kAmqpStatusCodeHeader[] = "x-status-code";
+const char kAmqpStatusMessageHeader[] = "x-status-message";
+
+AMQP::Table StatusToHeaders(const base::Status& status) {
+  AMQP::Table headers;
+  if (!status.ok()) {
+    headers.set(kAmqpStatusCodeHeader, static_cast<int64_t>(status.code()));
+    headers.set(kAmqpStatusMessageHeader, status.error_message());
+  }
+  return headers;
+}
+
+base::Status StatusFromHeaders(const AMQP::Table& headers) {
+  if (!headers.contains(kAmqpStatusCodeHeader)) {
+    return base::Status::OK();
+  }
+  int64_t code = headers.get(kAmqpStatusCodeHeader);
+  if (code == base::Code::OK) {
+    return base::Status::OK();
+  }
+  const std::string& message = headers.get(kAmqpStatusMessageHeader);
+  return base::Status(static_cast<base::Code>(code), message);
+}
+
+struct AmqpRpcClient::PendingCall {
+  PendingCall() : client(nullptr), timer(nullptr), sent(false) {}
+  ~PendingCall() {
+    if (timer != nullptr) {
+      ::event_free(timer);
+    }
+  }
+
+  AmqpRpcClient* client;
+  AmqpMessage request;
+  threading::Promise<AmqpRpcResponse> promise;
+  int64_t timeout_ms;
+  struct event* timer;
+  bool sent;
+};
+
+namespace {
+
+threading::Future<AmqpRpcResponse> Failed(base::Code code, const std::string& message) {
+  threading::Promise<AmqpRpcResponse> promise;
+  AmqpRpcResponse response;
+  response.status = base::Status(code, message);
+  promise.SetValue(response);
+  return promise.GetFuture();
+}
+
+} // namespace
+
+AmqpRpcClient::AmqpRpcClient(std::shared_ptr<AmqpConnectionHub> hub,
+                             const Options& options)
+    : options_(options),
+      hub_(hub),
+      loop_(hub->PickLoop()),
+      next_call_id_(0),
+      pending_count_(0),
+      stopped_(false),
+      ready_(false) {
+  Start();
+}
+
+AmqpRpcClient::AmqpRpcClient(const std::string& address, const Options& options)
+    : options_(options),
+      own_loop_(std::make_shared<AmqpEventLoop>(address)),
+      loop_(own_loop_.get()),
+      next_call_id_(0),
+      pending_count_(0),
+      stopped_(false),
+      ready_(false) {
+  threading::PosixThreadFactory factory(threading::ThreadFactory::ATTACHED);
+  own_thread_ = factory.NewThread(own_loop_);
+  own_thread_->SetName("amqp_rpc_client");
+  own_thread_->Start();
+  Start();
+}
+
+AmqpRpcClient::~AmqpRpcClient() {
+  Stop();
+}
+
+void AmqpRpcClient::Start() {
+  loop_->Attach(this);
+}
+
+threading::Future<AmqpRpcResponse> AmqpRpcClient::Call(const AmqpMessage& request,
+                                                       int64_t timeout_ms) {
+  if (stopped_) {
+    return Failed(base::Code::CANCELLED, "AmqpRpcClient stopped");
+  }
+  std::shared_ptr<PendingCall> call = std::make_shared<PendingCall>();
+  call->client = this;
+  call->request = request;
+  if (request.content_encoding.empty() &&
+      CompressPayload(request.body, options_.compression, &call->request.body)) {
+    call->request.content_encoding = kZstdContentEncoding;
+  }
+  call->request.reply_to = kAmqpDirectReplyTo;
+  call->request.correlation_id = std::to_string(++next_call_id_);
+  // Nobody waits for a reply that outlives a broker restart.
+  call->request.persistent = false;
+  call->timeout_ms = timeout_ms > 0 ? timeout_ms : options_.timeout_ms;
+  threading::Future<AmqpRpcResponse> future = call->promise.GetFuture();
+
+  pending_count_++;
+  loop_->RunInLoop([this, call] { Register(call); });
+  return future;
+}
+
+void AmqpRpcClient::Stop() {
+  if (stopped_.exchange(true)) {
+    return;
+  }
+  std::shared_ptr<threading::Promise<void>> detached =
+      std::make_shared<threading::Promise<void>>();
+  threading::Future<void> done = detached->GetFuture();
+  loop_->Detach(this, [this, detached] {
+    FailAll(base::Code::CANCELLED, "AmqpRpcClient stopped", false);
+    detached->SetValue();
+  });
+  done.Wait();
+
+  if (own_loop_) {
+    own_loop_->Stop();
+    own_thread_->Join();
+  }
+}
+
+void AmqpRpcClient::OnConnected(AMQP::TcpConnection* connection) {
+  channel_.reset(new AMQP::TcpChannel(connection));
+  ready_ = false;
+
+  channel_->onError([](const char* message) {
+    LOG(ERROR) << "AmqpRpcClient channel error: " << message;
+  });
+  // Direct reply-to must be consumed, with noack, before the first request
+  // naming it is published on this channel.
+  channel_->consume(kAmqpDirectReplyTo, AMQP::noack)
+      .onReceived([this](const AMQP::Message& message,
+                         uint64_t /* delivery_tag */,
+                         bool /* redelivered */) {
+        OnReply(message);
+      })
+      .onSuccess([this](const std::string& /* consumer_tag */) {
+        ready_ = true;
+        while (!unsent_.empty()) {
+          auto it = calls_.find(unsent_.front());
+          unsent_.pop_front();
+          if (it != calls_.end()) {
+            Send(it->second.get());
+          }
+        }
+      });
+}
+
+void AmqpRpcClient::OnDisconnected() {
+  channel_.reset();
+  ready_ = false;
+  FailAll(base::Code::UNAVAILABLE, "AMQP connection lost before the reply", true);
+}
+
+void AmqpRpcClient::Register(std::shared_ptr<PendingCall> call) {
+  if (stopped_) {
+    // Raced with Stop(); the client may be gone before a timer would fire.
+    pending_count_--;
+    AmqpRpcResponse response;
+    response.status = base::Status(base::Code::CANCELLED, "AmqpRpcClient stopped");
+    call->promise.SetValue(response);
+    return;
+  }
+  call->timer = ::evtimer_new(loop_->event_base(), &AmqpRpcClient::OnTimeout, call.get());
+  struct timeval tv = { static_cast<time_t>(call->timeout_ms / 1000),
+                        static_cast<suseconds_t>((call->timeout_ms % 1000) * 1000) };
+  ::evtimer_add(call->timer, &tv);
+
+  calls_[call->request.correlation_id] = call;
+  if (ready_) {
+    Send(call.get());
+  } else {
+    unsent_.push_back(call->request.correlation_id);
+  }
+}
+
+void AmqpRpcClient::Send(PendingCall* call) {
+  const AmqpMessage& request = call->request;
+  AMQP::Envelope envelope(request.body.data(), request.body.size());
+  SetEnvelopeProperties(request, &envelope);
+  call->sent = true;
+  if (!channel_->publish(request.exchange, request.routing_key, envelope)) {
+    AmqpRpcResponse response;
+    response.status = base::Status(base::Code::UNAVAILABLE, "AMQP channel not usable");
+    Complete(request.correlation_id, response);
+  }
+}
+
+void AmqpRpcClient::OnReply(const AMQP::Message& message) {
+  if (!message.hasCorrelationID()) {
+    LOG(WARNING) << "AmqpRpcClient: dropping a reply without correlation id";
+    return;
+  }
+  AmqpRpcResponse response;
+  response.status = StatusFromHeaders(message.headers());
+  base::Status decoded = DecompressPayload(
+      message.hasContentEncoding() ? message.contentEncoding() : std::string(),
+      message.body(), message.bodySize(), &response.body);
+  if (!decoded.ok() && response.status.ok()) {
+    response.status = decoded;
+  }
+  Complete(message.correlationID(), response);
+}
+
+void AmqpRpcClient::Complete(const std::string& correlation_id,
+                             const AmqpRpcResponse& response) {
+  auto it = calls_.find(correlation_id);
+  if (it == calls_.end()) {
+    return;  // Late reply to a call that already timed out.
+  }
+  std::shared_ptr<PendingCall> call = it->second;
+  calls_.erase(it);
+  pending_count_--;
+  call->promise.SetValue(response);
+}
+
+void AmqpRpcClient::FailAll(base::Code code, const std::string& message,
+                            bool sent_only) {
+  std::vector<std::string> failed;
+  for (const auto& entry : calls_) {
+    if (!sent_only || entry.second->sent) {
+      failed.push_back(entry.first);
+    }
+  }
+  if (!sent_only) {
+    unsent_.clear();
+  }
+  AmqpRpcResponse response;
+  response.status = base::Status(code, message);
+  for (const std::string& correlation_id : failed) {
+    Complete(correlation_id, response);
+  }
+}
+
+// static
+void AmqpRpcClient::OnTimeout(evutil_socket_t /* fd */, short /* what */, void* arg) {
+  PendingCall* call = static_cast<PendingCall*>(arg);
+  AmqpRpcResponse response;
+  response.status = base::Status(base::Code::DEADLINE_EXCEEDED,
+                                 "no reply within " + std::to_string(call->timeout_ms) + "ms");
+  call->client->Complete(call->request.correlation_id, response);
+}
+
+} // namespace server
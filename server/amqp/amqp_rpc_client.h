@@ -0,0 +1,123 @@
+#ifndef SERVER_AMQP_RPC_CLIENT_H_
+#define SERVER_AMQP_RPC_CLIENT_H_
+#include "base/macros.h"
+#include "base/status.h"
+#include "server/amqp/amqp_connection_hub.h"
+#include "server/amqp/amqp_publisher.h"
+#include "threading/future.h"
+#include "threading/thread.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace server {
+
+// RabbitMQ's direct reply-to pseudo queue: replies go straight to the
+// consuming channel, without declaring a reply queue per client.
+extern const char kAmqpDirectReplyTo[];
+
+// Headers carrying the handler's base::Status on a reply. A reply without
+// them is OK.
+extern const char kAmqpStatusCodeHeader[];
+extern const char kAmqpStatusMessageHeader[];
+
+AMQP::Table StatusToHeaders(const base::Status& status);
+base::Status StatusFromHeaders(const AMQP::Table& headers);
+
+struct AmqpRpcResponse {
+  base::Status status;
+  std::string body;
+};
+
+/**
+ * Calls AmqpConsumerService handlers and waits for their replies.
+ *
+ * All outstanding calls share one channel consuming direct reply-to and
+ * are told apart by correlation id. Call() is thread-safe and returns a
+ * future that is always fulfilled: with the handler's status and reply,
+ * DEADLINE_EXCEEDED once the timeout passes, or UNAVAILABLE if the
+ * connection drops before the reply arrives (direct replies are bound to
+ * the channel, so they are lost with it). Calls made before the channel
+ * is ready are sent once it is.
+ *
+ * Requests are published without confirms; a lost request surfaces as a
+ * timeout. Requests of at least `compression.min_size` bytes are sent
+ * zstd-compressed, and compressed replies are decompressed.
+ */
+class AmqpRpcClient : public AmqpChannelUser {
+ public:
+  struct Options {
+    Options() : timeout_ms(30000) {}
+
+    int64_t timeout_ms;  // default for Call()
+    CompressionOptions compression;
+  };
+
+  explicit AmqpRpcClient(std::shared_ptr<AmqpConnectionHub> hub,
+                         const Options& options = Options());
+  explicit AmqpRpcClient(const std::string& address,
+                         const Options& options = Options());
+  ~AmqpRpcClient() override;
+
+  /**
+   * Publishes `request` with reply_to and correlation_id set. A
+   * `timeout_ms` of 0 uses Options::timeout_ms.
+   */
+  threading::Future<AmqpRpcResponse> Call(const AmqpMessage& request,
+                                          int64_t timeout_ms = 0);
+  threading::Future<AmqpRpcResponse> Call(const std::string& routing_key,
+                                          const std::string& body,
+                                          int64_t timeout_ms = 0) {
+    return Call(AmqpMessage("", routing_key, body), timeout_ms);
+  }
+
+  /**
+   * Fails the outstanding calls with CANCELLED and detaches from the loop.
+   * Called by the destructor.
+   */
+  void Stop();
+
+  size_t PendingCount() const { return pending_count_.load(); }
+
+  // AmqpChannelUser, on the loop thread.
+  void OnConnected(AMQP::TcpConnection* connection) override;
+  void OnDisconnected() override;
+
+ private:
+  struct PendingCall;
+
+  void Start();
+  void Register(std::shared_ptr<PendingCall> call);
+  void Send(PendingCall* call);
+  void OnReply(const AMQP::Message& message);
+  void Complete(const std::string& correlation_id, const AmqpRpcResponse& response);
+  void FailAll(base::Code code, const std::string& message, bool sent_only);
+
+  static void OnTimeout(evutil_socket_t fd, short what, void* arg);
+
+  const Options options_;
+  std::shared_ptr<AmqpConnectionHub> hub_;
+  std::shared_ptr<AmqpEventLoop> own_loop_;
+  std::shared_ptr<threading::Thread> own_thread_;
+  AmqpEventLoop* loop_;
+
+  std::atomic<uint64_t> next_call_id_;
+  std::atomic<size_t> pending_count_;
+  std::atomic<bool> stopped_;
+
+  // Loop thread only.
+  std::unique_ptr<AMQP::TcpChannel> channel_;
+  bool ready_;  // consuming direct reply-to
+  std::map<std::string, std::shared_ptr<PendingCall>> calls_;
+  std::deque<std::string> unsent_;
+
+  DISALLOW_COPY_AND_ASSIGN(AmqpRpcClient);
+};
+
+} // namespace server
+#endif // SERVER_AMQP_RPC_CLIENT_H_
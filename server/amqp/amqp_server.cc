@@ -2,15 +2,34 @@
 #include "threading/thread.h"
 
 #include <limits>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
 #include <memory>
 #include <algorithm>
+#include <vector>
 
 namespace server {
 
+void ServiceExecutor::PinToCpus() {
+  if (cpus_.empty()) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus_) {
+    CPU_SET(cpu, &set);
+  }
+  int ret = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+  if (ret != 0) {
+    LOG(WARNING) << "Can't pin service executor to its cpus: " << ::strerror(ret);
+  }
+}
+
 AmqpServer::AmqpServer(const std::string& server_def)
     : server_def_(server_def),
       state_(NEW),
-      total_tasks_(0),
+      async_service_count_(0),
       thread_factory_(make_unique<threading::PosixThreadFactory>()){
 }
 
@@ -23,10 +42,7 @@ AmqpServer::~AmqpServer() {
 
 Status AmqpServer::Init() {
   std::lock_guard<std::mutex> l(mu_);
-  // TODO
-  // parse server_def_, get the needed infomation 
-  // init the services
-  return Status::OK();
+  return AmqpServerConfig::Parse(server_def_, &config_);
 }
 
 Status AmqpServer::Start() {
@@ -34,12 +50,34 @@ Status AmqpServer::Start() {
 
   switch (state_) {
     case NEW: {
-      // Start the serivce run in new thread
-      for (ServiceExecutorIterator it = service_executor_list_.begin();
-           it != service_executor_list_.end();
-           ++it) {
-        std::shared_ptr<threading::Thread> thread = thread_factory_->NewThread(*it);
-        thread_pool_.insert(thread);
+      if (config_.metrics_port > 0) {
+        metrics_server_.reset(new MetricsHttpServer(config_.metrics_address,
+                                                    config_.metrics_port));
+        Status status = metrics_server_->Start();
+        if (!status.ok()) {
+          metrics_server_.reset();
+          return status;
+        }
+      }
+      // Start every service on its configured number of executors, each
+      // either on a shared event loop or in a new thread.
+      for (const auto& service : service_list_) {
+        const ServiceOptions& options = config_.ForService(service->name());
+        service->Configure(options);
+        for (int i = 0; i < options.executors; ++i) {
+          std::shared_ptr<ServiceExecutor> executor =
+              std::make_shared<ServiceExecutor>(service, options.cpus);
+          service_executor_list_.push_back(executor);
+          if (executor->StartAsync()) {
+            async_service_count_++;
+            continue;
+          }
+          std::shared_ptr<threading::Thread> thread = thread_factory_->NewThread(executor);
+          thread_pool_.insert(thread);
+        }
+        LOG(INFO) << "Service '" << service->name() << "': "
+                  << options.executors << " executors, prefetch "
+                  << options.prefetch;
       }
       for (std::set<std::shared_ptr<threading::Thread>>::iterator thread = thread_pool_.begin();
            thread != thread_pool_.end();
@@ -70,7 +108,12 @@ Status AmqpServer::Stop() {
       state_ = STOPPED;
       return Status::OK();
     case STARTED:
-      // server_ shutdown()
+      for (const auto& service : service_list_) {
+        service->Shutdown();
+      }
+      if (metrics_server_) {
+        metrics_server_->Stop();
+      }
       state_ = STOPPED;
       return Status::OK();
     case STOPPED:
@@ -92,11 +135,12 @@ Status AmqpServer::Join() {
     case STARTED:
     case STOPPED:
       // reset and Join
-      {
-        threading::Synchronized s(monitor_);
-        while (total_tasks_ > 0) {
-          monitor_.Wait();
+      if (!thread_pool_.empty() || async_service_count_ > 0) {
+        std::vector<threading::Future<void>> done;
+        for (const auto& executor : service_executor_list_) {
+          done.push_back(executor->done());
         }
+        threading::WhenAll(done).Wait();
       }
       return Status::OK();
     default:
@@ -107,33 +151,21 @@ Status AmqpServer::Join() {
 }
 
 const std::string AmqpServer::target() const {
-  return "amqp://localhost";
+  return config_.address;
 }
 
 Status AmqpServer::InsertAsyncService(std::shared_ptr<AsyncServiceInterface> service) {
   std::lock_guard<std::mutex> l(mu_);
-  for (ServiceExecutorIterator it = service_executor_list_.begin();
-       it != service_executor_list_.end();
-       ++it) {
-    if ((*it)->service() == service) {
-      return Status(base::Code::ALREADY_EXISTS, "service already existed");
-    }
+  if (std::find(service_list_.begin(), service_list_.end(), service) != service_list_.end()) {
+    return Status(base::Code::ALREADY_EXISTS, "service already existed");
   }
-  service_executor_list_.push_back(std::make_shared<ServiceExecutor>(service, monitor_, total_tasks_));
-  total_tasks_++;
+  service_list_.push_back(service);
   return Status::OK();
 }
 
 Status AmqpServer::RemoveAsyncService(std::shared_ptr<AsyncServiceInterface> service) {
   std::lock_guard<std::mutex> l(mu_);
-  for (ServiceExecutorIterator it = service_executor_list_.begin();
-       it != service_executor_list_.end();
-       ++it) {
-    if ((*it)->service() == service) {
-      total_tasks_--;
-      service_executor_list_.erase(it);
-    }
-  }
+  service_list_.remove(service);
   return Status::OK();
 }
 
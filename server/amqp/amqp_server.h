@@ -5,43 +5,56 @@
 #include <list>
 #include <set>
 #include <unordered_map>
+#include <vector>
 
 #include "server/server_interface.h"
+#include "server/amqp/amqp_server_config.h"
+#include "server/metrics_http_server.h"
 #include "threading/thread.h"
 #include "threading/thread_factory.h"
-#include "threading/monitor.h"
+#include "threading/future.h"
 
 namespace server {
 
 class ServiceExecutor : public threading::Runnable {
  public:
+  // `cpus`: CPUs the thread running Run() is pinned to, empty = any.
   explicit ServiceExecutor(std::shared_ptr<AsyncServiceInterface> service,
-                           threading::Monitor& monitor,
-                           int& total_tasks)
+                           const std::vector<int>& cpus = std::vector<int>())
       : service_(service),
-        monitor_(monitor),
-        total_tasks_(total_tasks){}     
+        cpus_(cpus),
+        done_(std::make_shared<threading::Promise<void>>()) {}
 
   void Run() override {
-    service_->HandleLoop();
-
-    threading::Synchronized s(monitor_);
-    total_tasks_--;
-    if (total_tasks_ == 0) {
-      monitor_.Notify();
+    PinToCpus();
+    try {
+      service_->HandleLoop();
+      done_->SetValue();
+    } catch (...) {
+      done_->SetException(std::current_exception());
     }
   }
-  void Stop() {
-    service_->Shutdown();
+  // Starts a service that runs on a shared event loop. Returns false if
+  // the service needs a thread running Run() instead.
+  bool StartAsync() {
+    std::shared_ptr<threading::Promise<void>> done = done_;
+    return service_->StartAsync([done] { done->SetValue(); });
   }
   const std::shared_ptr<AsyncServiceInterface> service() const {
     return service_;
   }
+  // Becomes ready when HandleLoop() returns, or when an asynchronously
+  // started service has stopped.
+  threading::Future<void> done() const {
+    return done_->GetFuture();
+  }
 
  private:
+  void PinToCpus();
+
   const std::shared_ptr<AsyncServiceInterface> service_;      
-  threading::Monitor& monitor_;
-  int& total_tasks_;
+  const std::vector<int> cpus_;
+  const std::shared_ptr<threading::Promise<void>> done_;
 };
 
 class AmqpServer : public ServerInterface {
@@ -63,11 +76,14 @@ class AmqpServer : public ServerInterface {
   virtual Status InsertAsyncService(std::shared_ptr<AsyncServiceInterface> service) override;   
   virtual Status RemoveAsyncService(std::shared_ptr<AsyncServiceInterface> service) override;
 
+  const AmqpServerConfig& config() const { return config_; }
+
  protected:
   Status Init();
 
  private:
-  const std::string& server_def_;
+  const std::string server_def_;
+  AmqpServerConfig config_;
   
   // Guards state transitions.
   std::mutex mu_;
@@ -85,13 +101,19 @@ class AmqpServer : public ServerInterface {
   State state_ GUARDED_BY(mu_); 
 
 
+  // Registered services; Start() runs each on ServiceOptions::executors
+  // executors.
+  std::list<std::shared_ptr<AsyncServiceInterface>> service_list_ GUARDED_BY(mu_);
   std::list<std::shared_ptr<ServiceExecutor>> service_executor_list_ GUARDED_BY(mu_);
   using ServiceExecutorIterator = std::list<std::shared_ptr<ServiceExecutor>>::iterator;
   std::set<std::shared_ptr<threading::Thread>> thread_pool_;
-  threading::Monitor monitor_;
-  int total_tasks_;
+  // Started on a shared event loop, without a thread of their own.
+  size_t async_service_count_;
 
   std::unique_ptr<threading::ThreadFactory> thread_factory_;
+
+  // Serves /metrics while started, if config_.metrics_port is set.
+  std::unique_ptr<MetricsHttpServer> metrics_server_;
 };
 
 } // namespace
@@ -0,0 +1,222 @@
+#include "server/amqp/amqp_server_config.h"
+
+#include "base/numbers.h"
+#include "base/string_piece.h"
+#include "base/string_util.h"
+
+#include <utility>
+#include <vector>
+
+namespace server {
+
+namespace {
+
+const base::StringPiece kTrimWhiteSpace = " \t\r\n\f";
+
+base::Status InvalidDef(const std::string& message) {
+  return base::Status(base::Code::INVALID_ARGUMENT, "server_def: " + message);
+}
+
+// Splits `def` (without the driver prefix) into key/value pairs.
+base::Status Tokenize(const std::string& def,
+                      std::vector<std::pair<std::string, std::string>>* out) {
+  size_t pos = 0;
+  while (pos < def.size()) {
+    size_t eq = def.find('=', pos);
+    if (eq == std::string::npos) {
+      std::string rest;
+      base::TrimString(def.substr(pos), kTrimWhiteSpace, &rest);
+      if (rest.empty()) {
+        break;
+      }
+      return InvalidDef("missing '=' after '" + rest + "'");
+    }
+    std::string key;
+    base::TrimString(def.substr(pos, eq - pos), kTrimWhiteSpace, &key);
+    pos = eq + 1;
+    while (pos < def.size() && kTrimWhiteSpace.find(def[pos]) != base::StringPiece::npos) {
+      pos++;
+    }
+
+    std::string value;
+    if (pos < def.size() && def[pos] == '\'') {
+      // Quoted; '' stands for a literal quote.
+      pos++;
+      for (;;) {
+        if (pos >= def.size()) {
+          return InvalidDef("unterminated string for '" + key + "'");
+        }
+        if (def[pos] == '\'') {
+          if (pos + 1 < def.size() && def[pos + 1] == '\'') {
+            value += '\'';
+            pos += 2;
+            continue;
+          }
+          pos++;
+          break;
+        }
+        value += def[pos++];
+      }
+      pos = def.find(';', pos);
+      pos = pos == std::string::npos ? def.size() : pos + 1;
+    } else {
+      size_t end = def.find(';', pos);
+      if (end == std::string::npos) {
+        end = def.size();
+      }
+      base::TrimString(def.substr(pos, end - pos), kTrimWhiteSpace, &value);
+      pos = end + 1;
+    }
+    if (key.empty()) {
+      return InvalidDef("empty key");
+    }
+    out->push_back(std::make_pair(key, value));
+  }
+  return base::Status::OK();
+}
+
+base::Status ParseInt(const std::string& key, const std::string& value,
+                      int* out) {
+  int32_t parsed;
+  if (!base::safe_strto32(value, &parsed) || parsed < 0) {
+    return InvalidDef("'" + key + "' expects a non-negative integer, got '" +
+                      value + "'");
+  }
+  *out = parsed;
+  return base::Status::OK();
+}
+
+// "0-3,6" -> {0, 1, 2, 3, 6}
+base::Status ParseCpus(const std::string& key, const std::string& value,
+                       std::vector<int>* cpus) {
+  cpus->clear();
+  size_t pos = 0;
+  while (pos < value.size()) {
+    size_t comma = value.find(',', pos);
+    if (comma == std::string::npos) {
+      comma = value.size();
+    }
+    std::string range = value.substr(pos, comma - pos);
+    size_t dash = range.find('-');
+    int first, last;
+    if (dash == std::string::npos) {
+      RETURN_IF_ERROR(ParseInt(key, range, &first));
+      last = first;
+    } else {
+      RETURN_IF_ERROR(ParseInt(key, range.substr(0, dash), &first));
+      RETURN_IF_ERROR(ParseInt(key, range.substr(dash + 1), &last));
+      if (last < first) {
+        return InvalidDef("'" + key + "' has an empty range '" + range + "'");
+      }
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus->push_back(cpu);
+    }
+    pos = comma + 1;
+  }
+  return base::Status::OK();
+}
+
+base::Status SetOption(const std::string& key, const std::string& option,
+                       const std::string& value, ServiceOptions* options) {
+  if (option == "executors") {
+    RETURN_IF_ERROR(ParseInt(key, value, &options->executors));
+    if (options->executors == 0) {
+      return InvalidDef("'" + key + "' must be at least 1");
+    }
+    return base::Status::OK();
+  }
+  if (option == "prefetch") {
+    return ParseInt(key, value, &options->prefetch);
+  }
+  if (option == "cpus") {
+    return ParseCpus(key, value, &options->cpus);
+  }
+  if (option == "workers") {
+    return ParseInt(key, value, &options->workers);
+  }
+  if (option == "max_prefetch") {
+    return ParseInt(key, value, &options->max_prefetch);
+  }
+  if (option == "max_priority" || option == "short_priority") {
+    int* priority = option == "max_priority" ? &options->max_priority
+                                             : &options->short_priority;
+    RETURN_IF_ERROR(ParseInt(key, value, priority));
+    if (*priority > 255) {
+      return InvalidDef("'" + key + "' is not a priority: " + value);
+    }
+    return base::Status::OK();
+  }
+  if (option == "reserved_workers") {
+    return ParseInt(key, value, &options->reserved_workers);
+  }
+  if (option == "compress_min_size") {
+    int min_size;
+    RETURN_IF_ERROR(ParseInt(key, value, &min_size));
+    options->compress_min_size = min_size;
+    return base::Status::OK();
+  }
+  if (option == "retry_delay_ms") {
+    return ParseInt(key, value, &options->retry_delay_ms);
+  }
+  return InvalidDef("unknown key '" + key + "'");
+}
+
+} // namespace
+
+const ServiceOptions& AmqpServerConfig::ForService(const std::string& name) const {
+  std::map<std::string, ServiceOptions>::const_iterator it = services.find(name);
+  return it == services.end() ? defaults : it->second;
+}
+
+// static
+base::Status AmqpServerConfig::Parse(const std::string& server_def,
+                                     AmqpServerConfig* config) {
+  const std::string kDriver = "amqp:";
+  if (server_def.compare(0, kDriver.size(), kDriver) != 0) {
+    return InvalidDef("expected the '" + kDriver + "' prefix");
+  }
+  std::vector<std::pair<std::string, std::string>> pairs;
+  RETURN_IF_ERROR(Tokenize(server_def.substr(kDriver.size()), &pairs));
+
+  AmqpServerConfig parsed;
+  // Per-service keys override the defaults whatever their order, so they
+  // are applied in a second pass.
+  std::vector<std::pair<std::string, std::string>> service_keys;
+  for (const auto& pair : pairs) {
+    const std::string& key = pair.first;
+    const std::string& value = pair.second;
+    if (key == "address") {
+      parsed.address = value;
+    } else if (key == "loops") {
+      RETURN_IF_ERROR(ParseInt(key, value, &parsed.loops));
+    } else if (key == "metrics_address") {
+      parsed.metrics_address = value;
+    } else if (key == "metrics_port") {
+      RETURN_IF_ERROR(ParseInt(key, value, &parsed.metrics_port));
+      if (parsed.metrics_port > 65535) {
+        return InvalidDef("'" + key + "' is not a port: " + value);
+      }
+    } else if (key.find('.') != std::string::npos) {
+      service_keys.push_back(pair);
+    } else {
+      RETURN_IF_ERROR(SetOption(key, key, value, &parsed.defaults));
+    }
+  }
+  for (const auto& pair : service_keys) {
+    size_t dot = pair.first.rfind('.');
+    std::string service = pair.first.substr(0, dot);
+    if (parsed.services.find(service) == parsed.services.end()) {
+      parsed.services[service] = parsed.defaults;
+    }
+    RETURN_IF_ERROR(SetOption(pair.first, pair.first.substr(dot + 1),
+                              pair.second, &parsed.services[service]));
+  }
+  if (parsed.address.empty()) {
+    return InvalidDef("missing 'address'");
+  }
+  *config = parsed;
+  return base::Status::OK();
+}
+
+} // namespace server
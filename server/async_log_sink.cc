@@ -0,0 +1,230 @@
+#include "server/async_log_sink.h"
+#include "base/metrics.h"
+#include "base/string_printf.h"
+#include "threading/exception.h"
+#include "threading/function_runner.h"
+#include "threading/thread_factory.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace server {
+
+namespace {
+
+// Set by send() for a FATAL message: glog calls WaitTillSent() next and
+// aborts right after, so that one waits for the writer.
+thread_local bool fatal_pending = false;
+
+} // namespace
+
+AsyncLogSink::AsyncLogSink(const Options& options)
+    : options_(options),
+      queue_(options.capacity),
+      appended_(0),
+      written_(0),
+      dropped_(0),
+      stopping_(false),
+      reported_dropped_(0),
+      fd_(-1),
+      registered_(false),
+      dropped_metric_(0) {
+}
+
+AsyncLogSink::~AsyncLogSink() {
+  Stop();
+}
+
+base::Status AsyncLogSink::Start() {
+  if (thread_) {
+    return base::Status::OK();
+  }
+  if (options_.path.empty()) {
+    fd_ = STDERR_FILENO;
+  } else {
+    fd_ = ::open(options_.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      return base::Status(base::Code::UNAVAILABLE,
+                          "Can't open log file " + options_.path + ": " + ::strerror(errno));
+    }
+  }
+
+  stopping_ = false;
+  threading::PosixThreadFactory factory(threading::ThreadFactory::ATTACHED);
+  try {
+    thread_ = factory.NewThread(threading::FunctionRunner::Create([this] { Run(); }));
+    thread_->SetName("async_log");
+    thread_->Start();
+  } catch (const base::TLibraryException& e) {
+    thread_.reset();
+    return base::Status(base::Code::RESOURCE_EXHAUSTED, e.what());
+  }
+
+  dropped_metric_ = base::MetricsRegistry::GetInstance()->AddCallback(
+      base::MetricsRegistry::COUNTER, "log_sink_dropped_total",
+      "Log lines dropped because the async log buffer was full.",
+      base::MetricLabels(), [this] { return static_cast<double>(dropped()); });
+
+  google::AddLogSink(this);
+  registered_ = true;
+  if (options_.replace_glog_output) {
+    for (int severity = google::GLOG_INFO; severity < google::GLOG_FATAL; ++severity) {
+      google::SetLogDestination(severity, "");
+    }
+    FLAGS_logtostderr = false;
+    FLAGS_alsologtostderr = false;
+    FLAGS_stderrthreshold = google::GLOG_FATAL;
+  }
+  return base::Status::OK();
+}
+
+void AsyncLogSink::Stop() {
+  if (!thread_) {
+    return;
+  }
+  if (registered_) {
+    google::RemoveLogSink(this);
+    registered_ = false;
+    if (options_.replace_glog_output) {
+      FLAGS_logtostderr = true;
+    }
+  }
+  stopping_ = true;
+  not_empty_.Notify();
+  thread_->Join();
+  thread_.reset();
+
+  base::MetricsRegistry::GetInstance()->RemoveCallback(dropped_metric_);
+  if (fd_ != STDERR_FILENO) {
+    ::close(fd_);
+  }
+  fd_ = -1;
+}
+
+bool AsyncLogSink::Append(std::string line) {
+  if (!queue_.TryPush(std::move(line))) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  appended_.fetch_add(1, std::memory_order_release);
+  not_empty_.Notify();
+  return true;
+}
+
+void AsyncLogSink::Flush() {
+  if (!thread_) {
+    return;
+  }
+  const uint64_t target = appended_.load(std::memory_order_acquire);
+  while (written_.load(std::memory_order_acquire) < target) {
+    threading::EventCount::Key key = written_event_.PrepareWait();
+    if (written_.load(std::memory_order_acquire) >= target) {
+      written_event_.CancelWait();
+      break;
+    }
+    written_event_.Wait(key);
+  }
+}
+
+void AsyncLogSink::send(google::LogSeverity severity, const char* /* full_filename */,
+                        const char* base_filename, int line, const struct ::tm* tm_time,
+                        const char* message, size_t message_len) {
+  size_t length = std::min(message_len, options_.max_message_bytes);
+  std::string text = google::LogSink::ToString(severity, base_filename, line,
+                                               tm_time, message, length);
+  if (length < message_len) {
+    base::StringAppendF(&text, "...[%zu bytes]", message_len);
+  }
+  text.push_back('\n');
+  Append(std::move(text));
+  if (severity >= google::GLOG_FATAL) {
+    fatal_pending = true;
+  }
+}
+
+void AsyncLogSink::WaitTillSent() {
+  if (fatal_pending) {
+    fatal_pending = false;
+    Flush();
+  }
+}
+
+void AsyncLogSink::Run() {
+  // One iovec is kept for the dropped lines notice.
+  const size_t max_batch =
+      static_cast<size_t>(std::max(1, std::min(options_.max_batch, IOV_MAX - 1)));
+  std::vector<std::string> batch;
+  batch.reserve(max_batch);
+  std::string line;
+
+  for (;;) {
+    while (batch.size() < max_batch && queue_.TryPop(&line)) {
+      batch.push_back(std::move(line));
+    }
+    if (batch.empty()) {
+      threading::EventCount::Key key = not_empty_.PrepareWait();
+      if (queue_.TryPop(&line)) {
+        not_empty_.CancelWait();
+        batch.push_back(std::move(line));
+        continue;
+      }
+      if (stopping_.load()) {
+        not_empty_.CancelWait();
+        break;
+      }
+      not_empty_.Wait(key);
+      continue;
+    }
+
+    uint64_t dropped_now = dropped();
+    if (dropped_now != reported_dropped_) {
+      batch.push_back(base::StringPrintf(
+          "AsyncLogSink: %llu log lines dropped, buffer full\n",
+          static_cast<unsigned long long>(dropped_now - reported_dropped_)));
+      reported_dropped_ = dropped_now;
+      Write(batch);
+      batch.pop_back();
+    } else {
+      Write(batch);
+    }
+    written_.fetch_add(batch.size(), std::memory_order_release);
+    batch.clear();
+    written_event_.NotifyAll();
+  }
+}
+
+void AsyncLogSink::Write(const std::vector<std::string>& lines) {
+  std::vector<struct iovec> iov(lines.size());
+  for (size_t i = 0; i < lines.size(); ++i) {
+    iov[i].iov_base = const_cast<char*>(lines[i].data());
+    iov[i].iov_len = lines[i].size();
+  }
+  struct iovec* next = iov.data();
+  int left = static_cast<int>(iov.size());
+  while (left > 0) {
+    ssize_t n = ::writev(fd_, next, left);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;  // Nowhere to report it; the lines are lost.
+    }
+    while (left > 0 && static_cast<size_t>(n) >= next->iov_len) {
+      n -= next->iov_len;
+      ++next;
+      --left;
+    }
+    if (left > 0) {
+      next->iov_base = static_cast<char*>(next->iov_base) + n;
+      next->iov_len -= n;
+    }
+  }
+}
+
+} // namespace server
@@ -0,0 +1,112 @@
+#ifndef SERVER_ASYNC_LOG_SINK_H_
+#define SERVER_ASYNC_LOG_SINK_H_
+#include "base/macros.h"
+#include "base/status.h"
+#include "threading/event_count.h"
+#include "threading/mpmc_queue.h"
+#include "threading/thread.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace server {
+
+/**
+ * A glog sink that takes the log I/O off the logging threads.
+ *
+ * send() formats the line and pushes it into a lock-free ring buffer; a
+ * background thread drains it and writes up to `max_batch` lines with one
+ * writev(). A full buffer drops lines instead of blocking (the count is
+ * written to the log and exported as log_sink_dropped_total), and lines
+ * longer than `max_message_bytes` are cut.
+ *
+ * With `replace_glog_output`, Start() also turns off glog's own log files
+ * and stderr output below FATAL, so every existing LOG() goes through the
+ * sink. FATAL messages are still written by glog itself, and the sink is
+ * flushed before glog aborts.
+ *
+ *   server::AsyncLogSink sink;
+ *   sink.Start();
+ *   ...
+ *   sink.Stop();
+ */
+class AsyncLogSink : public google::LogSink {
+ public:
+  struct Options {
+    Options()
+        : capacity(65536),
+          max_message_bytes(4096),
+          max_batch(64),
+          replace_glog_output(true) {}
+
+    std::string path;          // appended to; empty = stderr
+    size_t capacity;           // lines buffered before dropping
+    size_t max_message_bytes;  // longer messages are truncated
+    int max_batch;             // lines per writev()
+    bool replace_glog_output;
+  };
+
+  explicit AsyncLogSink(const Options& options = Options());
+  ~AsyncLogSink() override;
+
+  /**
+   * Opens the output, starts the writer and registers with glog.
+   */
+  base::Status Start();
+
+  /**
+   * Unregisters from glog and returns once everything queued is written.
+   * glog writes to stderr again afterwards.
+   */
+  void Stop();
+
+  /**
+   * Queues one line, which should end in '\n'. Never blocks; returns false
+   * if the line was dropped.
+   */
+  bool Append(std::string line);
+
+  /**
+   * Blocks until the lines appended before the call are written.
+   */
+  void Flush();
+
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  // google::LogSink
+  void send(google::LogSeverity severity, const char* full_filename,
+            const char* base_filename, int line, const struct ::tm* tm_time,
+            const char* message, size_t message_len) override;
+  void WaitTillSent() override;
+
+ private:
+  void Run();
+  void Write(const std::vector<std::string>& lines);
+
+  const Options options_;
+  threading::MpmcQueue<std::string> queue_;
+  threading::EventCount not_empty_;
+  threading::EventCount written_event_;
+  std::atomic<uint64_t> appended_;
+  std::atomic<uint64_t> written_;
+  std::atomic<uint64_t> dropped_;
+  std::atomic<bool> stopping_;
+  // Writer thread only.
+  uint64_t reported_dropped_;
+
+  int fd_;
+  bool registered_;
+  int dropped_metric_;
+  std::shared_ptr<threading::Thread> thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncLogSink);
+};
+
+} // namespace server
+#endif // SERVER_ASYNC_LOG_SINK_H_
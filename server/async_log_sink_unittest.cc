@@ -0,0 +1,87 @@
+#include "server/async_log_sink.h"
+#include "base/file_path.h"
+#include "base/file_util.h"
+#include "base/scoped_temp_dir.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+server::AsyncLogSink::Options FileOptions(const base::FilePath& path) {
+  server::AsyncLogSink::Options options;
+  options.path = path.value();
+  options.replace_glog_output = false;
+  return options;
+}
+
+} // namespace
+
+TEST(AsyncLogSinkTest, Writes_Every_Line) {
+  base::ScopedTempDir dir;
+  ASSERT_TRUE(dir.CreateUniqueTempDir());
+  base::FilePath path = dir.path().Append("log");
+  server::AsyncLogSink::Options options = FileOptions(path);
+  options.max_batch = 7;
+  server::AsyncLogSink sink(options);
+  ASSERT_TRUE(sink.Start().ok());
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&sink, t] {
+      for (int i = 0; i < 1000; ++i) {
+        sink.Append(std::to_string(t) + ":" + std::to_string(i) + "\n");
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  sink.Flush();
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(path, &contents));
+  EXPECT_EQ(4000, std::count(contents.begin(), contents.end(), '\n'));
+  EXPECT_NE(std::string::npos, contents.find("3:999\n"));
+  EXPECT_EQ(0u, sink.dropped());
+  sink.Stop();
+}
+
+TEST(AsyncLogSinkTest, Truncates_And_Reports_Drops) {
+  base::ScopedTempDir dir;
+  ASSERT_TRUE(dir.CreateUniqueTempDir());
+  base::FilePath path = dir.path().Append("log");
+  server::AsyncLogSink::Options options = FileOptions(path);
+  options.capacity = 4;
+  options.max_message_bytes = 10;
+  server::AsyncLogSink sink(options);
+
+  // Not started: nothing drains the buffer, the fifth line is dropped.
+  for (int i = 0; i < 5; ++i) {
+    sink.Append("line\n");
+  }
+  EXPECT_EQ(1u, sink.dropped());
+
+  ASSERT_TRUE(sink.Start().ok());
+  sink.Flush();
+  struct tm tm_time;
+  time_t now = ::time(nullptr);
+  ::localtime_r(&now, &tm_time);
+  const std::string message(100, 'm');
+  sink.send(google::GLOG_INFO, "/src/file.cc", "file.cc", 12, &tm_time,
+            message.data(), message.size());
+  sink.Flush();
+  sink.Stop();
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(path, &contents));
+  EXPECT_NE(std::string::npos, contents.find("1 log lines dropped"));
+  EXPECT_NE(std::string::npos, contents.find("file.cc:12] mmmmmmmmmm...[100 bytes]\n"));
+  EXPECT_EQ(std::string::npos, contents.find("mmmmmmmmmmm"));
+}
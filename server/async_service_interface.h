@@ -2,7 +2,11 @@
 #define SERVER_ASYNC_SERVICE_INTERFACE_H_
 #include "base/status.h"
 
+#include <stddef.h>
+
+#include <functional>
 #include <string>
+#include <vector>
 
 namespace server {
 
@@ -11,15 +15,61 @@ class ServiceHandler {
   virtual ~ServiceHandler() {}
   virtual base::Status Handle(const std::string& message,
                               std::string* reply) = 0;
+
+  // What services call, with the content type of the delivery ("" if it
+  // has none). Handlers that accept several wire formats override this;
+  // the default ignores it.
+  virtual base::Status HandleMessage(const std::string& content_type,
+                                     const std::string& message,
+                                     std::string* reply) {
+    (void) content_type;
+    return Handle(message, reply);
+  }
+};
+
+// Per-service settings a server applies before starting a service.
+struct ServiceOptions {
+  ServiceOptions()
+      : executors(1), prefetch(0), workers(0), max_prefetch(0),
+        max_priority(0), reserved_workers(0), short_priority(0),
+        compress_min_size(0), retry_delay_ms(1000) {}
+
+  int executors;          // concurrent consumers of the service
+  int prefetch;           // unacked deliveries per consumer, 0 = unlimited
+  std::vector<int> cpus;  // affinity of the executor threads, empty = any
+  int workers;            // handler threads, 0 = handle on the consumer
+  int max_prefetch;       // > prefetch: adapt prefetch to handler latency
+  int max_priority;       // x-max-priority of the queue, 0 = FIFO queue
+  int reserved_workers;   // workers kept for deliveries of short_priority
+  int short_priority;     // and above
+  size_t compress_min_size;  // zstd-compress replies this large, 0 = never
+  int retry_delay_ms;     // pause after a retryable failure, 0 = ack failures
 };
 
 class AsyncServiceInterface {
  public:
   virtual ~AsyncServiceInterface() {}
 
+  // Key of the service's settings in the server configuration.
+  virtual std::string name() const { return std::string(); }
+
+  // Called once before the service is started. Services started with
+  // several executors run HandleLoop() (or StartAsync()) once per executor,
+  // concurrently.
+  virtual void Configure(const ServiceOptions& options) { (void) options; }
+
   // Handle loop
   virtual void HandleLoop() = 0;
   virtual void Shutdown() = 0;
+
+  // Services driven by an event loop they don't own (e.g. one of an
+  // AmqpConnectionHub) start handling here and return true, so the server
+  // doesn't spend a thread on HandleLoop(). `stopped` must be called once
+  // the service has stopped handling after Shutdown().
+  virtual bool StartAsync(const std::function<void()>& stopped) {
+    (void) stopped;
+    return false;
+  }
   virtual void SetHandler(ServiceHandler* service_handler) = 0;
 };
 
@@ -0,0 +1,125 @@
+#include "server/concurrency_limiter.h"
+#include "threading/mutex.h"
+#include "threading/time_util.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace server {
+
+namespace {
+
+// The baseline follows the short RTT with this weight per window, so it
+// reflects the backend's unloaded latency over the last few minutes.
+const double kLongRttWeight = 0.05;
+
+} // namespace
+
+ConcurrencyLimiter::ConcurrencyLimiter(const Options& options)
+    : options_(options),
+      limit_(options.initial_limit),
+      long_rtt_us_(0),
+      short_rtt_us_(0),
+      samples_(0),
+      drops_(0),
+      window_start_ms_(threading::TimeUtil::MonotonicTime()),
+      window_latency_sum_us_(0),
+      window_samples_(0),
+      window_max_in_flight_(0),
+      window_dropped_(false) {
+}
+
+bool ConcurrencyLimiter::OnSample(int64_t latency_us, int in_flight, bool dropped) {
+  int64_t now_ms = threading::TimeUtil::MonotonicTime();
+  threading::Guard g(lock_);
+  samples_++;
+  if (dropped) {
+    drops_++;
+    window_dropped_ = true;
+  } else {
+    window_latency_sum_us_ += latency_us;
+    window_samples_++;
+  }
+  window_max_in_flight_ = std::max(window_max_in_flight_, in_flight);
+
+  if (now_ms - window_start_ms_ < options_.window_ms) {
+    return false;
+  }
+  if (!window_dropped_ && window_samples_ < options_.min_window_samples) {
+    return false;  // Too few samples to tell; keep extending the window.
+  }
+  bool changed = UpdateLimit();
+
+  window_start_ms_ = now_ms;
+  window_latency_sum_us_ = 0;
+  window_samples_ = 0;
+  window_max_in_flight_ = 0;
+  window_dropped_ = false;
+  return changed;
+}
+
+bool ConcurrencyLimiter::UpdateLimit() {
+  int old_limit = static_cast<int>(limit_);
+  double new_limit;
+
+  if (window_dropped_) {
+    new_limit = limit_ * options_.backoff_ratio;
+  } else {
+    short_rtt_us_ = window_latency_sum_us_ / window_samples_;
+    if (long_rtt_us_ == 0) {
+      long_rtt_us_ = short_rtt_us_;
+    } else {
+      long_rtt_us_ = static_cast<int64_t>(
+          long_rtt_us_ * (1 - kLongRttWeight) + short_rtt_us_ * kLongRttWeight);
+    }
+    // After a long overload the baseline has drifted up; pull it down
+    // quickly once the backend is fast again.
+    if (long_rtt_us_ > 2 * short_rtt_us_) {
+      long_rtt_us_ = static_cast<int64_t>(long_rtt_us_ * 0.95);
+    }
+
+    if (window_max_in_flight_ * 2 < limit_) {
+      // The limit was not the bottleneck; nothing learned about raising it.
+      return false;
+    }
+    double gradient = options_.tolerance * long_rtt_us_ /
+                      std::max<int64_t>(short_rtt_us_, 1);
+    gradient = std::max(0.5, std::min(1.0, gradient));
+    new_limit = limit_ * gradient + std::sqrt(limit_);
+    new_limit = limit_ * (1 - options_.smoothing) + new_limit * options_.smoothing;
+  }
+
+  limit_ = std::max<double>(options_.min_limit,
+                            std::min<double>(options_.max_limit, new_limit));
+  return static_cast<int>(limit_) != old_limit;
+}
+
+int ConcurrencyLimiter::limit() const {
+  threading::Guard g(lock_);
+  return static_cast<int>(limit_);
+}
+
+ConcurrencyLimiter::Snapshot ConcurrencyLimiter::GetSnapshot() const {
+  threading::Guard g(lock_);
+  Snapshot snapshot;
+  snapshot.limit = static_cast<int>(limit_);
+  snapshot.short_rtt_us = short_rtt_us_;
+  snapshot.long_rtt_us = long_rtt_us_;
+  snapshot.samples = samples_;
+  snapshot.drops = drops_;
+  return snapshot;
+}
+
+// static
+bool ConcurrencyLimiter::IsOverload(const base::Status& status) {
+  switch (status.code()) {
+    case base::Code::DEADLINE_EXCEEDED:
+    case base::Code::RESOURCE_EXHAUSTED:
+    case base::Code::UNAVAILABLE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+} // namespace server
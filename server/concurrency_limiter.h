@@ -0,0 +1,101 @@
+#ifndef SERVER_CONCURRENCY_LIMITER_H_
+#define SERVER_CONCURRENCY_LIMITER_H_
+#include "base/macros.h"
+#include "base/status.h"
+#include "threading/futex_mutex.h"
+
+#include <stdint.h>
+
+namespace server {
+
+/**
+ * Finds how many requests a backend can take at once from the latency it
+ * shows, in the style of the gradient limiters used by service proxies.
+ *
+ * Samples are gathered over windows. At the end of each window the average
+ * latency of the window (short RTT) is compared with a slowly moving
+ * baseline (long RTT):
+ *
+ *   gradient  = clamp(tolerance * long_rtt / short_rtt, 0.5, 1.0)
+ *   new_limit = limit * gradient + sqrt(limit)
+ *
+ * so the limit grows by about sqrt(limit) while latency stays near the
+ * baseline and shrinks once requests start queuing in the backend. A
+ * window containing overload errors instead backs off multiplicatively
+ * (AIMD). Windows in which the limit was not used don't grow it.
+ *
+ * Thread-safe.
+ */
+class ConcurrencyLimiter {
+ public:
+  struct Options {
+    Options()
+        : initial_limit(4),
+          min_limit(1),
+          max_limit(256),
+          window_ms(1000),
+          min_window_samples(10),
+          smoothing(0.2),
+          tolerance(1.5),
+          backoff_ratio(0.9) {}
+
+    int initial_limit;
+    int min_limit;
+    int max_limit;
+    int64_t window_ms;
+    int min_window_samples;
+    double smoothing;      // weight of a new estimate against the old limit
+    double tolerance;      // latency growth accepted before shrinking
+    double backoff_ratio;  // applied to the limit after overload errors
+  };
+
+  struct Snapshot {
+    int limit;
+    int64_t short_rtt_us;
+    int64_t long_rtt_us;
+    uint64_t samples;
+    uint64_t drops;
+  };
+
+  explicit ConcurrencyLimiter(const Options& options = Options());
+
+  /**
+   * Records a finished call that took `latency_us` while `in_flight` calls
+   * (itself included) were outstanding. `dropped` marks overload: timeouts,
+   * unavailable or exhausted backends. Returns true if the limit changed.
+   */
+  bool OnSample(int64_t latency_us, int in_flight, bool dropped);
+
+  int limit() const;
+  Snapshot GetSnapshot() const;
+
+  /**
+   * Whether a handler status means the backend is overloaded, as opposed
+   * to a bad request.
+   */
+  static bool IsOverload(const base::Status& status);
+
+ private:
+  bool UpdateLimit();
+
+  const Options options_;
+
+  mutable threading::FutexMutex lock_;
+  double limit_;
+  int64_t long_rtt_us_;
+  int64_t short_rtt_us_;
+  uint64_t samples_;
+  uint64_t drops_;
+
+  // Current window.
+  int64_t window_start_ms_;
+  int64_t window_latency_sum_us_;
+  int window_samples_;
+  int window_max_in_flight_;
+  bool window_dropped_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConcurrencyLimiter);
+};
+
+} // namespace server
+#endif // SERVER_CONCURRENCY_LIMITER_H_
@@ -0,0 +1,74 @@
+#include "server/concurrency_limiter.h"
+
+#include <gtest/gtest.h>
+
+using server::ConcurrencyLimiter;
+
+namespace {
+
+ConcurrencyLimiter::Options TestOptions() {
+  ConcurrencyLimiter::Options options;
+  options.initial_limit = 10;
+  options.max_limit = 100;
+  options.window_ms = 0;           // close a window every time...
+  options.min_window_samples = 5;  // ...it has this many samples
+  return options;
+}
+
+// Feeds `windows` full windows of calls with the given latency, each
+// seeing the whole current limit in flight.
+void Feed(ConcurrencyLimiter* limiter, int windows, int64_t latency_us) {
+  for (int w = 0; w < windows; ++w) {
+    for (int i = 0; i < 5; ++i) {
+      limiter->OnSample(latency_us, limiter->limit(), false);
+    }
+  }
+}
+
+} // namespace
+
+TEST(ConcurrencyLimiterTest, Grows_While_Latency_Is_Flat) {
+  ConcurrencyLimiter limiter(TestOptions());
+  Feed(&limiter, 50, 1000);
+  EXPECT_GT(limiter.limit(), 30);
+  EXPECT_LE(limiter.limit(), 100);
+  EXPECT_EQ(1000, limiter.GetSnapshot().short_rtt_us);
+}
+
+TEST(ConcurrencyLimiterTest, Shrinks_When_Latency_Rises) {
+  ConcurrencyLimiter limiter(TestOptions());
+  Feed(&limiter, 20, 1000);
+  int grown = limiter.limit();
+  // The backend starts queuing: latency quadruples.
+  Feed(&limiter, 5, 4000);
+  EXPECT_LT(limiter.limit(), grown);
+}
+
+TEST(ConcurrencyLimiterTest, Backs_Off_On_Overload) {
+  ConcurrencyLimiter limiter(TestOptions());
+  limiter.OnSample(0, 10, true);
+  EXPECT_EQ(9, limiter.limit());
+  for (int i = 0; i < 100; ++i) {
+    limiter.OnSample(0, 10, true);
+  }
+  EXPECT_EQ(1, limiter.limit());
+  EXPECT_EQ(101u, limiter.GetSnapshot().drops);
+}
+
+TEST(ConcurrencyLimiterTest, Unused_Limit_Does_Not_Grow) {
+  ConcurrencyLimiter limiter(TestOptions());
+  for (int i = 0; i < 500; ++i) {
+    limiter.OnSample(1000, 1, false);
+  }
+  EXPECT_EQ(10, limiter.limit());
+}
+
+TEST(ConcurrencyLimiterTest, Overload_Codes) {
+  EXPECT_TRUE(ConcurrencyLimiter::IsOverload(
+      base::Status(base::Code::UNAVAILABLE, "backend down")));
+  EXPECT_TRUE(ConcurrencyLimiter::IsOverload(
+      base::Status(base::Code::DEADLINE_EXCEEDED, "slow")));
+  EXPECT_FALSE(ConcurrencyLimiter::IsOverload(
+      base::Status(base::Code::INVALID_ARGUMENT, "bad json")));
+  EXPECT_FALSE(ConcurrencyLimiter::IsOverload(base::Status::OK()));
+}
@@ -0,0 +1,227 @@
+#include "server/latency_histogram.h"
+#include "base/string_printf.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace server {
+
+namespace {
+
+void AtomicMin(std::atomic<int64_t>* target, int64_t value) {
+  int64_t current = target->load(std::memory_order_relaxed);
+  while (value < current &&
+         !target->compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+  }
+}
+
+void AtomicMax(std::atomic<int64_t>* target, int64_t value) {
+  int64_t current = target->load(std::memory_order_relaxed);
+  while (value > current &&
+         !target->compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+  }
+}
+
+int Log2Ceiling(int64_t value) {
+  int log = 0;
+  while ((static_cast<int64_t>(1) << log) < value) {
+    log++;
+  }
+  return log;
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram(int64_t highest_value, int significant_digits)
+    : highest_value_(std::max<int64_t>(highest_value, 2)),
+      total_count_(0),
+      total_sum_(0),
+      min_(std::numeric_limits<int64_t>::max()),
+      max_(0) {
+  significant_digits = std::max(1, std::min(significant_digits, 5));
+  int64_t largest_single_unit = 2 * static_cast<int64_t>(std::pow(10, significant_digits));
+  int sub_bucket_count_magnitude = Log2Ceiling(largest_single_unit);
+  sub_bucket_half_count_magnitude_ = sub_bucket_count_magnitude - 1;
+  sub_bucket_half_count_ = static_cast<int64_t>(1) << sub_bucket_half_count_magnitude_;
+  sub_bucket_mask_ = (static_cast<int64_t>(1) << sub_bucket_count_magnitude) - 1;
+
+  // Buckets needed so that the last one covers highest_value.
+  int64_t smallest_untrackable = static_cast<int64_t>(1) << sub_bucket_count_magnitude;
+  int bucket_count = 1;
+  while (smallest_untrackable <= highest_value_) {
+    if (smallest_untrackable > std::numeric_limits<int64_t>::max() / 2) {
+      bucket_count++;
+      break;
+    }
+    smallest_untrackable <<= 1;
+    bucket_count++;
+  }
+  counts_length_ = static_cast<int>((bucket_count + 1) * sub_bucket_half_count_);
+  counts_.reset(new std::atomic<uint64_t>[counts_length_]);
+  for (int i = 0; i < counts_length_; ++i) {
+    counts_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+int LatencyHistogram::CountsIndex(int64_t value) const {
+  int pow2_ceiling = 64 - __builtin_clzll(static_cast<uint64_t>(value | sub_bucket_mask_));
+  int bucket_index = pow2_ceiling - (sub_bucket_half_count_magnitude_ + 1);
+  int64_t sub_bucket_index = value >> bucket_index;
+  return static_cast<int>(((bucket_index + 1) << sub_bucket_half_count_magnitude_) +
+                          (sub_bucket_index - sub_bucket_half_count_));
+}
+
+int64_t LatencyHistogram::ValueFromIndex(int index) const {
+  int bucket_index = (index >> sub_bucket_half_count_magnitude_) - 1;
+  int64_t sub_bucket_index = (index & (sub_bucket_half_count_ - 1)) + sub_bucket_half_count_;
+  if (bucket_index < 0) {
+    sub_bucket_index -= sub_bucket_half_count_;
+    bucket_index = 0;
+  }
+  return sub_bucket_index << bucket_index;
+}
+
+int64_t LatencyHistogram::HighestEquivalentValue(int64_t value) const {
+  int pow2_ceiling = 64 - __builtin_clzll(static_cast<uint64_t>(value | sub_bucket_mask_));
+  int bucket_index = pow2_ceiling - (sub_bucket_half_count_magnitude_ + 1);
+  return ValueFromIndex(CountsIndex(value)) + (static_cast<int64_t>(1) << bucket_index) - 1;
+}
+
+void LatencyHistogram::Record(int64_t value) {
+  value = std::max<int64_t>(0, std::min(value, highest_value_));
+  counts_[CountsIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  total_count_.fetch_add(1, std::memory_order_relaxed);
+  total_sum_.fetch_add(value, std::memory_order_relaxed);
+  AtomicMin(&min_, value);
+  AtomicMax(&max_, value);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  if (other.counts_length_ != counts_length_ ||
+      other.sub_bucket_half_count_ != sub_bucket_half_count_) {
+    return;
+  }
+  for (int i = 0; i < counts_length_; ++i) {
+    uint64_t count = other.counts_[i].load(std::memory_order_relaxed);
+    if (count != 0) {
+      counts_[i].fetch_add(count, std::memory_order_relaxed);
+    }
+  }
+  total_count_.fetch_add(other.count(), std::memory_order_relaxed);
+  total_sum_.fetch_add(other.total_sum_.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+  if (other.count() != 0) {
+    AtomicMin(&min_, other.min());
+    AtomicMax(&max_, other.max());
+  }
+}
+
+void LatencyHistogram::Reset() {
+  for (int i = 0; i < counts_length_; ++i) {
+    counts_[i].store(0, std::memory_order_relaxed);
+  }
+  total_count_.store(0, std::memory_order_relaxed);
+  total_sum_.store(0, std::memory_order_relaxed);
+  min_.store(std::numeric_limits<int64_t>::max(), std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::min() const {
+  return count() == 0 ? 0 : min_.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::max() const {
+  return max_.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const {
+  uint64_t total = count();
+  return total == 0 ? 0.0
+                    : static_cast<double>(total_sum_.load(std::memory_order_relaxed)) / total;
+}
+
+int64_t LatencyHistogram::ValueAtPercentile(double percentile) const {
+  uint64_t total = count();
+  if (total == 0) {
+    return 0;
+  }
+  percentile = std::max(0.0, std::min(percentile, 100.0));
+  uint64_t wanted = static_cast<uint64_t>(percentile / 100.0 * total + 0.5);
+  wanted = std::max<uint64_t>(wanted, 1);
+
+  uint64_t seen = 0;
+  for (int i = 0; i < counts_length_; ++i) {
+    seen += counts_[i].load(std::memory_order_relaxed);
+    if (seen >= wanted) {
+      return std::min(HighestEquivalentValue(ValueFromIndex(i)), max());
+    }
+  }
+  return max();
+}
+
+uint64_t LatencyHistogram::CountAtOrBelow(int64_t value) const {
+  int last = std::min(CountsIndex(std::min(value, highest_value_)), counts_length_ - 1);
+  uint64_t count = 0;
+  for (int i = 0; i <= last; ++i) {
+    count += counts_[i].load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+std::string LatencyHistogram::Summary() const {
+  return base::StringPrintf("count=%llu mean=%.1f p50=%lld p99=%lld p999=%lld max=%lld",
+                            static_cast<unsigned long long>(count()), mean(),
+                            static_cast<long long>(ValueAtPercentile(50)),
+                            static_cast<long long>(ValueAtPercentile(99)),
+                            static_cast<long long>(ValueAtPercentile(99.9)),
+                            static_cast<long long>(max()));
+}
+
+std::string LatencyHistogram::PercentileDistribution(double value_scale,
+                                                     int ticks_per_half_distance) const {
+  std::string out = base::StringPrintf("%12s %14s %10s %14s\n\n",
+                                       "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+  uint64_t total = count();
+  if (total == 0) {
+    return out;
+  }
+  ticks_per_half_distance = std::max(ticks_per_half_distance, 1);
+  const int64_t largest = max();
+
+  double percentile = 0;
+  for (;;) {
+    int64_t value = ValueAtPercentile(percentile);
+    if (value >= largest || percentile >= 100) {
+      break;
+    }
+    base::StringAppendF(&out, "%12.3f %2.12f %10llu %14.2f\n",
+                        value / value_scale, percentile / 100,
+                        static_cast<unsigned long long>(CountAtOrBelow(value)),
+                        1 / (1 - percentile / 100));
+    double half_distance = std::pow(2, std::floor(std::log2(100 / (100 - percentile))) + 1);
+    percentile += 100 / (half_distance * ticks_per_half_distance);
+  }
+  base::StringAppendF(&out, "%12.3f %2.12f %10llu\n", largest / value_scale, 1.0,
+                      static_cast<unsigned long long>(total));
+
+  double mean_value = mean();
+  double variance = 0;
+  for (int i = 0; i < counts_length_; ++i) {
+    uint64_t n = counts_[i].load(std::memory_order_relaxed);
+    if (n != 0) {
+      double deviation = ValueFromIndex(i) - mean_value;
+      variance += deviation * deviation * n;
+    }
+  }
+  base::StringAppendF(&out, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n",
+                      mean_value / value_scale, std::sqrt(variance / total) / value_scale);
+  base::StringAppendF(&out, "#[Max     = %12.3f, Total count    = %12llu]\n",
+                      largest / value_scale, static_cast<unsigned long long>(total));
+  base::StringAppendF(&out, "#[Buckets = %12d, SubBuckets     = %12lld]\n",
+                      counts_length_ / static_cast<int>(sub_bucket_half_count_) - 1,
+                      static_cast<long long>(2 * sub_bucket_half_count_));
+  return out;
+}
+
+} // namespace server
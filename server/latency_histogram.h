@@ -0,0 +1,89 @@
+#ifndef SERVER_LATENCY_HISTOGRAM_H_
+#define SERVER_LATENCY_HISTOGRAM_H_
+#include "base/macros.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace server {
+
+/**
+ * Records latencies (or any non-negative values) with a bounded relative
+ * error, laid out like an HdrHistogram: values are grouped in buckets of
+ * powers of two, each split in enough linear sub-buckets to keep
+ * `significant_digits` decimal digits. With the defaults (3 digits up to
+ * an hour in microseconds) that is about 45k counters, and every
+ * percentile is within 0.1% of the recorded value.
+ *
+ * Record() is lock-free and may be called from any number of threads;
+ * the readers see a consistent enough picture while recording goes on.
+ */
+class LatencyHistogram {
+ public:
+  explicit LatencyHistogram(int64_t highest_value = 3600LL * 1000 * 1000,
+                            int significant_digits = 3);
+
+  /**
+   * Values above highest_value are recorded as highest_value, negative
+   * ones as 0.
+   */
+  void Record(int64_t value);
+
+  /**
+   * Adds the counts of `other`, which must have the same layout.
+   */
+  void Merge(const LatencyHistogram& other);
+  void Reset();
+
+  uint64_t count() const { return total_count_.load(std::memory_order_relaxed); }
+  int64_t min() const;
+  int64_t max() const;
+  double mean() const;
+
+  /**
+   * The smallest value such that `percentile` percent of the recorded
+   * values are at or below it, e.g. ValueAtPercentile(99.9).
+   */
+  int64_t ValueAtPercentile(double percentile) const;
+
+  /**
+   * "count=.. mean=.. p50=.. p99=.. p999=.. max=..".
+   */
+  std::string Summary() const;
+
+  /**
+   * The percentile distribution in HdrHistogram's text (.hgrm) format,
+   * readable by its plotter. Values are divided by `value_scale`, e.g.
+   * 1000 to print microseconds as milliseconds; the percentile step halves
+   * every time the distance to 100% does.
+   */
+  std::string PercentileDistribution(double value_scale = 1.0,
+                                     int ticks_per_half_distance = 5) const;
+
+ private:
+  int CountsIndex(int64_t value) const;
+  int64_t ValueFromIndex(int index) const;
+  // The largest value recorded in the same counter as `value`.
+  int64_t HighestEquivalentValue(int64_t value) const;
+  uint64_t CountAtOrBelow(int64_t value) const;
+
+  const int64_t highest_value_;
+  int sub_bucket_half_count_magnitude_;
+  int64_t sub_bucket_half_count_;
+  int64_t sub_bucket_mask_;
+  int counts_length_;
+
+  std::unique_ptr<std::atomic<uint64_t>[]> counts_;
+  std::atomic<uint64_t> total_count_;
+  std::atomic<int64_t> total_sum_;
+  std::atomic<int64_t> min_;
+  std::atomic<int64_t> max_;
+
+  DISALLOW_COPY_AND_ASSIGN(LatencyHistogram);
+};
+
+} // namespace server
+#endif // SERVER_LATENCY_HISTOGRAM_H_
@@ -0,0 +1,88 @@
+#include "server/latency_histogram.h"
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST(LatencyHistogramTest, Empty) {
+  server::LatencyHistogram histogram;
+  EXPECT_EQ(0u, histogram.count());
+  EXPECT_EQ(0, histogram.min());
+  EXPECT_EQ(0, histogram.ValueAtPercentile(99));
+}
+
+TEST(LatencyHistogramTest, Percentiles_Within_Precision) {
+  server::LatencyHistogram histogram;
+  for (int64_t value = 1; value <= 100000; ++value) {
+    histogram.Record(value);
+  }
+  EXPECT_EQ(100000u, histogram.count());
+  EXPECT_EQ(1, histogram.min());
+  EXPECT_EQ(100000, histogram.max());
+  EXPECT_NEAR(50000.5, histogram.mean(), 0.01);
+
+  // 3 significant digits: within 0.1%.
+  EXPECT_NEAR(50000, histogram.ValueAtPercentile(50), 50);
+  EXPECT_NEAR(99000, histogram.ValueAtPercentile(99), 99);
+  EXPECT_NEAR(99900, histogram.ValueAtPercentile(99.9), 100);
+  EXPECT_EQ(100000, histogram.ValueAtPercentile(100));
+  // Small values are exact.
+  EXPECT_EQ(1, histogram.ValueAtPercentile(0));
+}
+
+TEST(LatencyHistogramTest, Clamps_Out_Of_Range) {
+  server::LatencyHistogram histogram(1000, 2);
+  histogram.Record(-5);
+  histogram.Record(5000);
+  EXPECT_EQ(0, histogram.min());
+  EXPECT_EQ(1000, histogram.max());
+  EXPECT_EQ(1000, histogram.ValueAtPercentile(100));
+}
+
+TEST(LatencyHistogramTest, Merge_And_Reset) {
+  server::LatencyHistogram a;
+  server::LatencyHistogram b;
+  a.Record(10);
+  b.Record(20000);
+  a.Merge(b);
+  EXPECT_EQ(2u, a.count());
+  EXPECT_EQ(10, a.min());
+  EXPECT_EQ(20000, a.max());
+
+  a.Reset();
+  EXPECT_EQ(0u, a.count());
+  EXPECT_EQ(0, a.max());
+}
+
+TEST(LatencyHistogramTest, Concurrent_Record) {
+  server::LatencyHistogram histogram;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&histogram] {
+      for (int i = 0; i < 100000; ++i) {
+        histogram.Record(i % 1000);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(400000u, histogram.count());
+  EXPECT_EQ(999, histogram.max());
+}
+
+TEST(LatencyHistogramTest, Percentile_Distribution) {
+  server::LatencyHistogram histogram;
+  for (int64_t value = 1; value <= 1000; ++value) {
+    histogram.Record(value * 1000);
+  }
+  std::string hgrm = histogram.PercentileDistribution(1000);
+  EXPECT_NE(std::string::npos, hgrm.find("Percentile"));
+  // Ends at the maximum, 100%, then the footer.
+  EXPECT_NE(std::string::npos, hgrm.find("1000.000 1.000000000000       1000\n"));
+  EXPECT_NE(std::string::npos, hgrm.find("#[Max     =     1000.000, Total count    =         1000]"));
+  // 50% and 99% are on the 5-ticks-per-half-distance grid.
+  EXPECT_NE(std::string::npos, hgrm.find(" 0.500000000000 "));
+  EXPECT_NE(std::string::npos, hgrm.find(" 0.990625000000 "));
+}
@@ -0,0 +1,101 @@
+#ifndef SERVER_LOG_UTIL_H_
+#define SERVER_LOG_UTIL_H_
+#include "base/macros.h"
+#include "threading/time_util.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <ostream>
+#include <string>
+
+#include <glog/logging.h>
+
+namespace server {
+
+/**
+ * Lets one call through per interval, from any thread. Used by
+ * LOG_EVERY_MS, one per call site.
+ */
+class LogRateLimiter {
+ public:
+  explicit LogRateLimiter(int64_t interval_ms)
+      : interval_ms_(interval_ms), next_ms_(0) {}
+
+  bool Allow() {
+    int64_t now = threading::TimeUtil::MonotonicTime();
+    int64_t next = next_ms_.load(std::memory_order_relaxed);
+    return now >= next &&
+           next_ms_.compare_exchange_strong(next, now + interval_ms_,
+                                            std::memory_order_relaxed);
+  }
+
+ private:
+  const int64_t interval_ms_;
+  std::atomic<int64_t> next_ms_;
+
+  DISALLOW_COPY_AND_ASSIGN(LogRateLimiter);
+};
+
+/**
+ * True once in `one_in` calls on average, chosen at random so periodic
+ * traffic can't hide behind the sampling (unlike LOG_EVERY_N).
+ */
+inline bool LogSampled(uint32_t one_in) {
+  static thread_local uint32_t state = 0;
+  if (state == 0) {
+    state = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&state)) | 1;
+  }
+  // xorshift32
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return one_in <= 1 || state % one_in == 0;
+}
+
+/**
+ * Streams at most `max_bytes` of a payload followed by its full size, so
+ * a message body can be logged without copying megabytes into the log:
+ *
+ *   LOG(INFO) << "Received message: " << Truncated(message);
+ */
+struct Truncated {
+  explicit Truncated(const std::string& payload, size_t max_bytes = 256)
+      : payload(payload), max_bytes(max_bytes) {}
+
+  const std::string& payload;
+  const size_t max_bytes;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const Truncated& truncated) {
+  if (truncated.payload.size() <= truncated.max_bytes) {
+    return os << truncated.payload;
+  }
+  os.write(truncated.payload.data(), truncated.max_bytes);
+  return os << "...[" << truncated.payload.size() << " bytes]";
+}
+
+} // namespace server
+
+/**
+ * LOG(severity) at most once every `ms` milliseconds per call site; `ms`
+ * must be a constant. Like LOG_IF, the message isn't formatted when
+ * skipped:
+ *
+ *   LOG_EVERY_MS(INFO, 1000) << "progress: " << done << "/" << total;
+ */
+#define LOG_EVERY_MS(severity, ms)                                         \
+  !([]() -> ::server::LogRateLimiter& {                                    \
+      static ::server::LogRateLimiter log_rate_limiter(ms);                \
+      return log_rate_limiter;                                             \
+    }().Allow())                                                           \
+      ? (void) 0 : google::LogMessageVoidify() & LOG(severity)
+
+/**
+ * LOG(severity) for a random 1 in `one_in` of the calls.
+ */
+#define LOG_SAMPLED(severity, one_in)                                      \
+  !::server::LogSampled(one_in)                                            \
+      ? (void) 0 : google::LogMessageVoidify() & LOG(severity)
+
+#endif // SERVER_LOG_UTIL_H_
@@ -0,0 +1,41 @@
+#include "server/log_util.h"
+
+#include <unistd.h>
+
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+TEST(LogUtilTest, Every_Ms_Skips_Formatting) {
+  int formatted = 0;
+  for (int i = 0; i < 10; ++i) {
+    LOG_EVERY_MS(INFO, 60000) << "formatted " << ++formatted;
+  }
+  EXPECT_EQ(1, formatted);
+}
+
+TEST(LogUtilTest, Rate_Limiter) {
+  server::LogRateLimiter limiter(20);
+  EXPECT_TRUE(limiter.Allow());
+  EXPECT_FALSE(limiter.Allow());
+  ::usleep(30 * 1000);
+  EXPECT_TRUE(limiter.Allow());
+}
+
+TEST(LogUtilTest, Sampled) {
+  int logged = 0;
+  for (int i = 0; i < 100000; ++i) {
+    if (server::LogSampled(100)) {
+      logged++;
+    }
+  }
+  EXPECT_GT(logged, 500);
+  EXPECT_LT(logged, 1500);
+  EXPECT_TRUE(server::LogSampled(1));
+}
+
+TEST(LogUtilTest, Truncated) {
+  std::ostringstream os;
+  os << server::Truncated("short", 8) << "|" << server::Truncated(std::string(20, 'x'), 4);
+  EXPECT_EQ("short|xxxx...[20 bytes]", os.str());
+}
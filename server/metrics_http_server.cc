@@ -0,0 +1,129 @@
+#include "server/metrics_http_server.h"
+#include "threading/exception.h"
+#include "threading/function_runner.h"
+#include "threading/thread_factory.h"
+
+#include <event2/buffer.h>
+#include <event2/http.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+namespace server {
+
+MetricsHttpServer::MetricsHttpServer(const std::string& address, int port,
+                                     base::MetricsRegistry* registry)
+    : address_(address),
+      port_(port),
+      registry_(registry),
+      event_base_(nullptr),
+      http_(nullptr),
+      stop_fd_(-1),
+      stop_event_(nullptr) {
+}
+
+MetricsHttpServer::~MetricsHttpServer() {
+  Stop();
+  if (stop_event_ != nullptr) {
+    ::event_free(stop_event_);
+  }
+  if (stop_fd_ >= 0) {
+    ::close(stop_fd_);
+  }
+  if (http_ != nullptr) {
+    ::evhttp_free(http_);
+  }
+  if (event_base_ != nullptr) {
+    ::event_base_free(event_base_);
+  }
+}
+
+base::Status MetricsHttpServer::Start() {
+  if (thread_) {
+    return base::Status::OK();
+  }
+  event_base_ = ::event_base_new();
+  stop_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (event_base_ == nullptr || stop_fd_ < 0) {
+    return base::Status(base::Code::RESOURCE_EXHAUSTED, "metrics: event_base/eventfd");
+  }
+  http_ = ::evhttp_new(event_base_);
+  ::evhttp_set_allowed_methods(http_, EVHTTP_REQ_GET | EVHTTP_REQ_HEAD);
+  ::evhttp_set_gencb(http_, &MetricsHttpServer::OnRequest, this);
+
+  struct evhttp_bound_socket* socket =
+      ::evhttp_bind_socket_with_handle(http_, address_.c_str(), static_cast<uint16_t>(port_));
+  if (socket == nullptr) {
+    return base::Status(base::Code::UNAVAILABLE,
+                        "metrics: can't listen on " + address_ + ":" + std::to_string(port_));
+  }
+  struct sockaddr_storage bound;
+  socklen_t length = sizeof(bound);
+  if (::getsockname(::evhttp_bound_socket_get_fd(socket),
+                    reinterpret_cast<struct sockaddr*>(&bound), &length) == 0) {
+    port_ = ntohs(bound.ss_family == AF_INET6
+                      ? reinterpret_cast<struct sockaddr_in6*>(&bound)->sin6_port
+                      : reinterpret_cast<struct sockaddr_in*>(&bound)->sin_port);
+  }
+
+  stop_event_ = ::event_new(event_base_, stop_fd_, EV_READ,
+                            &MetricsHttpServer::OnStop, this);
+  ::event_add(stop_event_, nullptr);
+
+  threading::PosixThreadFactory factory(threading::ThreadFactory::ATTACHED);
+  try {
+    thread_ = factory.NewThread(threading::FunctionRunner::Create([this] { Run(); }));
+    thread_->SetName("metrics_http");
+    thread_->Start();
+  } catch (const base::TLibraryException& e) {
+    thread_.reset();
+    return base::Status(base::Code::RESOURCE_EXHAUSTED, e.what());
+  }
+  LOG(INFO) << "Serving metrics on http://" << address_ << ":" << port_ << "/metrics";
+  return base::Status::OK();
+}
+
+void MetricsHttpServer::Stop() {
+  if (!thread_) {
+    return;
+  }
+  uint64_t one = 1;
+  ssize_t ret = ::write(stop_fd_, &one, sizeof(one));
+  (void) ret;
+  thread_->Join();
+  thread_.reset();
+}
+
+void MetricsHttpServer::Run() {
+  ::event_base_dispatch(event_base_);
+}
+
+// static
+void MetricsHttpServer::OnStop(evutil_socket_t /* fd */, short /* what */, void* arg) {
+  ::event_base_loopbreak(static_cast<MetricsHttpServer*>(arg)->event_base_);
+}
+
+// static
+void MetricsHttpServer::OnRequest(struct evhttp_request* request, void* arg) {
+  MetricsHttpServer* server = static_cast<MetricsHttpServer*>(arg);
+  const char* path = ::evhttp_uri_get_path(::evhttp_request_get_evhttp_uri(request));
+  if (path == nullptr || ::strcmp(path, "/metrics") != 0) {
+    ::evhttp_send_error(request, HTTP_NOTFOUND, "Not Found");
+    return;
+  }
+  std::string text = server->registry_->ExportText();
+  struct evbuffer* body = ::evbuffer_new();
+  ::evbuffer_add(body, text.data(), text.size());
+  ::evhttp_add_header(::evhttp_request_get_output_headers(request),
+                      "Content-Type", "text/plain; version=0.0.4");
+  ::evhttp_send_reply(request, HTTP_OK, "OK", body);
+  ::evbuffer_free(body);
+}
+
+} // namespace server
@@ -0,0 +1,67 @@
+#ifndef SERVER_METRICS_HTTP_SERVER_H_
+#define SERVER_METRICS_HTTP_SERVER_H_
+#include "base/macros.h"
+#include "base/metrics.h"
+#include "base/status.h"
+#include "threading/thread.h"
+
+#include <event2/event.h>
+
+#include <memory>
+#include <string>
+
+struct evhttp;
+struct evhttp_request;
+
+namespace server {
+
+/**
+ * Serves a MetricsRegistry at GET /metrics in the Prometheus text format.
+ *
+ * The evhttp server runs on an event loop and thread of its own, so a
+ * scrape never waits behind message handling and a stuck consumer loop
+ * is still visible from outside.
+ */
+class MetricsHttpServer {
+ public:
+  MetricsHttpServer(const std::string& address, int port,
+                    base::MetricsRegistry* registry = base::MetricsRegistry::GetInstance());
+  ~MetricsHttpServer();
+
+  /**
+   * Binds address:port and starts serving. Port 0 picks a free port, see
+   * port().
+   */
+  base::Status Start();
+
+  /**
+   * Stops serving and joins the thread. May be called more than once;
+   * the destructor calls it too.
+   */
+  void Stop();
+
+  /**
+   * The bound port once started.
+   */
+  int port() const { return port_; }
+
+ private:
+  void Run();
+  static void OnRequest(struct evhttp_request* request, void* arg);
+  static void OnStop(evutil_socket_t fd, short what, void* arg);
+
+  const std::string address_;
+  int port_;
+  base::MetricsRegistry* const registry_;
+
+  struct event_base* event_base_;
+  struct evhttp* http_;
+  int stop_fd_;
+  struct event* stop_event_;
+  std::shared_ptr<threading::Thread> thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(MetricsHttpServer);
+};
+
+} // namespace server
+#endif // SERVER_METRICS_HTTP_SERVER_H_
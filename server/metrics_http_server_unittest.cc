@@ -0,0 +1,56 @@
+#include "server/metrics_http_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// The whole response to a GET of `path`; the server closes the connection.
+std::string HttpGet(int port, const std::string& path) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in address;
+  ::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(static_cast<uint16_t>(port));
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+    ::close(fd);
+    return std::string();
+  }
+  std::string request = "GET " + path + " HTTP/1.0\r\n\r\n";
+  ssize_t written = ::write(fd, request.data(), request.size());
+  (void) written;
+  std::string response;
+  char buffer[4096];
+  ssize_t n;
+  while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) {
+    response.append(buffer, n);
+  }
+  ::close(fd);
+  return response;
+}
+
+} // namespace
+
+TEST(MetricsHttpServerTest, Serves_Metrics) {
+  base::MetricsRegistry registry;
+  registry.GetCounter("deliveries_total", "Deliveries.", {{"queue", "q"}})->Increment(42);
+
+  server::MetricsHttpServer server("127.0.0.1", 0, &registry);
+  ASSERT_TRUE(server.Start().ok());
+  ASSERT_NE(0, server.port());
+
+  std::string response = HttpGet(server.port(), "/metrics");
+  EXPECT_EQ(0u, response.find("HTTP/1.0 200 OK\r\n")) << response;
+  EXPECT_NE(std::string::npos, response.find("text/plain; version=0.0.4"));
+  EXPECT_NE(std::string::npos, response.find("deliveries_total{queue=\"q\"} 42\n"));
+
+  EXPECT_NE(std::string::npos, HttpGet(server.port(), "/other").find(" 404 "));
+  server.Stop();
+  server.Stop();
+}
@@ -0,0 +1,428 @@
+#include "service/amqp_consumer_service.h"
+#include "base/metrics.h"
+#include "server/amqp/amqp_publisher.h"
+#include "service/amqp_delivery.h"
+#include "threading/function_runner.h"
+#include "threading/thread_factory.h"
+#include "threading/time_util.h"
+
+
+namespace server {
+
+// What a reply to a delivery needs once its handler has run.
+struct AmqpConsumerService::Delivery {
+  explicit Delivery(const AMQP::Message& message, uint64_t delivery_tag)
+    : delivery_tag(delivery_tag),
+      generation(0),
+      in_flight(0),
+      long_queue(false) {
+    if (message.hasReplyTo()) {
+      reply_to = message.replyTo();
+    }
+    if (message.hasCorrelationID()) {
+      correlation_id = message.correlationID();
+    }
+  }
+
+  uint64_t delivery_tag;
+  uint64_t generation;
+  int in_flight;
+  bool long_queue;  // delivered on long_channel
+  std::string reply_to;
+  std::string correlation_id;
+};
+
+// Owned by the registry and shared with any other service on the same
+// queue.
+struct AmqpConsumerService::Metrics {
+  explicit Metrics(const std::string& queue) {
+    base::MetricsRegistry* registry = base::MetricsRegistry::GetInstance();
+    const base::MetricLabels labels = {{"queue", queue}};
+    deliveries = registry->GetCounter("mq_deliveries_total",
+        "Messages delivered by the broker.", labels);
+    redeliveries = registry->GetCounter("mq_redeliveries_total",
+        "Deliveries flagged as redelivered.", labels);
+    acks = registry->GetCounter("mq_acks_total",
+        "Deliveries acknowledged.", labels);
+    requeues = registry->GetCounter("mq_requeues_total",
+        "Deliveries requeued after a retryable failure.", labels);
+    replies = registry->GetCounter("mq_replies_total",
+        "Replies published to reply_to.", labels);
+    in_flight = registry->GetGauge("mq_in_flight",
+        "Deliveries received and not handled yet.", labels);
+  }
+
+  base::Counter* deliveries;
+  base::Counter* redeliveries;
+  base::Counter* acks;
+  base::Counter* requeues;
+  base::Counter* replies;
+  base::Gauge* in_flight;
+};
+
+// One executor attached to a hub loop. Everything but the handler itself
+// runs on the loop thread.
+struct AmqpConsumerService::HubConsumer : public AmqpChannelUser {
+  HubConsumer(AmqpConsumerService* service,
+              const std::function<void()>& stopped)
+    : service(service),
+      stopped(stopped),
+      loop(nullptr),
+      connection(nullptr),
+      generation(0),
+      in_flight(0) {}
+
+  void OnConnected(AMQP::TcpConnection* connection) override {
+    generation++;
+    in_flight = 0;
+    this->connection = connection;
+    channel.reset(new AMQP::TcpChannel(connection));
+    subscription.reset(service->Consume(channel.get(), loop->event_base(), this));
+    LOG(INFO) << "--Consuming " << service->queue_name_ << " on shared connection";
+  }
+
+  void OnDisconnected() override {
+    // Deliveries still being handled belong to the dead channel; the
+    // broker redelivers them, so their acks are dropped.
+    generation++;
+    long_mover.reset();
+    long_subscription.reset();
+    subscription.reset();
+    long_channel.reset();
+    channel.reset();
+    connection = nullptr;
+  }
+
+  // A delivery handed to the workers finished.
+  void OnHandled(const Delivery& delivery, int64_t latency_us,
+                 const base::Status& status, const std::string& reply,
+                 bool reply_compressed) {
+    service->metrics_->in_flight->Add(-1);
+    if (delivery.generation != generation || !channel) {
+      return;
+    }
+    // Requeued deliveries are answered once they are handled for good.
+    const bool retry = service->Retry(status);
+    if (!delivery.reply_to.empty() && !retry) {
+      PublishReply(channel.get(), delivery.reply_to, delivery.correlation_id, status,
+                   reply, reply_compressed);
+      service->metrics_->replies->Increment();
+    }
+    AMQP::TcpChannel* from = delivery.long_queue ? long_channel.get() : channel.get();
+    PausableConsumer* source = delivery.long_queue ? long_subscription.get()
+                                                   : subscription.get();
+    if (retry) {
+      from->reject(delivery.delivery_tag, AMQP::requeue);
+      service->metrics_->requeues->Increment();
+      source->Pause();
+    } else {
+      from->ack(delivery.delivery_tag);
+      service->metrics_->acks->Increment();
+      source->Succeeded();
+    }
+    if (delivery.long_queue) {
+      return;
+    }
+    in_flight--;
+    if (limiter &&
+        limiter->OnSample(latency_us, delivery.in_flight,
+                          ConcurrencyLimiter::IsOverload(status))) {
+      int limit = limiter->limit();
+      VLOG(1) << service->queue_name_ << ": prefetch -> " << limit;
+      channel->setQos(static_cast<uint16_t>(limit));
+    }
+  }
+
+  AmqpConsumerService* const service;
+  const std::function<void()> stopped;
+  AmqpEventLoop* loop;
+  AMQP::TcpConnection* connection;
+  std::unique_ptr<AMQP::TcpChannel> channel;
+  std::unique_ptr<PausableConsumer> subscription;
+  // Long jobs moved out of the prefetch window, when workers are reserved.
+  std::unique_ptr<AMQP::TcpChannel> long_channel;
+  std::unique_ptr<PausableConsumer> long_subscription;
+  std::unique_ptr<ConfirmedRepublisher> long_mover;
+  std::unique_ptr<ConcurrencyLimiter> limiter;
+  uint64_t generation;
+  int in_flight;
+};
+
+AmqpConsumerService::AmqpConsumerService(const std::string& address,
+                                         const std::string& queue_name) 
+  : address_(address),
+    queue_name_(queue_name),
+    dispatcher_(queue_name),
+    metrics_(new Metrics(queue_name)),
+    long_moved_(nullptr) {
+}
+
+AmqpConsumerService::AmqpConsumerService(std::shared_ptr<AmqpConnectionHub> hub,
+                                         const std::string& queue_name)
+  : address_(hub->address()),
+    queue_name_(queue_name),
+    dispatcher_(queue_name),
+    metrics_(new Metrics(queue_name)),
+    hub_(hub),
+    long_moved_(nullptr) {
+}
+
+AmqpConsumerService::~AmqpConsumerService() {
+  for (int id : callback_metrics_) {
+    base::MetricsRegistry::GetInstance()->RemoveCallback(id);
+  }
+  workers_metrics_.reset();
+  if (workers_) {
+    workers_->Join();
+  }
+}
+
+void AmqpConsumerService::Configure(const ServiceOptions& options) {
+  options_ = options;
+  dispatcher_.set_compress_min_size(options_.compress_min_size);
+  if (hub_ && options_.workers > 0 && !workers_) {
+    if (options_.prefetch == 0) {
+      // Acks are needed to bound what the workers are handed. Long jobs
+      // take at most workers - reserved_workers of these.
+      options_.prefetch = options_.workers;
+    }
+    workers_ = threading::ThreadManager::NewSimpleThreadManager(options_.workers);
+    workers_->SetThreadFactory(std::make_shared<threading::PosixThreadFactory>());
+    workers_->Start();
+    workers_metrics_.reset(new threading::ThreadManagerMetrics(queue_name_, workers_));
+    if (options_.reserved_workers > 0) {
+      reserved_.reset(new ReservedWorkers(
+          options_.workers, options_.reserved_workers, options_.short_priority,
+          [this] (const RouteTable::Task& task) {
+            workers_->Add(threading::FunctionRunner::Create(task));
+          }));
+      ReservedWorkers* reserved = reserved_.get();
+      base::MetricsRegistry* registry = base::MetricsRegistry::GetInstance();
+      callback_metrics_.push_back(registry->AddCallback(
+          base::MetricsRegistry::GAUGE, "mq_long_jobs_waiting",
+          "Deliveries below short_priority waiting for an unreserved worker.",
+          {{"queue", queue_name_}},
+          [reserved] { return static_cast<double>(reserved->long_waiting()); }));
+      long_moved_ = registry->GetCounter("mq_long_jobs_moved_total",
+          "Deliveries below short_priority moved to the long queue at the limit.",
+          {{"queue", queue_name_}});
+    }
+  }
+}
+
+void AmqpConsumerService::Shutdown() {
+  std::lock_guard<std::mutex> l(consumers_lock_);
+  for (const auto& consumer : consumers_) {
+    if (consumer->loop != nullptr) {
+      consumer->loop->Detach(consumer.get(), consumer->stopped);
+      consumer->loop = nullptr;
+    }
+  }
+}
+
+bool AmqpConsumerService::StartAsync(const std::function<void()>& stopped) {
+  if (!hub_) {
+    return false;
+  }
+  HubConsumer* consumer = new HubConsumer(this, stopped);
+  if (workers_ && options_.max_prefetch > options_.prefetch) {
+    ConcurrencyLimiter::Options limiter_options;
+    limiter_options.initial_limit = options_.prefetch;
+    limiter_options.max_limit = options_.max_prefetch;
+    consumer->limiter.reset(new ConcurrencyLimiter(limiter_options));
+  }
+  {
+    std::lock_guard<std::mutex> l(consumers_lock_);
+    if (consumer->limiter) {
+      ConcurrencyLimiter* limiter = consumer->limiter.get();
+      callback_metrics_.push_back(base::MetricsRegistry::GetInstance()->AddCallback(
+          base::MetricsRegistry::GAUGE, "mq_prefetch_limit",
+          "Prefetch currently set by the adaptive limiter.",
+          {{"queue", queue_name_}, {"consumer", std::to_string(consumers_.size())}},
+          [limiter] { return static_cast<double>(limiter->limit()); }));
+    }
+    consumers_.emplace_back(consumer);
+  }
+  consumer->loop = hub_->PickLoop();
+  consumer->loop->Attach(consumer);
+  return true;
+}
+
+void AmqpConsumerService::HandleLoop() {
+  WrapperEventBase event_base;
+  AMQP::LibEventHandler event_handler(event_base.get());
+  AMQP::TcpConnection connection(&event_handler, AMQP::Address(address_));
+  AMQP::TcpChannel channel(&connection);
+
+  std::unique_ptr<PausableConsumer> subscription(
+      Consume(&channel, event_base.get(), nullptr));
+  
+  LOG(INFO) << "--Waiting for message.";
+  ::event_base_dispatch(event_base.get());
+}
+
+std::vector<ConcurrencyLimiter::Snapshot> AmqpConsumerService::LimiterSnapshots() const {
+  std::vector<ConcurrencyLimiter::Snapshot> snapshots;
+  std::lock_guard<std::mutex> l(consumers_lock_);
+  for (const auto& consumer : consumers_) {
+    if (consumer->limiter) {
+      snapshots.push_back(consumer->limiter->GetSnapshot());
+    }
+  }
+  return snapshots;
+}
+
+std::string AmqpConsumerService::LongQueue() const {
+  return queue_name_ + ".long";
+}
+
+bool AmqpConsumerService::Retry(const base::Status& status) const {
+  return options_.retry_delay_ms > 0 && RetryBackoff::IsRetryable(status);
+}
+
+void AmqpConsumerService::ConsumeLongQueue(HubConsumer* consumer) {
+  AMQP::TcpChannel* channel = new AMQP::TcpChannel(consumer->connection);
+  consumer->long_channel.reset(channel);
+  channel->declareQueue(LongQueue(), 0, QueueArguments(options_.max_priority));
+  consumer->long_mover.reset(new ConfirmedRepublisher(consumer->connection));
+  consumer->long_mover->DeclareQueue(LongQueue(), QueueArguments(options_.max_priority));
+  channel->setQos(static_cast<uint16_t>(reserved_->long_limit()));
+  consumer->long_subscription.reset(new PausableConsumer(
+      channel, consumer->loop->event_base(), LongQueue(), 0, options_.retry_delay_ms));
+  consumer->long_subscription->Consume(
+      [this, consumer] (const AMQP::Message& message,
+                        uint64_t delivery_tag,
+                        bool /* redelivered */) {
+    metrics_->in_flight->Add(1);
+    AmqpEventLoop* loop = consumer->loop;
+    Delivery delivery(message, delivery_tag);
+    delivery.generation = consumer->generation;
+    delivery.long_queue = true;
+    std::string body = message.message();
+    std::string content_type = MessageContentType(message);
+    std::string content_encoding = MessageContentEncoding(message);
+    reserved_->RunLong([this, consumer, loop, delivery, content_encoding,
+                        content_type, body] {
+      int64_t start = threading::TimeUtil::MonotonicTimeUsec();
+      std::string reply;
+      bool reply_compressed;
+      base::Status status = dispatcher_.Dispatch(content_encoding, content_type, body,
+                                                 &reply, &reply_compressed);
+      int64_t latency_us = threading::TimeUtil::MonotonicTimeUsec() - start;
+      loop->RunInLoop([consumer, delivery, latency_us, status, reply, reply_compressed] {
+        consumer->OnHandled(delivery, latency_us, status, reply, reply_compressed);
+      });
+    });
+  });
+}
+
+PausableConsumer* AmqpConsumerService::Consume(AMQP::TcpChannel* channel,
+                                               struct event_base* event_base,
+                                               HubConsumer* consumer) {
+  channel->declareQueue(queue_name_, 0, QueueArguments(options_.max_priority));
+  const bool ack = options_.prefetch > 0;
+  if (ack) {
+    int prefetch = consumer && consumer->limiter ? consumer->limiter->limit()
+                                                 : options_.prefetch;
+    channel->setQos(static_cast<uint16_t>(prefetch));
+  }
+  PausableConsumer* subscription = new PausableConsumer(
+      channel, event_base, queue_name_, ack ? 0 : AMQP::noack, options_.retry_delay_ms);
+
+  PausableConsumer::Callback callback;
+  if (consumer && workers_) {
+    callback = [this, consumer] (const AMQP::Message& message,
+                                 uint64_t delivery_tag,
+                                 bool redelivered) {
+      metrics_->deliveries->Increment();
+      if (redelivered) {
+        metrics_->redeliveries->Increment();
+      }
+      metrics_->in_flight->Add(1);
+      AmqpEventLoop* loop = consumer->loop;
+      Delivery delivery(message, delivery_tag);
+      delivery.generation = consumer->generation;
+      delivery.in_flight = ++consumer->in_flight;
+      std::string body = message.message();
+      std::string content_type = MessageContentType(message);
+      std::string content_encoding = MessageContentEncoding(message);
+      // Compressed bodies are decompressed on the worker, into its buffer.
+      RouteTable::Task task = [this, consumer, loop, delivery, content_encoding,
+                               content_type, body] {
+        int64_t start = threading::TimeUtil::MonotonicTimeUsec();
+        std::string reply;
+        bool reply_compressed;
+        base::Status status = dispatcher_.Dispatch(content_encoding, content_type, body,
+                                                   &reply, &reply_compressed);
+        int64_t latency_us = threading::TimeUtil::MonotonicTimeUsec() - start;
+        loop->RunInLoop([consumer, delivery, latency_us, status, reply, reply_compressed] {
+          consumer->OnHandled(delivery, latency_us, status, reply, reply_compressed);
+        });
+      };
+      int priority = message.hasPriority() ? message.priority() : 0;
+      if (!reserved_) {
+        workers_->Add(threading::FunctionRunner::Create(task));
+      } else if (!reserved_->TryRun(priority, task)) {
+        // Out of the prefetch window, to the back of the long queue. The
+        // delivery is only acked once the broker has confirmed the copy.
+        consumer->in_flight--;
+        metrics_->in_flight->Add(-1);
+        consumer->long_mover->Publish(LongQueue(), message,
+            [this, consumer, delivery_tag] (bool moved) {
+          if (moved) {
+            long_moved_->Increment();
+            consumer->channel->ack(delivery_tag);
+            metrics_->acks->Increment();
+          } else {
+            consumer->channel->reject(delivery_tag, AMQP::requeue);
+          }
+        });
+      }
+    };
+    if (reserved_) {
+      ConsumeLongQueue(consumer);
+    }
+  } else {
+    callback = [this, channel, subscription, ack] (const AMQP::Message& message,
+                                                   uint64_t delivery_tag,
+                                                   bool redelivered) {
+      metrics_->deliveries->Increment();
+      if (redelivered) {
+        metrics_->redeliveries->Increment();
+      }
+      metrics_->in_flight->Add(1);
+      std::string reply;
+      bool reply_compressed;
+      base::Status status = dispatcher_.Dispatch(MessageContentEncoding(message),
+                                                 MessageContentType(message),
+                                                 message.message(),
+                                                 &reply, &reply_compressed);
+      metrics_->in_flight->Add(-1);
+      const bool retry = ack && Retry(status);
+      if (message.hasReplyTo() && !retry) {
+        PublishReply(channel, message.replyTo(),
+                     message.hasCorrelationID() ? message.correlationID() : std::string(),
+                     status, reply, reply_compressed);
+        metrics_->replies->Increment();
+      }
+      if (retry) {
+        channel->reject(delivery_tag, AMQP::requeue);
+        metrics_->requeues->Increment();
+        subscription->Pause();
+        return;
+      }
+      if (ack) {
+        // Other failures are not requeued: a poison message would
+        // otherwise come straight back.
+        channel->ack(delivery_tag);
+        metrics_->acks->Increment();
+      }
+      subscription->Succeeded();
+    };
+  }
+
+  subscription->Consume(callback);
+  return subscription;
+}
+
+} // namespace server
@@ -8,8 +8,19 @@
 #include <amqpcpp/libevent.h>
 
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 #include "server/async_service_interface.h"
+#include "server/concurrency_limiter.h"
+#include "server/amqp/amqp_connection_hub.h"
+#include "service/confirmed_republisher.h"
+#include "service/message_dispatcher.h"
+#include "service/pausable_consumer.h"
+#include "service/reserved_workers.h"
+#include "threading/thread_manager.h"
+#include "threading/thread_manager_metrics.h"
 
 #include <glog/logging.h>
 
@@ -35,53 +46,106 @@ class WrapperEventBase {
 
 AsyncServiceInterface* NewAmqpConsumer(const std::string& info);
 
+// Consumes one queue and hands every message to its ServiceHandler.
+//
+// Built with an address, the service owns its connections and event loops
+// and needs a thread running HandleLoop() per executor. Built with an
+// AmqpConnectionHub, each executor is a channel on one of the hub's
+// shared connections, and StartAsync() replaces the dedicated thread.
+//
+// With a prefetch configured, deliveries are acknowledged after the
+// handler returns and the broker keeps at most `prefetch` of them in
+// flight per executor; otherwise they are consumed with noack.
+//
+// The handler gets the delivery's content type along with the body (see
+// ServiceHandler::HandleMessage). Bodies sent with a zstd content encoding
+// are decompressed first, and replies of at least `compress_min_size`
+// bytes are compressed (see service/message_dispatcher.h).
+//
+// A delivery carrying reply_to is answered there once handled, with the
+// handler's reply as body, the same correlation_id, and the handler's
+// status in the headers (see AmqpRpcClient).
+//
+// With acks, a delivery failing with UNAVAILABLE or DEADLINE_EXCEEDED, i.e.
+// while the service behind the handler is down or too slow, is requeued
+// instead of answered, and the executor stops consuming for
+// `retry_delay_ms`, twice as long each time it fails again (see
+// service/pausable_consumer.h). Other failures are acked and answered: a
+// poison message would otherwise come straight back.
+//
+// Hub-attached services may also run their handlers on `workers` threads
+// so the shared loop never blocks, and let a ConcurrencyLimiter move the
+// prefetch up to `max_prefetch` following the handler latency.
+// `reserved_workers` of them can be kept for deliveries whose priority is
+// at least `short_priority`: the others run at most workers -
+// reserved_workers at a time, and those beyond that are moved to the queue
+// "<queue_name>.long", consumed on a channel of their own, rather than held
+// in the prefetch window (see service/reserved_workers.h). A moved delivery
+// is acked once the broker confirms its copy, and requeued if it doesn't
+// (see service/confirmed_republisher.h). A burst of long jobs therefore
+// can't hold up short ones. The queues are declared with
+// x-max-priority when `max_priority` is set.
+//
+// Deliveries, acks, requeues, replies, handler failures and latency, and the
+// workers, adaptive prefetch and waiting long jobs if any, are exported
+// to the base::MetricsRegistry labelled with the queue name.
 class AmqpConsumerService : public AsyncServiceInterface {
  public:
   AmqpConsumerService(const std::string& address,
-                      const std::string& queue_name) 
-    : address_(address),
-      queue_name_(queue_name),
-      event_base_(),
-      handler_(nullptr){
-  }
+                      const std::string& queue_name);
+  AmqpConsumerService(std::shared_ptr<AmqpConnectionHub> hub,
+                      const std::string& queue_name);
+  virtual ~AmqpConsumerService();
 
-  virtual ~AmqpConsumerService() {}
-
-  void Shutdown() override {}
-
-  void HandleLoop() override {
-    AMQP::LibEventHandler event_handler(event_base_.get());
-    AMQP::TcpConnection connection(&event_handler, AMQP::Address(address_));
-    AMQP::TcpChannel channel(&connection);
-
-    channel.declareQueue(queue_name_);
-    std::function<void(const AMQP::Message&, uint64_t, bool)> callback = 
-        [=] (const AMQP::Message& message, uint64_t delivery_tag, bool redelivered) {
-      LOG(INFO) << "Received message: " << message.message();
-      if (this->handler_) {
-        std::string reply;
-        this->handler_->Handle(message.message(), &reply);
-      } else {
-        LOG(INFO) << "No consumer Handler";
-      }
-    };
-
-    channel.consume(queue_name_, AMQP::noack).onReceived(callback);
-    
-    LOG(INFO) << "--Waiting for message.";
-    ::event_base_dispatch(event_base_.get());
-  }
+  std::string name() const override { return queue_name_; }
+
+  void Configure(const ServiceOptions& options) override;
+  void Shutdown() override;
+  bool StartAsync(const std::function<void()>& stopped) override;
+  // Runs one executor on a connection and event loop of its own.
+  void HandleLoop() override;
 
   virtual void SetHandler(ServiceHandler* handler) override {
-    handler_ = handler;  
+    dispatcher_.SetHandler(handler);
   }
 
+  // The adaptive limit and observed latencies of every hub consumer; empty
+  // unless max_prefetch is configured.
+  std::vector<ConcurrencyLimiter::Snapshot> LimiterSnapshots() const;
+
  private:  
+  struct Delivery;
+  struct HubConsumer;
+  struct Metrics;
+
+  // Starts consuming on `channel`, pausing on the loop of `event_base`.
+  PausableConsumer* Consume(AMQP::TcpChannel* channel, struct event_base* event_base,
+                            HubConsumer* consumer);
+  // Deliveries of the long queue run as long jobs, whatever their priority.
+  void ConsumeLongQueue(HubConsumer* consumer);
+  std::string LongQueue() const;
+  // Whether a delivery that failed with `status` is requeued.
+  bool Retry(const base::Status& status) const;
+
   const std::string address_; // "amqp://"
   const std::string queue_name_;
 
-  WrapperEventBase event_base_;
-  ServiceHandler* handler_;
+  MessageDispatcher dispatcher_;
+  ServiceOptions options_;
+  const std::unique_ptr<Metrics> metrics_;
+
+  // Shared-connection mode only.
+  std::shared_ptr<AmqpConnectionHub> hub_;
+  std::shared_ptr<threading::ThreadManager> workers_;
+  mutable std::mutex consumers_lock_;
+  std::vector<std::unique_ptr<HubConsumer>> consumers_;
+  std::unique_ptr<threading::ThreadManagerMetrics> workers_metrics_;
+  std::vector<int> callback_metrics_;
+  // When workers are reserved.
+  std::unique_ptr<ReservedWorkers> reserved_;
+  base::Counter* long_moved_;
+
+  DISALLOW_COPY_AND_ASSIGN(AmqpConsumerService);
 };
 
 } // namespace server
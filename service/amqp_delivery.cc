@@ -0,0 +1,32 @@
+#include "service/amqp_delivery.h"
+#include "server/amqp/amqp_compression.h"
+#include "server/amqp/amqp_rpc_client.h"
+
+namespace server {
+
+std::string MessageContentType(const AMQP::Message& message) {
+  return message.hasContentType() ? message.contentType() : std::string();
+}
+
+std::string MessageContentEncoding(const AMQP::Message& message) {
+  return message.hasContentEncoding() ? message.contentEncoding() : std::string();
+}
+
+void PublishReply(AMQP::TcpChannel* channel,
+                  const std::string& reply_to,
+                  const std::string& correlation_id,
+                  const base::Status& status,
+                  const std::string& reply,
+                  bool compressed) {
+  AMQP::Envelope envelope(reply.data(), reply.size());
+  if (!correlation_id.empty()) {
+    envelope.setCorrelationID(correlation_id);
+  }
+  if (compressed) {
+    envelope.setContentEncoding(kZstdContentEncoding);
+  }
+  envelope.setHeaders(StatusToHeaders(status));
+  channel->publish("", reply_to, envelope);
+}
+
+} // namespace server
@@ -0,0 +1,31 @@
+#ifndef SERVICE_AMQP_DELIVERY_H_
+#define SERVICE_AMQP_DELIVERY_H_
+#include "base/status.h"
+
+#include <amqpcpp.h>
+
+#include <string>
+
+namespace server {
+
+// What AmqpConsumerService and AmqpDispatchService share about the
+// deliveries they consume.
+
+// The message's content type or content encoding property, empty if it
+// has none.
+std::string MessageContentType(const AMQP::Message& message);
+std::string MessageContentEncoding(const AMQP::Message& message);
+
+// Publishes a handler's result to the caller's reply_to queue, typically
+// RabbitMQ direct reply-to, carrying `status` in the headers (see
+// server/amqp/amqp_rpc_client.h). `compressed` tells whether `reply` is
+// zstd compressed.
+void PublishReply(AMQP::TcpChannel* channel,
+                  const std::string& reply_to,
+                  const std::string& correlation_id,
+                  const base::Status& status,
+                  const std::string& reply,
+                  bool compressed);
+
+} // namespace server
+#endif // SERVICE_AMQP_DELIVERY_H_
@@ -0,0 +1,381 @@
+#include "service/amqp_dispatch_service.h"
+#include "server/log_util.h"
+#include "server/amqp/amqp_publisher.h"
+#include "service/amqp_delivery.h"
+#include "threading/function_runner.h"
+#include "threading/thread_factory.h"
+
+#include <glog/logging.h>
+
+namespace server {
+
+// What a reply to a delivery needs once its handler has run.
+struct AmqpDispatchService::Delivery {
+  Delivery(const AMQP::Message& message, uint64_t delivery_tag, uint64_t generation,
+           RouteTable::Route* route, RouteTable::Route* overflow)
+    : delivery_tag(delivery_tag),
+      generation(generation),
+      route(route),
+      overflow(overflow) {
+    if (message.hasReplyTo()) {
+      reply_to = message.replyTo();
+    }
+    if (message.hasCorrelationID()) {
+      correlation_id = message.correlationID();
+    }
+  }
+
+  uint64_t delivery_tag;
+  uint64_t generation;
+  RouteTable::Route* route;
+  // The route whose own queue, and channel, it came from; nullptr for the
+  // shared one.
+  RouteTable::Route* overflow;
+  std::string reply_to;
+  std::string correlation_id;
+};
+
+// A route's dispatcher and metrics.
+struct AmqpDispatchService::RouteState {
+  RouteState(const std::string& queue, RouteTable* routes, RouteTable::Route* route)
+    : dispatcher(queue, route->key) {
+    dispatcher.SetHandler(route->handler);
+    base::MetricsRegistry* registry = base::MetricsRegistry::GetInstance();
+    const base::MetricLabels labels = {{"queue", queue}, {"route", route->key}};
+    deliveries = registry->GetCounter("mq_route_deliveries_total",
+        "Messages dispatched to the route.", labels);
+    overflows = registry->GetCounter("mq_route_overflows_total",
+        "Deliveries moved to the route's own queue while it was at its limit "
+        "or paused.", labels);
+    requeues = registry->GetCounter("mq_route_requeues_total",
+        "Deliveries requeued after a retryable failure.", labels);
+    callbacks.push_back(registry->AddCallback(
+        base::MetricsRegistry::GAUGE, "mq_route_running",
+        "Messages of the route being handled.", labels,
+        [routes, route] { return static_cast<double>(routes->running(route)); }));
+    callbacks.push_back(registry->AddCallback(
+        base::MetricsRegistry::GAUGE, "mq_route_queued",
+        "Messages of the route waiting for its concurrency limit.", labels,
+        [routes, route] { return static_cast<double>(routes->queued(route)); }));
+  }
+
+  ~RouteState() {
+    for (int id : callbacks) {
+      base::MetricsRegistry::GetInstance()->RemoveCallback(id);
+    }
+  }
+
+  // Exports the route's failures and latency.
+  MessageDispatcher dispatcher;
+  base::Counter* deliveries;
+  base::Counter* overflows;
+  base::Counter* requeues;
+  std::vector<int> callbacks;
+};
+
+namespace {
+
+// Label of the SetHandler() route.
+const char kFallbackRoute[] = "*";
+
+} // namespace
+
+// One executor attached to a hub loop. Everything but the handlers runs on
+// the loop thread.
+struct AmqpDispatchService::HubConsumer : public AmqpChannelUser {
+  HubConsumer(AmqpDispatchService* service,
+              const std::function<void()>& stopped)
+    : service(service),
+      stopped(stopped),
+      loop(nullptr),
+      connection(nullptr),
+      generation(0) {}
+
+  void OnConnected(AMQP::TcpConnection* connection) override {
+    generation++;
+    this->connection = connection;
+    channel.reset(new AMQP::TcpChannel(connection));
+    service->Consume(this);
+    LOG(INFO) << "--Dispatching " << service->queue_name_ << " from "
+              << service->exchange_ << " on shared connection";
+  }
+
+  void OnDisconnected() override {
+    // The broker redelivers whatever is still being handled.
+    generation++;
+    mover.reset();
+    overflows.clear();
+    channel.reset();
+    connection = nullptr;
+  }
+
+  void OnHandled(const Delivery& delivery, const base::Status& status,
+                 const std::string& reply, bool reply_compressed) {
+    if (delivery.generation != generation || !channel) {
+      return;
+    }
+    // Requeued deliveries are answered once they are handled for good.
+    const bool retry = service->Retry(status);
+    if (!delivery.reply_to.empty() && !retry) {
+      PublishReply(channel.get(), delivery.reply_to, delivery.correlation_id, status,
+                   reply, reply_compressed);
+    }
+    AMQP::TcpChannel* from = delivery.overflow ? overflows[delivery.overflow].channel.get()
+                                               : channel.get();
+    PausableConsumer* route_queue = overflows[delivery.route].subscription.get();
+    if (retry) {
+      from->reject(delivery.delivery_tag, AMQP::requeue);
+      service->route_states_.find(delivery.route)->second->requeues->Increment();
+      route_queue->Pause();
+    } else {
+      from->ack(delivery.delivery_tag);
+      route_queue->Succeeded();
+    }
+  }
+
+  // A route's own queue.
+  struct Overflow {
+    std::unique_ptr<AMQP::TcpChannel> channel;
+    std::unique_ptr<PausableConsumer> subscription;
+  };
+
+  AmqpDispatchService* const service;
+  const std::function<void()> stopped;
+  AmqpEventLoop* loop;
+  AMQP::TcpConnection* connection;
+  std::unique_ptr<AMQP::TcpChannel> channel;
+  // One per route, the SetHandler() one included.
+  std::unordered_map<const RouteTable::Route*, Overflow> overflows;
+  // Moves deliveries from the shared queue to the routes' own ones.
+  std::unique_ptr<ConfirmedRepublisher> mover;
+  uint64_t generation;
+};
+
+AmqpDispatchService::AmqpDispatchService(std::shared_ptr<AmqpConnectionHub> hub,
+                                         const std::string& exchange,
+                                         const std::string& queue_name,
+                                         const std::string& type_header)
+  : exchange_(exchange),
+    queue_name_(queue_name),
+    type_header_(type_header),
+    hub_(hub),
+    routes_([this] (const RouteTable::Task& task) {
+      workers_->Add(threading::FunctionRunner::Create(task));
+    }),
+    unrouted_(base::MetricsRegistry::GetInstance()->GetCounter(
+        "mq_unrouted_total", "Messages no route matched.", {{"queue", queue_name}})) {
+}
+
+AmqpDispatchService::~AmqpDispatchService() {
+  workers_metrics_.reset();
+  if (workers_) {
+    workers_->Join();
+  }
+}
+
+bool AmqpDispatchService::AddRoute(const std::string& key,
+                                   ServiceHandler* handler,
+                                   int max_concurrency) {
+  DCHECK(!workers_) << "routes are added before Configure()";
+  if (!routes_.Add(key, handler, max_concurrency)) {
+    return false;
+  }
+  RouteTable::Route* route = routes_.Find(key);
+  route_states_[route].reset(new RouteState(queue_name_, &routes_, route));
+  return true;
+}
+
+void AmqpDispatchService::SetHandler(ServiceHandler* handler) {
+  DCHECK(!workers_) << "the handler is set before Configure()";
+  if (fallback_) {
+    route_states_.erase(fallback_.get());
+  }
+  fallback_.reset(new RouteTable::Route(kFallbackRoute, handler, 0));
+  route_states_[fallback_.get()].reset(
+      new RouteState(queue_name_, &routes_, fallback_.get()));
+}
+
+void AmqpDispatchService::Configure(const ServiceOptions& options) {
+  options_ = options;
+  for (const auto& state : route_states_) {
+    state.second->dispatcher.set_compress_min_size(options_.compress_min_size);
+  }
+  if (workers_) {
+    return;
+  }
+  if (options_.workers == 0) {
+    int workers = 0;
+    routes_.ForEach([&workers] (const RouteTable::Route* route) {
+      workers += route->max_concurrency > 0 ? route->max_concurrency : 1;
+    });
+    options_.workers = workers > 0 ? workers : 1;
+  }
+  if (options_.prefetch == 0) {
+    options_.prefetch = options_.workers;
+  }
+  workers_ = threading::ThreadManager::NewSimpleThreadManager(options_.workers);
+  workers_->SetThreadFactory(std::make_shared<threading::PosixThreadFactory>());
+  workers_->Start();
+  workers_metrics_.reset(new threading::ThreadManagerMetrics(queue_name_, workers_));
+}
+
+void AmqpDispatchService::Shutdown() {
+  std::lock_guard<std::mutex> l(consumers_lock_);
+  for (const auto& consumer : consumers_) {
+    if (consumer->loop != nullptr) {
+      consumer->loop->Detach(consumer.get(), consumer->stopped);
+      consumer->loop = nullptr;
+    }
+  }
+}
+
+bool AmqpDispatchService::StartAsync(const std::function<void()>& stopped) {
+  if (!workers_) {
+    LOG(ERROR) << queue_name_ << ": started before Configure()";
+    return false;
+  }
+  HubConsumer* consumer = new HubConsumer(this, stopped);
+  {
+    std::lock_guard<std::mutex> l(consumers_lock_);
+    consumers_.emplace_back(consumer);
+  }
+  consumer->loop = hub_->PickLoop();
+  consumer->loop->Attach(consumer);
+  return true;
+}
+
+void AmqpDispatchService::HandleLoop() {
+  LOG(ERROR) << queue_name_ << ": AmqpDispatchService only runs on an AmqpConnectionHub";
+}
+
+std::string AmqpDispatchService::OverflowQueue(const RouteTable::Route* route) const {
+  return queue_name_ + "." + route->key;
+}
+
+bool AmqpDispatchService::Retry(const base::Status& status) const {
+  return options_.retry_delay_ms > 0 && RetryBackoff::IsRetryable(status);
+}
+
+void AmqpDispatchService::Consume(HubConsumer* consumer) {
+  AMQP::TcpChannel* channel = consumer->channel.get();
+  channel->declareExchange(exchange_, AMQP::topic);
+  channel->declareQueue(queue_name_, 0, QueueArguments(options_.max_priority));
+  if (type_header_.empty()) {
+    routes_.ForEach([this, channel] (const RouteTable::Route* route) {
+      channel->bindQueue(exchange_, queue_name_, route->key);
+    });
+    if (fallback_) {
+      channel->bindQueue(exchange_, queue_name_, "#");
+    }
+  } else {
+    channel->bindQueue(exchange_, queue_name_, "#");
+  }
+  channel->setQos(static_cast<uint16_t>(options_.prefetch));
+  channel->consume(queue_name_).onReceived(
+      [this, consumer] (const AMQP::Message& message,
+                        uint64_t delivery_tag,
+                        bool /* redelivered */) {
+    Dispatch(consumer, nullptr, message, delivery_tag);
+  });
+
+  // A queue of its own for every route; unlimited ones only use theirs
+  // while paused.
+  std::vector<RouteTable::Route*> routes;
+  routes_.ForEach([&routes] (RouteTable::Route* route) { routes.push_back(route); });
+  if (fallback_) {
+    routes.push_back(fallback_.get());
+  }
+  consumer->mover.reset(new ConfirmedRepublisher(consumer->connection));
+  for (RouteTable::Route* route : routes) {
+    consumer->mover->DeclareQueue(OverflowQueue(route),
+                                  QueueArguments(options_.max_priority));
+    HubConsumer::Overflow& overflow = consumer->overflows[route];
+    overflow.channel.reset(new AMQP::TcpChannel(consumer->connection));
+    overflow.channel->declareQueue(OverflowQueue(route), 0,
+                                   QueueArguments(options_.max_priority));
+    overflow.channel->setQos(static_cast<uint16_t>(
+        route->max_concurrency > 0 ? route->max_concurrency : options_.prefetch));
+    overflow.subscription.reset(new PausableConsumer(
+        overflow.channel.get(), consumer->loop->event_base(), OverflowQueue(route), 0,
+        options_.retry_delay_ms));
+    overflow.subscription->Consume(
+        [this, consumer, route] (const AMQP::Message& message,
+                                 uint64_t delivery_tag,
+                                 bool /* redelivered */) {
+      Dispatch(consumer, route, message, delivery_tag);
+    });
+  }
+}
+
+RouteTable::Route* AmqpDispatchService::Lookup(const AMQP::Message& message) const {
+  RouteTable::Route* route;
+  if (!type_header_.empty() && message.headers().contains(type_header_)) {
+    const std::string& type = message.headers().get(type_header_);
+    route = routes_.Find(type);
+  } else {
+    route = routes_.Find(message.routingkey());
+  }
+  return route ? route : fallback_.get();
+}
+
+void AmqpDispatchService::Dispatch(HubConsumer* consumer,
+                                   RouteTable::Route* overflow,
+                                   const AMQP::Message& message,
+                                   uint64_t delivery_tag) {
+  RouteTable::Route* route = overflow ? overflow : Lookup(message);
+  if (!route) {
+    unrouted_->Increment();
+    LOG_EVERY_MS(WARNING, 10000) << queue_name_ << ": no route for routing key '"
+                                 << message.routingkey() << "', message dropped";
+    if (message.hasReplyTo()) {
+      PublishReply(consumer->channel.get(), message.replyTo(),
+                   message.hasCorrelationID() ? message.correlationID() : std::string(),
+                   base::Status(base::Code::NOT_FOUND,
+                                "no route for " + message.routingkey()),
+                   std::string(), false);
+    }
+    consumer->channel->ack(delivery_tag);
+    return;
+  }
+
+  RouteState* state = route_states_.find(route)->second.get();
+  AmqpEventLoop* loop = consumer->loop;
+  Delivery delivery(message, delivery_tag, consumer->generation, route, overflow);
+  std::string body = message.message();
+  std::string content_type = MessageContentType(message);
+  std::string content_encoding = MessageContentEncoding(message);
+  RouteTable::Task task = [state, consumer, loop, delivery,
+                           content_encoding, content_type, body] {
+    std::string reply;
+    bool reply_compressed;
+    base::Status status = state->dispatcher.Dispatch(content_encoding, content_type, body,
+                                                     &reply, &reply_compressed);
+    loop->RunInLoop([consumer, delivery, status, reply, reply_compressed] {
+      consumer->OnHandled(delivery, status, reply, reply_compressed);
+    });
+  };
+  if (overflow) {
+    // Bounded by the overflow channel's prefetch.
+    state->deliveries->Increment();
+    routes_.Run(route, task);
+    return;
+  }
+  if (consumer->overflows[route].subscription->paused() || !routes_.TryRun(route, task)) {
+    // Paused or at its limit: to the back of the route's own queue,
+    // properties and all, so the shared prefetch window keeps moving. The
+    // delivery is only acked once the broker has confirmed the copy.
+    consumer->mover->Publish(OverflowQueue(route), message,
+        [consumer, state, delivery_tag] (bool moved) {
+      if (moved) {
+        state->overflows->Increment();
+        consumer->channel->ack(delivery_tag);
+      } else {
+        consumer->channel->reject(delivery_tag, AMQP::requeue);
+      }
+    });
+    return;
+  }
+  state->deliveries->Increment();
+}
+
+} // namespace server
@@ -0,0 +1,128 @@
+#ifndef SERVICE_AMQP_DISPATCH_SERVICE_H_
+#define SERVICE_AMQP_DISPATCH_SERVICE_H_
+#include "base/macros.h"
+#include "base/metrics.h"
+#include "base/status.h"
+
+#include <amqpcpp.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "server/async_service_interface.h"
+#include "server/amqp/amqp_connection_hub.h"
+#include "service/confirmed_republisher.h"
+#include "service/message_dispatcher.h"
+#include "service/pausable_consumer.h"
+#include "service/route_table.h"
+#include "threading/thread_manager.h"
+#include "threading/thread_manager_metrics.h"
+
+namespace server {
+
+// Consumes one queue bound to a topic exchange and hands each message to
+// the ServiceHandler routed by its key, so that job types share a queue, a
+// channel per executor and one pool of worker threads instead of each
+// having an AmqpConsumerService of its own.
+//
+// The key is the value of the `type_header` header when one is given and
+// the message carries it, the routing key otherwise. Without a
+// `type_header` the queue is bound to the exchange once per route key, so
+// the broker only delivers routed messages; with one it is bound to "#".
+// Messages without a route go to the handler set by SetHandler(), or are
+// acknowledged and answered with NOT_FOUND if there is none.
+//
+//   AmqpDispatchService dispatcher(hub, "mq_jobs", "mq_jobs");
+//   dispatcher.AddRoute("epub_info_queue", epub_info_handler, 2);
+//   dispatcher.AddRoute("video_rpc_queue", transcoder_handler, 32);
+//
+// Handlers run on the service's `workers` threads, by default as many as
+// the route limits add up to, and each route runs at most
+// `max_concurrency` of its messages at once (0 = no limit). Deliveries are
+// acknowledged once handled, with `prefetch` defaulting to the number of
+// workers, and answered on reply_to like those of an AmqpConsumerService,
+// compression included.
+//
+// A delivery for a route already at its limit is not held in the shared
+// prefetch window, where a burst of one slow job type would stop the
+// others from being delivered at all. It is republished to the route's own
+// queue, "<queue_name>.<key>", and acknowledged once the broker confirms
+// the copy, or requeued if it doesn't (see service/confirmed_republisher.h).
+// Each executor consumes that queue on a channel of its own with the
+// route's limit (or `prefetch`) as prefetch, and the route runs those
+// deliveries whenever it has room, before any new ones.
+//
+// A delivery failing with UNAVAILABLE or DEADLINE_EXCEEDED, i.e. while the
+// service behind its handler is down or too slow, is requeued instead of
+// answered, and its route paused on that executor for `retry_delay_ms`,
+// twice as long each time it fails again (see service/pausable_consumer.h):
+// the route's own queue isn't consumed, and its deliveries from the shared
+// queue are moved there, so the other routes keep running.
+//
+// Deliveries, failures, requeues, latency, running, queued and overflowing
+// messages are exported per route, labelled with the queue and the route
+// key.
+//
+// Only runs on an AmqpConnectionHub.
+class AmqpDispatchService : public AsyncServiceInterface {
+ public:
+  AmqpDispatchService(std::shared_ptr<AmqpConnectionHub> hub,
+                      const std::string& exchange,
+                      const std::string& queue_name,
+                      const std::string& type_header = std::string());
+  virtual ~AmqpDispatchService();
+
+  // Call before Configure(). Returns false if `key` already has a route.
+  bool AddRoute(const std::string& key, ServiceHandler* handler, int max_concurrency);
+
+  std::string name() const override { return queue_name_; }
+
+  void Configure(const ServiceOptions& options) override;
+  void Shutdown() override;
+  bool StartAsync(const std::function<void()>& stopped) override;
+  void HandleLoop() override;
+
+  // Handles the messages no route matches.
+  virtual void SetHandler(ServiceHandler* handler) override;
+
+ private:
+  struct Delivery;
+  struct HubConsumer;
+  struct RouteState;
+
+  void Consume(HubConsumer* consumer);
+  // `overflow` is the route whose own queue `message` came from, nullptr
+  // for the shared queue.
+  void Dispatch(HubConsumer* consumer, RouteTable::Route* overflow,
+                const AMQP::Message& message, uint64_t delivery_tag);
+  std::string OverflowQueue(const RouteTable::Route* route) const;
+  // The route of `message`, the fallback one if none matches.
+  RouteTable::Route* Lookup(const AMQP::Message& message) const;
+  // Whether a delivery that failed with `status` is requeued.
+  bool Retry(const base::Status& status) const;
+
+  const std::string exchange_;
+  const std::string queue_name_;
+  const std::string type_header_;
+  std::shared_ptr<AmqpConnectionHub> hub_;
+
+  ServiceOptions options_;
+  RouteTable routes_;
+  std::unique_ptr<RouteTable::Route> fallback_;
+  // Filled by AddRoute() and SetHandler(), read-only once started.
+  std::unordered_map<const RouteTable::Route*, std::unique_ptr<RouteState>> route_states_;
+  base::Counter* unrouted_;
+
+  std::shared_ptr<threading::ThreadManager> workers_;
+  std::unique_ptr<threading::ThreadManagerMetrics> workers_metrics_;
+  std::mutex consumers_lock_;
+  std::vector<std::unique_ptr<HubConsumer>> consumers_;
+
+  DISALLOW_COPY_AND_ASSIGN(AmqpDispatchService);
+};
+
+} // namespace server
+#endif // SERVICE_AMQP_DISPATCH_SERVICE_H_
@@ -0,0 +1,135 @@
+#include "service/circuit_breaker.h"
+#include "threading/mutex.h"
+#include "threading/time_util.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+namespace server {
+
+CircuitBreaker::CircuitBreaker(const std::string& name, const Options& options)
+  : name_(name),
+    options_(options),
+    state_(CLOSED),
+    open_until_usec_(0),
+    probes_(0),
+    probe_successes_(0) {
+  memset(buckets_, 0, sizeof(buckets_));
+  base::MetricsRegistry* registry = base::MetricsRegistry::GetInstance();
+  rejected_ = registry->GetCounter("circuit_breaker_rejected_total",
+      "Calls refused because the breaker was open.", {{"breaker", name}});
+  opened_ = registry->GetCounter("circuit_breaker_opened_total",
+      "Times the breaker opened.", {{"breaker", name}});
+  state_metric_ = registry->AddCallback(
+      base::MetricsRegistry::GAUGE, "circuit_breaker_state",
+      "0 = closed, 1 = open, 2 = half-open.", {{"breaker", name}},
+      [this] { return static_cast<double>(state()); });
+}
+
+CircuitBreaker::~CircuitBreaker() {
+  base::MetricsRegistry::GetInstance()->RemoveCallback(state_metric_);
+}
+
+bool CircuitBreaker::Allow() {
+  const int64_t now = threading::TimeUtil::MonotonicTimeUsec();
+  threading::Guard g(lock_);
+  if (state_ == OPEN && now >= open_until_usec_) {
+    state_ = HALF_OPEN;
+    probes_ = 0;
+    probe_successes_ = 0;
+    LOG(INFO) << name_ << ": circuit half-open, probing";
+  }
+  if (state_ == HALF_OPEN && probes_ < options_.half_open_calls) {
+    probes_++;
+    return true;
+  }
+  if (state_ != CLOSED) {
+    rejected_->Increment();
+    return false;
+  }
+  return true;
+}
+
+void CircuitBreaker::Record(int64_t start_usec, bool ok) {
+  const int64_t now = threading::TimeUtil::MonotonicTimeUsec();
+  const bool slow = options_.slow_call_ms > 0 &&
+                    now - start_usec > options_.slow_call_ms * 1000;
+  threading::Guard g(lock_);
+  switch (state_) {
+    case CLOSED: {
+      Bucket* bucket = CurrentBucket(now);
+      bucket->calls++;
+      bucket->failures += !ok;
+      bucket->slow_calls += slow;
+      if (options_.min_calls <= 0) {
+        return;
+      }
+      int calls = 0, failures = 0, slow_calls = 0;
+      for (const Bucket& b : buckets_) {
+        if (now - b.start_usec < options_.window_ms * 1000) {
+          calls += b.calls;
+          failures += b.failures;
+          slow_calls += b.slow_calls;
+        }
+      }
+      if (calls >= options_.min_calls &&
+          (failures >= options_.failure_rate * calls ||
+           (options_.slow_call_ms > 0 && slow_calls >= options_.slow_call_rate * calls))) {
+        LOG(WARNING) << name_ << ": circuit open, " << failures << " failed and "
+                     << slow_calls << " slow of the last " << calls << " calls";
+        Open(now);
+      }
+      break;
+    }
+    case HALF_OPEN:
+      if (!ok || slow) {
+        LOG(WARNING) << name_ << ": probe " << (ok ? "slow" : "failed") << ", circuit open";
+        Open(now);
+      } else if (++probe_successes_ >= options_.half_open_calls) {
+        LOG(INFO) << name_ << ": probes succeeded, circuit closed";
+        Close();
+      }
+      break;
+    case OPEN:
+      // Calls allowed before it opened; they don't keep it open longer.
+      break;
+  }
+}
+
+void CircuitBreaker::Cancel() {
+  threading::Guard g(lock_);
+  if (state_ == HALF_OPEN && probes_ > probe_successes_) {
+    probes_--;
+  }
+}
+
+CircuitBreaker::State CircuitBreaker::state() const {
+  threading::Guard g(lock_);
+  return state_;
+}
+
+void CircuitBreaker::Open(int64_t now_usec) {
+  state_ = OPEN;
+  open_until_usec_ = now_usec + options_.open_ms * 1000;
+  opened_->Increment();
+}
+
+void CircuitBreaker::Close() {
+  state_ = CLOSED;
+  memset(buckets_, 0, sizeof(buckets_));
+}
+
+CircuitBreaker::Bucket* CircuitBreaker::CurrentBucket(int64_t now_usec) {
+  const int64_t width = std::max<int64_t>(options_.window_ms * 1000 / kBuckets, 1);
+  const int64_t start = now_usec - now_usec % width;
+  Bucket* bucket = &buckets_[(now_usec / width) % kBuckets];
+  if (bucket->start_usec != start) {
+    *bucket = Bucket{start, 0, 0, 0};
+  }
+  return bucket;
+}
+
+} // namespace server
@@ -0,0 +1,104 @@
+#ifndef SERVICE_CIRCUIT_BREAKER_H_
+#define SERVICE_CIRCUIT_BREAKER_H_
+#include "base/macros.h"
+#include "base/metrics.h"
+#include "threading/futex_mutex.h"
+
+#include <stdint.h>
+
+#include <string>
+
+namespace server {
+
+// Stops calls to a backend that is failing or too slow, so that callers
+// get an error at once instead of each holding a thread until its call
+// times out.
+//
+// Closed, calls go through and their outcomes are counted over the last
+// `window_ms`. Once at least `min_calls` were made in the window and
+// `failure_rate` of them failed, or `slow_call_rate` of them took longer
+// than `slow_call_ms`, the breaker opens: Allow() refuses every call for
+// `open_ms`. Then it is half-open, letting `half_open_calls` probes
+// through; all of them succeeding closes it again, any one failing or
+// being slow opens it for another `open_ms`.
+//
+//   if (!breaker.Allow()) {
+//     return base::Status(base::Code::UNAVAILABLE, "backend unavailable");
+//   }
+//   int64_t start = threading::TimeUtil::MonotonicTimeUsec();
+//   ... call the backend ...
+//   breaker.Record(start, ok);
+//
+// The state and refused calls are exported to the base::MetricsRegistry
+// labelled with the breaker's name. Thread-safe.
+class CircuitBreaker {
+ public:
+  enum State { CLOSED = 0, OPEN = 1, HALF_OPEN = 2 };
+
+  struct Options {
+    Options()
+        : window_ms(10000),
+          min_calls(20),
+          failure_rate(0.5),
+          slow_call_ms(0),
+          slow_call_rate(0.5),
+          open_ms(5000),
+          half_open_calls(3) {}
+
+    int64_t window_ms;
+    int min_calls;          // 0 = never open
+    double failure_rate;
+    int64_t slow_call_ms;   // 0 = calls are never slow
+    double slow_call_rate;
+    int64_t open_ms;
+    int half_open_calls;
+  };
+
+  explicit CircuitBreaker(const std::string& name, const Options& options = Options());
+  ~CircuitBreaker();
+
+  // Whether to make a call. Every allowed call must be matched by a
+  // Record() or, if it was never made, a Cancel().
+  bool Allow();
+  // An allowed call started at `start_usec` (TimeUtil::MonotonicTimeUsec())
+  // ended, failing unless `ok`.
+  void Record(int64_t start_usec, bool ok);
+  void Cancel();
+
+  State state() const;
+  const std::string& name() const { return name_; }
+
+ private:
+  // Outcomes in one tenth of the window.
+  struct Bucket {
+    int64_t start_usec;
+    int calls;
+    int failures;
+    int slow_calls;
+  };
+  static const int kBuckets = 10;
+
+  // Called with lock_ held.
+  void Open(int64_t now_usec);
+  void Close();
+  Bucket* CurrentBucket(int64_t now_usec);
+
+  const std::string name_;
+  const Options options_;
+
+  mutable threading::FutexMutex lock_;
+  State state_;                   // guarded by lock_
+  int64_t open_until_usec_;       // guarded by lock_
+  int probes_;                    // half-open calls allowed, guarded by lock_
+  int probe_successes_;           // guarded by lock_
+  Bucket buckets_[kBuckets];      // guarded by lock_
+
+  base::Counter* rejected_;
+  base::Counter* opened_;
+  int state_metric_;
+
+  DISALLOW_COPY_AND_ASSIGN(CircuitBreaker);
+};
+
+} // namespace server
+#endif // SERVICE_CIRCUIT_BREAKER_H_
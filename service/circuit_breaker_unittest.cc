@@ -0,0 +1,87 @@
+#include "service/circuit_breaker.h"
+#include "threading/time_util.h"
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+int64_t Now() {
+  return threading::TimeUtil::MonotonicTimeUsec();
+}
+
+} // namespace
+
+TEST(CircuitBreakerTest, Opens_On_Failures_And_Closes_After_Probes) {
+  server::CircuitBreaker::Options options;
+  options.min_calls = 4;
+  options.failure_rate = 0.5;
+  options.open_ms = 50;
+  options.half_open_calls = 2;
+  server::CircuitBreaker breaker("test", options);
+
+  // Too few calls to judge.
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(breaker.Allow());
+    breaker.Record(Now(), false);
+  }
+  EXPECT_EQ(server::CircuitBreaker::CLOSED, breaker.state());
+  ASSERT_TRUE(breaker.Allow());
+  breaker.Record(Now(), false);
+  EXPECT_EQ(server::CircuitBreaker::OPEN, breaker.state());
+  EXPECT_FALSE(breaker.Allow());
+
+  // Half-open: two probes and no more until they are back.
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  EXPECT_TRUE(breaker.Allow());
+  EXPECT_EQ(server::CircuitBreaker::HALF_OPEN, breaker.state());
+  EXPECT_TRUE(breaker.Allow());
+  EXPECT_FALSE(breaker.Allow());
+  breaker.Record(Now(), true);
+  // A probe that was never made frees its slot.
+  breaker.Cancel();
+  EXPECT_TRUE(breaker.Allow());
+  breaker.Record(Now(), true);
+  EXPECT_EQ(server::CircuitBreaker::CLOSED, breaker.state());
+
+  // The window starts over: three failures are too few again.
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(breaker.Allow());
+    breaker.Record(Now(), false);
+  }
+  EXPECT_EQ(server::CircuitBreaker::CLOSED, breaker.state());
+}
+
+TEST(CircuitBreakerTest, Failed_Probe_Reopens) {
+  server::CircuitBreaker::Options options;
+  options.min_calls = 2;
+  options.open_ms = 20;
+  server::CircuitBreaker breaker("test", options);
+  for (int i = 0; i < 2; ++i) {
+    breaker.Allow();
+    breaker.Record(Now(), false);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  ASSERT_TRUE(breaker.Allow());
+  breaker.Record(Now(), false);
+  EXPECT_EQ(server::CircuitBreaker::OPEN, breaker.state());
+  EXPECT_FALSE(breaker.Allow());
+}
+
+TEST(CircuitBreakerTest, Opens_On_Slow_Calls) {
+  server::CircuitBreaker::Options options;
+  options.min_calls = 4;
+  options.slow_call_ms = 10;
+  options.slow_call_rate = 0.5;
+  server::CircuitBreaker breaker("test", options);
+  for (int i = 0; i < 2; ++i) {
+    breaker.Allow();
+    breaker.Record(Now(), true);
+  }
+  for (int i = 0; i < 2; ++i) {
+    breaker.Allow();
+    breaker.Record(Now() - 20000, true);
+  }
+  EXPECT_EQ(server::CircuitBreaker::OPEN, breaker.state());
+}
@@ -0,0 +1,91 @@
+#include "service/confirmed_republisher.h"
+
+#include <glog/logging.h>
+
+namespace server {
+
+ConfirmedRepublisher::ConfirmedRepublisher(AMQP::TcpConnection* connection)
+  : connection_(connection),
+    broken_(false),
+    next_delivery_tag_(0) {
+  Open();
+}
+
+ConfirmedRepublisher::~ConfirmedRepublisher() {
+  pending_.clear();
+  channel_.reset();
+}
+
+void ConfirmedRepublisher::DeclareQueue(const std::string& queue,
+                                        const AMQP::Table& arguments) {
+  queues_.emplace_back(queue, arguments);
+  channel_->declareQueue(queue, 0, arguments);
+}
+
+void ConfirmedRepublisher::Open() {
+  channel_.reset(new AMQP::TcpChannel(connection_));
+  broken_ = false;
+  next_delivery_tag_ = 0;  // Delivery tags are per channel.
+
+  channel_->onError([this](const char* message) {
+    LOG(ERROR) << "ConfirmedRepublisher channel error: " << message;
+    broken_ = true;
+    FailAll();
+  });
+  for (const auto& queue : queues_) {
+    channel_->declareQueue(queue.first, 0, queue.second);
+  }
+  // Publishes sent before the broker's select-ok are confirmed all the
+  // same: the channel keeps its frames in order.
+  channel_->confirmSelect()
+      .onAck([this](uint64_t delivery_tag, bool multiple) {
+        Settle(delivery_tag, multiple, true);
+      })
+      .onNack([this](uint64_t delivery_tag, bool multiple, bool /* requeue */) {
+        Settle(delivery_tag, multiple, false);
+      });
+}
+
+void ConfirmedRepublisher::Publish(const std::string& queue,
+                                   const AMQP::Message& message,
+                                   const Callback& done) {
+  if (broken_) {
+    // Not from within the old channel's own error callback.
+    Open();
+  }
+  if (!channel_->publish("", queue, message)) {
+    done(false);
+    return;
+  }
+  pending_[++next_delivery_tag_] = done;
+}
+
+void ConfirmedRepublisher::Settle(uint64_t delivery_tag, bool multiple, bool moved) {
+  auto begin = multiple ? pending_.begin() : pending_.find(delivery_tag);
+  auto end = pending_.upper_bound(delivery_tag);
+  if (begin == pending_.end() || begin->first > delivery_tag) {
+    return;  // Already settled.
+  }
+  std::vector<Callback> settled;
+  for (auto it = begin; it != end; ++it) {
+    settled.push_back(std::move(it->second));
+  }
+  pending_.erase(begin, end);
+  if (!moved) {
+    LOG(WARNING) << "ConfirmedRepublisher: broker nacked " << settled.size()
+                 << " messages";
+  }
+  for (const Callback& done : settled) {
+    done(moved);
+  }
+}
+
+void ConfirmedRepublisher::FailAll() {
+  std::map<uint64_t, Callback> failed;
+  failed.swap(pending_);
+  for (const auto& entry : failed) {
+    entry.second(false);
+  }
+}
+
+} // namespace server
@@ -0,0 +1,72 @@
+#ifndef SERVICE_CONFIRMED_REPUBLISHER_H_
+#define SERVICE_CONFIRMED_REPUBLISHER_H_
+#include "base/macros.h"
+
+#include <amqpcpp.h>
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace server {
+
+// Moves deliveries to another queue without a window where they are in
+// neither: the copy is published on a channel of its own in confirm mode
+// (like AmqpPublisher's), and the original is only settled once the broker
+// has answered for the copy.
+//
+//   ConfirmedRepublisher mover(connection);
+//   mover.DeclareQueue(target, QueueArguments(max_priority));
+//   ...
+//   mover.Publish(target, message, [channel, delivery_tag] (bool moved) {
+//     if (moved) {
+//       channel->ack(delivery_tag);
+//     } else {
+//       channel->reject(delivery_tag, AMQP::requeue);
+//     }
+//   });
+//
+// The target queues are declared on the publishing channel itself, ahead
+// of any publish, so that a copy never goes to a queue another channel
+// hasn't declared yet. Runs on the connection's loop thread, and goes away
+// before the connection; callbacks still pending then are dropped, as the
+// broker redelivers the originals anyway.
+class ConfirmedRepublisher {
+ public:
+  typedef std::function<void(bool)> Callback;
+
+  explicit ConfirmedRepublisher(AMQP::TcpConnection* connection);
+  ~ConfirmedRepublisher();
+
+  // Declares `queue` now and on every channel opened after a channel
+  // error.
+  void DeclareQueue(const std::string& queue, const AMQP::Table& arguments);
+
+  // Publishes `message`, properties and all, to `queue` through the default
+  // exchange. `done` gets true once the broker confirms the copy, false if
+  // it nacks it or the channel fails first.
+  void Publish(const std::string& queue, const AMQP::Message& message,
+               const Callback& done);
+
+ private:
+  void Open();
+  void Settle(uint64_t delivery_tag, bool multiple, bool moved);
+  void FailAll();
+
+  AMQP::TcpConnection* const connection_;
+  std::unique_ptr<AMQP::TcpChannel> channel_;
+  bool broken_;  // channel_ failed, a new one is opened on the next Publish()
+  std::vector<std::pair<std::string, AMQP::Table>> queues_;
+  uint64_t next_delivery_tag_;
+  std::map<uint64_t, Callback> pending_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConfirmedRepublisher);
+};
+
+} // namespace server
+#endif // SERVICE_CONFIRMED_REPUBLISHER_H_
@@ -0,0 +1,133 @@
+#include "service/dedup_handler.h"
+
+#include <glog/logging.h>
+
+namespace server {
+
+DedupHandler::DedupHandler(const std::string& name,
+                           ServiceHandler* handler,
+                           const KeyFunction& key_function,
+                           size_t capacity,
+                           std::shared_ptr<IdempotencyStore> store)
+  : handler_(handler),
+    key_function_(key_function),
+    capacity_(capacity),
+    store_(store) {
+  DCHECK(handler_);
+  base::MetricsRegistry* registry = base::MetricsRegistry::GetInstance();
+  const char help[] = "Messages answered with the result of an earlier run of their job.";
+  memory_hits_ = registry->GetCounter("mq_dedup_hits_total", help,
+                                      {{"handler", name}, {"found", "memory"}});
+  in_flight_hits_ = registry->GetCounter("mq_dedup_hits_total", help,
+                                         {{"handler", name}, {"found", "in_flight"}});
+  store_hits_ = registry->GetCounter("mq_dedup_hits_total", help,
+                                     {{"handler", name}, {"found", "store"}});
+  size_metric_ = registry->AddCallback(
+      base::MetricsRegistry::GAUGE, "mq_dedup_keys",
+      "Completed job keys held in memory.", {{"handler", name}},
+      [this] { return static_cast<double>(size()); });
+}
+
+DedupHandler::~DedupHandler() {
+  base::MetricsRegistry::GetInstance()->RemoveCallback(size_metric_);
+}
+
+base::Status DedupHandler::Handle(const std::string& message, std::string* reply) {
+  return HandleMessage(std::string(), message, reply);
+}
+
+base::Status DedupHandler::HandleMessage(const std::string& content_type,
+                                         const std::string& message,
+                                         std::string* reply) {
+  std::string key;
+  if (!key_function_(content_type, message, &key).ok()) {
+    return handler_->HandleMessage(content_type, message, reply);
+  }
+
+  std::shared_ptr<InFlight> run;
+  {
+    std::unique_lock<std::mutex> l(lock_);
+    if (FindCompleted(key, reply)) {
+      memory_hits_->Increment();
+      VLOG(1) << key << " completed before, not run again";
+      return base::Status::OK();
+    }
+    auto it = in_flight_.find(key);
+    if (it != in_flight_.end()) {
+      std::shared_ptr<InFlight> leader = it->second;
+      in_flight_hits_->Increment();
+      VLOG(1) << key << " is running, waiting for it";
+      done_.wait(l, [&leader] { return leader->done; });
+      *reply = leader->reply;
+      return leader->status;
+    }
+    run = std::make_shared<InFlight>();
+    in_flight_.emplace(key, run);
+  }
+
+  // Duplicates arriving from now on wait for this run, store lookup
+  // included.
+  base::Status status;
+  if (store_ && store_->Lookup(key, reply)) {
+    store_hits_->Increment();
+    VLOG(1) << key << " completed in an earlier process, not run again";
+  } else {
+    status = Run(key, content_type, message, reply);
+  }
+
+  {
+    std::lock_guard<std::mutex> l(lock_);
+    run->done = true;
+    run->status = status;
+    run->reply = *reply;
+    if (status.ok()) {
+      AddCompleted(key, *reply);
+    }
+    in_flight_.erase(key);
+  }
+  done_.notify_all();
+  return status;
+}
+
+size_t DedupHandler::size() const {
+  std::lock_guard<std::mutex> l(lock_);
+  return completed_.size();
+}
+
+base::Status DedupHandler::Run(const std::string& key,
+                               const std::string& content_type,
+                               const std::string& message,
+                               std::string* reply) {
+  base::Status status = handler_->HandleMessage(content_type, message, reply);
+  if (status.ok() && store_) {
+    store_->Record(key, *reply);
+  }
+  return status;
+}
+
+bool DedupHandler::FindCompleted(const std::string& key, std::string* reply) {
+  auto it = completed_.find(key);
+  if (it == completed_.end()) {
+    return false;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second);
+  *reply = it->second->reply;
+  return true;
+}
+
+void DedupHandler::AddCompleted(const std::string& key, const std::string& reply) {
+  if (capacity_ == 0) {
+    return;
+  }
+  if (completed_.count(key) != 0) {
+    return;
+  }
+  if (completed_.size() >= capacity_) {
+    completed_.erase(lru_.back().key);
+    lru_.pop_back();
+  }
+  lru_.push_front(Completed{key, reply});
+  completed_.emplace(key, lru_.begin());
+}
+
+} // namespace server
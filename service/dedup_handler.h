@@ -0,0 +1,113 @@
+#ifndef SERVICE_DEDUP_HANDLER_H_
+#define SERVICE_DEDUP_HANDLER_H_
+#include "base/macros.h"
+#include "base/metrics.h"
+#include "base/status.h"
+#include "server/async_service_interface.h"
+
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace server {
+
+// Where completed job keys outlive the process (see MysqlIdempotencyStore).
+// Called from handler threads, concurrently.
+class IdempotencyStore {
+ public:
+  virtual ~IdempotencyStore() {}
+
+  // Sets `reply` and returns true if the job `key` completed before.
+  virtual bool Lookup(const std::string& key, std::string* reply) = 0;
+  // Remembers that the job `key` completed with `reply`.
+  virtual void Record(const std::string& key, const std::string& reply) = 0;
+};
+
+// Runs a job only once however often it is delivered.
+//
+// Sits in front of another ServiceHandler and identifies each message by
+// the key `key_function` derives from it, typically TranscodeJobKey() of
+// the decoded job. A message whose job completed recently is answered
+// with the reply of that run straight away, so redeliveries and
+// re-published jobs are acked without being done again. A message whose
+// job is being handled right now waits for that run and shares its
+// status and reply. Otherwise the job runs, and if it succeeds its key
+// and reply are kept.
+//
+// The completed keys are an LRU bounded to `capacity` entries. With a
+// `store`, keys missing from it are also looked up there and completed
+// jobs are recorded there, so duplicates are caught across restarts and
+// consumers. Failed runs are not remembered: the job may be retried.
+//
+// Messages `key_function` fails on go to the handler as they are, which
+// reports the error.
+//
+// Hits are exported as mq_dedup_hits_total, labelled with `name` and where
+// the job was found.
+class DedupHandler : public ServiceHandler {
+ public:
+  typedef std::function<base::Status(const std::string& content_type,
+                                     const std::string& message,
+                                     std::string* key)> KeyFunction;
+
+  // Doesn't own `handler`.
+  DedupHandler(const std::string& name,
+               ServiceHandler* handler,
+               const KeyFunction& key_function,
+               size_t capacity,
+               std::shared_ptr<IdempotencyStore> store = nullptr);
+  virtual ~DedupHandler();
+
+  virtual base::Status HandleMessage(const std::string& content_type,
+                                     const std::string& message,
+                                     std::string* reply) override;
+  virtual base::Status Handle(const std::string& message, std::string* reply) override;
+
+  // Completed keys held in memory.
+  size_t size() const;
+
+ private:
+  struct Completed {
+    std::string key;
+    std::string reply;
+  };
+  // A run the duplicates of its job wait for.
+  struct InFlight {
+    InFlight() : done(false) {}
+
+    bool done;
+    base::Status status;
+    std::string reply;
+  };
+
+  base::Status Run(const std::string& key, const std::string& content_type,
+                   const std::string& message, std::string* reply);
+  // Sets `reply` from the LRU and moves `key` to its front. Needs lock_.
+  bool FindCompleted(const std::string& key, std::string* reply);
+  void AddCompleted(const std::string& key, const std::string& reply);
+
+  ServiceHandler* const handler_;
+  const KeyFunction key_function_;
+  const size_t capacity_;
+  const std::shared_ptr<IdempotencyStore> store_;
+
+  base::Counter* memory_hits_;
+  base::Counter* in_flight_hits_;
+  base::Counter* store_hits_;
+  int size_metric_;
+
+  mutable std::mutex lock_;
+  std::condition_variable done_;
+  std::list<Completed> lru_;  // most recently used first
+  std::unordered_map<std::string, std::list<Completed>::iterator> completed_;
+  std::unordered_map<std::string, std::shared_ptr<InFlight>> in_flight_;
+
+  DISALLOW_COPY_AND_ASSIGN(DedupHandler);
+};
+
+} // namespace server
+#endif // SERVICE_DEDUP_HANDLER_H_
@@ -0,0 +1,152 @@
+#include "service/dedup_handler.h"
+
+#include <atomic>
+#include <map>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// Replies with "done <message>"; fails messages starting with "bad".
+class CountingHandler : public server::ServiceHandler {
+ public:
+  CountingHandler() : runs(0), blocked(false), entered(false) {}
+
+  base::Status Handle(const std::string& message, std::string* reply) override {
+    runs++;
+    {
+      std::unique_lock<std::mutex> l(lock);
+      entered = true;
+      entered_cv.notify_all();
+      release_cv.wait(l, [this] { return !blocked; });
+    }
+    if (message.compare(0, 3, "bad") == 0) {
+      return base::Status(base::Code::INTERNAL, "failed " + message);
+    }
+    *reply = "done " + message;
+    return base::Status::OK();
+  }
+
+  void Release() {
+    std::lock_guard<std::mutex> l(lock);
+    blocked = false;
+    release_cv.notify_all();
+  }
+
+  std::atomic<int> runs;
+  std::mutex lock;
+  std::condition_variable entered_cv;
+  std::condition_variable release_cv;
+  bool blocked;
+  bool entered;
+};
+
+class MemoryStore : public server::IdempotencyStore {
+ public:
+  bool Lookup(const std::string& key, std::string* reply) override {
+    auto it = replies.find(key);
+    if (it == replies.end()) {
+      return false;
+    }
+    *reply = it->second;
+    return true;
+  }
+
+  void Record(const std::string& key, const std::string& reply) override {
+    replies[key] = reply;
+  }
+
+  std::map<std::string, std::string> replies;
+};
+
+// The job key of a message is the message.
+base::Status MessageKey(const std::string&, const std::string& message, std::string* key) {
+  *key = message;
+  return base::Status::OK();
+}
+
+} // namespace
+
+TEST(DedupHandlerTest, Runs_Completed_Jobs_Once) {
+  CountingHandler handler;
+  server::DedupHandler dedup("test", &handler, MessageKey, 2);
+  std::string reply;
+  EXPECT_TRUE(dedup.HandleMessage("", "a", &reply).ok());
+  EXPECT_EQ("done a", reply);
+  reply.clear();
+  EXPECT_TRUE(dedup.HandleMessage("", "a", &reply).ok());
+  EXPECT_EQ("done a", reply);
+  EXPECT_EQ(1, handler.runs);
+
+  // Failures are not remembered.
+  EXPECT_FALSE(dedup.HandleMessage("", "bad", &reply).ok());
+  EXPECT_FALSE(dedup.HandleMessage("", "bad", &reply).ok());
+  EXPECT_EQ(3, handler.runs);
+
+  // "a" was used last, so "b" is evicted by "c".
+  dedup.HandleMessage("", "b", &reply);
+  dedup.HandleMessage("", "a", &reply);
+  dedup.HandleMessage("", "c", &reply);
+  EXPECT_EQ(2u, dedup.size());
+  EXPECT_EQ(5, handler.runs);
+  dedup.HandleMessage("", "a", &reply);
+  EXPECT_EQ(5, handler.runs);
+  dedup.HandleMessage("", "b", &reply);
+  EXPECT_EQ(6, handler.runs);
+}
+
+TEST(DedupHandlerTest, Duplicates_Wait_For_The_Running_Job) {
+  CountingHandler handler;
+  handler.blocked = true;
+  server::DedupHandler dedup("test", &handler, MessageKey, 16);
+
+  base::Status first_status;
+  std::string first_reply;
+  std::thread first([&] { first_status = dedup.HandleMessage("", "a", &first_reply); });
+  {
+    std::unique_lock<std::mutex> l(handler.lock);
+    handler.entered_cv.wait(l, [&handler] { return handler.entered; });
+  }
+  base::Status second_status;
+  std::string second_reply;
+  std::thread second([&] { second_status = dedup.HandleMessage("", "a", &second_reply); });
+  // Let the duplicate get to its wait; it must not run the job either way.
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  handler.Release();
+  first.join();
+  second.join();
+
+  EXPECT_EQ(1, handler.runs);
+  EXPECT_TRUE(first_status.ok());
+  EXPECT_TRUE(second_status.ok());
+  EXPECT_EQ("done a", first_reply);
+  EXPECT_EQ("done a", second_reply);
+}
+
+TEST(DedupHandlerTest, Looks_Up_And_Records_In_The_Store) {
+  CountingHandler handler;
+  std::shared_ptr<MemoryStore> store = std::make_shared<MemoryStore>();
+  store->replies["a"] = "done a earlier";
+  server::DedupHandler dedup("test", &handler, MessageKey, 16, store);
+
+  std::string reply;
+  EXPECT_TRUE(dedup.HandleMessage("", "a", &reply).ok());
+  EXPECT_EQ("done a earlier", reply);
+  EXPECT_EQ(0, handler.runs);
+
+  EXPECT_TRUE(dedup.HandleMessage("", "b", &reply).ok());
+  EXPECT_EQ(1, handler.runs);
+  EXPECT_EQ("done b", store->replies["b"]);
+  dedup.HandleMessage("", "bad", &reply);
+  EXPECT_EQ(0u, store->replies.count("bad"));
+
+  // Without a key the handler decides.
+  server::DedupHandler keyless("test", &handler,
+      [](const std::string&, const std::string&, std::string*) {
+        return base::Status(base::Code::INVALID_ARGUMENT, "no key");
+      }, 16);
+  keyless.HandleMessage("", "c", &reply);
+  keyless.HandleMessage("", "c", &reply);
+  EXPECT_EQ(4, handler.runs);
+}
@@ -0,0 +1,37 @@
+#include "service/fiber_completion_queue.h"
+#include "threading/thread_factory.h"
+
+namespace server {
+
+class FiberCompletionQueue::Poller : public threading::Runnable {
+ public:
+  explicit Poller(grpc::CompletionQueue* cq) : cq_(cq) {}
+
+  void Run() override {
+    void* tag = nullptr;
+    bool ok = false;
+    while (cq_->Next(&tag, &ok)) {
+      FiberCompletionQueue::Call* call =
+          static_cast<FiberCompletionQueue::Call*>(tag);
+      call->ok = ok;
+      call->baton.Post();
+    }
+  }
+
+ private:
+  grpc::CompletionQueue* cq_;
+};
+
+FiberCompletionQueue::FiberCompletionQueue() {
+  threading::PosixThreadFactory factory(threading::ThreadFactory::ATTACHED);
+  poller_ = factory.NewThread(std::make_shared<Poller>(&cq_));
+  poller_->SetName("fiber_grpc_cq");
+  poller_->Start();
+}
+
+FiberCompletionQueue::~FiberCompletionQueue() {
+  cq_.Shutdown();
+  poller_->Join();
+}
+
+} // namespace server
@@ -0,0 +1,80 @@
+#ifndef SERVICE_FIBER_COMPLETION_QUEUE_H_
+#define SERVICE_FIBER_COMPLETION_QUEUE_H_
+#include "base/macros.h"
+#include "threading/fiber.h"
+#include "threading/thread.h"
+
+#include <memory>
+#include <grpc++/grpc++.h>
+
+namespace server {
+
+// A grpc::CompletionQueue whose events resume fibers.
+//
+// A poller thread drains the queue; every tag is a Call, whose baton is
+// posted when the operation completes. The fiber that started the
+// operation simply blocks in Await() while its scheduler runs other fibers:
+//
+//   FiberCompletionQueue::Call call;
+//   grpc::ClientContext context;
+//   auto rpc = stub->AsyncCreateSymmetricKey(&context, request, fcq.cq());
+//   rpc->Finish(&response, &call.status, &call);
+//   if (!fcq.Await(&call) || !call.status.ok()) { ... }
+//
+// Not used by the handlers yet, which still make synchronous calls; see
+// threading::FiberScheduler.
+class FiberCompletionQueue {
+ public:
+  struct Call {
+    Call() : ok(false) {}
+
+    grpc::Status status;
+    bool ok;
+    threading::FiberBaton baton;
+  };
+
+  FiberCompletionQueue();
+  ~FiberCompletionQueue();
+
+  grpc::CompletionQueue* cq() { return &cq_; }
+
+  // Suspends the calling fiber until `call` completes. Returns the `ok`
+  // flag reported by the completion queue.
+  bool Await(Call* call) {
+    call->baton.Wait();
+    return call->ok;
+  }
+
+ private:
+  class Poller;
+
+  grpc::CompletionQueue cq_;
+  std::shared_ptr<threading::Thread> poller_;
+
+  DISALLOW_COPY_AND_ASSIGN(FiberCompletionQueue);
+};
+
+// Issues a unary call through `fcq` and suspends the calling fiber until it
+// finishes, e.g.
+//
+//   grpc::Status status = FiberUnaryCall(&fcq, &context, request, &response,
+//       [&](grpc::ClientContext* c, const Request& r, grpc::CompletionQueue* q) {
+//         return stub->AsyncCreateSymmetricKey(c, r, q);
+//       });
+template <typename Request, typename Response, typename StartCall>
+grpc::Status FiberUnaryCall(FiberCompletionQueue* fcq,
+                            grpc::ClientContext* context,
+                            const Request& request,
+                            Response* response,
+                            StartCall start_call) {
+  FiberCompletionQueue::Call call;
+  auto rpc = start_call(context, request, fcq->cq());
+  rpc->Finish(response, &call.status, &call);
+  if (!fcq->Await(&call)) {
+    return grpc::Status(grpc::StatusCode::CANCELLED, "completion queue shut down");
+  }
+  return call.status;
+}
+
+} // namespace server
+#endif // SERVICE_FIBER_COMPLETION_QUEUE_H_
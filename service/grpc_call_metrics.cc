@@ -0,0 +1,46 @@
+#include "service/grpc_call_metrics.h"
+#include "threading/time_util.h"
+
+namespace server {
+
+namespace {
+
+const char* const kCodeNames[] = {
+  "OK", "CANCELLED", "UNKNOWN", "INVALID_ARGUMENT", "DEADLINE_EXCEEDED",
+  "NOT_FOUND", "ALREADY_EXISTS", "PERMISSION_DENIED", "RESOURCE_EXHAUSTED",
+  "FAILED_PRECONDITION", "ABORTED", "OUT_OF_RANGE", "UNIMPLEMENTED",
+  "INTERNAL", "UNAVAILABLE", "DATA_LOSS", "UNAUTHENTICATED",
+};
+
+} // namespace
+
+GrpcCallMetrics::GrpcCallMetrics(const std::string& method)
+  : method_(method),
+    latency_(base::MetricsRegistry::GetInstance()->GetHistogram(
+        "grpc_client_call_latency_seconds",
+        "Time from starting a gRPC call to its status.",
+        {{"method", method}})) {
+  for (int i = 0; i < kCodeCount; ++i) {
+    calls_[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+base::Counter* GrpcCallMetrics::Calls(grpc::StatusCode code) {
+  int index = code >= 0 && code < kCodeCount ? code : grpc::UNKNOWN;
+  base::Counter* counter = calls_[index].load(std::memory_order_acquire);
+  if (counter == nullptr) {
+    // Racing threads get the same counter from the registry.
+    counter = base::MetricsRegistry::GetInstance()->GetCounter(
+        "grpc_client_calls_total", "Finished gRPC calls by status code.",
+        {{"method", method_}, {"code", kCodeNames[index]}});
+    calls_[index].store(counter, std::memory_order_release);
+  }
+  return counter;
+}
+
+void GrpcCallMetrics::Record(int64_t start_usec, const grpc::Status& status) {
+  latency_->Observe((threading::TimeUtil::MonotonicTimeUsec() - start_usec) / 1e6);
+  Calls(status.error_code())->Increment();
+}
+
+} // namespace server
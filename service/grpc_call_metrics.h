@@ -0,0 +1,49 @@
+#ifndef SERVICE_GRPC_CALL_METRICS_H_
+#define SERVICE_GRPC_CALL_METRICS_H_
+#include "base/macros.h"
+#include "base/metrics.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <grpc++/grpc++.h>
+
+namespace server {
+
+// Client-side numbers of one gRPC method, exported to the
+// base::MetricsRegistry:
+//
+//   grpc_client_calls_total{method,code}        finished calls by status
+//   grpc_client_call_latency_seconds{method}    call start to status
+//
+//   int64_t start = threading::TimeUtil::MonotonicTimeUsec();
+//   grpc::Status status = stub_->GetEpubCatalog(&context, request, &response);
+//   get_epub_catalog_metrics_.Record(start, status);
+//
+// Thread-safe.
+class GrpcCallMetrics {
+ public:
+  // `method` as in the .proto, e.g. "epub_info.EpubInfo/GetEpubCatalog".
+  explicit GrpcCallMetrics(const std::string& method);
+
+  // A call started at `start_usec` (TimeUtil::MonotonicTimeUsec()) ended
+  // with `status`.
+  void Record(int64_t start_usec, const grpc::Status& status);
+
+ private:
+  static const int kCodeCount = grpc::UNAUTHENTICATED + 1;
+
+  base::Counter* Calls(grpc::StatusCode code);
+
+  const std::string method_;
+  base::Histogram* latency_;
+  // Registered on the first call with each code, so only the codes seen
+  // are exported.
+  std::atomic<base::Counter*> calls_[kCodeCount];
+
+  DISALLOW_COPY_AND_ASSIGN(GrpcCallMetrics);
+};
+
+} // namespace server
+#endif // SERVICE_GRPC_CALL_METRICS_H_
@@ -0,0 +1,71 @@
+#include "service/grpc_channel_pool.h"
+#include "base/string_util.h"
+
+#include <chrono>
+
+#include <glog/logging.h>
+
+namespace server {
+
+std::vector<std::string> ParseAddresses(const std::string& addresses) {
+  std::vector<std::string> parsed;
+  size_t pos = 0;
+  while (pos <= addresses.size()) {
+    size_t comma = addresses.find(',', pos);
+    if (comma == std::string::npos) {
+      comma = addresses.size();
+    }
+    std::string address;
+    base::TrimString(addresses.substr(pos, comma - pos), " \t", &address);
+    if (!address.empty()) {
+      parsed.push_back(address);
+    }
+    pos = comma + 1;
+  }
+  return parsed;
+}
+
+std::vector<std::shared_ptr<grpc::Channel>> CreateChannels(
+    const std::vector<std::string>& addresses, int channels_per_address) {
+  CHECK(!addresses.empty()) << "no gRPC addresses";
+  CHECK_GT(channels_per_address, 0);
+  std::vector<std::shared_ptr<grpc::Channel>> channels;
+  for (const std::string& address : addresses) {
+    for (int i = 0; i < channels_per_address; ++i) {
+      grpc::ChannelArguments args;
+      args.SetInt("mpr_mq.channel_index", i);
+      std::shared_ptr<grpc::Channel> channel =
+          grpc::CreateCustomChannel(address, grpc::InsecureChannelCredentials(), args);
+      CHECK(channel) << address;
+      channels.push_back(channel);
+    }
+  }
+  return channels;
+}
+
+base::Status SetDeadline(const JobDeadline& deadline, bool unary,
+                         grpc::ClientContext* context) {
+  int64_t timeout_usec;
+  RETURN_IF_ERROR(deadline.RpcTimeoutUsec(unary, &timeout_usec));
+  if (timeout_usec >= 0) {
+    context->set_deadline(std::chrono::system_clock::now() +
+                          std::chrono::microseconds(timeout_usec));
+  }
+  return base::Status::OK();
+}
+
+base::Status FromRpcStatus(const grpc::Status& status, const std::string& message) {
+  switch (status.error_code()) {
+    case grpc::StatusCode::OK:
+      return base::Status::OK();
+    case grpc::StatusCode::UNAVAILABLE:
+      return base::Status(base::Code::UNAVAILABLE, message + ": " + status.error_message());
+    case grpc::StatusCode::DEADLINE_EXCEEDED:
+      return base::Status(base::Code::DEADLINE_EXCEEDED,
+                          message + ": " + status.error_message());
+    default:
+      return base::Status(base::Code::INTERNAL, message + ": " + status.error_message());
+  }
+}
+
+} // namespace server
@@ -0,0 +1,183 @@
+#ifndef SERVICE_GRPC_CHANNEL_POOL_H_
+#define SERVICE_GRPC_CHANNEL_POOL_H_
+#include "base/macros.h"
+#include "base/status.h"
+#include "service/circuit_breaker.h"
+#include "service/job_deadline.h"
+#include "service/load_balancer.h"
+#include "threading/time_util.h"
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include <grpc++/grpc++.h>
+
+namespace server {
+
+// "host1:50053, host2:50053" -> {"host1:50053", "host2:50053"}
+std::vector<std::string> ParseAddresses(const std::string& addresses);
+
+// `channels_per_address` channels to each address, each on connections of
+// its own: gRPC shares a connection between channels with equal
+// arguments, so every channel gets a distinct one.
+std::vector<std::shared_ptr<grpc::Channel>> CreateChannels(
+    const std::vector<std::string>& addresses, int channels_per_address);
+
+// Sets the deadline of an RPC of the job `deadline` is for; an error
+// instead if the job is out of time.
+base::Status SetDeadline(const JobDeadline& deadline, bool unary,
+                         grpc::ClientContext* context);
+
+// `status` of an RPC as the job's: UNAVAILABLE and DEADLINE_EXCEEDED, which
+// a retry may not get, are kept, anything else is INTERNAL.
+base::Status FromRpcStatus(const grpc::Status& status, const std::string& message);
+
+struct GrpcChannelPoolOptions {
+  GrpcChannelPoolOptions() : channels_per_address(2) {}
+
+  int channels_per_address;  // at least 1 is used
+  LoadBalancer::Options balancer;
+  CircuitBreaker::Options breaker;
+};
+
+// Stubs of `Service` over several channels to each of its replicas, with
+// every call sent through the one a LoadBalancer picks: the least loaded
+// of two random channels, skipping those that kept failing with
+// UNAVAILABLE or DEADLINE_EXCEEDED. Per-request balancing sees how busy
+// each replica is, which a TCP load balancer in front of them can't.
+//
+// A CircuitBreaker over all of them fails calls at once while the service
+// as a whole keeps failing or is too slow, instead of letting every caller
+// wait for its deadline.
+//
+//   GrpcChannelPool<transcoder::Transcoder> transcoders(
+//       "transcoders", "host1:50053,host2:50053");
+//   auto transcoder = transcoders.Pick(deadline, false, &context);
+//   RETURN_IF_ERROR(transcoder.status());
+//   grpc::Status status = transcoder->Transcode(&context, request, &response);
+//   transcoder.Done(status);
+//
+// Thread-safe.
+template <typename Service>
+class GrpcChannelPool {
+ public:
+  typedef typename Service::Stub Stub;
+
+  typedef GrpcChannelPoolOptions Options;
+
+  // A picked channel, returned to the balancer and the breaker by Done()
+  // or, as neither success nor failure, when it goes away without.
+  class Call {
+   public:
+    Call(Call&& other)
+        : pool_(other.pool_), channel_(other.channel_),
+          start_usec_(other.start_usec_), status_(other.status_) {
+      other.pool_ = nullptr;
+    }
+    ~Call() {
+      if (pool_ != nullptr) {
+        pool_->balancer_.Cancel(channel_);
+        pool_->breaker_.Cancel();
+      }
+    }
+
+    // UNAVAILABLE if the circuit breaker is open, or the deadline's error;
+    // the call must not be made then.
+    const base::Status& status() const { return status_; }
+
+    Stub* operator->() const { return pool_->stubs_[channel_].get(); }
+    Stub* get() const { return pool_->stubs_[channel_].get(); }
+
+    // For streaming calls, once Finish() has returned `status`.
+    void Done(const grpc::Status& status) {
+      if (pool_ == nullptr) {
+        return;
+      }
+      const bool healthy = IsHealthy(status);
+      pool_->balancer_.Done(channel_, healthy);
+      pool_->breaker_.Record(start_usec_, healthy);
+      pool_ = nullptr;
+    }
+
+   private:
+    friend class GrpcChannelPool;
+
+    Call(GrpcChannelPool* pool, size_t channel)
+        : pool_(pool), channel_(channel),
+          start_usec_(threading::TimeUtil::MonotonicTimeUsec()) {}
+    explicit Call(const base::Status& status)
+        : pool_(nullptr), channel_(0), start_usec_(0), status_(status) {}
+
+    GrpcChannelPool* pool_;
+    const size_t channel_;
+    const int64_t start_usec_;
+    const base::Status status_;
+
+    DISALLOW_COPY_AND_ASSIGN(Call);
+  };
+
+  // `addresses` as for ParseAddresses(); `name` labels the metrics.
+  GrpcChannelPool(const std::string& name, const std::string& addresses,
+                  const Options& options = Options())
+      : addresses_(ParseAddresses(addresses)),
+        channels_per_address_(std::max(options.channels_per_address, 1)),
+        channels_(CreateChannels(addresses_, channels_per_address_)),
+        balancer_(name, Labels(addresses_, channels_per_address_), options.balancer),
+        breaker_(name, options.breaker) {
+    for (const auto& channel : channels_) {
+      stubs_.push_back(Service::NewStub(channel));
+    }
+  }
+
+  Call Pick() {
+    if (!breaker_.Allow()) {
+      return Call(base::Status(base::Code::UNAVAILABLE,
+                               breaker_.name() + ": circuit open, try again later"));
+    }
+    return Call(this, balancer_.Pick());
+  }
+
+  // Sets the deadline of the call with `context` first; see SetDeadline().
+  Call Pick(const JobDeadline& deadline, bool unary, grpc::ClientContext* context) {
+    base::Status status = SetDeadline(deadline, unary, context);
+    if (!status.ok()) {
+      return Call(status);
+    }
+    return Pick();
+  }
+
+  // Errors the backend isn't answering with, rather than about the call.
+  static bool IsHealthy(const grpc::Status& status) {
+    return status.error_code() != grpc::StatusCode::UNAVAILABLE &&
+           status.error_code() != grpc::StatusCode::DEADLINE_EXCEEDED;
+  }
+
+  const std::vector<std::string>& addresses() const { return addresses_; }
+
+ private:
+  static std::vector<std::string> Labels(const std::vector<std::string>& addresses,
+                                         int channels_per_address) {
+    std::vector<std::string> labels;
+    for (const std::string& address : addresses) {
+      for (int i = 0; i < channels_per_address; ++i) {
+        labels.push_back(address + "#" + std::to_string(i));
+      }
+    }
+    return labels;
+  }
+
+  const std::vector<std::string> addresses_;
+  const int channels_per_address_;
+  const std::vector<std::shared_ptr<grpc::Channel>> channels_;
+  std::vector<std::unique_ptr<Stub>> stubs_;
+  LoadBalancer balancer_;
+  CircuitBreaker breaker_;
+
+  DISALLOW_COPY_AND_ASSIGN(GrpcChannelPool);
+};
+
+} // namespace server
+#endif // SERVICE_GRPC_CHANNEL_POOL_H_
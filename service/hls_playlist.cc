@@ -0,0 +1,78 @@
+#include "service/hls_playlist.h"
+#include "base/numbers.h"
+#include "base/string_printf.h"
+
+#include <math.h>
+
+namespace server {
+
+bool ParseBitRate(const std::string& rate_bit, int64_t* bits_per_second) {
+  if (rate_bit.empty()) {
+    return false;
+  }
+  double scale = 1;
+  std::string number = rate_bit;
+  switch (number.back()) {
+    case 'k':
+    case 'K':
+      scale = 1e3;
+      number.pop_back();
+      break;
+    case 'm':
+    case 'M':
+      scale = 1e6;
+      number.pop_back();
+      break;
+  }
+  double value;
+  if (number.empty() || !base::safe_strtod(number, &value) ||
+      !(value > 0) || value * scale >= 1e15) {
+    return false;
+  }
+  *bits_per_second = static_cast<int64_t>(llround(value * scale));
+  return true;
+}
+
+namespace {
+
+bool ParseResolution(const std::string& frame_size, int* width, int* height) {
+  size_t x = frame_size.find('x');
+  if (x == std::string::npos) {
+    return false;
+  }
+  int32_t w, h;
+  if (!base::safe_strto32(frame_size.substr(0, x), &w) ||
+      !base::safe_strto32(frame_size.substr(x + 1), &h) || w <= 0 || h <= 0) {
+    return false;
+  }
+  *width = w;
+  *height = h;
+  return true;
+}
+
+} // namespace
+
+base::Status MasterPlaylist(const std::vector<TranscodeRendition>& renditions,
+                            const std::string& m3u8_name,
+                            std::string* playlist) {
+  playlist->assign("#EXTM3U\n");
+  for (const TranscodeRendition& rendition : renditions) {
+    int64_t bandwidth;
+    if (!ParseBitRate(rendition.rate_bit, &bandwidth)) {
+      return base::Status(base::Code::INVALID_ARGUMENT,
+                          "rendition " + rendition.name + ": bad rate_bit " +
+                          rendition.rate_bit);
+    }
+    base::StringAppendF(playlist, "#EXT-X-STREAM-INF:BANDWIDTH=%lld",
+                        static_cast<long long>(bandwidth));
+    int width, height;
+    if (ParseResolution(rendition.frame_size, &width, &height)) {
+      base::StringAppendF(playlist, ",RESOLUTION=%dx%d", width, height);
+    }
+    playlist->append("\n");
+    playlist->append(rendition.name).append("/").append(m3u8_name).append("\n");
+  }
+  return base::Status::OK();
+}
+
+} // namespace server
@@ -0,0 +1,27 @@
+#ifndef SERVICE_HLS_PLAYLIST_H_
+#define SERVICE_HLS_PLAYLIST_H_
+#include "base/status.h"
+#include "service/job_decoder.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace server {
+
+// An ffmpeg style bit rate, e.g. "800k", "2.5M" or "96000", in bits per
+// second.
+bool ParseBitRate(const std::string& rate_bit, int64_t* bits_per_second);
+
+// The HLS master playlist of a rendition ladder: one variant stream per
+// rendition, its media playlist at "<name>/<m3u8_name>" relative to the
+// master. BANDWIDTH is the rendition's rate_bit and RESOLUTION its
+// frame_size when that is "<width>x<height>". INVALID_ARGUMENT for a
+// rate_bit that doesn't parse, which callers can check before transcoding.
+base::Status MasterPlaylist(const std::vector<TranscodeRendition>& renditions,
+                            const std::string& m3u8_name,
+                            std::string* playlist);
+
+} // namespace server
+#endif // SERVICE_HLS_PLAYLIST_H_
@@ -0,0 +1,38 @@
+#include "service/hls_playlist.h"
+
+#include <gtest/gtest.h>
+
+TEST(HlsPlaylistTest, Parses_Bit_Rates) {
+  int64_t bits = 0;
+  EXPECT_TRUE(server::ParseBitRate("800k", &bits));
+  EXPECT_EQ(800000, bits);
+  EXPECT_TRUE(server::ParseBitRate("2.5M", &bits));
+  EXPECT_EQ(2500000, bits);
+  EXPECT_TRUE(server::ParseBitRate("96000", &bits));
+  EXPECT_EQ(96000, bits);
+  for (const char* bad : {"", "k", "-1k", "0", "800kb", "fast"}) {
+    EXPECT_FALSE(server::ParseBitRate(bad, &bits)) << bad;
+  }
+}
+
+TEST(HlsPlaylistTest, Lists_Every_Rendition) {
+  std::vector<server::TranscodeRendition> renditions(2);
+  renditions[0].name = "360p";
+  renditions[0].frame_size = "640x360";
+  renditions[0].rate_bit = "800k";
+  renditions[1].name = "720p";
+  renditions[1].frame_size = "hd720";
+  renditions[1].rate_bit = "2800k";
+  std::string playlist;
+  ASSERT_TRUE(server::MasterPlaylist(renditions, "my.m3u8", &playlist).ok());
+  EXPECT_EQ("#EXTM3U\n"
+            "#EXT-X-STREAM-INF:BANDWIDTH=800000,RESOLUTION=640x360\n"
+            "360p/my.m3u8\n"
+            "#EXT-X-STREAM-INF:BANDWIDTH=2800000\n"
+            "720p/my.m3u8\n", playlist);
+
+  renditions[1].rate_bit = "high";
+  base::Status status = server::MasterPlaylist(renditions, "my.m3u8", &playlist);
+  EXPECT_EQ(base::Code::INVALID_ARGUMENT, status.code());
+  EXPECT_EQ("rendition 720p: bad rate_bit high", status.error_message());
+}
@@ -0,0 +1,30 @@
+#include "service/job_deadline.h"
+#include "base/string_printf.h"
+#include "threading/time_util.h"
+
+#include <algorithm>
+
+namespace server {
+
+JobDeadline::JobDeadline(const DeadlineOptions& options)
+  : options_(options),
+    deadline_usec_(options.job_budget_ms > 0
+                   ? threading::TimeUtil::MonotonicTimeUsec() + options.job_budget_ms * 1000
+                   : 0) {}
+
+base::Status JobDeadline::RpcTimeoutUsec(bool unary, int64_t* timeout_usec) const {
+  *timeout_usec = unary && options_.rpc_timeout_ms > 0 ? options_.rpc_timeout_ms * 1000 : -1;
+  if (deadline_usec_ == 0) {
+    return base::Status::OK();
+  }
+  const int64_t left = deadline_usec_ - threading::TimeUtil::MonotonicTimeUsec();
+  if (left <= 0) {
+    return base::Status(base::Code::DEADLINE_EXCEEDED,
+                        base::StringPrintf("job budget of %lld ms spent",
+                                           static_cast<long long>(options_.job_budget_ms)));
+  }
+  *timeout_usec = *timeout_usec < 0 ? left : std::min(*timeout_usec, left);
+  return base::Status::OK();
+}
+
+} // namespace server
@@ -0,0 +1,42 @@
+#ifndef SERVICE_JOB_DEADLINE_H_
+#define SERVICE_JOB_DEADLINE_H_
+#include "base/status.h"
+
+#include <stdint.h>
+
+namespace server {
+
+struct DeadlineOptions {
+  DeadlineOptions() : job_budget_ms(0), rpc_timeout_ms(0) {}
+
+  // All of a job's RPCs together, 0 = unlimited.
+  int64_t job_budget_ms;
+  // Each unary RPC, 0 = the rest of the job's budget.
+  int64_t rpc_timeout_ms;
+};
+
+// The time left for a job's downstream RPCs, started when the job is. The
+// deadline of each RPC is the earlier of the job's and its own timeout, so
+// a hung backend fails the job within its budget rather than holding the
+// consumer thread.
+//
+//   JobDeadline deadline(options);
+//   grpc::ClientContext context;
+//   RETURN_IF_ERROR(SetDeadline(deadline, true, &context));
+//
+// (see SetDeadline() in service/grpc_channel_pool.h)
+class JobDeadline {
+ public:
+  explicit JobDeadline(const DeadlineOptions& options);
+
+  // Microseconds an RPC may take, limited to rpc_timeout_ms if `unary`;
+  // -1 if unlimited. DEADLINE_EXCEEDED once the job's budget is spent.
+  base::Status RpcTimeoutUsec(bool unary, int64_t* timeout_usec) const;
+
+ private:
+  const DeadlineOptions options_;
+  const int64_t deadline_usec_;  // 0 = none
+};
+
+} // namespace server
+#endif // SERVICE_JOB_DEADLINE_H_
@@ -0,0 +1,34 @@
+#include "service/job_deadline.h"
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+TEST(JobDeadlineTest, Rpc_Timeouts_Stay_Within_The_Job_Budget) {
+  int64_t timeout;
+  server::JobDeadline unlimited{server::DeadlineOptions()};
+  ASSERT_TRUE(unlimited.RpcTimeoutUsec(true, &timeout).ok());
+  EXPECT_EQ(-1, timeout);
+
+  server::DeadlineOptions options;
+  options.rpc_timeout_ms = 10;
+  server::JobDeadline per_rpc(options);
+  ASSERT_TRUE(per_rpc.RpcTimeoutUsec(true, &timeout).ok());
+  EXPECT_EQ(10000, timeout);
+  ASSERT_TRUE(per_rpc.RpcTimeoutUsec(false, &timeout).ok());
+  EXPECT_EQ(-1, timeout);
+
+  options.job_budget_ms = 30;
+  server::JobDeadline budget(options);
+  ASSERT_TRUE(budget.RpcTimeoutUsec(true, &timeout).ok());
+  EXPECT_EQ(10000, timeout);
+  ASSERT_TRUE(budget.RpcTimeoutUsec(false, &timeout).ok());
+  EXPECT_GT(timeout, 20000);
+  EXPECT_LE(timeout, 30000);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(25));
+  ASSERT_TRUE(budget.RpcTimeoutUsec(true, &timeout).ok());
+  EXPECT_LE(timeout, 5000);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(base::Code::DEADLINE_EXCEEDED, budget.RpcTimeoutUsec(true, &timeout).code());
+}
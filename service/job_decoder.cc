@@ -0,0 +1,548 @@
+#include "service/job_decoder.h"
+#include "base/macros.h"
+#include "base/numbers.h"
+#include "base/string_piece.h"
+#include "base/string_printf.h"
+#include "base/string_util.h"
+#include "protos/mq_jobs.pb.h"
+#include "threading/thread_local_cache.h"
+
+#include "third_party/rapidjson/include/rapidjson/allocators.h"
+#include "third_party/rapidjson/include/rapidjson/error/en.h"
+#include "third_party/rapidjson/include/rapidjson/reader.h"
+
+#include <string.h>
+
+#include <inttypes.h>
+
+#include <limits>
+#include <vector>
+
+namespace server {
+
+const char kJsonContentType[] = "application/json";
+const char kProtobufContentType[] = "application/x-protobuf";
+
+namespace {
+
+// One top-level field of a job. Exactly one of `text`, `integer` and
+// `renditions` is set.
+struct Field {
+  Field(const char* name, std::string* text, bool required = true)
+      : name(name), text(text), integer(nullptr), renditions(nullptr),
+        required(required), seen(false) {}
+  Field(const char* name, int64_t* integer)
+      : name(name), text(nullptr), integer(integer), renditions(nullptr),
+        required(true), seen(false) {}
+  Field(const char* name, std::vector<TranscodeRendition>* renditions)
+      : name(name), text(nullptr), integer(nullptr), renditions(renditions),
+        required(false), seen(false) {}
+
+  const char* name;
+  std::string* text;
+  int64_t* integer;
+  std::vector<TranscodeRendition>* renditions;
+  bool required;
+  bool seen;
+};
+
+// SAX handler storing the top-level members of the root object into the
+// matching fields. Returning false stops the reader; error() says why.
+class FieldHandler
+    : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, FieldHandler> {
+ public:
+  FieldHandler(Field* fields, size_t count)
+      : fields_(fields), count_(count), current_(nullptr), depth_(0),
+        in_renditions_(false), rendition_field_(nullptr) {}
+
+  const std::string& error() const { return error_; }
+
+  // Every value type not handled below.
+  bool Default() { return Value(nullptr, 0, false); }
+
+  bool Int(int i) { return Integer(i); }
+  bool Uint(unsigned u) { return Integer(u); }
+  bool Int64(int64_t i) { return Integer(i); }
+  bool Uint64(uint64_t u) {
+    if (u > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+      return Value(nullptr, 0, false);
+    }
+    return Integer(static_cast<int64_t>(u));
+  }
+
+  bool String(const char* str, rapidjson::SizeType length, bool /* copy */) {
+    return Value(str, length, true);
+  }
+
+  bool StartObject() {
+    if (depth_ == 0) {
+      ++depth_;
+      return true;
+    }
+    if (in_renditions_ && depth_ == 2) {
+      current_->renditions->emplace_back();
+      rendition_field_ = nullptr;
+      ++depth_;
+      return true;
+    }
+    return Nested();
+  }
+
+  bool Key(const char* str, rapidjson::SizeType length, bool /* copy */) {
+    if (depth_ == 1) {
+      current_ = Find(base::StringPiece(str, length));
+    } else if (in_renditions_ && depth_ == 3) {
+      rendition_field_ = FindRenditionField(base::StringPiece(str, length));
+    }
+    return true;
+  }
+
+  bool EndObject(rapidjson::SizeType /* count */) {
+    --depth_;
+    return true;
+  }
+
+  bool StartArray() {
+    if (depth_ == 1 && current_ && current_->renditions) {
+      current_->renditions->clear();
+      current_->seen = true;
+      in_renditions_ = true;
+      ++depth_;
+      return true;
+    }
+    return Nested();
+  }
+
+  bool EndArray(rapidjson::SizeType /* count */) {
+    if (in_renditions_ && depth_ == 2) {
+      in_renditions_ = false;
+    }
+    --depth_;
+    return true;
+  }
+
+ private:
+  Field* Find(const base::StringPiece& name) {
+    for (size_t i = 0; i < count_; ++i) {
+      if (name == fields_[i].name) {
+        return &fields_[i];
+      }
+    }
+    return nullptr;
+  }
+
+  // Members of a rendition object.
+  std::string* FindRenditionField(const base::StringPiece& name) {
+    TranscodeRendition& rendition = current_->renditions->back();
+    if (name == "name") {
+      return &rendition.name;
+    }
+    if (name == "frame_size") {
+      return &rendition.frame_size;
+    }
+    if (name == "rate_bit") {
+      return &rendition.rate_bit;
+    }
+    return nullptr;
+  }
+
+  bool Nested() {
+    if (depth_ == 0) {
+      error_ = "expected a JSON object";
+      return false;
+    }
+    if (depth_ == 1 && current_) {
+      return Invalid();
+    }
+    if (in_renditions_ && (depth_ == 2 || (depth_ == 3 && rendition_field_))) {
+      return Invalid();
+    }
+    ++depth_;
+    return true;
+  }
+
+  bool Integer(int64_t value) {
+    if (depth_ != 1 || !current_) {
+      return Value(nullptr, 0, false);
+    }
+    if (!current_->integer) {
+      return Invalid();
+    }
+    *current_->integer = value;
+    current_->seen = true;
+    return true;
+  }
+
+  // A scalar; `str` is set for strings.
+  bool Value(const char* str, size_t length, bool is_string) {
+    if (depth_ == 0) {
+      error_ = "expected a JSON object";
+      return false;
+    }
+    if (in_renditions_ && depth_ == 2) {
+      return Invalid();
+    }
+    if (in_renditions_ && depth_ == 3 && rendition_field_) {
+      if (!is_string) {
+        return Invalid();
+      }
+      rendition_field_->assign(str, length);
+      return true;
+    }
+    if (depth_ > 1 || !current_) {
+      return true;
+    }
+    if (!is_string || current_->renditions) {
+      return Invalid();
+    }
+    if (current_->text) {
+      current_->text->assign(str, length);
+    } else if (!base::safe_strto64(base::StringPiece(str, length), current_->integer)) {
+      return Invalid();
+    }
+    current_->seen = true;
+    return true;
+  }
+
+  bool Invalid() {
+    error_ = base::StringPrintf("field %s must be %s", current_->name,
+                                current_->text ? "a string" :
+                                current_->integer ? "an integer" :
+                                "an array of objects of strings");
+    return false;
+  }
+
+  Field* const fields_;
+  const size_t count_;
+  Field* current_;
+  int depth_;
+  // Inside the array of a `renditions` field, which is current_.
+  bool in_renditions_;
+  std::string* rendition_field_;
+  std::string error_;
+
+  DISALLOW_COPY_AND_ASSIGN(FieldHandler);
+};
+
+typedef rapidjson::GenericReader<rapidjson::UTF8<>, rapidjson::UTF8<>,
+                                 rapidjson::MemoryPoolAllocator<> > PooledReader;
+
+// Per-thread parse state, reused across messages: the in-situ copy of the
+// payload keeps its capacity and the reader's stack is carved out of
+// `stack_chunk`.
+struct DecodeContext {
+  DecodeContext()
+      : allocator(stack_chunk, sizeof(stack_chunk)),
+        reader(&allocator) {}
+
+  std::vector<char> text;
+  uint64_t stack_chunk[128];
+  rapidjson::MemoryPoolAllocator<> allocator;
+  PooledReader reader;
+};
+
+thread_local DecodeContext decode_context;
+
+base::Status Decode(const std::string& message, Field* fields, size_t count) {
+  DecodeContext& context = decode_context;
+  context.text.resize(message.size() + 1);
+  ::memcpy(context.text.data(), message.data(), message.size());
+  context.text[message.size()] = '\0';
+
+  FieldHandler handler(fields, count);
+  rapidjson::InsituStringStream stream(context.text.data());
+  rapidjson::ParseResult result =
+      context.reader.Parse<rapidjson::kParseInsituFlag>(stream, handler);
+  if (!handler.error().empty()) {
+    return base::Status(base::Code::INVALID_ARGUMENT, handler.error());
+  }
+  if (result.IsError()) {
+    return base::Status(base::Code::INVALID_ARGUMENT,
+                        base::StringPrintf("Can't parse json at offset %zu: %s",
+                                           result.Offset(),
+                                           rapidjson::GetParseError_En(result.Code())));
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (fields[i].seen) {
+      continue;
+    }
+    if (fields[i].required) {
+      return base::Status(base::Code::INVALID_ARGUMENT,
+                          std::string("missing field ") + fields[i].name);
+    }
+    // Left over from the job the struct was last used for.
+    if (fields[i].text) {
+      fields[i].text->clear();
+    } else if (fields[i].renditions) {
+      fields[i].renditions->clear();
+    }
+  }
+  return base::Status::OK();
+}
+
+enum Format { JSON, PROTOBUF, UNKNOWN };
+
+Format FormatOf(const std::string& content_type) {
+  base::StringPiece media_type(content_type);
+  size_t semicolon = media_type.find(';');
+  if (semicolon != base::StringPiece::npos) {
+    media_type = media_type.substr(0, semicolon);
+  }
+  base::StringPiece type = base::TrimString(media_type, " \t", base::TRIM_ALL);
+  if (type.empty() || base::LowerCaseEqualsASCII(type, kJsonContentType)) {
+    return JSON;
+  }
+  if (base::LowerCaseEqualsASCII(type, kProtobufContentType) ||
+      base::LowerCaseEqualsASCII(type, "application/protobuf")) {
+    return PROTOBUF;
+  }
+  return UNKNOWN;
+}
+
+base::Status UnsupportedContentType(const std::string& content_type) {
+  return base::Status(base::Code::INVALID_ARGUMENT,
+                      "unsupported content type " + content_type);
+}
+
+// Parsed messages are reused per thread; Clear() keeps their strings.
+threading::ThreadLocalObjectCache<
+    jobs::EpubInfoJob, threading::ClearObjectReset<jobs::EpubInfoJob> > epub_info_cache;
+threading::ThreadLocalObjectCache<
+    jobs::TranscodeJob, threading::ClearObjectReset<jobs::TranscodeJob> > transcode_cache;
+
+// Moves a required string out of the parsed message; the job's old
+// buffer goes back with the message to be reused.
+bool TakeString(const char* name, std::string* from, std::string* to, std::string* missing) {
+  if (from->empty()) {
+    if (missing->empty()) {
+      missing->assign(name);
+    }
+    return false;
+  }
+  to->swap(*from);
+  return true;
+}
+
+base::Status MissingField(const std::string& name) {
+  return base::Status(base::Code::INVALID_ARGUMENT, "missing field " + name);
+}
+
+// The video fields a transcode job needs either at the top level or in
+// every rendition.
+base::Status CheckRenditions(const TranscodeJob& job) {
+  if (job.renditions.empty()) {
+    if (job.frame_size.empty()) {
+      return MissingField("frame_size");
+    }
+    if (job.rate_bit.empty()) {
+      return MissingField("rate_bit");
+    }
+    return base::Status::OK();
+  }
+  for (size_t i = 0; i < job.renditions.size(); ++i) {
+    const TranscodeRendition& rendition = job.renditions[i];
+    if (rendition.name.empty()) {
+      return MissingField("renditions.name");
+    }
+    if (rendition.frame_size.empty()) {
+      return MissingField("renditions.frame_size");
+    }
+    if (rendition.rate_bit.empty()) {
+      return MissingField("renditions.rate_bit");
+    }
+    if (rendition.name == "." || rendition.name == ".." ||
+        rendition.name.find('/') != std::string::npos) {
+      return base::Status(base::Code::INVALID_ARGUMENT,
+                          "rendition name " + rendition.name + " is not a directory name");
+    }
+    for (size_t j = 0; j < i; ++j) {
+      if (job.renditions[j].name == rendition.name) {
+        return base::Status(base::Code::INVALID_ARGUMENT,
+                            "duplicate rendition " + rendition.name);
+      }
+    }
+  }
+  return base::Status::OK();
+}
+
+base::Status DecodeProtobuf(const std::string& message, EpubInfoJob* job) {
+  auto pb = epub_info_cache.Acquire();
+  if (!pb->ParseFromString(message)) {
+    return base::Status(base::Code::INVALID_ARGUMENT, "Can't parse protobuf jobs.EpubInfoJob");
+  }
+  if (pb->book_id() == 0) {
+    return MissingField("book_id");
+  }
+  std::string missing;
+  TakeString("book_path", pb->mutable_book_path(), &job->book_path, &missing);
+  if (!missing.empty()) {
+    return MissingField(missing);
+  }
+  job->book_id = pb->book_id();
+  return base::Status::OK();
+}
+
+base::Status DecodeProtobuf(const std::string& message, TranscodeJob* job) {
+  auto pb = transcode_cache.Acquire();
+  if (!pb->ParseFromString(message)) {
+    return base::Status(base::Code::INVALID_ARGUMENT, "Can't parse protobuf jobs.TranscodeJob");
+  }
+  std::string missing;
+  TakeString("video_source_path", pb->mutable_video_source_path(),
+             &job->video_source_path, &missing);
+  TakeString("video_target_path", pb->mutable_video_target_path(),
+             &job->video_target_path, &missing);
+  if (pb->target_id() == 0 && missing.empty()) {
+    missing = "target_id";
+  }
+  TakeString("sample", pb->mutable_sample(), &job->sample, &missing);
+  // Checked with the renditions, which make them optional.
+  job->frame_size.clear();
+  job->rate_bit.clear();
+  pb->mutable_frame_size()->swap(job->frame_size);
+  pb->mutable_rate_bit()->swap(job->rate_bit);
+  TakeString("frame_aspect", pb->mutable_frame_aspect(), &job->frame_aspect, &missing);
+  TakeString("frame_rate", pb->mutable_frame_rate(), &job->frame_rate, &missing);
+  TakeString("time", pb->mutable_time(), &job->time, &missing);
+  TakeString("url_prefix", pb->mutable_url_prefix(), &job->url_prefix, &missing);
+  TakeString("m3u8_name", pb->mutable_m3u8_name(), &job->m3u8_name, &missing);
+  if (!missing.empty()) {
+    return MissingField(missing);
+  }
+  job->target_id = pb->target_id();
+  job->renditions.resize(pb->renditions_size());
+  for (int i = 0; i < pb->renditions_size(); ++i) {
+    jobs::TranscodeJob::Rendition* from = pb->mutable_renditions(i);
+    TranscodeRendition& to = job->renditions[i];
+    to.name.swap(*from->mutable_name());
+    to.frame_size.swap(*from->mutable_frame_size());
+    to.rate_bit.swap(*from->mutable_rate_bit());
+  }
+  return CheckRenditions(*job);
+}
+
+// 64-bit FNV-1a; the key must not change between builds, which rules out
+// std::hash.
+class KeyHash {
+ public:
+  KeyHash() : hash_(UINT64_C(14695981039346656037)) {}
+
+  // Each field ends with a NUL so "ab","c" and "a","bc" differ.
+  void Add(const std::string& field) {
+    for (size_t i = 0; i <= field.size(); ++i) {
+      hash_ ^= static_cast<unsigned char>(field.c_str()[i]);
+      hash_ *= UINT64_C(1099511628211);
+    }
+  }
+
+  uint64_t value() const { return hash_; }
+
+ private:
+  uint64_t hash_;
+};
+
+} // namespace
+
+base::Status DecodeEpubInfoJob(const std::string& message, EpubInfoJob* job) {
+  Field fields[] = {
+    Field("book_id", &job->book_id),
+    Field("book_path", &job->book_path),
+  };
+  return Decode(message, fields, arraysize(fields));
+}
+
+base::Status DecodeTranscodeJob(const std::string& message, TranscodeJob* job) {
+  Field fields[] = {
+    Field("video_source_path", &job->video_source_path),
+    Field("video_target_path", &job->video_target_path),
+    Field("target_id", &job->target_id),
+    Field("sample", &job->sample),
+    Field("frame_size", &job->frame_size, false),
+    Field("frame_aspect", &job->frame_aspect),
+    Field("frame_rate", &job->frame_rate),
+    Field("rate_bit", &job->rate_bit, false),
+    Field("time", &job->time),
+    Field("url_prefix", &job->url_prefix),
+    Field("m3u8_name", &job->m3u8_name),
+    Field("renditions", &job->renditions),
+  };
+  RETURN_IF_ERROR(Decode(message, fields, arraysize(fields)));
+  return CheckRenditions(*job);
+}
+
+base::Status DecodeEpubInfoJob(const std::string& content_type,
+                               const std::string& message, EpubInfoJob* job) {
+  switch (FormatOf(content_type)) {
+    case JSON: return DecodeEpubInfoJob(message, job);
+    case PROTOBUF: return DecodeProtobuf(message, job);
+    case UNKNOWN: break;
+  }
+  return UnsupportedContentType(content_type);
+}
+
+base::Status DecodeTranscodeJob(const std::string& content_type,
+                                const std::string& message, TranscodeJob* job) {
+  switch (FormatOf(content_type)) {
+    case JSON: return DecodeTranscodeJob(message, job);
+    case PROTOBUF: return DecodeProtobuf(message, job);
+    case UNKNOWN: break;
+  }
+  return UnsupportedContentType(content_type);
+}
+
+void EncodeEpubInfoJob(const EpubInfoJob& job, std::string* message) {
+  auto pb = epub_info_cache.Acquire();
+  pb->set_book_id(job.book_id);
+  pb->set_book_path(job.book_path);
+  pb->SerializeToString(message);
+}
+
+void EncodeTranscodeJob(const TranscodeJob& job, std::string* message) {
+  auto pb = transcode_cache.Acquire();
+  pb->set_video_source_path(job.video_source_path);
+  pb->set_video_target_path(job.video_target_path);
+  pb->set_target_id(job.target_id);
+  pb->set_sample(job.sample);
+  pb->set_frame_size(job.frame_size);
+  pb->set_frame_aspect(job.frame_aspect);
+  pb->set_frame_rate(job.frame_rate);
+  pb->set_rate_bit(job.rate_bit);
+  pb->set_time(job.time);
+  pb->set_url_prefix(job.url_prefix);
+  pb->set_m3u8_name(job.m3u8_name);
+  for (const TranscodeRendition& rendition : job.renditions) {
+    jobs::TranscodeJob::Rendition* to = pb->add_renditions();
+    to->set_name(rendition.name);
+    to->set_frame_size(rendition.frame_size);
+    to->set_rate_bit(rendition.rate_bit);
+  }
+  pb->SerializeToString(message);
+}
+
+std::string EpubInfoJobKey(const EpubInfoJob& job) {
+  KeyHash hash;
+  hash.Add(job.book_path);
+  return base::StringPrintf("epub_info:%" PRId64 ":%016" PRIx64, job.book_id, hash.value());
+}
+
+std::string TranscodeJobKey(const TranscodeJob& job) {
+  KeyHash hash;
+  hash.Add(job.video_source_path);
+  hash.Add(job.video_target_path);
+  hash.Add(job.sample);
+  hash.Add(job.frame_size);
+  hash.Add(job.frame_aspect);
+  hash.Add(job.frame_rate);
+  hash.Add(job.rate_bit);
+  hash.Add(job.time);
+  hash.Add(job.url_prefix);
+  hash.Add(job.m3u8_name);
+  for (const TranscodeRendition& rendition : job.renditions) {
+    hash.Add(rendition.name);
+    hash.Add(rendition.frame_size);
+    hash.Add(rendition.rate_bit);
+  }
+  return base::StringPrintf("transcode:%" PRId64 ":%016" PRIx64, job.target_id, hash.value());
+}
+
+} // namespace server
@@ -0,0 +1,96 @@
+#ifndef SERVICE_JOB_DECODER_H_
+#define SERVICE_JOB_DECODER_H_
+#include "base/status.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace server {
+
+// The jobs published to the service queues, decoded into typed structs.
+// Producers send either JSON or the protobuf messages of
+// protos/mq_jobs.proto, and say which in the content type. A missing
+// field, a field of the wrong type or a malformed payload is an
+// INVALID_ARGUMENT error naming the field.
+//
+// JSON: unknown fields are ignored and integer ids may be sent as JSON
+// numbers or decimal strings. The payload is copied once into a
+// thread-local buffer and parsed in place with the SAX reader, so a warm
+// thread decodes without allocating beyond the job's own strings, which
+// keep their capacity when a job object is reused.
+//
+// Protobuf: proto3 can't tell an unset field from an empty one, so empty
+// strings and zero ids count as missing.
+
+// epub_info_queue:
+//   {"book_id": "1000001", "book_path": "/tmp/1000001.epub"}
+struct EpubInfoJob {
+  EpubInfoJob() : book_id(0) {}
+
+  int64_t book_id;
+  std::string book_path;
+};
+
+// One variant of a multi-rendition transcode job.
+struct TranscodeRendition {
+  std::string name;        // subdirectory and playlist entry, e.g. "hd"
+  std::string frame_size;  // e.g. "1280x720"
+  std::string rate_bit;    // e.g. "3000k"
+};
+
+// video_rpc_queue. All fields are required, except that `renditions`, if
+// given, replaces `frame_size` and `rate_bit`: the source is then decoded
+// once into every rendition, each encoded into a subdirectory of its own
+// under a master playlist. In JSON:
+//
+//   "renditions": [{"name": "ld", "frame_size": "640x360", "rate_bit": "800k"},
+//                  {"name": "hd", "frame_size": "1280x720", "rate_bit": "3000k"}]
+//
+// Rendition names must be distinct and usable as a directory name.
+struct TranscodeJob {
+  TranscodeJob() : target_id(0) {}
+
+  std::string video_source_path;
+  std::string video_target_path;
+  int64_t target_id;
+  std::string sample;
+  std::string frame_size;
+  std::string frame_aspect;
+  std::string frame_rate;
+  std::string rate_bit;
+  std::string time;
+  std::string url_prefix;
+  std::string m3u8_name;
+  std::vector<TranscodeRendition> renditions;
+};
+
+// Content types of the job payloads. Deliveries without one are JSON.
+extern const char kJsonContentType[];      // application/json
+extern const char kProtobufContentType[];  // application/x-protobuf
+
+// JSON payloads.
+base::Status DecodeEpubInfoJob(const std::string& message, EpubInfoJob* job);
+base::Status DecodeTranscodeJob(const std::string& message, TranscodeJob* job);
+
+// Payloads in the format named by `content_type`, parameters such as
+// "; charset=utf-8" aside. Other content types are INVALID_ARGUMENT.
+base::Status DecodeEpubInfoJob(const std::string& content_type,
+                               const std::string& message, EpubInfoJob* job);
+base::Status DecodeTranscodeJob(const std::string& content_type,
+                                const std::string& message, TranscodeJob* job);
+
+// The protobuf encoding of a job, for producers.
+void EncodeEpubInfoJob(const EpubInfoJob& job, std::string* message);
+void EncodeTranscodeJob(const TranscodeJob& job, std::string* message);
+
+// The identity of a job, whatever its wire format: equal for jobs that
+// would do the same work, e.g. "transcode:1000001:9f86d081884c7d65". A
+// transcode job is identified by its target id and a hash of its paths and
+// encoding parameters.
+std::string EpubInfoJobKey(const EpubInfoJob& job);
+std::string TranscodeJobKey(const TranscodeJob& job);
+
+} // namespace server
+#endif // SERVICE_JOB_DECODER_H_
@@ -0,0 +1,223 @@
+#include "service/job_decoder.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+const char kTranscodeMessage[] =
+    "{\"video_source_path\":\"/data/note/1/orig/isli_video_1.mp4\","
+    "\"video_target_path\":\"/data/note/1/ld/orig/\","
+    "\"target_id\":\"1000001\",\"sample\":\"48000\",\"frame_size\":\"320x240\","
+    "\"frame_aspect\":\"4:3\",\"frame_rate\":\"25\",\"rate_bit\":\"350k\",\"time\":\"10\","
+    "\"url_prefix\":\"http://172.16.2.103/data/note/1/ld/orig/\","
+    "\"m3u8_name\":\"my.m3u8\"}";
+
+const char kLadderMessage[] =
+    "{\"video_source_path\":\"/data/note/1/orig/isli_video_1.mp4\","
+    "\"video_target_path\":\"/data/note/1/abr/orig/\","
+    "\"target_id\":1000001,\"sample\":\"48000\","
+    "\"frame_aspect\":\"16:9\",\"frame_rate\":\"25\",\"time\":\"10\","
+    "\"url_prefix\":\"http://172.16.2.103/data/note/1/abr/orig/\","
+    "\"renditions\":[{\"name\":\"360p\",\"frame_size\":\"640x360\",\"rate_bit\":\"800k\"},"
+    "{\"name\":\"720p\",\"frame_size\":\"1280x720\",\"rate_bit\":\"2800k\","
+    "\"comment\":[1]}],"
+    "\"m3u8_name\":\"my.m3u8\"}";
+
+} // namespace
+
+TEST(JobDecoderTest, Decodes_Epub_Info_Job) {
+  server::EpubInfoJob job;
+  ASSERT_TRUE(server::DecodeEpubInfoJob(
+      "{\"book_id\":\"1000001\", \"book_path\":\"/tmp/1000001.epub\"}", &job).ok());
+  EXPECT_EQ(1000001, job.book_id);
+  EXPECT_EQ("/tmp/1000001.epub", job.book_path);
+
+  // Numeric ids, escapes and unknown members, nested ones included.
+  ASSERT_TRUE(server::DecodeEpubInfoJob(
+      "{\"trace\":{\"ids\":[1,{\"book_id\":\"x\"}]}, \"book_id\":9000000000,"
+      " \"book_path\":\"/tmp/a \\\"b\\\".epub\", \"retry\":null}", &job).ok());
+  EXPECT_EQ(9000000000, job.book_id);
+  EXPECT_EQ("/tmp/a \"b\".epub", job.book_path);
+}
+
+TEST(JobDecoderTest, Decodes_Transcode_Job) {
+  server::TranscodeJob job;
+  ASSERT_TRUE(server::DecodeTranscodeJob(kTranscodeMessage, &job).ok());
+  EXPECT_EQ("/data/note/1/orig/isli_video_1.mp4", job.video_source_path);
+  EXPECT_EQ("/data/note/1/ld/orig/", job.video_target_path);
+  EXPECT_EQ(1000001, job.target_id);
+  EXPECT_EQ("48000", job.sample);
+  EXPECT_EQ("320x240", job.frame_size);
+  EXPECT_EQ("4:3", job.frame_aspect);
+  EXPECT_EQ("25", job.frame_rate);
+  EXPECT_EQ("350k", job.rate_bit);
+  EXPECT_EQ("10", job.time);
+  EXPECT_EQ("http://172.16.2.103/data/note/1/ld/orig/", job.url_prefix);
+  EXPECT_EQ("my.m3u8", job.m3u8_name);
+}
+
+TEST(JobDecoderTest, Rejects_Invalid_Jobs) {
+  server::EpubInfoJob job;
+  struct {
+    const char* message;
+    const char* error;
+  } cases[] = {
+    { "{\"book_path\":\"/tmp/1.epub\"}", "missing field book_id" },
+    { "{\"book_id\":\"1\"}", "missing field book_path" },
+    { "{\"book_id\":\"1x\", \"book_path\":\"/tmp/1.epub\"}", "field book_id must be an integer" },
+    { "{\"book_id\":1.5, \"book_path\":\"/tmp/1.epub\"}", "field book_id must be an integer" },
+    { "{\"book_id\":1, \"book_path\":7}", "field book_path must be a string" },
+    { "{\"book_id\":1, \"book_path\":[\"/tmp/1.epub\"]}", "field book_path must be a string" },
+    { "{\"book_id\":1, \"book_path\":null}", "field book_path must be a string" },
+    { "[{\"book_id\":1, \"book_path\":\"/tmp/1.epub\"}]", "expected a JSON object" },
+    { "\"book_id\"", "expected a JSON object" },
+  };
+  for (const auto& c : cases) {
+    base::Status status = server::DecodeEpubInfoJob(c.message, &job);
+    EXPECT_EQ(base::Code::INVALID_ARGUMENT, status.code()) << c.message;
+    EXPECT_EQ(c.error, status.error_message()) << c.message;
+  }
+
+  const char* malformed[] = {
+    "",
+    "{\"book_id\":1, \"book_path\":\"/tmp/1.epub\"",
+    "{\"book_id\":1, \"book_path\":\"/tmp/1.epub\"} {}",
+  };
+  for (const char* message : malformed) {
+    base::Status status = server::DecodeEpubInfoJob(message, &job);
+    EXPECT_EQ(base::Code::INVALID_ARGUMENT, status.code()) << message;
+    EXPECT_EQ(0u, status.error_message().find("Can't parse json")) << message;
+  }
+}
+
+TEST(JobDecoderTest, Decodes_Renditions) {
+  server::TranscodeJob job;
+  ASSERT_TRUE(server::DecodeTranscodeJob(kTranscodeMessage, &job).ok());
+  EXPECT_TRUE(job.renditions.empty());
+
+  ASSERT_TRUE(server::DecodeTranscodeJob(kLadderMessage, &job).ok());
+  // Not in the ladder message; not left over from the first one either.
+  EXPECT_EQ("", job.frame_size);
+  EXPECT_EQ("", job.rate_bit);
+  EXPECT_EQ("my.m3u8", job.m3u8_name);
+  ASSERT_EQ(2u, job.renditions.size());
+  EXPECT_EQ("360p", job.renditions[0].name);
+  EXPECT_EQ("640x360", job.renditions[0].frame_size);
+  EXPECT_EQ("800k", job.renditions[0].rate_bit);
+  EXPECT_EQ("720p", job.renditions[1].name);
+  EXPECT_EQ("2800k", job.renditions[1].rate_bit);
+
+  std::string encoded;
+  server::EncodeTranscodeJob(job, &encoded);
+  server::TranscodeJob decoded;
+  ASSERT_TRUE(server::DecodeTranscodeJob(server::kProtobufContentType, encoded, &decoded).ok());
+  ASSERT_EQ(2u, decoded.renditions.size());
+  EXPECT_EQ("1280x720", decoded.renditions[1].frame_size);
+  EXPECT_EQ(server::TranscodeJobKey(job), server::TranscodeJobKey(decoded));
+  decoded.renditions[1].rate_bit = "2000k";
+  EXPECT_NE(server::TranscodeJobKey(job), server::TranscodeJobKey(decoded));
+
+  const std::string head =
+      "{\"video_source_path\":\"a.mp4\",\"video_target_path\":\"/t/\",\"target_id\":1,"
+      "\"sample\":\"48000\",\"frame_aspect\":\"4:3\",\"frame_rate\":\"25\","
+      "\"time\":\"10\",\"url_prefix\":\"/u/\",\"m3u8_name\":\"my.m3u8\"";
+  struct {
+    const char* rest;
+    const char* error;
+  } cases[] = {
+    { "}", "missing field frame_size" },
+    { ",\"frame_size\":\"320x240\"}", "missing field rate_bit" },
+    { ",\"renditions\":[]}", "missing field frame_size" },
+    { ",\"renditions\":[{\"name\":\"a\",\"frame_size\":\"1x1\"}]}",
+      "missing field renditions.rate_bit" },
+    { ",\"renditions\":[{\"name\":\"a\",\"frame_size\":\"1x1\",\"rate_bit\":1}]}",
+      "field renditions must be an array of objects of strings" },
+    { ",\"renditions\":[\"a\"]}", "field renditions must be an array of objects of strings" },
+    { ",\"renditions\":{}}", "field renditions must be an array of objects of strings" },
+    { ",\"renditions\":[{\"name\":\"../a\",\"frame_size\":\"1x1\",\"rate_bit\":\"1k\"}]}",
+      "rendition name ../a is not a directory name" },
+    { ",\"renditions\":[{\"name\":\"a\",\"frame_size\":\"1x1\",\"rate_bit\":\"1k\"},"
+      "{\"name\":\"a\",\"frame_size\":\"2x2\",\"rate_bit\":\"2k\"}]}",
+      "duplicate rendition a" },
+  };
+  for (const auto& c : cases) {
+    base::Status status = server::DecodeTranscodeJob(head + c.rest, &job);
+    EXPECT_EQ(base::Code::INVALID_ARGUMENT, status.code()) << c.rest;
+    EXPECT_EQ(c.error, status.error_message()) << c.rest;
+  }
+}
+
+TEST(JobDecoderTest, Dispatches_On_Content_Type) {
+  server::TranscodeJob job;
+  ASSERT_TRUE(server::DecodeTranscodeJob(kTranscodeMessage, &job).ok());
+  std::string encoded;
+  server::EncodeTranscodeJob(job, &encoded);
+  EXPECT_LT(encoded.size(), sizeof(kTranscodeMessage));
+
+  server::TranscodeJob decoded;
+  ASSERT_TRUE(server::DecodeTranscodeJob(server::kProtobufContentType, encoded, &decoded).ok());
+  EXPECT_EQ(job.video_source_path, decoded.video_source_path);
+  EXPECT_EQ(1000001, decoded.target_id);
+  EXPECT_EQ("my.m3u8", decoded.m3u8_name);
+
+  // Unset, JSON with parameters, and the reused job decoded again.
+  EXPECT_TRUE(server::DecodeTranscodeJob("", kTranscodeMessage, &decoded).ok());
+  EXPECT_TRUE(server::DecodeTranscodeJob("Application/JSON; charset=utf-8",
+                                         kTranscodeMessage, &decoded).ok());
+  ASSERT_TRUE(server::DecodeTranscodeJob("application/protobuf", encoded, &decoded).ok());
+  EXPECT_EQ(job.url_prefix, decoded.url_prefix);
+
+  base::Status status = server::DecodeTranscodeJob("text/xml", kTranscodeMessage, &decoded);
+  EXPECT_EQ(base::Code::INVALID_ARGUMENT, status.code());
+  EXPECT_EQ("unsupported content type text/xml", status.error_message());
+  EXPECT_FALSE(server::DecodeTranscodeJob(server::kProtobufContentType,
+                                          kTranscodeMessage, &decoded).ok());
+}
+
+TEST(JobDecoderTest, Rejects_Incomplete_Protobuf_Jobs) {
+  server::EpubInfoJob job;
+  job.book_id = 7;
+  std::string encoded;
+  server::EncodeEpubInfoJob(job, &encoded);
+  base::Status status = server::DecodeEpubInfoJob(server::kProtobufContentType, encoded, &job);
+  EXPECT_EQ("missing field book_path", status.error_message());
+
+  job.book_id = 0;
+  job.book_path = "/tmp/7.epub";
+  server::EncodeEpubInfoJob(job, &encoded);
+  status = server::DecodeEpubInfoJob(server::kProtobufContentType, encoded, &job);
+  EXPECT_EQ("missing field book_id", status.error_message());
+
+  job.book_id = 7;
+  server::EncodeEpubInfoJob(job, &encoded);
+  server::EpubInfoJob decoded;
+  ASSERT_TRUE(server::DecodeEpubInfoJob(server::kProtobufContentType, encoded, &decoded).ok());
+  EXPECT_EQ(7, decoded.book_id);
+  EXPECT_EQ("/tmp/7.epub", decoded.book_path);
+}
+
+TEST(JobDecoderTest, Keys_Jobs_By_Identity) {
+  server::TranscodeJob json_job;
+  ASSERT_TRUE(server::DecodeTranscodeJob(kTranscodeMessage, &json_job).ok());
+  std::string encoded;
+  server::EncodeTranscodeJob(json_job, &encoded);
+  server::TranscodeJob protobuf_job;
+  ASSERT_TRUE(server::DecodeTranscodeJob(server::kProtobufContentType, encoded,
+                                         &protobuf_job).ok());
+
+  const std::string key = server::TranscodeJobKey(json_job);
+  EXPECT_EQ(0u, key.find("transcode:1000001:"));
+  EXPECT_EQ(key.size(), std::string("transcode:1000001:").size() + 16);
+  EXPECT_EQ(key, server::TranscodeJobKey(protobuf_job));
+
+  protobuf_job.rate_bit = "700k";
+  EXPECT_NE(key, server::TranscodeJobKey(protobuf_job));
+  protobuf_job.rate_bit = json_job.rate_bit;
+  protobuf_job.target_id = 1000002;
+  EXPECT_NE(key, server::TranscodeJobKey(protobuf_job));
+
+  server::EpubInfoJob epub_info;
+  epub_info.book_id = 7;
+  epub_info.book_path = "/tmp/7.epub";
+  EXPECT_EQ(0u, server::EpubInfoJobKey(epub_info).find("epub_info:7:"));
+}
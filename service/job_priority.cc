@@ -0,0 +1,23 @@
+#include "service/job_priority.h"
+#include "base/file_path.h"
+#include "base/file_util.h"
+
+namespace server {
+
+int PriorityForSize(int64_t bytes, const JobPriorityOptions& options) {
+  int priority = options.max_priority;
+  for (int64_t limit = options.short_job_bytes; bytes > limit && priority > 0; limit *= 2) {
+    priority--;
+  }
+  return priority;
+}
+
+int TranscodeJobPriority(const TranscodeJob& job, const JobPriorityOptions& options) {
+  int64_t size;
+  if (!base::GetFileSize(base::FilePath(job.video_source_path), &size)) {
+    return options.max_priority / 2;
+  }
+  return PriorityForSize(size, options);
+}
+
+} // namespace server
@@ -0,0 +1,33 @@
+#ifndef SERVICE_JOB_PRIORITY_H_
+#define SERVICE_JOB_PRIORITY_H_
+#include "service/job_decoder.h"
+
+#include <stdint.h>
+
+namespace server {
+
+// AMQP priorities of jobs, for queues declared with x-max-priority (see
+// QueueArguments()), so that short jobs overtake long ones instead of
+// queueing behind them.
+//
+// A transcode job's cost follows the size of its source video, which is
+// one stat() to find, where its duration would take opening the
+// container. Sources up to `short_job_bytes` get `max_priority`, and each
+// doubling above that one level less, down to 0:
+//
+//   short_job_bytes = 64 MB, max_priority = 9
+//   40 MB clip -> 9, 200 MB -> 7, 2 GB lecture -> 4
+//
+// A source that can't be stat'ed gets max_priority / 2.
+struct JobPriorityOptions {
+  JobPriorityOptions() : max_priority(9), short_job_bytes(64 << 20) {}
+
+  int max_priority;
+  int64_t short_job_bytes;
+};
+
+int PriorityForSize(int64_t bytes, const JobPriorityOptions& options);
+int TranscodeJobPriority(const TranscodeJob& job, const JobPriorityOptions& options);
+
+} // namespace server
+#endif // SERVICE_JOB_PRIORITY_H_
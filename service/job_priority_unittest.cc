@@ -0,0 +1,38 @@
+#include "service/job_priority.h"
+#include "base/file_util.h"
+#include "base/scoped_temp_dir.h"
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+TEST(JobPriorityTest, Lowers_Priority_Per_Doubling) {
+  server::JobPriorityOptions options;
+  options.max_priority = 9;
+  options.short_job_bytes = 64 << 20;
+  EXPECT_EQ(9, server::PriorityForSize(0, options));
+  EXPECT_EQ(9, server::PriorityForSize(40 << 20, options));
+  EXPECT_EQ(9, server::PriorityForSize(64 << 20, options));
+  EXPECT_EQ(8, server::PriorityForSize((64 << 20) + 1, options));
+  EXPECT_EQ(7, server::PriorityForSize(200 << 20, options));
+  EXPECT_EQ(4, server::PriorityForSize(2048LL << 20, options));
+  EXPECT_EQ(0, server::PriorityForSize(1LL << 50, options));
+}
+
+TEST(JobPriorityTest, Probes_The_Source_Size) {
+  base::ScopedTempDir dir;
+  ASSERT_TRUE(dir.CreateUniqueTempDir());
+  base::FilePath source = dir.path().Append("clip.mp4");
+  std::string content(3000, 'x');
+  ASSERT_EQ(3000, base::WriteFile(source, content.data(), content.size()));
+
+  server::JobPriorityOptions options;
+  options.max_priority = 5;
+  options.short_job_bytes = 1000;
+  server::TranscodeJob job;
+  job.video_source_path = source.value();
+  EXPECT_EQ(3, server::TranscodeJobPriority(job, options));
+
+  job.video_source_path = dir.path().Append("missing.mp4").value();
+  EXPECT_EQ(2, server::TranscodeJobPriority(job, options));
+}
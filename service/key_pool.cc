@@ -0,0 +1,249 @@
+#include "service/key_pool.h"
+#include "base/string_printf.h"
+#include "server/log_util.h"
+#include "threading/exception.h"
+#include "threading/function_runner.h"
+#include "threading/thread_factory.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <glog/logging.h>
+
+namespace server {
+
+namespace {
+
+void WipeBytes(void* data, size_t size) {
+  volatile char* p = static_cast<volatile char*>(data);
+  while (size-- > 0) {
+    *p++ = 0;
+  }
+}
+
+} // namespace
+
+KeyPool::KeyPool(const std::string& name,
+                 const GenerateFunction& generate,
+                 const Options& options)
+  : name_(name),
+    generate_(generate),
+    options_(options),
+    arena_(nullptr),
+    arena_size_(0),
+    stopping_(false),
+    refilling_(false),
+    size_metric_(-1) {
+  options_.high_watermark = std::max(options_.high_watermark, options_.low_watermark);
+  misses_ = base::MetricsRegistry::GetInstance()->GetCounter(
+      "key_pool_misses_total", "Keys generated on demand because the pool was empty.",
+      {{"pool", name}});
+}
+
+KeyPool::~KeyPool() {
+  Stop();
+}
+
+base::Status KeyPool::Start() {
+  if (thread_ || options_.low_watermark == 0) {
+    return base::Status::OK();
+  }
+  arena_size_ = options_.high_watermark * options_.max_key_bytes;
+  void* arena = ::mmap(nullptr, arena_size_, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (arena == MAP_FAILED) {
+    return base::Status(base::Code::RESOURCE_EXHAUSTED,
+                        name_ + ": mmap of key pool failed: " + ::strerror(errno));
+  }
+  if (::mlock(arena, arena_size_) != 0) {
+    int error = errno;
+    ::munmap(arena, arena_size_);
+    return base::Status(base::Code::RESOURCE_EXHAUSTED,
+                        base::StringPrintf("%s: can't lock %zu bytes of keys in memory "
+                                           "(RLIMIT_MEMLOCK?): %s",
+                                           name_.c_str(), arena_size_, ::strerror(error)));
+  }
+#ifdef MADV_DONTDUMP
+  ::madvise(arena, arena_size_, MADV_DONTDUMP);
+#endif
+  arena_ = static_cast<char*>(arena);
+
+  {
+    std::lock_guard<std::mutex> l(lock_);
+    stopping_ = false;
+    refilling_ = false;
+    ready_.clear();
+    ready_.reserve(options_.high_watermark);
+    free_.clear();
+    for (size_t i = options_.high_watermark; i > 0; --i) {
+      free_.push_back(i - 1);
+    }
+  }
+
+  threading::PosixThreadFactory factory(threading::ThreadFactory::ATTACHED);
+  try {
+    thread_ = factory.NewThread(threading::FunctionRunner::Create([this] { Run(); }));
+    thread_->SetName("key_pool");
+    thread_->Start();
+  } catch (const base::TLibraryException& e) {
+    thread_.reset();
+    ::munlock(arena_, arena_size_);
+    ::munmap(arena_, arena_size_);
+    arena_ = nullptr;
+    return base::Status(base::Code::RESOURCE_EXHAUSTED, e.what());
+  }
+
+  size_metric_ = base::MetricsRegistry::GetInstance()->AddCallback(
+      base::MetricsRegistry::GAUGE, "key_pool_keys", "Keys ready in the pool.",
+      {{"pool", name_}}, [this] { return static_cast<double>(size()); });
+  return base::Status::OK();
+}
+
+void KeyPool::Stop() {
+  if (!thread_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> l(lock_);
+    stopping_ = true;
+  }
+  refill_.notify_all();
+  thread_->Join();
+  thread_.reset();
+  base::MetricsRegistry::GetInstance()->RemoveCallback(size_metric_);
+
+  std::lock_guard<std::mutex> l(lock_);
+  ready_.clear();
+  free_.clear();
+  WipeBytes(arena_, arena_size_);
+  ::munlock(arena_, arena_size_);
+  ::munmap(arena_, arena_size_);
+  arena_ = nullptr;
+}
+
+base::Status KeyPool::Take(Key* key) {
+  size_t slot = 0;
+  bool pooled = false;
+  {
+    std::lock_guard<std::mutex> l(lock_);
+    if (!ready_.empty()) {
+      slot = ready_.back();
+      ready_.pop_back();
+      pooled = true;
+    }
+    if (arena_ != nullptr && ready_.size() < options_.low_watermark) {
+      refill_.notify_one();
+    }
+  }
+  if (!pooled) {
+    if (arena_ != nullptr) {
+      misses_->Increment();
+    }
+    key->clear();
+    return generate_(key);
+  }
+  Load(Slot(slot), key);
+  std::lock_guard<std::mutex> l(lock_);
+  free_.push_back(slot);
+  if (refilling_) {
+    refill_.notify_one();
+  }
+  return base::Status::OK();
+}
+
+size_t KeyPool::size() const {
+  std::lock_guard<std::mutex> l(lock_);
+  return ready_.size();
+}
+
+void KeyPool::Wipe(std::string* s) {
+  if (!s->empty()) {
+    WipeBytes(&(*s)[0], s->size());
+  }
+}
+
+void KeyPool::Wipe(Key* key) {
+  for (std::string& field : *key) {
+    Wipe(&field);
+  }
+}
+
+void KeyPool::Run() {
+  Key key;
+  std::unique_lock<std::mutex> l(lock_);
+  while (!stopping_) {
+    if (ready_.size() < options_.low_watermark) {
+      refilling_ = true;
+    } else if (ready_.size() >= options_.high_watermark) {
+      refilling_ = false;
+    }
+    // Without a free slot, the keys being taken free some.
+    if (!refilling_ || free_.empty()) {
+      refill_.wait(l);
+      continue;
+    }
+    const size_t slot = free_.back();
+    free_.pop_back();
+    l.unlock();
+    key.clear();
+    base::Status status = generate_(&key);
+    bool stored = status.ok() && Store(key, Slot(slot));
+    Wipe(&key);
+    l.lock();
+    if (stored) {
+      ready_.push_back(slot);
+      continue;
+    }
+    free_.push_back(slot);
+    if (status.ok()) {
+      status = base::Status(base::Code::OUT_OF_RANGE,
+                            base::StringPrintf("key longer than %zu bytes",
+                                               options_.max_key_bytes));
+    }
+    LOG_EVERY_MS(WARNING, 10000) << name_ << ": can't refill the key pool: "
+                                 << status.ToString();
+    refill_.wait_for(l, std::chrono::milliseconds(options_.retry_ms),
+                     [this] { return stopping_; });
+  }
+}
+
+// A slot holds the number of fields, then each field's length and bytes.
+bool KeyPool::Store(const Key& key, char* slot) const {
+  size_t size = sizeof(uint32_t);
+  for (const std::string& field : key) {
+    size += sizeof(uint32_t) + field.size();
+  }
+  if (size > options_.max_key_bytes) {
+    return false;
+  }
+  uint32_t n = static_cast<uint32_t>(key.size());
+  memcpy(slot, &n, sizeof(n));
+  slot += sizeof(n);
+  for (const std::string& field : key) {
+    n = static_cast<uint32_t>(field.size());
+    memcpy(slot, &n, sizeof(n));
+    memcpy(slot + sizeof(n), field.data(), field.size());
+    slot += sizeof(n) + field.size();
+  }
+  return true;
+}
+
+void KeyPool::Load(char* slot, Key* key) const {
+  uint32_t fields;
+  memcpy(&fields, slot, sizeof(fields));
+  key->resize(fields);
+  const char* p = slot + sizeof(fields);
+  for (std::string& field : *key) {
+    uint32_t n;
+    memcpy(&n, p, sizeof(n));
+    field.assign(p + sizeof(n), n);
+    p += sizeof(n) + n;
+  }
+  WipeBytes(slot, options_.max_key_bytes);
+}
+
+} // namespace server
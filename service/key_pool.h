@@ -0,0 +1,118 @@
+#ifndef SERVICE_KEY_POOL_H_
+#define SERVICE_KEY_POOL_H_
+#include "base/macros.h"
+#include "base/metrics.h"
+#include "base/status.h"
+#include "threading/thread.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace server {
+
+// Keys generated ahead of the jobs that need them, so that a job takes one
+// in O(1) instead of waiting for the crypto service to make it.
+//
+// A background thread refills the pool with `generate` whenever it falls
+// below `low_watermark` keys, up to `high_watermark`; failed generations
+// are retried after `retry_ms`. Take() on an empty pool generates in the
+// caller's thread, so jobs never wait for the refill.
+//
+// Pooled keys are held in one mapping, locked into memory so that they are
+// never swapped out and excluded from core dumps; slots are wiped as their
+// keys are taken and on Stop(). Locking needs RLIMIT_MEMLOCK to cover
+// `high_watermark * max_key_bytes`: Start() fails otherwise, and Take()
+// generates every key itself.
+//
+//   KeyPool pool("sm2", [](KeyPool::Key* key) { ... });
+//   pool.Start();
+//   KeyPool::ScopedKey key;
+//   RETURN_IF_ERROR(pool.Take(key.get()));
+//
+// Pooled keys and misses are exported to the base::MetricsRegistry
+// labelled with the pool's name. Thread-safe.
+class KeyPool {
+ public:
+  struct Options {
+    Options()
+        : low_watermark(8), high_watermark(32), max_key_bytes(1024), retry_ms(1000) {}
+
+    size_t low_watermark;   // 0 = no pool, every key generated on Take()
+    size_t high_watermark;
+    size_t max_key_bytes;   // all fields of a key together
+    int retry_ms;
+  };
+
+  // A key's fields, e.g. {public key, private key}.
+  typedef std::vector<std::string> Key;
+  typedef std::function<base::Status(Key*)> GenerateFunction;
+
+  // A taken key, wiped when it goes out of scope on whatever path.
+  class ScopedKey {
+   public:
+    ScopedKey() {}
+    ~ScopedKey() { Wipe(&key_); }
+
+    Key* get() { return &key_; }
+    const std::string& operator[](size_t field) const { return key_[field]; }
+
+   private:
+    Key key_;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedKey);
+  };
+
+  KeyPool(const std::string& name, const GenerateFunction& generate,
+          const Options& options = Options());
+  ~KeyPool();
+
+  // Maps and locks the slots and starts the refill.
+  base::Status Start();
+  // Stops the refill and wipes the pooled keys.
+  void Stop();
+
+  // A pooled key, or a new one if the pool is empty.
+  base::Status Take(Key* key);
+
+  size_t size() const;
+
+  // Overwrites `s` before it is freed; the compiler can't drop the writes.
+  static void Wipe(std::string* s);
+  static void Wipe(Key* key);
+
+ private:
+  void Run();
+  bool Store(const Key& key, char* slot) const;
+  void Load(char* slot, Key* key) const;
+  char* Slot(size_t index) const { return arena_ + index * options_.max_key_bytes; }
+
+  const std::string name_;
+  const GenerateFunction generate_;
+  Options options_;
+
+  char* arena_;
+  size_t arena_size_;
+
+  mutable std::mutex lock_;
+  std::condition_variable refill_;
+  std::vector<size_t> ready_;  // slots holding keys, guarded by lock_
+  std::vector<size_t> free_;   // guarded by lock_
+  bool stopping_;              // guarded by lock_
+  bool refilling_;             // low to high watermark, guarded by lock_
+
+  base::Counter* misses_;
+  int size_metric_;
+  std::shared_ptr<threading::Thread> thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(KeyPool);
+};
+
+} // namespace server
+#endif // SERVICE_KEY_POOL_H_
@@ -0,0 +1,170 @@
+#include "service/key_pool.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// Keys {"public-<n>", "private-<n>"}, numbered in generation order.
+class CountingGenerator {
+ public:
+  CountingGenerator() : generated(0), fail(false) {}
+
+  base::Status operator()(server::KeyPool::Key* key) {
+    if (fail) {
+      return base::Status(base::Code::UNAVAILABLE, "crypto service down");
+    }
+    int n = generated++;
+    key->push_back("public-" + std::to_string(n));
+    key->push_back("private-" + std::to_string(n));
+    return base::Status::OK();
+  }
+
+  std::atomic<int> generated;
+  std::atomic<bool> fail;
+};
+
+// A block whose contents are checked when it is freed.
+const void* watched_block = nullptr;
+size_t watched_size = 0;
+bool watched_block_wiped = false;
+
+void CheckFreed(void* p) {
+  if (p == nullptr || p != watched_block) {
+    return;
+  }
+  const char* data = static_cast<const char*>(p);
+  watched_block_wiped = std::all_of(data, data + watched_size,
+                                    [](char c) { return c == '\0'; });
+  watched_block = nullptr;
+}
+
+void WaitForSize(const server::KeyPool& pool, size_t size) {
+  for (int i = 0; i < 1000 && pool.size() != size; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+  void* p = std::malloc(size > 0 ? size : 1);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  CheckFreed(p);
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  CheckFreed(p);
+  std::free(p);
+}
+
+TEST(KeyPoolTest, Refills_Between_Watermarks) {
+  CountingGenerator generator;
+  server::KeyPool::Options options;
+  options.low_watermark = 2;
+  options.high_watermark = 4;
+  server::KeyPool pool("test", std::ref(generator), options);
+  ASSERT_TRUE(pool.Start().ok());
+  WaitForSize(pool, 4);
+  EXPECT_EQ(4u, pool.size());
+  EXPECT_EQ(4, generator.generated);
+
+  server::KeyPool::Key key;
+  ASSERT_TRUE(pool.Take(&key).ok());
+  ASSERT_EQ(2u, key.size());
+  EXPECT_EQ(0u, key[0].find("public-"));
+  EXPECT_EQ(0u, key[1].find("private-"));
+  // Above the low watermark: no refill yet.
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(3u, pool.size());
+
+  ASSERT_TRUE(pool.Take(&key).ok());
+  ASSERT_TRUE(pool.Take(&key).ok());
+  WaitForSize(pool, 4);
+  EXPECT_EQ(4u, pool.size());
+  EXPECT_EQ(7, generator.generated);
+  pool.Stop();
+  EXPECT_EQ(0u, pool.size());
+}
+
+TEST(KeyPoolTest, Generates_When_Empty) {
+  CountingGenerator generator;
+  generator.fail = true;
+  server::KeyPool::Options options;
+  options.low_watermark = 2;
+  options.high_watermark = 2;
+  options.retry_ms = 10;
+  server::KeyPool pool("test", std::ref(generator), options);
+  ASSERT_TRUE(pool.Start().ok());
+
+  server::KeyPool::Key key;
+  EXPECT_EQ(base::Code::UNAVAILABLE, pool.Take(&key).code());
+  generator.fail = false;
+  ASSERT_TRUE(pool.Take(&key).ok());
+  EXPECT_EQ(2u, key.size());
+  // The refill retries on its own.
+  WaitForSize(pool, 2);
+  EXPECT_EQ(2u, pool.size());
+
+  // Without a pool every key is generated on Take().
+  options.low_watermark = 0;
+  server::KeyPool unpooled("unpooled", std::ref(generator), options);
+  ASSERT_TRUE(unpooled.Start().ok());
+  int before = generator.generated;
+  ASSERT_TRUE(unpooled.Take(&key).ok());
+  EXPECT_EQ(before + 1, generator.generated);
+  EXPECT_EQ(0u, unpooled.size());
+}
+
+TEST(KeyPoolTest, Rejects_Keys_Larger_Than_A_Slot) {
+  server::KeyPool::Options options;
+  options.low_watermark = 1;
+  options.high_watermark = 1;
+  options.max_key_bytes = 16;
+  options.retry_ms = 10;
+  server::KeyPool pool("test", [](server::KeyPool::Key* key) {
+    key->push_back(std::string(64, 'k'));
+    return base::Status::OK();
+  }, options);
+  ASSERT_TRUE(pool.Start().ok());
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(0u, pool.size());
+  // Still handed out, just not pooled.
+  server::KeyPool::Key key;
+  ASSERT_TRUE(pool.Take(&key).ok());
+  EXPECT_EQ(64u, key[0].size());
+}
+
+TEST(KeyPoolTest, Scoped_Keys_Are_Wiped) {
+  const std::string secret(64, 'k');
+  server::KeyPool::Options options;
+  options.low_watermark = 0;
+  server::KeyPool pool("test", [&secret](server::KeyPool::Key* key) {
+    key->push_back(secret);
+    return base::Status::OK();
+  }, options);
+  ASSERT_TRUE(pool.Start().ok());
+  {
+    server::KeyPool::ScopedKey key;
+    ASSERT_TRUE(pool.Take(key.get()).ok());
+    ASSERT_EQ(secret, key[0]);
+    // Too long for the small-string buffer, so freed by operator delete.
+    watched_block = key[0].data();
+    watched_size = key[0].size();
+  }
+  EXPECT_EQ(nullptr, watched_block);
+  EXPECT_TRUE(watched_block_wiped);
+}
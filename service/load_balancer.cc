@@ -0,0 +1,144 @@
+#include "service/load_balancer.h"
+#include "base/metrics.h"
+#include "threading/time_util.h"
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+namespace server {
+
+struct LoadBalancer::Backend {
+  Backend() : outstanding(0), failures(0), ejections(0), ejected_until_usec(0) {}
+
+  std::string label;
+  std::atomic<int> outstanding;
+  std::atomic<int> failures;   // in a row
+  std::atomic<int> ejections;  // in a row
+  std::atomic<int64_t> ejected_until_usec;
+  base::Counter* ejection_count;
+};
+
+namespace {
+
+// xorshift64*, seeded per thread; the quality a pick needs and no lock.
+uint64_t NextRandom() {
+  thread_local uint64_t state = 0;
+  if (state == 0) {
+    state = static_cast<uint64_t>(threading::TimeUtil::MonotonicTimeUsec()) ^
+            reinterpret_cast<uintptr_t>(&state) ^ UINT64_C(0x9e3779b97f4a7c15);
+  }
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * UINT64_C(2685821657736338717);
+}
+
+} // namespace
+
+LoadBalancer::LoadBalancer(const std::string& pool,
+                           const std::vector<std::string>& labels,
+                           const Options& options)
+  : options_(options) {
+  CHECK(!labels.empty()) << pool << ": no backends";
+  base::MetricsRegistry* registry = base::MetricsRegistry::GetInstance();
+  for (const std::string& label : labels) {
+    Backend* backend = new Backend;
+    backend->label = label;
+    const base::MetricLabels metric_labels = {{"pool", pool}, {"backend", label}};
+    backend->ejection_count = registry->GetCounter("lb_ejections_total",
+        "Times the backend was ejected for failing requests.", metric_labels);
+    metrics_.push_back(registry->AddCallback(
+        base::MetricsRegistry::GAUGE, "lb_outstanding_requests",
+        "Requests sent to the backend and not done yet.", metric_labels,
+        [backend] { return static_cast<double>(backend->outstanding.load()); }));
+    backends_.emplace_back(backend);
+  }
+}
+
+LoadBalancer::~LoadBalancer() {
+  for (int id : metrics_) {
+    base::MetricsRegistry::GetInstance()->RemoveCallback(id);
+  }
+}
+
+bool LoadBalancer::Available(const Backend& backend, int64_t now_usec) const {
+  return backend.ejected_until_usec.load(std::memory_order_relaxed) <= now_usec;
+}
+
+size_t LoadBalancer::Pick() {
+  const size_t n = backends_.size();
+  size_t picked = 0;
+  if (n > 1) {
+    const int64_t now = threading::TimeUtil::MonotonicTimeUsec();
+    uint64_t random = NextRandom();
+    size_t a = random % n;
+    size_t b = (random >> 32) % (n - 1);
+    if (b >= a) {
+      b++;
+    }
+    bool a_ok = Available(*backends_[a], now);
+    bool b_ok = Available(*backends_[b], now);
+    if (!a_ok && !b_ok) {
+      // Both drawn backends are ejected; the least loaded of the others,
+      // if any is left.
+      for (size_t i = 0; i < n; ++i) {
+        if (Available(*backends_[i], now) &&
+            (!a_ok || backends_[i]->outstanding < backends_[a]->outstanding)) {
+          a = i;
+          a_ok = true;
+        }
+      }
+      // With none left, a and b compete as if healthy.
+      b_ok = !a_ok;
+      a_ok = true;
+    }
+    if (a_ok != b_ok) {
+      picked = a_ok ? a : b;
+    } else {
+      picked = backends_[b]->outstanding < backends_[a]->outstanding ? b : a;
+    }
+  }
+  backends_[picked]->outstanding++;
+  return picked;
+}
+
+void LoadBalancer::Done(size_t index, bool ok) {
+  Backend* backend = backends_[index].get();
+  backend->outstanding--;
+  if (ok) {
+    backend->failures.store(0, std::memory_order_relaxed);
+    backend->ejections.store(0, std::memory_order_relaxed);
+    return;
+  }
+  if (options_.failures_to_eject <= 0) {
+    return;
+  }
+  const int64_t now = threading::TimeUtil::MonotonicTimeUsec();
+  // Requests still in flight when it was ejected don't extend the ejection.
+  if (!Available(*backend, now) || ++backend->failures < options_.failures_to_eject) {
+    return;
+  }
+  int ejections = backend->ejections++;
+  int64_t ejection_ms = options_.ejection_ms << std::min(ejections, 4);
+  backend->ejected_until_usec = now + ejection_ms * 1000;
+  // On probation: the next failure ejects it again.
+  backend->failures = options_.failures_to_eject - 1;
+  backend->ejection_count->Increment();
+  LOG(WARNING) << backend->label << " ejected for " << ejection_ms << " ms after "
+               << options_.failures_to_eject << " failures in a row";
+}
+
+void LoadBalancer::Cancel(size_t index) {
+  backends_[index]->outstanding--;
+}
+
+int LoadBalancer::outstanding(size_t backend) const {
+  return backends_[backend]->outstanding.load();
+}
+
+bool LoadBalancer::ejected(size_t backend) const {
+  return !Available(*backends_[backend], threading::TimeUtil::MonotonicTimeUsec());
+}
+
+} // namespace server
@@ -0,0 +1,74 @@
+#ifndef SERVICE_LOAD_BALANCER_H_
+#define SERVICE_LOAD_BALANCER_H_
+#include "base/macros.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace server {
+
+// Picks one of a fixed set of backends per request by power of two
+// choices: two distinct backends are drawn at random and the one with
+// fewer requests outstanding wins. That follows per-request load about as
+// well as scanning for the least loaded backend, without every caller
+// converging on the same one.
+//
+// A backend failing `failures_to_eject` requests in a row (failures being
+// what the caller reports as such, e.g. UNAVAILABLE) is ejected for
+// `ejection_ms`: picks skip it until then. Back in rotation, one more
+// failure ejects it again, for twice as long, up to 16 times
+// `ejection_ms`; a success resets both. When every backend is ejected,
+// picks fall back to all of them rather than failing outright.
+//
+//   size_t backend = balancer.Pick();
+//   ... call backend ...
+//   balancer.Done(backend, ok);
+//
+// Outstanding requests and ejections are exported to the
+// base::MetricsRegistry labelled with the `pool` name and the backend's
+// label. Thread-safe and lock-free.
+class LoadBalancer {
+ public:
+  struct Options {
+    Options() : failures_to_eject(5), ejection_ms(10000) {}
+
+    int failures_to_eject;  // consecutive failures, 0 = never eject
+    int64_t ejection_ms;
+  };
+
+  // One backend per entry of `labels`, e.g. its address.
+  LoadBalancer(const std::string& pool,
+               const std::vector<std::string>& labels,
+               const Options& options = Options());
+  ~LoadBalancer();
+
+  // A backend to send the next request to. Every Pick() must be matched
+  // by a Done(), or by a Cancel() for a request that was never sent or
+  // whose outcome says nothing about the backend.
+  size_t Pick();
+  void Done(size_t backend, bool ok);
+  void Cancel(size_t backend);
+
+  size_t size() const { return backends_.size(); }
+  int outstanding(size_t backend) const;
+  bool ejected(size_t backend) const;
+
+ private:
+  struct Backend;
+
+  bool Available(const Backend& backend, int64_t now_usec) const;
+
+  const Options options_;
+  std::vector<std::unique_ptr<Backend>> backends_;
+  std::vector<int> metrics_;
+
+  DISALLOW_COPY_AND_ASSIGN(LoadBalancer);
+};
+
+} // namespace server
+#endif // SERVICE_LOAD_BALANCER_H_
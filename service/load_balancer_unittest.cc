@@ -0,0 +1,114 @@
+#include "service/load_balancer.h"
+
+#include <stdlib.h>
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<std::string> Labels(int n) {
+  std::vector<std::string> labels;
+  for (int i = 0; i < n; ++i) {
+    labels.push_back("backend-" + std::to_string(i));
+  }
+  return labels;
+}
+
+} // namespace
+
+TEST(LoadBalancerTest, Prefers_Less_Loaded_Backends) {
+  server::LoadBalancer balancer("test", Labels(2));
+  // Two backends: every pick draws both, so outstanding requests stay even.
+  std::vector<size_t> picked;
+  for (int i = 0; i < 100; ++i) {
+    picked.push_back(balancer.Pick());
+    EXPECT_LE(std::abs(balancer.outstanding(0) - balancer.outstanding(1)), 1);
+  }
+  EXPECT_EQ(50, balancer.outstanding(0));
+  for (size_t backend : picked) {
+    balancer.Done(backend, true);
+  }
+  EXPECT_EQ(0, balancer.outstanding(0));
+  EXPECT_EQ(0, balancer.outstanding(1));
+
+  // A slow backend holding requests gets fewer new ones.
+  server::LoadBalancer four("test4", Labels(4));
+  for (int i = 0; i < 30; ++i) {
+    size_t backend = four.Pick();
+    if (backend != 0) {
+      four.Done(backend, true);
+    }
+  }
+  EXPECT_LE(four.outstanding(0), 2);
+}
+
+TEST(LoadBalancerTest, Ejects_Failing_Backends) {
+  server::LoadBalancer::Options options;
+  options.failures_to_eject = 3;
+  options.ejection_ms = 50;
+  server::LoadBalancer balancer("test", Labels(3), options);
+
+  for (int i = 0; i < 3; ++i) {
+    balancer.Pick();
+    balancer.Done(1, false);
+  }
+  EXPECT_TRUE(balancer.ejected(1));
+  EXPECT_FALSE(balancer.ejected(0));
+  for (int i = 0; i < 100; ++i) {
+    size_t backend = balancer.Pick();
+    EXPECT_NE(1u, backend);
+    balancer.Done(backend, true);
+  }
+
+  // Back on probation after the ejection: one failure ejects it again.
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  EXPECT_FALSE(balancer.ejected(1));
+  balancer.Pick();
+  balancer.Done(1, false);
+  EXPECT_TRUE(balancer.ejected(1));
+
+  // Everything ejected: picks still go somewhere.
+  for (size_t backend : {0u, 2u}) {
+    for (int i = 0; i < 3; ++i) {
+      balancer.Pick();
+      balancer.Done(backend, false);
+    }
+  }
+  EXPECT_TRUE(balancer.ejected(0));
+  EXPECT_TRUE(balancer.ejected(2));
+  size_t backend = balancer.Pick();
+  EXPECT_LT(backend, 3u);
+  balancer.Done(backend, true);
+}
+
+TEST(LoadBalancerTest, Success_Resets_Failures) {
+  server::LoadBalancer::Options options;
+  options.failures_to_eject = 2;
+  server::LoadBalancer balancer("test", Labels(2), options);
+  for (int i = 0; i < 10; ++i) {
+    balancer.Pick();
+    balancer.Done(0, false);
+    balancer.Pick();
+    balancer.Done(0, true);
+  }
+  EXPECT_FALSE(balancer.ejected(0));
+}
+
+TEST(LoadBalancerTest, Cancel_Keeps_Failures) {
+  server::LoadBalancer::Options options;
+  options.failures_to_eject = 2;
+  // One backend, so every Pick() returns it.
+  server::LoadBalancer balancer("test", Labels(1), options);
+  ASSERT_EQ(0u, balancer.Pick());
+  balancer.Done(0, false);
+  ASSERT_EQ(0u, balancer.Pick());
+  balancer.Cancel(0);
+  EXPECT_EQ(0, balancer.outstanding(0));
+  EXPECT_FALSE(balancer.ejected(0));
+  ASSERT_EQ(0u, balancer.Pick());
+  balancer.Done(0, false);
+  EXPECT_TRUE(balancer.ejected(0));
+}
@@ -0,0 +1,179 @@
+#include "service/loopback_service.h"
+#include "base/file_path.h"
+#include "base/file_util.h"
+#include "threading/time_util.h"
+
+#include <unistd.h>
+
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace server {
+
+LoopbackService::LoopbackService(const std::string& name, const Options& options)
+  : name_(name),
+    options_(options),
+    dispatcher_(name),
+    queue_(options.queue_capacity),
+    outstanding_(0),
+    stopping_(false),
+    handled_(0),
+    failed_(0) {
+}
+
+LoopbackService::~LoopbackService() {
+}
+
+void LoopbackService::Configure(const ServiceOptions& options) {
+  dispatcher_.set_compress_min_size(options.compress_min_size);
+}
+
+void LoopbackService::HandleLoop() {
+  Item item;
+  for (;;) {
+    if (!queue_.TryPop(&item)) {
+      // Whatever was queued before Shutdown() is still handled.
+      if (stopping_) {
+        return;
+      }
+      threading::EventCount::Key key = not_empty_.PrepareWait();
+      if (!queue_.TryPop(&item)) {
+        if (stopping_) {
+          not_empty_.CancelWait();
+          return;
+        }
+        not_empty_.Wait(key);
+        continue;
+      }
+      not_empty_.CancelWait();
+    }
+    not_full_.Notify();
+    Handle(&item);
+  }
+}
+
+void LoopbackService::Shutdown() {
+  stopping_ = true;
+  not_empty_.NotifyAll();
+  not_full_.NotifyAll();
+}
+
+bool LoopbackService::Push(const std::string& message, const ReplyCallback& done,
+                           const std::string& content_type,
+                           const std::string& content_encoding) {
+  if (stopping_) {
+    return false;
+  }
+  Item item;
+  item.message = message;
+  item.content_type = content_type;
+  item.content_encoding = content_encoding;
+  item.enqueued_us = threading::TimeUtil::MonotonicTimeUsec();
+  item.done = done;
+
+  outstanding_++;
+  while (!queue_.TryPush(std::move(item))) {
+    threading::EventCount::Key key = not_full_.PrepareWait();
+    if (queue_.TryPush(std::move(item))) {
+      not_full_.CancelWait();
+      break;
+    }
+    if (stopping_) {
+      not_full_.CancelWait();
+      if (--outstanding_ == 0) {
+        drained_.NotifyAll();
+      }
+      return false;
+    }
+    not_full_.Wait(key);
+  }
+  not_empty_.Notify();
+  return true;
+}
+
+base::Status LoopbackService::Replay(const std::string& path, int repeat) {
+  std::string contents;
+  if (!base::ReadFileToString(base::FilePath(path), &contents)) {
+    return base::Status(base::Code::NOT_FOUND, "can't read replay file " + path);
+  }
+  std::vector<std::string> messages;
+  size_t pos = 0;
+  while (pos < contents.size()) {
+    size_t end = contents.find('\n', pos);
+    if (end == std::string::npos) {
+      end = contents.size();
+    }
+    std::string line = contents.substr(pos, end - pos);
+    if (!line.empty() && line[line.size() - 1] == '\r') {
+      line.resize(line.size() - 1);
+    }
+    if (!line.empty()) {
+      messages.push_back(line);
+    }
+    pos = end + 1;
+  }
+  if (messages.empty()) {
+    return base::Status(base::Code::INVALID_ARGUMENT, "no messages in " + path);
+  }
+
+  const int64_t interval_us = options_.rate > 0 ? static_cast<int64_t>(1e6 / options_.rate) : 0;
+  int64_t next_us = threading::TimeUtil::MonotonicTimeUsec();
+  for (int i = 0; i < repeat; ++i) {
+    for (const std::string& message : messages) {
+      if (interval_us > 0) {
+        // Paced against a fixed schedule, so a slow Push() doesn't lower
+        // the rate, it only bunches up the following messages.
+        int64_t now_us = threading::TimeUtil::MonotonicTimeUsec();
+        if (next_us > now_us) {
+          ::usleep(static_cast<useconds_t>(next_us - now_us));
+        }
+        next_us += interval_us;
+      }
+      if (!Push(message)) {
+        return base::Status(base::Code::CANCELLED, name_ + " shut down during replay");
+      }
+    }
+  }
+  return base::Status::OK();
+}
+
+void LoopbackService::Drain() {
+  for (;;) {
+    if (outstanding_ == 0) {
+      return;
+    }
+    threading::EventCount::Key key = drained_.PrepareWait();
+    if (outstanding_ == 0) {
+      drained_.CancelWait();
+      return;
+    }
+    drained_.Wait(key);
+  }
+}
+
+void LoopbackService::Handle(Item* item) {
+  std::string reply;
+  bool reply_compressed;
+  int64_t start_us = threading::TimeUtil::MonotonicTimeUsec();
+  base::Status status = dispatcher_.Dispatch(item->content_encoding, item->content_type,
+                                             item->message, &reply, &reply_compressed);
+  int64_t end_us = threading::TimeUtil::MonotonicTimeUsec();
+
+  handler_latency_.Record(end_us - start_us);
+  latency_.Record(end_us - item->enqueued_us);
+  handled_++;
+  if (!status.ok()) {
+    failed_++;
+    VLOG(1) << name_ << ": " << status.ToString();
+  }
+  if (item->done) {
+    item->done(status, reply);
+  }
+  item->done = ReplyCallback();
+  if (--outstanding_ == 0) {
+    drained_.NotifyAll();
+  }
+}
+
+} // namespace server
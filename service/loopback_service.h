@@ -0,0 +1,121 @@
+#ifndef SERVICE_LOOPBACK_SERVICE_H_
+#define SERVICE_LOOPBACK_SERVICE_H_
+#include "base/macros.h"
+#include "base/status.h"
+#include "server/async_service_interface.h"
+#include "server/latency_histogram.h"
+#include "service/message_dispatcher.h"
+#include "threading/event_count.h"
+#include "threading/mpmc_queue.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+namespace server {
+
+// An AsyncServiceInterface fed from memory instead of a broker, for
+// benchmarking and testing ServiceHandlers without RabbitMQ.
+//
+// Messages are pushed into a bounded lock-free queue, by Push() or from a
+// replay file, and every executor running HandleLoop() takes them off and
+// dispatches them as AmqpConsumerService does its deliveries (see
+// service/message_dispatcher.h), so the concurrency is the service's
+// `executors` option and `compress_min_size` applies to the replies:
+//
+//   auto loopback = std::make_shared<LoopbackService>("video_rpc_queue");
+//   loopback->SetHandler(handler);
+//   server->InsertAsyncService(loopback);  // executors=8
+//   server->Start();
+//   loopback->Replay("jobs.jsonl", 10);
+//   loopback->Drain();
+//   LOG(INFO) << loopback->latency().Summary();
+//
+// latency() measures from Push() to the dispatch's return, in
+// microseconds, and so includes queueing; handler_latency() is the
+// dispatch alone.
+class LoopbackService : public AsyncServiceInterface {
+ public:
+  // Gets the handler's status and reply.
+  typedef std::function<void(const base::Status&, const std::string&)> ReplyCallback;
+
+  struct Options {
+    Options() : queue_capacity(4096), rate(0) {}
+
+    size_t queue_capacity;
+    double rate;  // messages per second fed by Replay(), 0 = unpaced
+  };
+
+  explicit LoopbackService(const std::string& name,
+                           const Options& options = Options());
+  virtual ~LoopbackService();
+
+  std::string name() const override { return name_; }
+
+  void Configure(const ServiceOptions& options) override;
+  void HandleLoop() override;
+  void Shutdown() override;
+  void SetHandler(ServiceHandler* handler) override { dispatcher_.SetHandler(handler); }
+
+  /**
+   * Queues `message`, blocking while the queue is full. `done` (may be
+   * empty) runs on the executor once the message is handled, with the
+   * reply as it would be published, so compressed if it is large enough.
+   * The message is dispatched with `content_type` and `content_encoding`
+   * as a delivery's. Returns false after Shutdown(); pushes racing
+   * Shutdown() may never be handled.
+   */
+  bool Push(const std::string& message, const ReplyCallback& done = ReplyCallback(),
+            const std::string& content_type = std::string(),
+            const std::string& content_encoding = std::string());
+
+  /**
+   * Pushes every non-empty line of `path` as a message, `repeat` times,
+   * paced at Options::rate. Returns once all are queued.
+   */
+  base::Status Replay(const std::string& path, int repeat = 1);
+
+  /**
+   * Blocks until every pushed message has been handled.
+   */
+  void Drain();
+
+  const LatencyHistogram& latency() const { return latency_; }
+  const LatencyHistogram& handler_latency() const { return handler_latency_; }
+  uint64_t handled() const { return handled_.load(); }
+  uint64_t failed() const { return failed_.load(); }
+
+ private:
+  struct Item {
+    std::string message;
+    std::string content_type;
+    std::string content_encoding;
+    int64_t enqueued_us;
+    ReplyCallback done;
+  };
+
+  void Handle(Item* item);
+
+  const std::string name_;
+  const Options options_;
+  MessageDispatcher dispatcher_;
+
+  threading::MpmcQueue<Item> queue_;
+  threading::EventCount not_empty_;
+  threading::EventCount not_full_;
+  threading::EventCount drained_;
+  std::atomic<uint64_t> outstanding_;
+  std::atomic<bool> stopping_;
+
+  LatencyHistogram latency_;
+  LatencyHistogram handler_latency_;
+  std::atomic<uint64_t> handled_;
+  std::atomic<uint64_t> failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(LoopbackService);
+};
+
+} // namespace server
+#endif // SERVICE_LOOPBACK_SERVICE_H_
@@ -0,0 +1,142 @@
+#include "service/loopback_service.h"
+#include "base/file_path.h"
+#include "base/file_util.h"
+#include "base/scoped_temp_dir.h"
+#include "server/amqp/amqp_compression.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+class EchoHandler : public server::ServiceHandler {
+ public:
+  base::Status Handle(const std::string& message, std::string* reply) override {
+    if (message == "bad") {
+      return base::Status(base::Code::INVALID_ARGUMENT, "bad message");
+    }
+    reply->assign("echo:" + message);
+    return base::Status::OK();
+  }
+
+  base::Status HandleMessage(const std::string& content_type, const std::string& message,
+                             std::string* reply) override {
+    RETURN_IF_ERROR(Handle(message, reply));
+    if (!content_type.empty()) {
+      reply->insert(0, content_type + " ");
+    }
+    return base::Status::OK();
+  }
+};
+
+class LoopbackServiceTest : public testing::Test {
+ protected:
+  void Start(server::LoopbackService* service, int executors) {
+    service->SetHandler(&handler_);
+    for (int i = 0; i < executors; ++i) {
+      executors_.emplace_back([service] { service->HandleLoop(); });
+    }
+  }
+
+  void Stop(server::LoopbackService* service) {
+    service->Shutdown();
+    for (auto& executor : executors_) {
+      executor.join();
+    }
+  }
+
+  EchoHandler handler_;
+  std::vector<std::thread> executors_;
+};
+
+} // namespace
+
+TEST_F(LoopbackServiceTest, Handles_Every_Message) {
+  server::LoopbackService::Options options;
+  options.queue_capacity = 16;  // Push() has to block now and then.
+  server::LoopbackService service("loopback", options);
+  Start(&service, 4);
+
+  std::atomic<int> replies(0);
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(service.Push(std::to_string(i),
+        [&replies, i](const base::Status& status, const std::string& reply) {
+      EXPECT_TRUE(status.ok());
+      EXPECT_EQ("echo:" + std::to_string(i), reply);
+      replies++;
+    }));
+  }
+  service.Push("bad");
+  ASSERT_TRUE(service.Push("pb",
+      [&replies](const base::Status& status, const std::string& reply) {
+    EXPECT_TRUE(status.ok());
+    EXPECT_EQ("application/x-protobuf echo:pb", reply);
+    replies++;
+  }, "application/x-protobuf"));
+  service.Drain();
+
+  EXPECT_EQ(1001, replies.load());
+  EXPECT_EQ(1002u, service.handled());
+  EXPECT_EQ(1u, service.failed());
+  EXPECT_EQ(1002u, service.latency().count());
+  EXPECT_GE(service.latency().max(), service.handler_latency().min());
+
+  Stop(&service);
+  EXPECT_FALSE(service.Push("late"));
+}
+
+TEST_F(LoopbackServiceTest, Replay) {
+  base::ScopedTempDir dir;
+  ASSERT_TRUE(dir.CreateUniqueTempDir());
+  base::FilePath path = dir.path().Append("jobs.jsonl");
+  const std::string contents = "{\"book_id\":\"1\"}\r\n\n{\"book_id\":\"2\"}\n";
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            base::WriteFile(path, contents.data(), contents.size()));
+
+  server::LoopbackService::Options options;
+  options.rate = 1000;
+  server::LoopbackService service("loopback", options);
+  Start(&service, 2);
+
+  EXPECT_TRUE(service.Replay(path.value(), 5).ok());
+  service.Drain();
+  EXPECT_EQ(10u, service.handled());
+  EXPECT_EQ(0u, service.failed());
+
+  EXPECT_EQ(base::Code::NOT_FOUND,
+            service.Replay(dir.path().Append("missing").value()).code());
+  Stop(&service);
+}
+
+TEST_F(LoopbackServiceTest, Dispatches_Like_A_Consumer) {
+  server::LoopbackService service("loopback");
+  server::ServiceOptions options;
+  options.compress_min_size = 1024;
+  service.Configure(options);
+  Start(&service, 1);
+
+  const std::string large(4096, 'x');
+  server::CompressionOptions compression;
+  compression.min_size = 1;
+  std::string body;
+  ASSERT_TRUE(server::CompressPayload(large, compression, &body));
+  std::string reply;
+  ASSERT_TRUE(service.Push(body,
+      [&reply](const base::Status& status, const std::string& r) {
+    EXPECT_TRUE(status.ok());
+    reply = r;
+  }, "", server::kZstdContentEncoding));
+  service.Push("corrupt", server::LoopbackService::ReplyCallback(), "", server::kZstdContentEncoding);
+  service.Drain();
+
+  // Decompressed for the handler, its reply compressed on the way out.
+  std::string decompressed;
+  ASSERT_TRUE(server::DecompressPayload(server::kZstdContentEncoding, reply.data(),
+                                        reply.size(), &decompressed).ok());
+  EXPECT_EQ("echo:" + large, decompressed);
+  EXPECT_EQ(1u, service.failed());
+  Stop(&service);
+}
@@ -0,0 +1,76 @@
+#include "service/message_dispatcher.h"
+#include "server/log_util.h"
+#include "server/amqp/amqp_compression.h"
+#include "threading/time_util.h"
+
+#include <glog/logging.h>
+
+namespace server {
+
+MessageDispatcher::MessageDispatcher(const std::string& queue_name)
+  : MessageDispatcher(queue_name, {{"queue", queue_name}},
+                      "mq_handler_failures_total", "mq_handler_latency_seconds") {
+}
+
+MessageDispatcher::MessageDispatcher(const std::string& queue_name,
+                                     const std::string& route)
+  : MessageDispatcher(queue_name + "/" + route,
+                      {{"queue", queue_name}, {"route", route}},
+                      "mq_route_failures_total", "mq_route_latency_seconds") {
+}
+
+MessageDispatcher::MessageDispatcher(const std::string& name,
+                                     const base::MetricLabels& labels,
+                                     const char* failures_metric,
+                                     const char* latency_metric)
+  : name_(name),
+    handler_(nullptr),
+    compress_min_size_(0) {
+  base::MetricsRegistry* registry = base::MetricsRegistry::GetInstance();
+  failures_ = registry->GetCounter(failures_metric,
+      "Messages whose handler returned an error.", labels);
+  handler_latency_ = registry->GetHistogram(latency_metric,
+      "Time spent in the handler.", labels);
+}
+
+base::Status MessageDispatcher::Dispatch(const std::string& content_encoding,
+                                         const std::string& content_type,
+                                         const std::string& body,
+                                         std::string* reply,
+                                         bool* reply_compressed) {
+  *reply_compressed = false;
+  const std::string* payload;
+  base::Status status = DecodePayload(content_encoding, body, &payload);
+  if (!status.ok()) {
+    failures_->Increment();
+    LOG_EVERY_MS(ERROR, 1000) << name_ << ": " << status.ToString();
+    return status;
+  }
+  const std::string& message = *payload;
+  VLOG(1) << name_ << " received " << message.size() << " bytes, content type '"
+          << content_type << "'";
+  VLOG(2) << name_ << " received: " << Truncated(message);
+  if (!handler_) {
+    LOG_EVERY_MS(WARNING, 10000) << name_ << ": no handler, messages are dropped";
+    return base::Status::OK();
+  }
+  int64_t start = threading::TimeUtil::MonotonicTimeUsec();
+  status = handler_->HandleMessage(content_type, message, reply);
+  handler_latency_->Observe((threading::TimeUtil::MonotonicTimeUsec() - start) / 1e6);
+  if (!status.ok()) {
+    failures_->Increment();
+    // Counted in failures_; a poison flood must not turn into a log flood.
+    LOG_EVERY_MS(ERROR, 1000) << name_ << ": " << status.ToString()
+                              << ", message: " << Truncated(message);
+  }
+  CompressionOptions compression;
+  compression.min_size = compress_min_size_;
+  std::string compressed;
+  if (CompressPayload(*reply, compression, &compressed)) {
+    reply->swap(compressed);
+    *reply_compressed = true;
+  }
+  return status;
+}
+
+} // namespace server
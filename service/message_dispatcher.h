@@ -0,0 +1,61 @@
+#ifndef SERVICE_MESSAGE_DISPATCHER_H_
+#define SERVICE_MESSAGE_DISPATCHER_H_
+#include "base/macros.h"
+#include "base/metrics.h"
+#include "base/status.h"
+#include "server/async_service_interface.h"
+
+#include <stddef.h>
+
+#include <string>
+
+namespace server {
+
+// What a consumer does with each message it takes, whichever transport
+// delivered it: bodies sent with a zstd content encoding are decompressed,
+// the handler runs on the payload with the delivery's content type, and
+// replies of at least `compress_min_size` bytes are compressed (see
+// server/amqp/amqp_compression.h). AmqpConsumerService, AmqpDispatchService
+// (one per route) and LoopbackService all go through it, so a loopback
+// benchmark measures the broker path minus the broker.
+//
+// Handler failures and latency are exported to the base::MetricsRegistry
+// labelled with the queue name, and the route key for a route's. Set the
+// handler and options before the first Dispatch(); Dispatch() itself is
+// thread-safe.
+class MessageDispatcher {
+ public:
+  explicit MessageDispatcher(const std::string& queue_name);
+  // For the route `route` of an AmqpDispatchService on `queue_name`, with
+  // mq_route_failures_total and mq_route_latency_seconds as metrics.
+  MessageDispatcher(const std::string& queue_name, const std::string& route);
+
+  void SetHandler(ServiceHandler* handler) { handler_ = handler; }
+  void set_compress_min_size(size_t size) { compress_min_size_ = size; }
+
+  // `reply_compressed` tells whether `reply` is to be sent with
+  // kZstdContentEncoding. Without a handler, messages are dropped.
+  base::Status Dispatch(const std::string& content_encoding,
+                        const std::string& content_type,
+                        const std::string& body,
+                        std::string* reply,
+                        bool* reply_compressed);
+
+ private:
+  MessageDispatcher(const std::string& name,
+                    const base::MetricLabels& labels,
+                    const char* failures_metric,
+                    const char* latency_metric);
+
+  const std::string name_;  // prefix of the log lines
+  ServiceHandler* handler_;
+  size_t compress_min_size_;
+
+  base::Counter* failures_;
+  base::Histogram* handler_latency_;
+
+  DISALLOW_COPY_AND_ASSIGN(MessageDispatcher);
+};
+
+} // namespace server
+#endif // SERVICE_MESSAGE_DISPATCHER_H_
@@ -0,0 +1,71 @@
+#include "service/message_dispatcher.h"
+#include "base/metrics.h"
+#include "server/amqp/amqp_compression.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+class EchoHandler : public server::ServiceHandler {
+ public:
+  base::Status Handle(const std::string& message, std::string* reply) override {
+    if (message == "bad") {
+      return base::Status(base::Code::INVALID_ARGUMENT, "bad message");
+    }
+    reply->assign(message);
+    return base::Status::OK();
+  }
+};
+
+} // namespace
+
+TEST(MessageDispatcherTest, Decompresses_Bodies_And_Compresses_Replies) {
+  EchoHandler handler;
+  server::MessageDispatcher dispatcher("test");
+  dispatcher.SetHandler(&handler);
+  dispatcher.set_compress_min_size(1024);
+
+  const std::string large(4096, 'x');
+  server::CompressionOptions compression;
+  compression.min_size = 1;
+  std::string body;
+  ASSERT_TRUE(server::CompressPayload(large, compression, &body));
+
+  std::string reply;
+  bool reply_compressed;
+  ASSERT_TRUE(dispatcher.Dispatch(server::kZstdContentEncoding, "", body, &reply,
+                                  &reply_compressed).ok());
+  ASSERT_TRUE(reply_compressed);
+  std::string decompressed;
+  ASSERT_TRUE(server::DecompressPayload(server::kZstdContentEncoding, reply.data(),
+                                        reply.size(), &decompressed).ok());
+  EXPECT_EQ(large, decompressed);
+
+  reply.clear();
+  ASSERT_TRUE(dispatcher.Dispatch("", "", "small", &reply, &reply_compressed).ok());
+  EXPECT_FALSE(reply_compressed);
+  EXPECT_EQ("small", reply);
+
+  EXPECT_EQ(base::Code::INVALID_ARGUMENT,
+            dispatcher.Dispatch("", "", "bad", &reply, &reply_compressed).code());
+  EXPECT_EQ(base::Code::INVALID_ARGUMENT,
+            dispatcher.Dispatch(server::kZstdContentEncoding, "", "not zstd", &reply,
+                                &reply_compressed).code());
+}
+
+TEST(MessageDispatcherTest, Counts_Route_Failures_Per_Route) {
+  EchoHandler handler;
+  server::MessageDispatcher dispatcher("test_jobs", "epub");
+  dispatcher.SetHandler(&handler);
+
+  std::string reply;
+  bool reply_compressed;
+  EXPECT_FALSE(dispatcher.Dispatch("", "", "bad", &reply, &reply_compressed).ok());
+  EXPECT_TRUE(dispatcher.Dispatch("", "", "good", &reply, &reply_compressed).ok());
+
+  base::MetricsRegistry* registry = base::MetricsRegistry::GetInstance();
+  EXPECT_EQ(1u, registry->GetCounter("mq_route_failures_total", "",
+      {{"queue", "test_jobs"}, {"route", "epub"}})->value());
+  EXPECT_EQ(0u, registry->GetCounter("mq_handler_failures_total", "",
+      {{"queue", "test_jobs"}})->value());
+}
@@ -0,0 +1,45 @@
+#include "service/mysql_idempotency_store.h"
+
+#include "db/frontend/common.h"
+#include "db/frontend/result.h"
+#include "db/frontend/statement.h"
+#include "db/frontend/session.h"
+#include "db/common/exception.h"
+
+#include <glog/logging.h>
+
+namespace server {
+
+MysqlIdempotencyStore::MysqlIdempotencyStore(const std::string& db_connection_info,
+                                             const std::string& table)
+  : db_connection_info_(db_connection_info),
+    lookup_query_("SELECT reply FROM " + table + " WHERE job_key=?"),
+    record_query_("INSERT IGNORE INTO " + table + " (job_key, reply) VALUES (?, ?)") {
+}
+
+bool MysqlIdempotencyStore::Lookup(const std::string& key, std::string* reply) {
+  try {
+    db::Session sql(db_connection_info_);
+    db::Result result = sql << lookup_query_ << key << db::Row;
+    if (result.Empty()) {
+      return false;
+    }
+    result.Fetch(0, *reply);
+    return true;
+  } catch (const db::DBException& e) {
+    LOG(ERROR) << "Mysql idempotency lookup of " << key << " failed: " << e.what();
+  }
+  return false;
+}
+
+void MysqlIdempotencyStore::Record(const std::string& key, const std::string& reply) {
+  try {
+    db::Session sql(db_connection_info_);
+    db::Statement statement = sql << record_query_ << key << reply;
+    statement.Execute();
+  } catch (const db::DBException& e) {
+    LOG(ERROR) << "Mysql idempotency record of " << key << " failed: " << e.what();
+  }
+}
+
+} // namespace server
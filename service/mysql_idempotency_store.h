@@ -0,0 +1,38 @@
+#ifndef SERVICE_MYSQL_IDEMPOTENCY_STORE_H_
+#define SERVICE_MYSQL_IDEMPOTENCY_STORE_H_
+#include "base/macros.h"
+#include "service/dedup_handler.h"
+
+#include <string>
+
+namespace server {
+
+// Completed job keys in a MySQL table, shared by every consumer of the
+// database:
+//
+//   CREATE TABLE mq_idempotency (
+//     job_key    VARCHAR(64) NOT NULL PRIMARY KEY,
+//     reply      MEDIUMBLOB NOT NULL,
+//     created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP
+//   );
+//
+// Database errors are logged and the job treated as not completed, so an
+// unreachable database costs a duplicate run rather than a lost job.
+class MysqlIdempotencyStore : public IdempotencyStore {
+ public:
+  MysqlIdempotencyStore(const std::string& db_connection_info,
+                        const std::string& table);
+
+  bool Lookup(const std::string& key, std::string* reply) override;
+  void Record(const std::string& key, const std::string& reply) override;
+
+ private:
+  const std::string db_connection_info_;
+  const std::string lookup_query_;
+  const std::string record_query_;
+
+  DISALLOW_COPY_AND_ASSIGN(MysqlIdempotencyStore);
+};
+
+} // namespace server
+#endif // SERVICE_MYSQL_IDEMPOTENCY_STORE_H_
@@ -0,0 +1,51 @@
+#include "service/pausable_consumer.h"
+
+#include <glog/logging.h>
+
+namespace server {
+
+PausableConsumer::PausableConsumer(AMQP::TcpChannel* channel,
+                                   struct event_base* event_base,
+                                   const std::string& queue,
+                                   int flags,
+                                   int64_t retry_delay_ms)
+  : channel_(channel),
+    queue_(queue),
+    flags_(flags),
+    backoff_(retry_delay_ms),
+    paused_(false),
+    resume_timer_(::evtimer_new(event_base, &PausableConsumer::OnResume, this)) {
+}
+
+PausableConsumer::~PausableConsumer() {
+  ::event_free(resume_timer_);
+}
+
+void PausableConsumer::Consume(const Callback& callback) {
+  callback_ = callback;
+  // Tagged with the queue name so that Pause() can cancel it right away.
+  channel_->consume(queue_, queue_, flags_).onReceived(callback_);
+}
+
+void PausableConsumer::Pause() {
+  if (paused_) {
+    return;
+  }
+  paused_ = true;
+  channel_->cancel(queue_);
+  const int64_t delay_ms = backoff_.Next();
+  struct timeval tv = { static_cast<time_t>(delay_ms / 1000),
+                        static_cast<suseconds_t>((delay_ms % 1000) * 1000) };
+  ::evtimer_add(resume_timer_, &tv);
+  LOG(WARNING) << queue_ << ": retryable failure, consuming again in " << delay_ms
+               << " ms";
+}
+
+void PausableConsumer::OnResume(evutil_socket_t /* fd */, short /* what */, void* arg) {
+  PausableConsumer* consumer = static_cast<PausableConsumer*>(arg);
+  consumer->paused_ = false;
+  consumer->channel_->consume(consumer->queue_, consumer->queue_, consumer->flags_)
+      .onReceived(consumer->callback_);
+}
+
+} // namespace server
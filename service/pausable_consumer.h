@@ -0,0 +1,68 @@
+#ifndef SERVICE_PAUSABLE_CONSUMER_H_
+#define SERVICE_PAUSABLE_CONSUMER_H_
+#include "base/macros.h"
+#include "service/retry_backoff.h"
+
+#include <event2/event.h>
+#include <amqpcpp.h>
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+
+namespace server {
+
+// Consumes a queue on a channel, and stops consuming for a while when a
+// delivery fails with an error a retry may not get, so that an outage of
+// the service behind the handler doesn't drain the queue into failures.
+// The failed delivery goes back to the queue, and the consumer resumes on
+// its own after the RetryBackoff delay:
+//
+//   PausableConsumer consumer(channel, loop->event_base(), queue, 0, 1000);
+//   consumer.Consume(on_received);
+//   ...
+//   if (RetryBackoff::IsRetryable(status)) {
+//     channel->reject(delivery_tag, AMQP::requeue);
+//     consumer.Pause();
+//   } else {
+//     channel->ack(delivery_tag);
+//     consumer.Succeeded();
+//   }
+//
+// Deliveries received before the pause are still handled. Runs on the
+// thread of `event_base`, and goes away before the channel.
+class PausableConsumer {
+ public:
+  typedef std::function<void(const AMQP::Message&, uint64_t, bool)> Callback;
+
+  PausableConsumer(AMQP::TcpChannel* channel, struct event_base* event_base,
+                   const std::string& queue, int flags, int64_t retry_delay_ms);
+  ~PausableConsumer();
+
+  void Consume(const Callback& callback);
+
+  // Stops consuming until the next backoff delay has passed, unless paused
+  // already.
+  void Pause();
+  // A delivery was handled, and the next pause is back to the first delay.
+  void Succeeded() { backoff_.Reset(); }
+
+  bool paused() const { return paused_; }
+
+ private:
+  static void OnResume(evutil_socket_t fd, short what, void* arg);
+
+  AMQP::TcpChannel* const channel_;
+  const std::string queue_;
+  const int flags_;
+  Callback callback_;
+  RetryBackoff backoff_;
+  bool paused_;
+  struct event* resume_timer_;
+
+  DISALLOW_COPY_AND_ASSIGN(PausableConsumer);
+};
+
+} // namespace server
+#endif // SERVICE_PAUSABLE_CONSUMER_H_
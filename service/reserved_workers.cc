@@ -0,0 +1,28 @@
+#include "service/reserved_workers.h"
+
+#include <algorithm>
+
+namespace server {
+
+ReservedWorkers::ReservedWorkers(int workers, int reserved_workers, int short_priority,
+                                 const RouteTable::SubmitFunction& submit)
+  : short_priority_(short_priority),
+    submit_(submit),
+    long_jobs_(submit) {
+  long_jobs_.Add("long", nullptr, std::max(workers - reserved_workers, 1));
+  long_route_ = long_jobs_.Find("long");
+}
+
+bool ReservedWorkers::TryRun(int priority, const RouteTable::Task& task) {
+  if (IsShort(priority)) {
+    submit_(task);
+    return true;
+  }
+  return long_jobs_.TryRun(long_route_, task);
+}
+
+void ReservedWorkers::RunLong(const RouteTable::Task& task) {
+  long_jobs_.Run(long_route_, task);
+}
+
+} // namespace server
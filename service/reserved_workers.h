@@ -0,0 +1,56 @@
+#ifndef SERVICE_RESERVED_WORKERS_H_
+#define SERVICE_RESERVED_WORKERS_H_
+#include "base/macros.h"
+#include "service/route_table.h"
+
+#include <stddef.h>
+
+namespace server {
+
+// Keeps `reserved_workers` of a consumer's `workers` for short jobs, those
+// whose delivery priority is at least `short_priority`: long jobs run at
+// most long_limit() = workers - reserved_workers (at least one) at a time.
+//
+// A long job over the limit must not wait holding an unacknowledged
+// delivery, or a burst of them fills the prefetch window and no short job
+// gets delivered to the idle reserved workers. TryRun() therefore refuses
+// it, and the consumer moves it to a queue of its own, consumed with
+// long_limit() as prefetch, whose deliveries go to RunLong(). With that,
+// a prefetch of `workers` always leaves room for reserved_workers short
+// deliveries.
+//
+//   if (!reserved.TryRun(priority, task)) {
+//     ... republish to the long queue and ack ...
+//   }
+//
+// Thread-safe.
+class ReservedWorkers {
+ public:
+  ReservedWorkers(int workers, int reserved_workers, int short_priority,
+                  const RouteTable::SubmitFunction& submit);
+
+  bool IsShort(int priority) const { return priority >= short_priority_; }
+
+  // Submits a short task, or a long one under the limit, and returns true.
+  // Returns false for a long task at the limit.
+  bool TryRun(int priority, const RouteTable::Task& task);
+
+  // Submits a long task now if under the limit, or once a long one
+  // finishes.
+  void RunLong(const RouteTable::Task& task);
+
+  int long_limit() const { return long_route_->max_concurrency; }
+  int long_running() const { return long_jobs_.running(long_route_); }
+  size_t long_waiting() const { return long_jobs_.queued(long_route_); }
+
+ private:
+  const int short_priority_;
+  const RouteTable::SubmitFunction submit_;
+  RouteTable long_jobs_;
+  RouteTable::Route* long_route_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReservedWorkers);
+};
+
+} // namespace server
+#endif // SERVICE_RESERVED_WORKERS_H_
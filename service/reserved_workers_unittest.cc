@@ -0,0 +1,52 @@
+#include "service/reserved_workers.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST(ReservedWorkersTest, Long_Jobs_Never_Hold_Up_Short_Ones) {
+  // 4 workers, 1 reserved; submitted tasks run when the test says so.
+  std::vector<server::RouteTable::Task> submitted;
+  server::ReservedWorkers reserved(4, 1, 5, [&submitted](const server::RouteTable::Task& task) {
+    submitted.push_back(task);
+  });
+  EXPECT_EQ(3, reserved.long_limit());
+
+  // A prefetch window of `workers` deliveries, fed 20 long jobs and then a
+  // short one. A delivery holds its slot until its task finishes; refused
+  // ones go to the long queue and free theirs at once.
+  const int prefetch = 4;
+  int unacked = 0;
+  int moved = 0;
+  bool short_ran = false;
+  for (int i = 0; i < 20 && unacked < prefetch; ++i) {
+    unacked++;
+    if (!reserved.TryRun(0, [] {})) {
+      moved++;
+      unacked--;
+    }
+  }
+  EXPECT_EQ(3, unacked);
+  EXPECT_EQ(17, moved);
+  ASSERT_LT(unacked, prefetch);
+  unacked++;
+  EXPECT_TRUE(reserved.TryRun(9, [&short_ran] { short_ran = true; }));
+  ASSERT_EQ(4u, submitted.size());
+  server::RouteTable::Task last = submitted.back();
+  last();
+  EXPECT_TRUE(short_ran);
+
+  // Long queue deliveries wait for a long slot, not a reserved one.
+  reserved.RunLong([] {});
+  EXPECT_EQ(1u, reserved.long_waiting());
+  EXPECT_EQ(3, reserved.long_running());
+  server::RouteTable::Task first = submitted[0];
+  first();
+  EXPECT_EQ(0u, reserved.long_waiting());
+  EXPECT_EQ(3, reserved.long_running());
+  EXPECT_EQ(5u, submitted.size());
+
+  // All workers reserved still lets one long job through.
+  server::ReservedWorkers all(2, 2, 5, [](const server::RouteTable::Task&) {});
+  EXPECT_EQ(1, all.long_limit());
+}
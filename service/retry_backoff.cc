@@ -0,0 +1,24 @@
+#include "service/retry_backoff.h"
+
+namespace server {
+
+namespace {
+
+const int kMaxDoublings = 4;
+
+} // namespace
+
+bool RetryBackoff::IsRetryable(const base::Status& status) {
+  return status.code() == base::Code::UNAVAILABLE ||
+         status.code() == base::Code::DEADLINE_EXCEEDED;
+}
+
+int64_t RetryBackoff::Next() {
+  int64_t delay_ms = delay_ms_ << failures_;
+  if (failures_ < kMaxDoublings) {
+    failures_++;
+  }
+  return delay_ms;
+}
+
+} // namespace server
@@ -0,0 +1,31 @@
+#ifndef SERVICE_RETRY_BACKOFF_H_
+#define SERVICE_RETRY_BACKOFF_H_
+#include "base/status.h"
+
+#include <stdint.h>
+
+namespace server {
+
+// How long to stop taking deliveries after one failed with an error a
+// retry may not get: `delay_ms` at first, twice as long for each further
+// failure, up to 16 times `delay_ms`, and `delay_ms` again after a
+// success. Not thread-safe.
+class RetryBackoff {
+ public:
+  explicit RetryBackoff(int64_t delay_ms) : delay_ms_(delay_ms), failures_(0) {}
+
+  // UNAVAILABLE and DEADLINE_EXCEEDED: the service behind the handler is
+  // down or too slow, and the same job may well succeed later.
+  static bool IsRetryable(const base::Status& status);
+
+  // The delay after another failure.
+  int64_t Next();
+  void Reset() { failures_ = 0; }
+
+ private:
+  const int64_t delay_ms_;
+  int failures_;  // in a row, up to the last doubling
+};
+
+} // namespace server
+#endif // SERVICE_RETRY_BACKOFF_H_
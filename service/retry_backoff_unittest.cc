@@ -0,0 +1,27 @@
+#include "service/retry_backoff.h"
+
+#include <gtest/gtest.h>
+
+TEST(RetryBackoffTest, Doubles_Up_To_Sixteen_Times) {
+  server::RetryBackoff backoff(100);
+  EXPECT_EQ(100, backoff.Next());
+  EXPECT_EQ(200, backoff.Next());
+  EXPECT_EQ(400, backoff.Next());
+  EXPECT_EQ(800, backoff.Next());
+  EXPECT_EQ(1600, backoff.Next());
+  EXPECT_EQ(1600, backoff.Next());
+  backoff.Reset();
+  EXPECT_EQ(100, backoff.Next());
+}
+
+TEST(RetryBackoffTest, Retries_Outages_Only) {
+  EXPECT_TRUE(server::RetryBackoff::IsRetryable(
+      base::Status(base::Code::UNAVAILABLE, "circuit open")));
+  EXPECT_TRUE(server::RetryBackoff::IsRetryable(
+      base::Status(base::Code::DEADLINE_EXCEEDED, "out of time")));
+  EXPECT_FALSE(server::RetryBackoff::IsRetryable(base::Status::OK()));
+  EXPECT_FALSE(server::RetryBackoff::IsRetryable(
+      base::Status(base::Code::INVALID_ARGUMENT, "bad job")));
+  EXPECT_FALSE(server::RetryBackoff::IsRetryable(
+      base::Status(base::Code::INTERNAL, "transcode failed")));
+}
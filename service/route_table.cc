@@ -0,0 +1,75 @@
+#include "service/route_table.h"
+#include "threading/mutex.h"
+
+namespace server {
+
+bool RouteTable::Add(const std::string& key, ServiceHandler* handler, int max_concurrency) {
+  std::unique_ptr<Route>& route = routes_[key];
+  if (route) {
+    return false;
+  }
+  route.reset(new Route(key, handler, max_concurrency > 0 ? max_concurrency : 0));
+  return true;
+}
+
+RouteTable::Route* RouteTable::Find(const std::string& key) const {
+  auto it = routes_.find(key);
+  return it == routes_.end() ? nullptr : it->second.get();
+}
+
+void RouteTable::Run(Route* route, const Task& task) {
+  {
+    threading::Guard g(route->lock);
+    if (route->max_concurrency > 0 && route->running >= route->max_concurrency) {
+      route->queued.push_back(task);
+      return;
+    }
+    route->running++;
+  }
+  Submit(route, task);
+}
+
+bool RouteTable::TryRun(Route* route, const Task& task) {
+  {
+    threading::Guard g(route->lock);
+    if (route->max_concurrency > 0 && route->running >= route->max_concurrency) {
+      return false;
+    }
+    route->running++;
+  }
+  Submit(route, task);
+  return true;
+}
+
+int RouteTable::running(Route* route) const {
+  threading::Guard g(route->lock);
+  return route->running;
+}
+
+size_t RouteTable::queued(Route* route) const {
+  threading::Guard g(route->lock);
+  return route->queued.size();
+}
+
+void RouteTable::Submit(Route* route, const Task& task) {
+  submit_([this, route, task] {
+    task();
+    Finished(route);
+  });
+}
+
+void RouteTable::Finished(Route* route) {
+  Task next;
+  {
+    threading::Guard g(route->lock);
+    if (route->queued.empty()) {
+      route->running--;
+      return;
+    }
+    next = std::move(route->queued.front());
+    route->queued.pop_front();
+  }
+  Submit(route, next);
+}
+
+} // namespace server
@@ -0,0 +1,93 @@
+#ifndef SERVICE_ROUTE_TABLE_H_
+#define SERVICE_ROUTE_TABLE_H_
+#include "base/macros.h"
+#include "server/async_service_interface.h"
+#include "threading/futex_mutex.h"
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace server {
+
+// The handlers of an AmqpDispatchService by key (a routing key or a
+// message type), each with a limit on how many of its messages are handled
+// at once. AmqpConsumerService caps its long jobs with a route too.
+//
+// Routes are added up front and the table is read-only afterwards, so
+// Find() is one hash lookup without locking. Run() passes a route's task
+// to `submit` while the route is under its limit and queues it otherwise;
+// a finished task starts the next queued one of the same route. A slow
+// route therefore holds its own queue instead of every worker.
+//
+//   RouteTable routes(submit);
+//   routes.Add("video_rpc_queue", transcoder, 4);
+//   ...
+//   RouteTable::Route* route = routes.Find(message.routingkey());
+//   routes.Run(route, [=] { route->handler->HandleMessage(...); });
+//
+// Find() and Run() are thread-safe.
+class RouteTable {
+ public:
+  typedef std::function<void()> Task;
+  typedef std::function<void(const Task&)> SubmitFunction;
+
+  struct Route {
+    Route(const std::string& key, ServiceHandler* handler, int max_concurrency)
+        : key(key), handler(handler), max_concurrency(max_concurrency), running(0) {}
+
+    const std::string key;
+    ServiceHandler* const handler;
+    const int max_concurrency;  // 0 = unlimited
+
+    threading::FutexMutex lock;
+    int running;              // guarded by lock
+    std::deque<Task> queued;  // guarded by lock
+  };
+
+  explicit RouteTable(const SubmitFunction& submit) : submit_(submit) {}
+
+  // Not thread-safe; call before the first Find(). Returns false if `key`
+  // already has a route.
+  bool Add(const std::string& key, ServiceHandler* handler, int max_concurrency);
+
+  // The route of `key`, nullptr if there is none.
+  Route* Find(const std::string& key) const;
+
+  // Submits `task` now if `route` is under its limit, or once one of its
+  // running tasks finishes.
+  void Run(Route* route, const Task& task);
+
+  // Submits `task` and returns true if `route` is under its limit, which
+  // it isn't while anything is queued; returns false otherwise.
+  bool TryRun(Route* route, const Task& task);
+
+  // Running and queued tasks of `route`.
+  int running(Route* route) const;
+  size_t queued(Route* route) const;
+
+  template <typename Visitor>
+  void ForEach(const Visitor& visitor) const {
+    for (const auto& entry : routes_) {
+      visitor(entry.second.get());
+    }
+  }
+
+  size_t size() const { return routes_.size(); }
+
+ private:
+  void Submit(Route* route, const Task& task);
+  void Finished(Route* route);
+
+  const SubmitFunction submit_;
+  std::unordered_map<std::string, std::unique_ptr<Route>> routes_;
+
+  DISALLOW_COPY_AND_ASSIGN(RouteTable);
+};
+
+} // namespace server
+#endif // SERVICE_ROUTE_TABLE_H_
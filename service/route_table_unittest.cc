@@ -0,0 +1,100 @@
+#include "service/route_table.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+class NullHandler : public server::ServiceHandler {
+ public:
+  base::Status Handle(const std::string&, std::string*) override {
+    return base::Status::OK();
+  }
+};
+
+} // namespace
+
+TEST(RouteTableTest, Finds_Routes_By_Key) {
+  NullHandler epub_info, transcoder;
+  server::RouteTable routes([](const server::RouteTable::Task& task) { task(); });
+  EXPECT_TRUE(routes.Add("epub_info_queue", &epub_info, 0));
+  EXPECT_TRUE(routes.Add("video_rpc_queue", &transcoder, 2));
+  EXPECT_FALSE(routes.Add("video_rpc_queue", &epub_info, 1));
+  EXPECT_EQ(2u, routes.size());
+
+  ASSERT_NE(nullptr, routes.Find("video_rpc_queue"));
+  EXPECT_EQ(&transcoder, routes.Find("video_rpc_queue")->handler);
+  EXPECT_EQ(2, routes.Find("video_rpc_queue")->max_concurrency);
+  EXPECT_EQ(&epub_info, routes.Find("epub_info_queue")->handler);
+  EXPECT_EQ(nullptr, routes.Find("video_rpc"));
+}
+
+TEST(RouteTableTest, Limits_Concurrency_Per_Route) {
+  // Submitted tasks wait here until the test runs them.
+  std::vector<server::RouteTable::Task> submitted;
+  server::RouteTable routes([&submitted](const server::RouteTable::Task& task) {
+    submitted.push_back(task);
+  });
+  NullHandler slow, fast;
+  routes.Add("slow", &slow, 2);
+  routes.Add("fast", &fast, 0);
+  server::RouteTable::Route* slow_route = routes.Find("slow");
+  server::RouteTable::Route* fast_route = routes.Find("fast");
+
+  std::vector<int> done;
+  for (int i = 0; i < 5; ++i) {
+    routes.Run(slow_route, [&done, i] { done.push_back(i); });
+  }
+  for (int i = 0; i < 3; ++i) {
+    routes.Run(fast_route, [&done, i] { done.push_back(100 + i); });
+  }
+  // Two slow ones and every fast one; the other slow ones wait their turn.
+  EXPECT_EQ(5u, submitted.size());
+  EXPECT_EQ(2, routes.running(slow_route));
+  EXPECT_EQ(3u, routes.queued(slow_route));
+  EXPECT_EQ(3, routes.running(fast_route));
+  EXPECT_EQ(0u, routes.queued(fast_route));
+
+  // Each finished slow task submits the next one, in order.
+  for (size_t i = 0; i < submitted.size(); ++i) {
+    server::RouteTable::Task task = submitted[i];
+    task();
+  }
+  EXPECT_EQ(8u, submitted.size());
+  EXPECT_EQ((std::vector<int>{0, 1, 100, 101, 102, 2, 3, 4}), done);
+  EXPECT_EQ(0, routes.running(slow_route));
+  EXPECT_EQ(0u, routes.queued(slow_route));
+  EXPECT_EQ(0, routes.running(fast_route));
+}
+
+TEST(RouteTableTest, Try_Run_Never_Queues) {
+  std::vector<server::RouteTable::Task> submitted;
+  server::RouteTable routes([&submitted](const server::RouteTable::Task& task) {
+    submitted.push_back(task);
+  });
+  NullHandler handler;
+  routes.Add("slow", &handler, 1);
+  routes.Add("fast", &handler, 0);
+  server::RouteTable::Route* slow = routes.Find("slow");
+
+  int runs = 0;
+  EXPECT_TRUE(routes.TryRun(slow, [&runs] { runs++; }));
+  EXPECT_FALSE(routes.TryRun(slow, [&runs] { runs++; }));
+  routes.Run(slow, [&runs] { runs++; });
+  EXPECT_EQ(1u, routes.queued(slow));
+  EXPECT_TRUE(routes.TryRun(routes.Find("fast"), [&runs] { runs++; }));
+
+  // The queued task goes before anything tried later.
+  server::RouteTable::Task first = submitted[0];
+  first();
+  EXPECT_FALSE(routes.TryRun(slow, [&runs] { runs++; }));
+  EXPECT_EQ(0u, routes.queued(slow));
+  for (size_t i = 1; i < submitted.size(); ++i) {
+    server::RouteTable::Task task = submitted[i];
+    task();
+  }
+  EXPECT_EQ(3, runs);
+  EXPECT_EQ(0, routes.running(slow));
+  EXPECT_TRUE(routes.TryRun(slow, [&runs] { runs++; }));
+}
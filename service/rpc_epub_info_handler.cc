@@ -1,88 +1,96 @@
-#include "base/numbers.h"
 #include "base/file_path.h"
 #include "service/rpc_epub_info_handler.h"
-#include "third_party/rapidjson/include/rapidjson/reader.h"
-#include "third_party/rapidjson/include/rapidjson/document.h"
+#include "service/job_decoder.h"
+#include "server/log_util.h"
 
 #include "db/frontend/common.h"
 #include "db/frontend/result.h"
 #include "db/frontend/statement.h"
 #include "db/frontend/session.h"
 
+#include "threading/thread_local_cache.h"
+#include "threading/time_util.h"
+
 namespace server {
 
-RpcEpubInfoServiceHandler::RpcEpubInfoServiceHandler(const std::string& address,
-                                                     const std::string& db_connection_info)
-  : address_(address) ,
-    db_connection_info_(db_connection_info) {
-  Init();
-}
+namespace {
 
-void RpcEpubInfoServiceHandler::Init() {
-  channel_ = grpc::CreateChannel(address_, grpc::InsecureChannelCredentials());  
-  CHECK(channel_);
-  stub_ = epub_info::EpubInfo::NewStub(channel_);
-  CHECK(stub_);
-  
+// Decoding overwrites every field, so the strings just keep their capacity.
+threading::ThreadLocalObjectCache<EpubInfoJob> job_cache;
+threading::ThreadLocalObjectCache<
+    epub_info::GetEpubCatalogRequest,
+    threading::ClearObjectReset<epub_info::GetEpubCatalogRequest> > request_cache;
+threading::ThreadLocalObjectCache<
+    epub_info::GetEpubCatalogResponse,
+    threading::ClearObjectReset<epub_info::GetEpubCatalogResponse> > response_cache;
+
+} // namespace
+
+RpcEpubInfoServiceHandler::RpcEpubInfoServiceHandler(const std::string& address,
+                                                     const std::string& db_connection_info,
+                                                     const GrpcChannelPoolOptions& pool_options,
+                                                     const DeadlineOptions& deadline_options)
+  : epub_info_service_("epub_info", address, pool_options),
+    get_epub_catalog_metrics_("epub_info.EpubInfo/GetEpubCatalog"),
+    db_connection_info_(db_connection_info),
+    deadline_options_(deadline_options) {
 }
 
 base::Status
 RpcEpubInfoServiceHandler::Handle(const std::string& message, std::string* output) {
-  // handle json
-  rapidjson::Document d;
-  rapidjson::ParseResult ok = d.Parse(message.c_str());
-  if (!ok) {
-    return base::Status(base::Code::INVALID_ARGUMENT, "Can't parse json: " + message);
-  }
-
-  std::string book_id;
-  std::string book_path;
-
-  if (!d.HasMember("book_id")  &&
-      !d.HasMember("book_path")) {
-    return base::Status(base::Code::INVALID_ARGUMENT, "expect book_id and book_path");
-  }
+  return HandleMessage(kJsonContentType, message, output);
+}
 
-  rapidjson::Value& book_id_val = d["book_id"];
-  rapidjson::Value& book_path_val = d["book_path"];
-  book_id = book_id_val.GetString();
-  book_path = book_path_val.GetString();
-  const std::string catalog_path =  base::FilePath(book_path).ReplaceExtension(".info").value();
+base::Status
+RpcEpubInfoServiceHandler::HandleMessage(const std::string& content_type,
+                                         const std::string& message,
+                                         std::string* output) {
+  auto job = job_cache.Acquire();
+  RETURN_IF_ERROR(DecodeEpubInfoJob(content_type, message, job.get()));
+  const std::string catalog_path = base::FilePath(job->book_path).ReplaceExtension(".info").value();
 
   // handle rpc
-  epub_info::GetEpubCatalogRequest request;
-  epub_info::GetEpubCatalogResponse response;
+  auto request = request_cache.Acquire();
+  auto response = response_cache.Acquire();
 
-  int64_t book_id_int = 0;
-  base::StringAsValue<int64_t>(book_id, &book_id_int);
-  request.set_book_id(book_id_int);
-  request.set_book_path(book_path);
-  request.set_catalog_path(catalog_path);
+  request->set_book_id(job->book_id);
+  request->set_book_path(job->book_path);
+  request->set_catalog_path(catalog_path);
 
   grpc::ClientContext context;
-  grpc::Status rcp_status = stub_->GetEpubCatalog(&context, request, &response);
+  int64_t start = threading::TimeUtil::MonotonicTimeUsec();
+  JobDeadline deadline(deadline_options_);
+  auto epub_info = epub_info_service_.Pick(deadline, true, &context);
+  RETURN_IF_ERROR(epub_info.status());
+  grpc::Status rcp_status = epub_info->GetEpubCatalog(&context, *request, response.get());
+  epub_info.Done(rcp_status);
+  get_epub_catalog_metrics_.Record(start, rcp_status);
 
   if (rcp_status.ok()) {
-    std::string ret_catalog_path = response.catalog_path();
-    LOG(INFO) << "-----catalog_path: " << ret_catalog_path; 
+    std::string ret_catalog_path = response->catalog_path();
+    VLOG(1) << "catalog_path: " << ret_catalog_path;
     output->assign(ret_catalog_path);
     // persistence::GetInstance().UpdateEpubCatalog(book_id_int, catalog_path);
     try {
       db::Session sql(db_connection_info_);
       db::Statement statement = sql << "UPDATE t_book SET epub_info_dir=? WHERE id=?"
             << ret_catalog_path
-            << book_id_int;
+            << job->book_id;
       statement.Execute();
-      LOG(INFO) << "-----Affected rows " << statement.Affected();
+      VLOG(1) << "Affected rows " << statement.Affected();
     } catch (...) {
     }
 
     return base::Status::OK();
   } else {
-    LOG(ERROR) << "rpc error: " << rcp_status.error_message();
+    LOG_EVERY_MS(ERROR, 1000) << "rpc error: " << rcp_status.error_message();
+    if (!epub_info_service_.IsHealthy(rcp_status)) {
+      // Not the book's fault: worth retrying.
+      return FromRpcStatus(rcp_status, "RPC: book_path " + job->book_path);
+    }
   }
   
-  return base::Status(base::Code::DATA_LOSS, "RCP: book_path " + book_path + " Loss");
+  return base::Status(base::Code::DATA_LOSS, "RCP: book_path " + job->book_path + " Loss");
 }
 
 } // namespace server
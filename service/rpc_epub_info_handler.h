@@ -6,6 +6,9 @@
 #include "db/frontend/session.h"
 
 #include "service/amqp_consumer_service.h"
+#include "service/grpc_call_metrics.h"
+#include "service/grpc_channel_pool.h"
+#include "service/job_deadline.h"
 
 #include <memory>
 #include <grpc++/grpc++.h>
@@ -16,29 +19,39 @@ namespace server {
 
 class RpcEpubInfoServiceHandler : public ServiceHandler {
  public:
+  // `address` may list several replicas, comma-separated, which calls are
+  // balanced over (see service/grpc_channel_pool.h). GetEpubCatalog gets
+  // the earlier of `deadline_options`' job budget and RPC timeout.
   RpcEpubInfoServiceHandler(const std::string& address,
-                            const std::string& db_connection);
+                            const std::string& db_connection,
+                            const GrpcChannelPoolOptions& pool_options =
+                                GrpcChannelPoolOptions(),
+                            const DeadlineOptions& deadline_options =
+                                DeadlineOptions());
 
   virtual ~RpcEpubInfoServiceHandler() {} 
 
   // From AmqpConsumerServiceHandler
-  // @message { "book_id":"NUMBER", "book_path" : "PATH" }
-  // @output  nullptr
+  // @message { "book_id":"NUMBER", "book_path" : "PATH" }, or a
+  //          jobs.EpubInfoJob with content type application/x-protobuf
+  // @output  catalog path, replied to the caller's reply_to queue
   //
-  // json = dump_json(message);
-  // response = RPC_GetEpubCatalog(json_to_proto(json));
+  // job = DecodeEpubInfoJob(content_type, message);
+  // response = RPC_GetEpubCatalog(job);
   // UpdateDB(response);
   //
+  virtual base::Status HandleMessage(const std::string& content_type,
+                                     const std::string& message,
+                                     std::string* output) override;
+  // A JSON message.
   virtual base::Status Handle(const std::string& message, std::string* output) override;
 
  private:
-  const std::string address_; // "host:port"
-  std::unique_ptr<epub_info::EpubInfo::Stub> stub_; 
-  std::shared_ptr<grpc::Channel> channel_;
+  GrpcChannelPool<epub_info::EpubInfo> epub_info_service_;
+  GrpcCallMetrics get_epub_catalog_metrics_;
   
   const std::string db_connection_info_;
-
-  void Init();
+  const DeadlineOptions deadline_options_;
 };
 
 } // namespace server
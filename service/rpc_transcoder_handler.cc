@@ -1,13 +1,17 @@
 #include "service/rpc_transcoder_handler.h"
+#include "service/hls_playlist.h"
+#include "service/job_decoder.h"
+#include "server/log_util.h"
 
-#include "third_party/rapidjson/include/rapidjson/reader.h"
-#include "third_party/rapidjson/include/rapidjson/document.h"
+#include "third_party/rapidjson/include/rapidjson/stringbuffer.h"
+#include "third_party/rapidjson/include/rapidjson/writer.h"
 
 #include "base/file_util.h"
 #include "base/file_path.h"
 #include "base/dir_reader.h"
 #include "base/string_util.h"
 #include "base/string_encode.h"
+#include "base/string_printf.h"
 #include "base/numbers.h"
 
 #include "db/frontend/common.h"
@@ -16,42 +20,123 @@
 #include "db/frontend/session.h"
 #include "db/common/exception.h"
 
+#include "threading/thread_local_cache.h"
+#include "threading/time_util.h"
+
 #include <exception>
+#include <thread>
+#include <vector>
 
 namespace server {
 
+// A transcode takes as long as the video, so it is never slow.
+static GrpcChannelPoolOptions TranscoderPoolOptions(GrpcChannelPoolOptions options) {
+  options.breaker.slow_call_ms = 0;
+  return options;
+}
+
 RpcTranscoderServiceHandler::RpcTranscoderServiceHandler(
         const std::string& transcoder_service_address,
         const std::string& crypto_service_address,
-        const std::string& db_connection_info) 
-    : transcoder_service_address_(transcoder_service_address),
-      symmetric_service_address_(crypto_service_address),
-      asymmetric_service_address_(crypto_service_address),
-      db_connection_info_(db_connection_info) {
-  Init();      
+        const std::string& db_connection_info,
+        const GrpcChannelPoolOptions& pool_options,
+        const DeadlineOptions& deadline_options,
+        const KeyPool::Options& key_pool_options)
+    : transcoder_service_("transcoder", transcoder_service_address,
+                          TranscoderPoolOptions(pool_options)),
+      symmetric_service_("symmetric", crypto_service_address, pool_options),
+      asymmetric_service_("asymmetric", crypto_service_address, pool_options),
+      db_connection_info_(db_connection_info),
+      deadline_options_(deadline_options),
+      create_symmetric_key_metrics_("crypto.SymmetricService/CreateSymmetricKey"),
+      create_key_pair_metrics_("crypto.AsymmetricService/CreateKeyPair"),
+      transcode_metrics_("transcoder.Transcoder/Transcode"),
+      cbc_encrypt_files_metrics_("crypto.SymmetricService/CbcEncryptFiles"),
+      ecb_encrypt_file_metrics_("crypto.SymmetricService/EcbEncryptFile"),
+      public_key_encrypt_metrics_("crypto.AsymmetricService/PublicKeyEncrypt"),
+      cbc_keys_("cbc",
+                [this](KeyPool::Key* key) { return GenerateCbcKey(key); },
+                key_pool_options),
+      sm2_key_pairs_("sm2",
+                     [this](KeyPool::Key* key) { return GenerateSm2KeyPair(key); },
+                     key_pool_options) {
+  for (KeyPool* pool : {&cbc_keys_, &sm2_key_pairs_}) {
+    base::Status status = pool->Start();
+    if (!status.ok()) {
+      LOG(WARNING) << status.ToString() << "; generating keys per job";
+    }
+  }
+}
+
+base::Status RpcTranscoderServiceHandler::GenerateCbcKey(KeyPool::Key* key) {
+  // Made ahead of any job: the RPC timeout is all the deadline there is.
+  DeadlineOptions options;
+  options.rpc_timeout_ms = deadline_options_.rpc_timeout_ms;
+  JobDeadline deadline(options);
+  grpc::ClientContext context;
+  crypto::CreateSymmetricKeyRequest request;
+  crypto::CreateSymmetricKeyResponse response;
+  request.set_key_bits(crypto::SymmetricKey128Bits);
+  int64_t start = threading::TimeUtil::MonotonicTimeUsec();
+  auto symmetric = symmetric_service_.Pick(deadline, true, &context);
+  RETURN_IF_ERROR(symmetric.status());
+  grpc::Status rpc_status = symmetric->CreateSymmetricKey(&context, request, &response);
+  symmetric.Done(rpc_status);
+  create_symmetric_key_metrics_.Record(start, rpc_status);
+  RETURN_IF_ERROR(FromRpcStatus(rpc_status, "rpc generate cbc key error"));
+  key->push_back(response.key());
+  KeyPool::Wipe(response.mutable_key());
+  return base::Status::OK();
 }
 
-void RpcTranscoderServiceHandler::Init() {
-  transcoder_service_channel_ = grpc::CreateChannel(transcoder_service_address_,
-                                                    grpc::InsecureChannelCredentials());
-  DCHECK(transcoder_service_channel_);
-  transcoder_service_stub_ = transcoder::Transcoder::NewStub(transcoder_service_channel_);
-  DCHECK(transcoder_service_stub_);
-
-  symmetric_service_channel_ = grpc::CreateChannel(symmetric_service_address_,
-                                                   grpc::InsecureChannelCredentials());
-  asymmetric_service_channel_ = grpc::CreateChannel(asymmetric_service_address_,
-                                                    grpc::InsecureChannelCredentials());
-  DCHECK(symmetric_service_channel_);
-  DCHECK(asymmetric_service_channel_);
-
-  symmetric_service_stub_ = crypto::SymmetricService::NewStub(symmetric_service_channel_);
-  DCHECK(symmetric_service_stub_);
-
-  asymmetric_service_stub_ = crypto::AsymmetricService::NewStub(asymmetric_service_channel_);
-  DCHECK(asymmetric_service_stub_);
+base::Status RpcTranscoderServiceHandler::GenerateSm2KeyPair(KeyPool::Key* key) {
+  DeadlineOptions options;
+  options.rpc_timeout_ms = deadline_options_.rpc_timeout_ms;
+  JobDeadline deadline(options);
+  grpc::ClientContext context;
+  crypto::CreateKeyPairRequest request;
+  crypto::CreateKeyPairResponse response;
+  request.set_type(crypto::SM2);
+  request.set_key_bits(crypto::KEY256BITS);
+  int64_t start = threading::TimeUtil::MonotonicTimeUsec();
+  auto asymmetric = asymmetric_service_.Pick(deadline, true, &context);
+  RETURN_IF_ERROR(asymmetric.status());
+  grpc::Status rpc_status = asymmetric->CreateKeyPair(&context, request, &response);
+  asymmetric.Done(rpc_status);
+  create_key_pair_metrics_.Record(start, rpc_status);
+  RETURN_IF_ERROR(FromRpcStatus(rpc_status, "rpc generate sm2 key error"));
+  key->push_back(response.public_key());
+  key->push_back(response.private_key());
+  KeyPool::Wipe(response.mutable_private_key());
+  return base::Status::OK();
 }
-    
+
+namespace {
+
+// Clear() deletes the sub-messages of a proto3 message; clearing them in
+// place keeps them, and the capacity of their strings, for the next job.
+// They stay set, empty, which reads the same as unset.
+struct TranscodeRequestReset {
+  void operator()(transcoder::TranscodeRequest* request) const {
+    request->mutable_media_source_path()->clear();
+    request->mutable_media_target_path()->clear();
+    request->mutable_audio_data()->Clear();
+    request->mutable_video_data()->Clear();
+    request->mutable_segment_data()->Clear();
+    request->mutable_renditions()->Clear();
+  }
+};
+
+// Decoding overwrites every field, so the strings just keep their capacity.
+threading::ThreadLocalObjectCache<TranscodeJob> transcode_job_cache;
+threading::ThreadLocalObjectCache<
+    transcoder::TranscodeRequest, TranscodeRequestReset> transcode_request_cache;
+threading::ThreadLocalObjectCache<
+    transcoder::TranscodeResponse,
+    threading::ClearObjectReset<transcoder::TranscodeResponse> > transcode_response_cache;
+
+} // namespace
+
 static void ReplaceAll(std::string& source, 
                        const std::string& search, 
                        const std::string replace) {
@@ -69,107 +154,200 @@ static std::string MakeExtM3u8KeyPath(const std::string& http_key_path) {
   return std::string("METHOD=AES-128,URI=") + "\"" + http_key_path + "\"";
 }
 
+base::Status RpcTranscoderServiceHandler::EncryptSegments(
+    const JobDeadline& deadline, const std::string& key,
+    const std::vector<std::pair<base::FilePath, base::FilePath>>& dirs) {
+  // {source, target}
+  std::vector<std::pair<std::string, std::string>> segments;
+  for (const auto& dir : dirs) {
+    base::DirReader dir_reader(dir.first.value().c_str());
+    while (dir_reader.Next()) {
+      std::string name = dir_reader.name();
+      std::string ext = base::FilePath(name).Extension();
+      if (name != ".." && name != "." && base::CompareCaseInsensitiveASCII(ext, ".ts") == 0) {
+        segments.emplace_back(dir.first.Append(name).value(), dir.second.Append(name).value());
+      }
+    }
+  }
+  if (segments.empty()) {
+    return base::Status::OK();
+  }
+
+  // Every segment over one stream, bounded by the job's budget only.
+  grpc::ClientContext context;
+  int64_t start = threading::TimeUtil::MonotonicTimeUsec();
+  auto symmetric = symmetric_service_.Pick(deadline, false, &context);
+  RETURN_IF_ERROR(symmetric.status());
+  std::unique_ptr<grpc::ClientReaderWriter<crypto::CbcEncryptFilesRequest,
+                                           crypto::CbcEncryptFilesResponse>> stream(
+      symmetric->CbcEncryptFiles(&context));
+
+  // Requests are written from a thread of their own while the responses
+  // are read here, so neither side's flow control can stall the other.
+  // The key goes with the first one only, and is wiped once written.
+  std::thread writer([&] {
+    crypto::CbcEncryptFilesRequest request;
+    request.set_key(key);
+    for (size_t i = 0; i < segments.size(); ++i) {
+      request.set_file_source_path(segments[i].first);
+      request.set_file_target_path(segments[i].second);
+      request.set_index(i);
+      bool written = stream->Write(request);
+      if (i == 0) {
+        KeyPool::Wipe(request.mutable_key());
+        request.clear_key();
+      }
+      if (!written) {
+        break;
+      }
+    }
+    stream->WritesDone();
+  });
+  crypto::CbcEncryptFilesResponse response;
+  size_t encrypted = 0;
+  base::Status status;
+  while (stream->Read(&response)) {
+    if (response.error_code() != grpc::StatusCode::OK && status.ok()) {
+      const int64_t index = response.index();
+      status = base::Status(base::Code::INTERNAL, "encrypt_file error: " +
+          (index >= 0 && static_cast<size_t>(index) < segments.size()
+               ? segments[index].first : std::string()) + ": " + response.error_message());
+      // The rest is wasted work.
+      context.TryCancel();
+    }
+    encrypted++;
+  }
+  writer.join();
+  grpc::Status rpc_status = stream->Finish();
+  symmetric.Done(rpc_status);
+  cbc_encrypt_files_metrics_.Record(start, rpc_status);
+  if (!status.ok()) {
+    LOG(ERROR) << status.ToString();
+    return status;
+  }
+  RETURN_IF_ERROR(FromRpcStatus(rpc_status, "encrypt_file error"));
+  if (encrypted != segments.size()) {
+    return base::Status(base::Code::INTERNAL,
+                        base::StringPrintf("encrypt_file error: %zu of %zu segments answered",
+                                           encrypted, segments.size()));
+  }
+  VLOG(1) << "Encrypted " << segments.size() << " segments in " << dirs.size()
+          << " directories";
+  return base::Status::OK();
+}
+
 base::Status RpcTranscoderServiceHandler::Handle(const std::string& message,
                                                  std::string* output) {
-  LOG(INFO) << "message: " << message;
-  // handle Json
-  rapidjson::Document d;
-  rapidjson::ParseResult ok = d.Parse(message.c_str()); 
-  if (!ok) {
-    return base::Status(base::Code::INVALID_ARGUMENT, "Can't parse json: " + message);
+  return HandleMessage(kJsonContentType, message, output);
+}
+
+base::Status RpcTranscoderServiceHandler::HandleMessage(const std::string& content_type,
+                                                        const std::string& message,
+                                                        std::string* output) {
+  auto job = transcode_job_cache.Acquire();
+  RETURN_IF_ERROR(DecodeTranscodeJob(content_type, message, job.get()));
+  const std::string& video_source_path = job->video_source_path;
+  const std::string& video_target_path = job->video_target_path;
+  const int64_t target_id = job->target_id;
+  const std::string& sample = job->sample;
+  const std::string& frame_size = job->frame_size;
+  const std::string& frame_aspect = job->frame_aspect;
+  const std::string& frame_rate = job->frame_rate;
+  const std::string& rate_bit = job->rate_bit;
+  const std::string& time = job->time;
+  const std::string& url_prefix = job->url_prefix;
+  const std::string& m3u8_name = job->m3u8_name;
+  const std::vector<TranscodeRendition>& renditions = job->renditions;
+
+  // Checked before any work, not after the transcode.
+  std::string master_playlist;
+  if (!renditions.empty()) {
+    RETURN_IF_ERROR(MasterPlaylist(renditions, m3u8_name, &master_playlist));
   }
-  //TODO
-  std::string video_source_path = d["video_source_path"].GetString();
-  std::string video_target_path = d["video_target_path"].GetString();
-  std::string target_id = d["target_id"].GetString();
-  std::string sample = d["sample"].GetString();
-  std::string frame_size = d["frame_size"].GetString();
-  std::string frame_aspect = d["frame_aspect"].GetString();
-  std::string frame_rate = d["frame_rate"].GetString();
-  std::string rate_bit = d["rate_bit"].GetString();
-  std::string time = d["time"].GetString();
-  std::string url_prefix = d["url_prefix"].GetString();
-  std::string m3u8_name = d["m3u8_name"].GetString();
 
   std::string out("hello, world");
   output->resize(out.size());
   output->swap(out);
 
   grpc::Status rpc_status;
+  int64_t start;
+  // Every RPC below shares the job's budget.
+  JobDeadline deadline(deadline_options_);
 
   //TODO
   // Check file path
   
-  // Generate CBC key
-  grpc::ClientContext context;
-  crypto::CreateSymmetricKeyRequest cbc_key_request;
-  crypto::CreateSymmetricKeyResponse cbc_key_response;
-  cbc_key_request.set_key_bits(crypto::SymmetricKey128Bits);
-  rpc_status = symmetric_service_stub_->CreateSymmetricKey(&context,
-                                                     cbc_key_request,
-                                                     &cbc_key_response);
-  if (!rpc_status.ok()) {
-    return base::Status(base::Code::INTERNAL, "rpc generate cbc key error");
-  }
-  LOG(INFO) << "cbc_key: " << cbc_key_response.key();
-
-  // Generate Sm2 key pair
-  grpc::ClientContext sm2_key_context;
-  crypto::CreateKeyPairRequest sm2_key_request;
-  crypto::CreateKeyPairResponse sm2_key_response;
-  sm2_key_request.set_type(crypto::SM2);
-  sm2_key_request.set_key_bits(crypto::KEY256BITS);
-  rpc_status = asymmetric_service_stub_->CreateKeyPair(&sm2_key_context,
-                                                       sm2_key_request,
-                                                       &sm2_key_response);
-  if (!rpc_status.ok()) {
-    return base::Status(base::Code::INTERNAL, "rpc generate sm2 key error");
-  }
-  LOG(INFO) << "public_key: " << sm2_key_response.public_key();
-  LOG(INFO) << "private_key: " << sm2_key_response.private_key();
+  // Keys generated ahead of the job, wiped on return; see GenerateCbcKey()
+  // and GenerateSm2KeyPair().
+  KeyPool::ScopedKey cbc_key;
+  RETURN_IF_ERROR(cbc_keys_.Take(cbc_key.get()));
+  KeyPool::ScopedKey sm2_key_pair;
+  RETURN_IF_ERROR(sm2_key_pairs_.Take(sm2_key_pair.get()));
+  const std::string& cbc_key_value = cbc_key[0];
+  const std::string& sm2_public_key = sm2_key_pair[0];
+  const std::string& sm2_private_key = sm2_key_pair[1];
 
   // Transcode And Segment
   grpc::ClientContext transcode_context;
-  transcoder::TranscodeRequest transcode_request;
-  transcoder::TranscodeResponse transcode_response;
-  transcoder::AudioData* audio_data = new transcoder::AudioData();
-  transcoder::VideoData* video_data = new transcoder::VideoData();
-  transcoder::SegmentData* segment_data = new transcoder::SegmentData();
+  auto transcode_request = transcode_request_cache.Acquire();
+  auto transcode_response = transcode_response_cache.Acquire();
+  // Kept by TranscodeRequestReset, so reused in place.
+  transcoder::AudioData* audio_data = transcode_request->mutable_audio_data();
+  transcoder::VideoData* video_data = transcode_request->mutable_video_data();
+  transcoder::SegmentData* segment_data = transcode_request->mutable_segment_data();
 
-  transcode_request.set_media_source_path(video_source_path);
-  transcode_request.set_media_target_path(video_target_path);
+  transcode_request->set_media_source_path(video_source_path);
+  transcode_request->set_media_target_path(video_target_path);
 
   audio_data->set_sample(sample);
 
-  video_data->set_frame_size(frame_size);
-  video_data->set_frame_aspect(frame_aspect);
-  video_data->set_frame_rate(frame_rate);
-  video_data->set_rate_bit(rate_bit);
+  if (renditions.empty()) {
+    video_data->set_frame_size(frame_size);
+    video_data->set_frame_aspect(frame_aspect);
+    video_data->set_frame_rate(frame_rate);
+    video_data->set_rate_bit(rate_bit);
 
-  segment_data->set_time(time);
-  segment_data->set_url_prefix(url_prefix);
-  segment_data->set_m3u8_name(video_target_path + m3u8_name);
-
-  transcode_request.set_allocated_audio_data(audio_data);
-  transcode_request.set_allocated_video_data(video_data);
-  transcode_request.set_allocated_segment_data(segment_data);
+    segment_data->set_time(time);
+    segment_data->set_url_prefix(url_prefix);
+    segment_data->set_m3u8_name(video_target_path + m3u8_name);
+  }
+  // Decoded once by the transcoder, encoded and segmented per rendition.
+  for (const TranscodeRendition& rendition : renditions) {
+    const std::string rendition_path = video_target_path + rendition.name + "/";
+    if (!base::CreateDirectory(base::FilePath(rendition_path))) {
+      return base::Status(base::Code::INTERNAL, "can't create " + rendition_path);
+    }
+    transcoder::Rendition* to = transcode_request->add_renditions();
+    to->set_name(rendition.name);
+    transcoder::VideoData* rendition_video = to->mutable_video_data();
+    rendition_video->set_frame_size(rendition.frame_size);
+    rendition_video->set_frame_aspect(frame_aspect);
+    rendition_video->set_frame_rate(frame_rate);
+    rendition_video->set_rate_bit(rendition.rate_bit);
+    transcoder::SegmentData* rendition_segment = to->mutable_segment_data();
+    rendition_segment->set_time(time);
+    rendition_segment->set_url_prefix(url_prefix + rendition.name + "/");
+    rendition_segment->set_m3u8_name(rendition_path + m3u8_name);
+  }
 
+  start = threading::TimeUtil::MonotonicTimeUsec();
+  // No RPC timeout: the stream runs as long as the transcode, within the budget.
+  auto transcoder = transcoder_service_.Pick(deadline, false, &transcode_context);
+  RETURN_IF_ERROR(transcoder.status());
   std::unique_ptr<grpc::ClientReader<transcoder::TranscodeResponse>> reader(
-          transcoder_service_stub_->Transcode(&transcode_context,
-                                              transcode_request));
-  while (reader->Read(&transcode_response)) {
+          transcoder->Transcode(&transcode_context, *transcode_request));
+  while (reader->Read(transcode_response.get())) {
     int64_t duration=0;
     int64_t out_time=0;
-    DCHECK(base::safe_strto64(transcode_response.duration(), &duration));
-    DCHECK(base::safe_strto64(transcode_response.out_time(), &out_time));
-    //LOG(INFO) << "transcode Done: " << duration / out_time;
-    LOG(INFO) << "duration: " << transcode_response.duration()
-      << ", out_time: " << transcode_response.out_time();
+    DCHECK(base::safe_strto64(transcode_response->duration(), &duration));
+    DCHECK(base::safe_strto64(transcode_response->out_time(), &out_time));
+    LOG_EVERY_MS(INFO, 5000) << target_id << ": transcoded " << transcode_response->out_time()
+                             << " of " << transcode_response->duration();
   }
   rpc_status = reader->Finish();
-  if (!rpc_status.ok()) {
-    return base::Status(base::Code::INTERNAL, "trancode and segment error");
-  }
+  transcoder.Done(rpc_status);
+  transcode_metrics_.Record(start, rpc_status);
+  RETURN_IF_ERROR(FromRpcStatus(rpc_status, "trancode and segment error"));
   LOG(INFO) << "Transcode: " << video_source_path << "  ---Done";
   // Encrypt ts Media 
   //
@@ -181,31 +359,27 @@ base::Status RpcTranscoderServiceHandler::Handle(const std::string& message,
   DCHECK(base::CreateDirectory(enc_path));
   DCHECK(base::SetPosixFilePermissions(enc_path, base::FILE_PERMISSION_MASK));
 
-  base::DirReader dir_reader(orig_path.value().c_str());
-  while (dir_reader.Next()) {
-    std::string name = dir_reader.name();
-    std::string ext = base::FilePath(name).Extension();
-    if (name != ".." && name != "." && base::CompareCaseInsensitiveASCII(ext, ".ts") == 0) {
-      grpc::ClientContext cbc_enc_context;
-      crypto::CbcEncryptFileRequest cbc_enc_request;
-      crypto::CbcEncryptFileResponse cbc_enc_response;
-      cbc_enc_request.set_file_source_path(orig_path.Append(name).value());
-      cbc_enc_request.set_file_target_path(enc_path.Append(name).value());
-      cbc_enc_request.set_key(cbc_key_response.key());
-      rpc_status = symmetric_service_stub_->CbcEncryptFile(&cbc_enc_context,
-                                                           cbc_enc_request,
-                                                           &cbc_enc_response);
-      if (!rpc_status.ok()) {
-        DCHECK(base::DeleteFile(enc_path, true)); // clean up
-        LOG(ERROR) << "encrypt_file: " << orig_path.Append(name).value();
-        return base::Status(base::Code::INTERNAL,
-                            "encrypt_file error");
-      } else {
-        LOG(INFO) << "Encrypt file: " << cbc_enc_request.file_source_path() << " Ok";
-      }
+  // {orig, enc} directories of the variant playlists and their segments.
+  std::vector<std::pair<base::FilePath, base::FilePath>> variant_paths;
+  if (renditions.empty()) {
+    variant_paths.emplace_back(orig_path, enc_path);
+  }
+  for (const TranscodeRendition& rendition : renditions) {
+    variant_paths.emplace_back(orig_path.Append(rendition.name),
+                               enc_path.Append(rendition.name));
+    if (!base::CreateDirectory(variant_paths.back().second)) {
+      DCHECK(base::DeleteFile(enc_path, true)); // clean up
+      return base::Status(base::Code::INTERNAL,
+                          "can't create " + variant_paths.back().second.value());
     }
   }
-  LOG(INFO) << "------- Encrypt TS DONE";
+
+  base::Status status = EncryptSegments(deadline, cbc_key_value, variant_paths);
+  if (!status.ok()) {
+    DCHECK(base::DeleteFile(enc_path, true)); // clean up
+    return status;
+  }
+  VLOG(1) << "Encrypt TS done";
   // Encrypt MP4 media
   base::FilePath video_source_fp(video_source_path);
   std::string full_video_target = enc_path.Append(video_source_fp.BaseName().value()).value();
@@ -213,26 +387,37 @@ base::Status RpcTranscoderServiceHandler::Handle(const std::string& message,
   grpc::ClientContext ecb_enc_context;
   crypto::EcbEncryptFileRequest ecb_enc_request;
   crypto::EcbEncryptFileResponse ecb_enc_response;
-  ecb_enc_request.set_key(cbc_key_response.key());
+  ecb_enc_request.set_key(cbc_key_value);
   ecb_enc_request.set_file_source_path(video_source_path);
   ecb_enc_request.set_file_target_path(full_video_target);
 
-  rpc_status = symmetric_service_stub_->EcbEncryptFile(&ecb_enc_context,
-                                                       ecb_enc_request,
-                                                       &ecb_enc_response);
-  if (!rpc_status.ok()) {
-    DCHECK(base::DeleteFile(enc_path, true)); // clean up
-    LOG(ERROR) << "ECB encrypt_file: " << full_video_target;
-    return base::Status(base::Code::INTERNAL, "ECB encrypt_file error");
+  start = threading::TimeUtil::MonotonicTimeUsec();
+  {
+    auto symmetric = symmetric_service_.Pick(deadline, true, &ecb_enc_context);
+    base::Status status = symmetric.status();
+    if (status.ok()) {
+      rpc_status = symmetric->EcbEncryptFile(&ecb_enc_context,
+                                             ecb_enc_request,
+                                             &ecb_enc_response);
+      symmetric.Done(rpc_status);
+      ecb_encrypt_file_metrics_.Record(start, rpc_status);
+      status = FromRpcStatus(rpc_status, "ECB encrypt_file error");
+    }
+    KeyPool::Wipe(ecb_enc_request.mutable_key());
+    if (!status.ok()) {
+      DCHECK(base::DeleteFile(enc_path, true)); // clean up
+      LOG(ERROR) << "ECB encrypt_file: " << full_video_target;
+      return status;
+    }
   }
-  LOG(INFO) << "------- Encrypt: " << full_video_target << " DONE";
+  VLOG(1) << "Encrypt: " << full_video_target << " done";
 
   // Handle M3U8
-  base::FilePath orig_m3u8_path = base::FilePath(orig_path.Append(m3u8_name));
   base::FilePath video_key_path = enc_path.Append("video.key");
-  std::string cbc_key_hex = base::HexDecode(cbc_key_response.key());
+  std::string cbc_key_hex = base::HexDecode(cbc_key_value);
   DCHECK(base::WriteFile(video_key_path, cbc_key_hex.data(), cbc_key_hex.size())); 
-  LOG(INFO) << "------ video.key path: " << video_key_path.value();
+  KeyPool::Wipe(&cbc_key_hex);
+  VLOG(1) << "video.key path: " << video_key_path.value();
 
   // Handle Sm2 
   base::FilePath orig_url_path = base::FilePath(url_prefix);
@@ -241,28 +426,43 @@ base::Status RpcTranscoderServiceHandler::Handle(const std::string& message,
   crypto::PublicKeyEncryptRequest public_key_enc_request;
   crypto::PublicKeyEncryptResponse public_key_enc_response;
   public_key_enc_request.set_type(crypto::SM2);
-  public_key_enc_request.set_public_key(sm2_key_response.public_key());
+  public_key_enc_request.set_public_key(sm2_public_key);
   public_key_enc_request.set_plaintext(MakeExtM3u8KeyPath(enc_url_path.value()));
 
-  rpc_status = asymmetric_service_stub_->PublicKeyEncrypt(&sm2_enc_context,
-                                                          public_key_enc_request,
-                                                          &public_key_enc_response);
+  start = threading::TimeUtil::MonotonicTimeUsec();
+  {
+    auto asymmetric = asymmetric_service_.Pick(deadline, true, &sm2_enc_context);
+    RETURN_IF_ERROR(asymmetric.status());
+    rpc_status = asymmetric->PublicKeyEncrypt(&sm2_enc_context,
+                                              public_key_enc_request,
+                                              &public_key_enc_response);
+    asymmetric.Done(rpc_status);
+  }
+  public_key_encrypt_metrics_.Record(start, rpc_status);
   if (!rpc_status.ok()) {
     LOG(ERROR) << "sm2 encrypt video.key path error";
-    return base::Status(base::Code::INTERNAL,
-                            "encrypt video key path error");
+    return FromRpcStatus(rpc_status, "encrypt video key path error");
   }
-  LOG(INFO) << "Encrypt: " << enc_url_path.value() << " -- OK";
-  LOG(INFO) << "Encrypted video key path: " << public_key_enc_response.cipher();
+  VLOG(1) << "Encrypt: " << enc_url_path.value() << " ok";
 
-  // Handle m3u8 content
+  // Handle m3u8 content; every variant shares the key.
   std::string m3u8_content;
-  base::FilePath enc_m3u8_path = base::FilePath(enc_path.Append(m3u8_name));
-  DCHECK(base::ReadFileToString(orig_m3u8_path, &m3u8_content));
-  ReplaceAll(m3u8_content, "/orig/", "/enc/");
-  ReplaceAll(m3u8_content, "#EXTM3U\n", std::string("#EXTM3U\n") + "#EXT-X-KEY:" +
-                                             public_key_enc_response.cipher() + "\n");
-  DCHECK(base::WriteFile(enc_m3u8_path, m3u8_content.data(), m3u8_content.size()));
+  for (const auto& variant_path : variant_paths) {
+    base::FilePath orig_m3u8_path = variant_path.first.Append(m3u8_name);
+    DCHECK(base::ReadFileToString(orig_m3u8_path, &m3u8_content));
+    ReplaceAll(m3u8_content, "/orig/", "/enc/");
+    ReplaceAll(m3u8_content, "#EXTM3U\n", std::string("#EXTM3U\n") + "#EXT-X-KEY:" +
+                                               public_key_enc_response.cipher() + "\n");
+    DCHECK(base::WriteFile(variant_path.second.Append(m3u8_name),
+                           m3u8_content.data(), m3u8_content.size()));
+  }
+  // The variants' own playlist, or the master playlist over them.
+  base::FilePath enc_m3u8_path = enc_path.Append(m3u8_name);
+  if (!renditions.empty() &&
+      base::WriteFile(enc_m3u8_path, master_playlist.data(), master_playlist.size()) !=
+          static_cast<int>(master_playlist.size())) {
+    return base::Status(base::Code::INTERNAL, "can't write " + enc_m3u8_path.value());
+  }
   //std::string new
   // Update DB
   // mpr_metadb.t_isli_target
@@ -272,23 +472,34 @@ base::Status RpcTranscoderServiceHandler::Handle(const std::string& message,
   // status => -1 
   // encrypted_target_content_path TODO  /data/.... 
 
-  int64_t target_id_int = 0;
-  base::StringAsValue<int64_t>(target_id, &target_id_int);
   try {
     db::Session sql(db_connection_info_);
     db::Statement statement = sql << "UPDATE "
     " t_isli_target SET status=-1 , m3u8_key=?,m3u8_path=?,video_key=?,encrypted_target_content_path=?"
            " WHERE id=? "
-       << sm2_key_response.private_key()
+       << sm2_private_key
        << enc_m3u8_path.value()
-       << cbc_key_response.key()
+       << cbc_key_value
        << full_video_target
-       << target_id_int;
+       << target_id;
     statement.Execute();
   } catch (const db::DBException& e) {
     LOG(ERROR) << "Mysql Update Error: " << e.what();
   }
 
+  // Replied to callers that set reply_to, so they don't poll t_isli_target.
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  writer.StartObject();
+  writer.Key("target_id");
+  writer.String(std::to_string(target_id).c_str());
+  writer.Key("m3u8_path");
+  writer.String(enc_m3u8_path.value().c_str());
+  writer.Key("encrypted_target_content_path");
+  writer.String(full_video_target.c_str());
+  writer.EndObject();
+  output->assign(buffer.GetString(), buffer.GetSize());
+
   return base::Status::OK();
 }
 
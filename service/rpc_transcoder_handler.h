@@ -1,12 +1,19 @@
 #ifndef SERVICE_RPC_TRANSCODER_SERVICE_HANDLER_H_
 #define SERVICE_RPC_TRANSCODER_SERVICE_HANDLER_H_
+#include "base/file_path.h"
 #include "base/macros.h"
 #include "base/status.h"
 
 #include "db/frontend/session.h"
 #include "service/amqp_consumer_service.h"
+#include "service/grpc_call_metrics.h"
+#include "service/grpc_channel_pool.h"
+#include "service/job_deadline.h"
+#include "service/key_pool.h"
 
 #include <memory>
+#include <utility>
+#include <vector>
 #include <grpc++/grpc++.h>
 #include "protos/crypto_server.grpc.pb.h"
 #include "protos/transcode.grpc.pb.h"
@@ -17,31 +24,64 @@ namespace server {
 
 class RpcTranscoderServiceHandler : public ServiceHandler {
  public:
+  // Each address may list several replicas, comma-separated, which calls
+  // are balanced over (see service/grpc_channel_pool.h). A job's RPCs
+  // together get `deadline_options.job_budget_ms`, the unary ones
+  // `rpc_timeout_ms` each; out of time or with a service's circuit open,
+  // the job fails with DEADLINE_EXCEEDED or UNAVAILABLE. The CBC key and
+  // SM2 key pair of each job come from pools refilled in the background
+  // (see service/key_pool.h).
+  //
+  // A job listing renditions is transcoded into one variant per rendition,
+  // in <video_target_path>/<name>/, all under the job's one key; the
+  // m3u8_name it replies with is then a master playlist of the variants.
   RpcTranscoderServiceHandler(const std::string& transcoder_service_address,
                               const std::string& crypto_service_address,
-                              const std::string& db_connection);
+                              const std::string& db_connection,
+                              const GrpcChannelPoolOptions& pool_options =
+                                  GrpcChannelPoolOptions(),
+                              const DeadlineOptions& deadline_options =
+                                  DeadlineOptions(),
+                              const KeyPool::Options& key_pool_options =
+                                  KeyPool::Options());
 
   virtual ~RpcTranscoderServiceHandler() {}
 
+  // `message` is a TranscodeJob, JSON or protobuf as `content_type` says
+  // (see service/job_decoder.h).
+  virtual base::Status HandleMessage(const std::string& content_type,
+                                     const std::string& message,
+                                     std::string* output) override;
+  // A JSON message.
   virtual base::Status Handle(const std::string& message, std::string* output) override;
 
  private:
-  const std::string transcoder_service_address_; // host:port
-  std::unique_ptr<transcoder::Transcoder::Stub> transcoder_service_stub_;
-  std::shared_ptr<grpc::Channel> transcoder_service_channel_;
-
-  const std::string symmetric_service_address_;
-  std::unique_ptr<crypto::SymmetricService::Stub> symmetric_service_stub_;
-  std::shared_ptr<grpc::Channel> symmetric_service_channel_;
-
-  const std::string asymmetric_service_address_;
-  std::unique_ptr<crypto::AsymmetricService::Stub> asymmetric_service_stub_;
-  std::shared_ptr<grpc::Channel> asymmetric_service_channel_;
+  GrpcChannelPool<transcoder::Transcoder> transcoder_service_;
+  GrpcChannelPool<crypto::SymmetricService> symmetric_service_;
+  GrpcChannelPool<crypto::AsymmetricService> asymmetric_service_;
 
   const std::string db_connection_info_;
+  const DeadlineOptions deadline_options_;
   //db::Session sql_;
 
-  void Init();
+  GrpcCallMetrics create_symmetric_key_metrics_;
+  GrpcCallMetrics create_key_pair_metrics_;
+  GrpcCallMetrics transcode_metrics_;
+  GrpcCallMetrics cbc_encrypt_files_metrics_;
+  GrpcCallMetrics ecb_encrypt_file_metrics_;
+  GrpcCallMetrics public_key_encrypt_metrics_;
+
+  // Declared last, so their refill stops before what it uses goes away.
+  KeyPool cbc_keys_;        // {key}
+  KeyPool sm2_key_pairs_;   // {public key, private key}
+
+  base::Status GenerateCbcKey(KeyPool::Key* key);
+  base::Status GenerateSm2KeyPair(KeyPool::Key* key);
+  // Encrypts the .ts segments in the first directory of each pair into
+  // the second, all with one CbcEncryptFiles stream.
+  base::Status EncryptSegments(
+      const JobDeadline& deadline, const std::string& key,
+      const std::vector<std::pair<base::FilePath, base::FilePath>>& dirs);
 };
 
 } // namespace server
@@ -0,0 +1,73 @@
+#ifndef THREADING_EVENT_COUNT_H_
+#define THREADING_EVENT_COUNT_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "base/macros.h"
+#include "threading/futex.h"
+
+namespace threading {
+
+/**
+ * EventCount lets a thread wait for a condition on lock-free data without
+ * holding a mutex, and lets the producer skip the wake-up system call when
+ * nobody is waiting.
+ *
+ * Consumer:
+ *
+ *   for (;;) {
+ *     if (TryPop(&item)) break;
+ *     EventCount::Key key = ec.PrepareWait();
+ *     if (TryPop(&item)) { ec.CancelWait(); break; }
+ *     ec.Wait(key);
+ *   }
+ *
+ * Producer:
+ *
+ *   Push(item);
+ *   ec.Notify();
+ */
+class EventCount {
+ public:
+  typedef uint32_t Key;
+
+  EventCount() : epoch_(0), waiters_(0) {}
+
+  Key PrepareWait() {
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return epoch_.load(std::memory_order_acquire);
+  }
+
+  void CancelWait() {
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void Wait(Key key) {
+    while (epoch_.load(std::memory_order_acquire) == key) {
+      futex::Wait(&epoch_, key);
+    }
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void Notify() { DoNotify(1); }
+  void NotifyAll() { DoNotify(INT_MAX); }
+
+ private:
+  void DoNotify(int count) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) != 0) {
+      epoch_.fetch_add(1, std::memory_order_release);
+      futex::Wake(&epoch_, count);
+    }
+  }
+
+  std::atomic<uint32_t> epoch_;
+  std::atomic<uint32_t> waiters_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventCount);
+};
+
+} // namespace threading
+#endif // THREADING_EVENT_COUNT_H_
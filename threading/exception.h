@@ -31,6 +31,13 @@ class TooManyPendingTasksException : public base::TLibraryException {
     TLibraryException(message) {}
 };
   
+class BrokenPromiseException : public base::TLibraryException {
+ public:
+  BrokenPromiseException() : TLibraryException("BrokenPromiseException") {}
+  BrokenPromiseException(const std::string& message) :
+    TLibraryException(message) {}
+};
+
 class SystemResourceException : public base::TLibraryException {
  public:
   SystemResourceException() {}
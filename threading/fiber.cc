@@ -0,0 +1,360 @@
+#include "threading/fiber.h"
+#include "threading/exception.h"
+#include "threading/mutex.h"
+#include "threading/time_util.h"
+
+#include <exception>
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+#include <glog/logging.h>
+
+namespace threading {
+
+const size_t FiberScheduler::kDefaultStackSize;
+
+namespace {
+
+__thread FiberScheduler* tls_scheduler = nullptr;
+__thread Fiber* tls_fiber = nullptr;
+__thread ucontext_t* tls_main_context = nullptr;
+
+} // namespace
+
+/**
+ * A fiber: a ucontext plus an mmap'ed stack with a guard page below it.
+ */
+class Fiber {
+ public:
+  Fiber(FiberScheduler* scheduler,
+        const std::function<void()>& func,
+        size_t stack_size)
+      : scheduler_(scheduler),
+        func_(func),
+        finished_(false) {
+    page_size_ = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    mapping_size_ = ((stack_size + page_size_ - 1) / page_size_ + 1) * page_size_;
+    mapping_ = ::mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping_ == MAP_FAILED) {
+      throw SystemResourceException("mmap of fiber stack failed");
+    }
+    // Guard page: overflowing the stack faults instead of scribbling.
+    ::mprotect(mapping_, page_size_, PROT_NONE);
+
+    CHECK(::getcontext(&context_) == 0);
+    context_.uc_stack.ss_sp = static_cast<char*>(mapping_) + page_size_;
+    context_.uc_stack.ss_size = mapping_size_ - page_size_;
+    context_.uc_link = nullptr;
+
+    uintptr_t self = reinterpret_cast<uintptr_t>(this);
+    ::makecontext(&context_, reinterpret_cast<void (*)()>(&Fiber::Trampoline),
+                  2,
+                  static_cast<uint32_t>(self >> 32),
+                  static_cast<uint32_t>(self & 0xffffffffu));
+  }
+
+  ~Fiber() {
+    ::munmap(mapping_, mapping_size_);
+  }
+
+  FiberScheduler* scheduler() const { return scheduler_; }
+
+  // Puts the running fiber at the back of the ready queue and suspends it.
+  static void Yield() {
+    Fiber* fiber = tls_fiber;
+    CHECK(fiber != nullptr) << "Yield() called outside a fiber";
+    fiber->scheduler_->ScheduleLocal(fiber);
+    Suspend();
+  }
+
+  // Called from any thread to resume a suspended fiber.
+  void Resume() {
+    scheduler_->Schedule(this);
+  }
+  ucontext_t* context() { return &context_; }
+  bool finished() const { return finished_; }
+
+  // Switches from the running fiber back to the scheduler.
+  static void Suspend() {
+    Fiber* fiber = tls_fiber;
+    CHECK(fiber != nullptr) << "not running inside a fiber";
+    ::swapcontext(&fiber->context_, tls_main_context);
+  }
+
+ private:
+  static void Trampoline(uint32_t high, uint32_t low) {
+    Fiber* fiber = reinterpret_cast<Fiber*>(
+        (static_cast<uintptr_t>(high) << 32) | static_cast<uintptr_t>(low));
+    try {
+      fiber->func_();
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "fiber raised an exception: " << e.what();
+    } catch (...) {
+      LOG(ERROR) << "fiber raised an unknown exception";
+    }
+    fiber->func_ = nullptr;
+    fiber->finished_ = true;
+    ::swapcontext(&fiber->context_, tls_main_context);
+  }
+
+  FiberScheduler* scheduler_;
+  std::function<void()> func_;
+  bool finished_;
+
+  ucontext_t context_;
+  void* mapping_;
+  size_t mapping_size_;
+  size_t page_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(Fiber);
+};
+
+/////////////////////////// FiberBaton
+
+void FiberBaton::Wait() {
+  if (state_.load(std::memory_order_acquire) == kPosted) {
+    return;
+  }
+  waiter_ = tls_fiber;
+  CHECK(waiter_ != nullptr) << "FiberBaton::Wait() called outside a fiber";
+
+  int expected = kInit;
+  if (!state_.compare_exchange_strong(expected, kWaiting,
+                                      std::memory_order_acq_rel)) {
+    return;  // posted in the meantime
+  }
+  Fiber::Suspend();
+}
+
+void FiberBaton::Post() {
+  int prev = state_.exchange(kPosted, std::memory_order_acq_rel);
+  if (prev == kWaiting) {
+    waiter_->Resume();
+  }
+}
+
+/////////////////////////// FiberScheduler
+
+FiberScheduler::FiberScheduler(size_t stack_size)
+    : stack_size_(stack_size),
+      event_base_(::event_base_new()),
+      wakeup_fd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      wakeup_event_(nullptr),
+      fiber_count_(0),
+      stopping_(false) {
+  if (event_base_ == nullptr || wakeup_fd_ < 0) {
+    throw SystemResourceException("FiberScheduler: event_base/eventfd");
+  }
+  wakeup_event_ = ::event_new(event_base_, wakeup_fd_, EV_READ | EV_PERSIST,
+                              &FiberScheduler::OnWakeup, this);
+  ::event_add(wakeup_event_, nullptr);
+}
+
+FiberScheduler::~FiberScheduler() {
+  for (Fiber* fiber : ready_) {
+    delete fiber;
+  }
+  for (Fiber* fiber : remote_ready_) {
+    delete fiber;
+  }
+  ::event_free(wakeup_event_);
+  ::close(wakeup_fd_);
+  ::event_base_free(event_base_);
+}
+
+// static
+FiberScheduler* FiberScheduler::Current() {
+  return tls_scheduler;
+}
+
+void FiberScheduler::Spawn(const std::function<void()>& func) {
+  fiber_count_++;
+  if (tls_scheduler == this) {
+    ready_.push_back(new Fiber(this, func, stack_size_));
+    return;
+  }
+  bool was_empty;
+  {
+    Guard g(remote_lock_);
+    was_empty = remote_ready_.empty() && remote_spawn_.empty();
+    remote_spawn_.push_back(func);
+  }
+  if (was_empty) {
+    Wakeup();
+  }
+}
+
+void FiberScheduler::Stop() {
+  stopping_ = true;
+  Wakeup();
+}
+
+void FiberScheduler::Schedule(Fiber* fiber) {
+  if (tls_scheduler == this) {
+    ScheduleLocal(fiber);
+    return;
+  }
+  bool was_empty;
+  {
+    Guard g(remote_lock_);
+    was_empty = remote_ready_.empty() && remote_spawn_.empty();
+    remote_ready_.push_back(fiber);
+  }
+  if (was_empty) {
+    Wakeup();
+  }
+}
+
+void FiberScheduler::ScheduleLocal(Fiber* fiber) {
+  ready_.push_back(fiber);
+}
+
+void FiberScheduler::Wakeup() {
+  uint64_t one = 1;
+  ssize_t ret = ::write(wakeup_fd_, &one, sizeof(one));
+  (void) ret;  // EAGAIN only means the counter is already non-zero.
+}
+
+// static
+void FiberScheduler::OnWakeup(evutil_socket_t fd, short /* what */, void* /* arg */) {
+  uint64_t value;
+  ssize_t ret = ::read(fd, &value, sizeof(value));
+  (void) ret;
+}
+
+void FiberScheduler::DrainRemote() {
+  std::vector<Fiber*> ready;
+  std::vector<std::function<void()>> spawn;
+  {
+    Guard g(remote_lock_);
+    if (remote_ready_.empty() && remote_spawn_.empty()) {
+      return;
+    }
+    ready.swap(remote_ready_);
+    spawn.swap(remote_spawn_);
+  }
+  for (Fiber* fiber : ready) {
+    ready_.push_back(fiber);
+  }
+  for (const auto& func : spawn) {
+    ready_.push_back(new Fiber(this, func, stack_size_));
+  }
+}
+
+void FiberScheduler::SwitchTo(Fiber* fiber) {
+  tls_fiber = fiber;
+  ::swapcontext(tls_main_context, fiber->context());
+  tls_fiber = nullptr;
+  if (fiber->finished()) {
+    delete fiber;
+    fiber_count_--;
+  }
+}
+
+void FiberScheduler::RunReady() {
+  // Only run the fibers that are ready now; ones made ready while we run
+  // wait for the next round so fd events get polled in between.
+  size_t count = ready_.size();
+  while (count-- > 0 && !ready_.empty()) {
+    Fiber* fiber = ready_.front();
+    ready_.pop_front();
+    SwitchTo(fiber);
+  }
+}
+
+void FiberScheduler::Run() {
+  CHECK(tls_scheduler == nullptr) << "nested FiberScheduler::Run()";
+  ucontext_t main_context;
+  tls_scheduler = this;
+  tls_main_context = &main_context;
+
+  for (;;) {
+    DrainRemote();
+    RunReady();
+    DrainRemote();
+    if (!ready_.empty()) {
+      ::event_base_loop(event_base_, EVLOOP_NONBLOCK);
+      continue;
+    }
+    if (stopping_ && fiber_count_ == 0) {
+      break;
+    }
+    ::event_base_loop(event_base_, EVLOOP_ONCE);
+  }
+
+  tls_main_context = nullptr;
+  tls_scheduler = nullptr;
+}
+
+/////////////////////////// this_fiber
+
+namespace this_fiber {
+
+namespace {
+
+struct FdWait {
+  FiberBaton baton;
+  short what;
+};
+
+void OnFdWait(evutil_socket_t /* fd */, short what, void* arg) {
+  FdWait* wait = static_cast<FdWait*>(arg);
+  wait->what = what;
+  wait->baton.Post();
+}
+
+bool WaitEvent(int fd, short events, int64_t timeout_ms) {
+  FiberScheduler* scheduler = FiberScheduler::Current();
+  CHECK(scheduler != nullptr && tls_fiber != nullptr)
+      << "this_fiber called outside a fiber";
+
+  FdWait wait;
+  wait.what = 0;
+  struct timeval tv;
+  struct timeval* timeout = nullptr;
+  if (timeout_ms > 0) {
+    TimeUtil::ToTimeval(tv, timeout_ms);
+    timeout = &tv;
+  }
+  if (::event_base_once(scheduler->event_base(), fd, events,
+                        &OnFdWait, &wait, timeout) != 0) {
+    throw SystemResourceException("event_base_once failed");
+  }
+  wait.baton.Wait();
+  return (wait.what & EV_TIMEOUT) == 0;
+}
+
+} // namespace
+
+bool InFiber() {
+  return tls_fiber != nullptr;
+}
+
+void Yield() {
+  Fiber::Yield();
+}
+
+void SleepFor(int64_t timeout_ms) {
+  if (timeout_ms <= 0) {
+    Yield();
+    return;
+  }
+  WaitEvent(-1, EV_TIMEOUT, timeout_ms);
+}
+
+bool WaitReadable(int fd, int64_t timeout_ms) {
+  return WaitEvent(fd, EV_READ, timeout_ms);
+}
+
+bool WaitWritable(int fd, int64_t timeout_ms) {
+  return WaitEvent(fd, EV_WRITE, timeout_ms);
+}
+
+} // namespace this_fiber
+
+} // namespace threading
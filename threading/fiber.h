@@ -0,0 +1,182 @@
+#ifndef THREADING_FIBER_H_
+#define THREADING_FIBER_H_
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <event2/event.h>
+
+#include "base/macros.h"
+#include "threading/futex_mutex.h"
+#include "threading/future.h"
+#include "threading/thread_manager.h"
+
+namespace threading {
+
+class Fiber;
+class FiberScheduler;
+
+/**
+ * One-shot wake-up for a fiber: Wait() suspends the calling fiber until
+ * Post() is called. Post() may be called from any thread (a gRPC
+ * completion-queue poller, a ThreadManager worker, ...), and may come
+ * before Wait(), in which case Wait() returns immediately.
+ */
+class FiberBaton {
+ public:
+  FiberBaton() : state_(kInit), waiter_(nullptr) {}
+
+  void Wait();
+  void Post();
+
+  bool IsPosted() const {
+    return state_.load(std::memory_order_acquire) == kPosted;
+  }
+
+ private:
+  enum State { kInit, kWaiting, kPosted };
+
+  std::atomic<int> state_;
+  Fiber* waiter_;
+
+  DISALLOW_COPY_AND_ASSIGN(FiberBaton);
+};
+
+/**
+ * A cooperative scheduler running stackful fibers on the thread that calls
+ * Run().
+ *
+ * Fibers are written as plain sequential code; whenever one has to wait
+ * (for a timer, a file descriptor, a FiberBaton or a Future) it suspends
+ * and the scheduler switches to another ready fiber. When no fiber is
+ * ready the thread blocks in the scheduler's libevent loop, which also
+ * drives fd readiness and timers. One OS thread can therefore keep
+ * thousands of blocking-style jobs in flight.
+ *
+ * Spawn(), Stop() and FiberBaton::Post() are thread-safe; everything in
+ * this_fiber must be called from inside a fiber.
+ *
+ * Infrastructure only so far: no consumer or handler runs on a scheduler
+ * yet, and the handlers still block a ThreadManager worker per job.
+ */
+class FiberScheduler {
+ public:
+  static const size_t kDefaultStackSize = 256 * 1024;
+
+  explicit FiberScheduler(size_t stack_size = kDefaultStackSize);
+  ~FiberScheduler();
+
+  /**
+   * Creates a fiber running `func`. It starts at the next scheduling
+   * point of the scheduler thread.
+   */
+  void Spawn(const std::function<void()>& func);
+
+  /**
+   * Runs fibers on the calling thread until Stop() has been called and
+   * every fiber has finished.
+   */
+  void Run();
+
+  /**
+   * Makes Run() return once the live fibers have finished. New fibers may
+   * still be spawned by running ones.
+   */
+  void Stop();
+
+  size_t FiberCount() const { return fiber_count_.load(); }
+
+  struct event_base* event_base() const { return event_base_; }
+
+  /**
+   * The scheduler running on the current thread, or nullptr.
+   */
+  static FiberScheduler* Current();
+
+ private:
+  friend class Fiber;
+  friend class FiberBaton;
+
+  // Makes a suspended fiber runnable. Thread-safe.
+  void Schedule(Fiber* fiber);
+  // Same, for callers already on the scheduler thread.
+  void ScheduleLocal(Fiber* fiber);
+
+  void DrainRemote();
+  void RunReady();
+  void SwitchTo(Fiber* fiber);
+  void Wakeup();
+
+  static void OnWakeup(evutil_socket_t fd, short what, void* arg);
+
+  const size_t stack_size_;
+  struct event_base* event_base_;
+  int wakeup_fd_;
+  struct event* wakeup_event_;
+
+  std::deque<Fiber*> ready_;
+  std::atomic<size_t> fiber_count_;
+  std::atomic<bool> stopping_;
+
+  FutexMutex remote_lock_;
+  std::vector<Fiber*> remote_ready_;
+  std::vector<std::function<void()>> remote_spawn_;
+
+  DISALLOW_COPY_AND_ASSIGN(FiberScheduler);
+};
+
+/**
+ * Operations on the currently running fiber.
+ */
+namespace this_fiber {
+
+/**
+ * True when called from inside a fiber.
+ */
+bool InFiber();
+
+/**
+ * Lets the other ready fibers run.
+ */
+void Yield();
+
+void SleepFor(int64_t timeout_ms);
+
+/**
+ * Suspends until `fd` is readable (writable). Returns false on timeout;
+ * timeout_ms == 0 waits forever.
+ */
+bool WaitReadable(int fd, int64_t timeout_ms = 0);
+bool WaitWritable(int fd, int64_t timeout_ms = 0);
+
+/**
+ * Suspends until `future` is ready, then returns its value (or rethrows).
+ */
+template <typename T>
+T Await(const Future<T>& future) {
+  if (!future.IsReady()) {
+    FiberBaton baton;
+    future.Then([&baton](Future<T>) { baton.Post(); });
+    baton.Wait();
+  }
+  return future.Get();
+}
+
+/**
+ * Runs a blocking call (a libmysqlclient query, a synchronous gRPC stub
+ * call, file I/O...) on `executor` and suspends the fiber until it
+ * returns, so the scheduler thread keeps running other fibers meanwhile.
+ */
+template <typename Func>
+auto RunBlocking(const std::shared_ptr<ThreadManager>& executor, Func func)
+    -> decltype(func()) {
+  return Await(executor->Add(func));
+}
+
+} // namespace this_fiber
+
+} // namespace threading
+#endif // THREADING_FIBER_H_
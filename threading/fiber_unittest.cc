@@ -0,0 +1,139 @@
+#include "threading/fiber.h"
+#include "threading/thread_manager.h"
+#include "threading/thread_factory.h"
+#include "threading/time_util.h"
+
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+using namespace threading;
+
+TEST(FiberTest, Spawn_And_Yield) {
+  FiberScheduler scheduler;
+  std::vector<int> trace;
+
+  for (int id = 0; id < 2; ++id) {
+    scheduler.Spawn([&trace, id] {
+      for (int i = 0; i < 3; ++i) {
+        trace.push_back(id);
+        this_fiber::Yield();
+      }
+    });
+  }
+  scheduler.Stop();
+  scheduler.Run();
+
+  std::vector<int> expected = { 0, 1, 0, 1, 0, 1 };
+  EXPECT_EQ(expected, trace);
+  EXPECT_EQ(0u, scheduler.FiberCount());
+}
+
+TEST(FiberTest, Thousands_Of_Sleepers) {
+  const int kFibers = 2000;
+  FiberScheduler scheduler(64 * 1024);
+  int done = 0;
+
+  int64_t start = TimeUtil::MonotonicTime();
+  for (int i = 0; i < kFibers; ++i) {
+    scheduler.Spawn([&done] {
+      this_fiber::SleepFor(50);
+      ++done;
+    });
+  }
+  scheduler.Stop();
+  scheduler.Run();
+
+  EXPECT_EQ(kFibers, done);
+  // All of them slept concurrently on one thread.
+  EXPECT_LT(TimeUtil::MonotonicTime() - start, 1000);
+}
+
+TEST(FiberTest, Wait_Readable) {
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  FiberScheduler scheduler;
+  bool timed_out = true;
+  bool readable = false;
+
+  scheduler.Spawn([&] {
+    timed_out = !this_fiber::WaitReadable(fds[0], 10);
+    readable = this_fiber::WaitReadable(fds[0]);
+  });
+  scheduler.Spawn([&] {
+    this_fiber::SleepFor(30);
+    ASSERT_EQ(1, write(fds[1], "x", 1));
+  });
+  scheduler.Stop();
+  scheduler.Run();
+
+  EXPECT_TRUE(timed_out);
+  EXPECT_TRUE(readable);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST(FiberTest, Baton_Posted_From_Other_Thread) {
+  FiberScheduler scheduler;
+  FiberBaton baton;
+  bool resumed = false;
+
+  scheduler.Spawn([&] {
+    baton.Wait();
+    resumed = true;
+  });
+  std::thread poster([&baton] {
+    usleep(20 * TimeUtil::US_PER_MS);
+    baton.Post();
+  });
+  scheduler.Stop();
+  scheduler.Run();
+  poster.join();
+
+  EXPECT_TRUE(resumed);
+}
+
+TEST(FiberTest, Run_Blocking_On_Thread_Manager) {
+  auto executor = ThreadManager::NewSimpleThreadManager(4);
+  executor->SetThreadFactory(std::make_shared<PosixThreadFactory>());
+  executor->Start();
+
+  const int kJobs = 16;
+  FiberScheduler scheduler;
+  int sum = 0;
+
+  int64_t start = TimeUtil::MonotonicTime();
+  for (int i = 0; i < kJobs; ++i) {
+    scheduler.Spawn([&, i] {
+      // Stand-in for a blocking MySQL or gRPC call.
+      sum += this_fiber::RunBlocking(executor, [i] {
+        usleep(20 * TimeUtil::US_PER_MS);
+        return i;
+      });
+    });
+  }
+  scheduler.Stop();
+  scheduler.Run();
+
+  EXPECT_EQ(kJobs * (kJobs - 1) / 2, sum);
+  // 16 jobs of 20ms on 4 workers, not 16 * 20ms in sequence.
+  EXPECT_LT(TimeUtil::MonotonicTime() - start, 16 * 20);
+  executor->Join();
+}
+
+TEST(FiberTest, Spawn_From_Other_Thread) {
+  FiberScheduler scheduler;
+  int ran = 0;
+  std::thread runner([&scheduler] { scheduler.Run(); });
+
+  for (int i = 0; i < 100; ++i) {
+    scheduler.Spawn([&ran] { ++ran; });
+  }
+  scheduler.Stop();
+  runner.join();
+  EXPECT_EQ(100, ran);
+}
@@ -0,0 +1,34 @@
+#ifndef THREADING_FUNCTION_RUNNER_H_
+#define THREADING_FUNCTION_RUNNER_H_
+
+#include <functional>
+#include <memory>
+
+#include "threading/thread.h"
+
+namespace threading {
+
+/**
+ * Adapts a std::function<void()> to the Runnable interface so lambdas can be
+ * handed to ThreadManager::Add(), TimerManager and friends.
+ */
+class FunctionRunner : public Runnable {
+ public:
+  typedef std::function<void()> VoidFunc;
+
+  static std::shared_ptr<Runnable> Create(const VoidFunc& func) {
+    return std::make_shared<FunctionRunner>(func);
+  }
+
+  explicit FunctionRunner(const VoidFunc& func) : func_(func) {}
+
+  void Run() override {
+    func_();
+  }
+
+ private:
+  VoidFunc func_;
+};
+
+} // namespace threading
+#endif // THREADING_FUNCTION_RUNNER_H_
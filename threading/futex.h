@@ -0,0 +1,86 @@
+#ifndef THREADING_FUTEX_H_
+#define THREADING_FUTEX_H_
+
+#include <atomic>
+#include <climits>
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+namespace threading {
+
+/**
+ * Thin wrappers around the linux futex(2) system call.
+ *
+ * All functions return 0 on success or the errno value on failure, so the
+ * callers can tell ETIMEDOUT apart from EAGAIN (the value already changed)
+ * and EINTR (spurious wakeup).
+ */
+namespace futex {
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "futex word must be a plain 32-bit integer");
+
+inline int SysFutex(const std::atomic<uint32_t>* addr,
+                    int op,
+                    uint32_t value,
+                    const struct timespec* timeout,
+                    uint32_t bitset) {
+  long ret = ::syscall(SYS_futex,
+                       reinterpret_cast<const uint32_t*>(addr),
+                       op, value, timeout, nullptr, bitset);
+  return ret < 0 ? errno : 0;
+}
+
+/**
+ * Blocks while *addr == expected, for at most `timeout` (relative, may be
+ * nullptr to wait forever).
+ */
+inline int Wait(const std::atomic<uint32_t>* addr,
+                uint32_t expected,
+                const struct timespec* timeout = nullptr) {
+  return SysFutex(addr, FUTEX_WAIT | FUTEX_PRIVATE_FLAG,
+                  expected, timeout, 0);
+}
+
+/**
+ * Blocks while *addr == expected, until the absolute CLOCK_REALTIME time
+ * `abstime`.
+ */
+inline int WaitUntil(const std::atomic<uint32_t>* addr,
+                     uint32_t expected,
+                     const struct timespec* abstime) {
+  return SysFutex(addr,
+                  FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME,
+                  expected, abstime, FUTEX_BITSET_MATCH_ANY);
+}
+
+/**
+ * Wakes at most `count` waiters blocked on addr.
+ */
+inline int Wake(const std::atomic<uint32_t>* addr, int count = 1) {
+  return SysFutex(addr, FUTEX_WAKE | FUTEX_PRIVATE_FLAG,
+                  static_cast<uint32_t>(count), nullptr, 0);
+}
+
+inline int WakeAll(const std::atomic<uint32_t>* addr) {
+  return Wake(addr, INT_MAX);
+}
+
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#else
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+} // namespace futex
+} // namespace threading
+#endif // THREADING_FUTEX_H_
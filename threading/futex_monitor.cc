@@ -0,0 +1,78 @@
+#include "threading/futex_monitor.h"
+#include "threading/futex.h"
+#include "threading/time_util.h"
+#include "threading/exception.h"
+
+#include <assert.h>
+#include <errno.h>
+
+namespace threading {
+
+FutexMonitor::FutexMonitor()
+    : owned_mutex_(new FutexMutex()),
+      mutex_(owned_mutex_.get()),
+      seq_(0),
+      waiters_(0) {}
+
+FutexMonitor::FutexMonitor(FutexMutex* mutex)
+    : mutex_(mutex),
+      seq_(0),
+      waiters_(0) {}
+
+FutexMonitor::FutexMonitor(FutexMonitor* monitor)
+    : mutex_(&monitor->mutex()),
+      seq_(0),
+      waiters_(0) {}
+
+/**
+ * Returns 0 if woken up (possibly spuriously, exactly like
+ * pthread_cond_wait) and ETIMEDOUT on timeout.
+ */
+int FutexMonitor::WaitImpl(const timespec* relative,
+                           const timespec* absolute) const {
+  // The caller must lock the mutex before waiting.
+  assert(mutex_->IsLocked());
+
+  const uint32_t seq = seq_.load(std::memory_order_relaxed);
+  ++waiters_;
+  mutex_->Unlock();
+
+  int ret = absolute ? futex::WaitUntil(&seq_, seq, absolute)
+                     : futex::Wait(&seq_, seq, relative);
+
+  mutex_->LockContended();
+  --waiters_;
+  return ret == ETIMEDOUT ? ETIMEDOUT : 0;
+}
+
+void FutexMonitor::Wake(uint32_t count) const {
+  // The caller must lock the mutex before notifying.
+  assert(mutex_->IsLocked());
+  seq_.fetch_add(1, std::memory_order_relaxed);
+  futex::Wake(&seq_, static_cast<int>(count));
+}
+
+int FutexMonitor::WaitForever() const {
+  return WaitImpl(nullptr, nullptr);
+}
+
+int FutexMonitor::WaitForTime(const timespec* abstime) const {
+  return WaitImpl(nullptr, abstime);
+}
+
+int FutexMonitor::WaitForTimeRelative(int64_t timeout_ms) const {
+  if (timeout_ms == 0LL) {
+    return WaitForever();
+  }
+  struct timespec relative;
+  TimeUtil::ToTimespec(relative, timeout_ms);
+  return WaitImpl(&relative, nullptr);
+}
+
+void FutexMonitor::Wait(int64_t timeout_ms) const {
+  if (WaitForTimeRelative(timeout_ms) == ETIMEDOUT) {
+    throw TimedOutException();
+  }
+}
+
+} // namespace threading
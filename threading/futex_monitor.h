@@ -0,0 +1,70 @@
+#ifndef THREADING_FUTEX_MONITOR_H_
+#define THREADING_FUTEX_MONITOR_H_
+
+#include <atomic>
+#include <memory>
+
+#include <time.h>
+
+#include "base/macros.h"
+#include "threading/futex_mutex.h"
+
+namespace threading {
+
+/**
+ * Drop-in counterpart of Monitor built on FutexMutex and a futex sequence
+ * counter instead of pthread_cond_t.
+ *
+ * The interface and the wait/timeout semantics are those of Monitor, but
+ * nothing is virtual and Lock()/Unlock()/Notify()/NotifyAll() are inlined:
+ * notifying a monitor nobody waits on costs no system call.
+ *
+ * As with Monitor, waiting and notifying require the caller to own the
+ * mutex, and a FutexMonitor can share the mutex of another one.
+ */
+class FutexMonitor {
+ public:
+  FutexMonitor();
+
+  explicit FutexMonitor(FutexMutex* mutex);
+  explicit FutexMonitor(FutexMonitor* monitor);
+
+  ~FutexMonitor() {}
+
+  FutexMutex& mutex() const { return *mutex_; }
+  void Lock() const { mutex_->Lock(); }
+  void Unlock() const { mutex_->Unlock(); }
+
+  int WaitForTimeRelative(int64_t timeout_ms) const;
+  int WaitForTime(const timespec* abstime) const;
+  int WaitForever() const;
+  void Wait(int64_t timeout_ms = 0LL) const;
+
+  void Notify() const {
+    if (waiters_ != 0) {
+      Wake(1);
+    }
+  }
+
+  void NotifyAll() const {
+    if (waiters_ != 0) {
+      Wake(waiters_);
+    }
+  }
+
+ private:
+  int WaitImpl(const timespec* relative, const timespec* absolute) const;
+  void Wake(uint32_t count) const;
+
+  std::unique_ptr<FutexMutex> owned_mutex_;
+  FutexMutex* mutex_;
+
+  mutable std::atomic<uint32_t> seq_;
+  // Number of threads blocked in WaitImpl(). Only touched with mutex_ held.
+  mutable uint32_t waiters_;
+
+  DISALLOW_COPY_AND_ASSIGN(FutexMonitor);
+};
+
+} // namespace threading
+#endif // THREADING_FUTEX_MONITOR_H_
@@ -0,0 +1,73 @@
+#include "threading/futex_mutex.h"
+#include "threading/futex.h"
+#include "threading/time_util.h"
+
+#include <algorithm>
+
+namespace threading {
+
+const int32_t FutexMutex::kInitialSpins;
+const int32_t FutexMutex::kMaxSpins;
+
+bool FutexMutex::Spin() const {
+  int32_t spins = spins_.load(std::memory_order_relaxed);
+  int32_t budget = std::min(spins * 2 + 10, kMaxSpins);
+  for (int32_t i = 0; i < budget; ++i) {
+    if (state_.load(std::memory_order_relaxed) == kUnlocked && TryLock()) {
+      spins_.store(spins + (i - spins) / 8, std::memory_order_relaxed);
+      return true;
+    }
+    futex::CpuRelax();
+  }
+  spins_.store(spins + (budget - spins) / 8, std::memory_order_relaxed);
+  return false;
+}
+
+void FutexMutex::LockSlow() const {
+  if (Spin()) {
+    return;
+  }
+  LockContended();
+}
+
+void FutexMutex::LockContended() const {
+  uint32_t c = state_.exchange(kContended, std::memory_order_acquire);
+  while (c != kUnlocked) {
+    futex::Wait(&state_, kContended);
+    c = state_.exchange(kContended, std::memory_order_acquire);
+  }
+}
+
+bool FutexMutex::TimedLock(int64_t milliseconds) const {
+  if (TryLock()) {
+    return true;
+  }
+  if (milliseconds <= 0) {
+    return false;
+  }
+  if (Spin()) {
+    return true;
+  }
+
+  const int64_t deadline = TimeUtil::MonotonicTimeUsec()
+                           + milliseconds * TimeUtil::US_PER_MS;
+  uint32_t c = state_.exchange(kContended, std::memory_order_acquire);
+  while (c != kUnlocked) {
+    int64_t remaining = deadline - TimeUtil::MonotonicTimeUsec();
+    if (remaining <= 0) {
+      return false;
+    }
+    struct timespec ts;
+    ts.tv_sec = remaining / TimeUtil::US_PER_S;
+    ts.tv_nsec = (remaining % TimeUtil::US_PER_S) * TimeUtil::NS_PER_US;
+    futex::Wait(&state_, kContended, &ts);
+    c = state_.exchange(kContended, std::memory_order_acquire);
+  }
+  return true;
+}
+
+void FutexMutex::WakeOne() const {
+  futex::Wake(&state_, 1);
+}
+
+} // namespace threading
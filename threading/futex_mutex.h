@@ -0,0 +1,92 @@
+#ifndef THREADING_FUTEX_MUTEX_H_
+#define THREADING_FUTEX_MUTEX_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "base/macros.h"
+
+namespace threading {
+
+/**
+ * An adaptive spin-then-futex mutex.
+ *
+ * Unlike Mutex, none of the methods are virtual and there is no pimpl: an
+ * uncontended Lock()/Unlock() pair is a single inlined compare-and-swap and
+ * a single inlined exchange. Under contention the locker spins for a while
+ * (the spin budget adapts to how long the lock has recently been held) and
+ * then sleeps on a futex.
+ *
+ * The state word follows Drepper's "Futexes Are Tricky":
+ *   0 - unlocked
+ *   1 - locked, no waiters
+ *   2 - locked, maybe waiters (Unlock() has to wake one)
+ *
+ * FutexMutex is not recursive; keep using Mutex(RECURSIVE_INITIALIZER) for
+ * that.
+ */
+class FutexMutex {
+ public:
+  FutexMutex() : state_(kUnlocked), spins_(kInitialSpins) {}
+  ~FutexMutex() {}
+
+  void Lock() const {
+    uint32_t expected = kUnlocked;
+    if (PREDICT_TRUE(state_.compare_exchange_strong(expected, kLocked,
+                                                    std::memory_order_acquire,
+                                                    std::memory_order_relaxed))) {
+      return;
+    }
+    LockSlow();
+  }
+
+  bool TryLock() const {
+    uint32_t expected = kUnlocked;
+    return state_.compare_exchange_strong(expected, kLocked,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns false if the lock could not be acquired within `milliseconds`.
+   */
+  bool TimedLock(int64_t milliseconds) const;
+
+  void Unlock() const {
+    if (PREDICT_FALSE(state_.exchange(kUnlocked, std::memory_order_release)
+                      == kContended)) {
+      WakeOne();
+    }
+  }
+
+  bool IsLocked() const {
+    return state_.load(std::memory_order_relaxed) != kUnlocked;
+  }
+
+ private:
+  friend class FutexMonitor;
+
+  enum : uint32_t { kUnlocked = 0, kLocked = 1, kContended = 2 };
+
+  static const int32_t kInitialSpins = 16;
+  static const int32_t kMaxSpins = 1000;
+
+  void LockSlow() const;
+
+  // Used after a condition wait: we may not be the only sleeper, so take
+  // the lock in the contended state to make the next Unlock() wake someone.
+  void LockContended() const;
+
+  bool Spin() const;
+  void WakeOne() const;
+
+  mutable std::atomic<uint32_t> state_;
+  // Running average of spins needed to acquire the lock (not exact; racy
+  // updates are fine).
+  mutable std::atomic<int32_t> spins_;
+
+  DISALLOW_COPY_AND_ASSIGN(FutexMutex);
+};
+
+} // namespace threading
+#endif // THREADING_FUTEX_MUTEX_H_
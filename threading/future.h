@@ -0,0 +1,445 @@
+#ifndef THREADING_FUTURE_H_
+#define THREADING_FUTURE_H_
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+
+#include "base/macros.h"
+#include "threading/exception.h"
+#include "threading/function_runner.h"
+#include "threading/futex_monitor.h"
+#include "threading/monitor.h"
+#include "threading/thread_manager.h"
+
+namespace threading {
+
+/**
+ * Future/Promise with continuations.
+ *
+ * A Future<T> is a copyable handle on a value (or exception) that becomes
+ * available later; the producing side holds the matching Promise<T>.
+ * Continuations are attached with Then() and are handed the ready Future,
+ * so they see exceptions as well as values:
+ *
+ *   Future<int> size = thread_manager->Add([] { return Transcode(); });
+ *   size.Then([](Future<int> f) { Report(f.Get()); }, other_thread_manager);
+ *
+ * A continuation runs on the given ThreadManager, or inline on the thread
+ * that completes the future when no executor is given. WhenAll() and
+ * WhenAny() join several futures without blocking a thread.
+ *
+ * A Promise destroyed without being fulfilled (for example when its task
+ * is dropped from a stopped ThreadManager) breaks its future with a
+ * BrokenPromiseException instead of leaving waiters hanging.
+ */
+
+template <typename T> class Future;
+template <typename T> class Promise;
+
+// Placeholder value stored by Future<void>.
+struct Unit {};
+
+namespace detail {
+
+template <typename T>
+struct Lift {
+  typedef T type;
+};
+
+template <>
+struct Lift<void> {
+  typedef Unit type;
+};
+
+template <typename T>
+class FutureState {
+ public:
+  typedef typename Lift<T>::type StoredType;
+  typedef std::function<void()> Callback;
+
+  FutureState() : ready_(false) {}
+
+  bool IsReady() const {
+    return ready_.load(std::memory_order_acquire);
+  }
+
+  void SetValue(StoredType value) {
+    std::vector<Callback> callbacks;
+    {
+      Synchronized s(monitor_);
+      if (IsReady()) {
+        throw IllegalStateException("Promise already satisfied");
+      }
+      value_.reset(new StoredType(std::move(value)));
+      Publish(&callbacks);
+    }
+    Run(callbacks);
+  }
+
+  void SetException(std::exception_ptr exception) {
+    std::vector<Callback> callbacks;
+    {
+      Synchronized s(monitor_);
+      if (IsReady()) {
+        throw IllegalStateException("Promise already satisfied");
+      }
+      exception_ = exception;
+      Publish(&callbacks);
+    }
+    Run(callbacks);
+  }
+
+  void AddCallback(const Callback& callback) {
+    {
+      Synchronized s(monitor_);
+      if (!IsReady()) {
+        callbacks_.push_back(callback);
+        return;
+      }
+    }
+    callback();
+  }
+
+  void Wait() const {
+    if (IsReady()) {
+      return;
+    }
+    Synchronized s(monitor_);
+    while (!IsReady()) {
+      monitor_.WaitForever();
+    }
+  }
+
+  bool WaitFor(int64_t timeout_ms) const {
+    if (IsReady()) {
+      return true;
+    }
+    Synchronized s(monitor_);
+    while (!IsReady()) {
+      if (monitor_.WaitForTimeRelative(timeout_ms) == ETIMEDOUT) {
+        return IsReady();
+      }
+    }
+    return true;
+  }
+
+  // Only valid once ready.
+  const StoredType& Value() const {
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+    return *value_;
+  }
+
+  bool HasException() const {
+    return IsReady() && exception_ != nullptr;
+  }
+
+ private:
+  void Publish(std::vector<Callback>* callbacks) {
+    ready_.store(true, std::memory_order_release);
+    callbacks->swap(callbacks_);
+    monitor_.NotifyAll();
+  }
+
+  static void Run(const std::vector<Callback>& callbacks) {
+    for (const auto& callback : callbacks) {
+      callback();
+    }
+  }
+
+  FutexMonitor monitor_;
+  std::atomic<bool> ready_;
+  std::unique_ptr<StoredType> value_;
+  std::exception_ptr exception_;
+  std::vector<Callback> callbacks_;
+
+  DISALLOW_COPY_AND_ASSIGN(FutureState);
+};
+
+template <typename T>
+struct Extract {
+  static T Get(const FutureState<T>& state) {
+    return state.Value();
+  }
+};
+
+template <>
+struct Extract<void> {
+  static void Get(const FutureState<void>& state) {
+    state.Value();
+  }
+};
+
+// Runs `callback` on `executor`, or inline if there is none. If the
+// executor refuses the task the failure is reported through `on_error`.
+inline void Execute(const std::shared_ptr<ThreadManager>& executor,
+                    const std::function<void()>& callback,
+                    const std::function<void(std::exception_ptr)>& on_error) {
+  if (!executor) {
+    callback();
+    return;
+  }
+  try {
+    executor->Add(FunctionRunner::Create(callback));
+  } catch (...) {
+    on_error(std::current_exception());
+  }
+}
+
+// Calls func() and stores its result or exception into promise. Defined
+// after Promise.
+template <typename R>
+struct Fulfill;
+
+} // namespace detail
+
+template <typename T>
+class Future {
+ public:
+  typedef T ValueType;
+
+  Future() {}
+
+  bool Valid() const { return state_ != nullptr; }
+  bool IsReady() const { return state_ && state_->IsReady(); }
+  bool HasException() const { return state_ && state_->HasException(); }
+
+  /**
+   * Blocks until the future is ready.
+   */
+  void Wait() const { state_->Wait(); }
+
+  /**
+   * Blocks for at most `timeout_ms`. Returns true if the future is ready.
+   */
+  bool WaitFor(int64_t timeout_ms) const { return state_->WaitFor(timeout_ms); }
+
+  /**
+   * Blocks until ready, then returns the value or rethrows the exception.
+   */
+  T Get() const {
+    state_->Wait();
+    return detail::Extract<T>::Get(*state_);
+  }
+
+  /**
+   * Attaches a continuation taking the ready Future<T>. Returns a future
+   * for the continuation's result; an exception thrown by `func` ends up
+   * in that future.
+   */
+  template <typename Func>
+  auto Then(Func func,
+            std::shared_ptr<ThreadManager> executor = nullptr) const
+      -> Future<decltype(func(std::declval<Future<T>>()))> {
+    typedef decltype(func(std::declval<Future<T>>())) R;
+    std::shared_ptr<Promise<R>> promise = std::make_shared<Promise<R>>();
+    Future<R> result = promise->GetFuture();
+    Future<T> self = *this;
+
+    std::function<void()> call = [promise, func, self]() mutable {
+      auto bound = [&func, &self]() { return func(self); };
+      detail::Fulfill<R>::Call(promise.get(), bound);
+    };
+    state_->AddCallback([executor, promise, call]() {
+      detail::Execute(executor, call, [promise](std::exception_ptr e) {
+        promise->SetException(e);
+      });
+    });
+    return result;
+  }
+
+ private:
+  friend class Promise<T>;
+
+  explicit Future(std::shared_ptr<detail::FutureState<T>> state)
+      : state_(state) {}
+
+  std::shared_ptr<detail::FutureState<T>> state_;
+};
+
+template <typename T>
+class Promise {
+ public:
+  typedef typename detail::Lift<T>::type StoredType;
+
+  Promise() : state_(std::make_shared<detail::FutureState<T>>()) {}
+
+  Promise(Promise&& other) noexcept : state_(std::move(other.state_)) {}
+  Promise& operator=(Promise&& other) noexcept {
+    if (&other != this) {
+      Break();
+      state_ = std::move(other.state_);
+    }
+    return *this;
+  }
+
+  ~Promise() { Break(); }
+
+  Future<T> GetFuture() const { return Future<T>(state_); }
+
+  void SetValue(StoredType value) { state_->SetValue(std::move(value)); }
+
+  template <typename U = T>
+  typename std::enable_if<std::is_void<U>::value>::type SetValue() {
+    state_->SetValue(Unit());
+  }
+
+  void SetException(std::exception_ptr exception) {
+    state_->SetException(exception);
+  }
+
+  bool IsFulfilled() const { return state_->IsReady(); }
+
+ private:
+  void Break() {
+    if (state_ && !state_->IsReady()) {
+      try {
+        state_->SetException(std::make_exception_ptr(BrokenPromiseException()));
+      } catch (const IllegalStateException&) {
+        // Raced with a concurrent SetValue(); nothing to break.
+      }
+    }
+  }
+
+  std::shared_ptr<detail::FutureState<T>> state_;
+
+  DISALLOW_COPY_AND_ASSIGN(Promise);
+};
+
+namespace detail {
+
+// Calls func() and stores its result or exception into promise.
+template <typename R>
+struct Fulfill {
+  template <typename Func>
+  static void Call(Promise<R>* promise, Func& func) {
+    try {
+      promise->SetValue(func());
+    } catch (...) {
+      promise->SetException(std::current_exception());
+    }
+  }
+};
+
+template <>
+struct Fulfill<void> {
+  template <typename Func>
+  static void Call(Promise<void>* promise, Func& func) {
+    try {
+      func();
+      promise->SetValue();
+    } catch (...) {
+      promise->SetException(std::current_exception());
+    }
+  }
+};
+
+} // namespace detail
+
+/**
+ * Returns a future that is already fulfilled.
+ */
+template <typename T>
+Future<T> MakeReadyFuture(T value) {
+  Promise<T> promise;
+  promise.SetValue(std::move(value));
+  return promise.GetFuture();
+}
+
+inline Future<void> MakeReadyFuture() {
+  Promise<void> promise;
+  promise.SetValue();
+  return promise.GetFuture();
+}
+
+/**
+ * Becomes ready when every input is ready, with the (ready) inputs as its
+ * value. Failed inputs do not fail the result; inspect them individually.
+ */
+template <typename T>
+Future<std::vector<Future<T>>> WhenAll(const std::vector<Future<T>>& futures) {
+  typedef std::vector<Future<T>> Futures;
+  if (futures.empty()) {
+    return MakeReadyFuture(Futures());
+  }
+
+  struct Context {
+    explicit Context(const Futures& f) : futures(f), pending(f.size()) {}
+    Futures futures;
+    std::atomic<size_t> pending;
+    Promise<Futures> promise;
+  };
+  std::shared_ptr<Context> context = std::make_shared<Context>(futures);
+  Future<Futures> result = context->promise.GetFuture();
+
+  for (const auto& future : futures) {
+    future.Then([context](Future<T>) {
+      if (context->pending.fetch_sub(1) == 1) {
+        context->promise.SetValue(context->futures);
+      }
+    });
+  }
+  return result;
+}
+
+template <typename T>
+struct WhenAnyResult {
+  size_t index;
+  std::vector<Future<T>> futures;
+};
+
+/**
+ * Becomes ready as soon as one input is ready; `index` names it.
+ */
+template <typename T>
+Future<WhenAnyResult<T>> WhenAny(const std::vector<Future<T>>& futures) {
+  struct Context {
+    explicit Context(const std::vector<Future<T>>& f) : futures(f), done(false) {}
+    std::vector<Future<T>> futures;
+    std::atomic<bool> done;
+    Promise<WhenAnyResult<T>> promise;
+  };
+  std::shared_ptr<Context> context = std::make_shared<Context>(futures);
+  Future<WhenAnyResult<T>> result = context->promise.GetFuture();
+
+  if (futures.empty()) {
+    context->promise.SetException(std::make_exception_ptr(
+        InvalidArgumentException()));
+    return result;
+  }
+
+  for (size_t i = 0; i < futures.size(); ++i) {
+    futures[i].Then([context, i](Future<T>) {
+      if (!context->done.exchange(true)) {
+        WhenAnyResult<T> any;
+        any.index = i;
+        any.futures = context->futures;
+        context->promise.SetValue(std::move(any));
+      }
+    });
+  }
+  return result;
+}
+
+// Declared in threading/thread_manager.h.
+template <typename Func>
+auto ThreadManager::Add(Func func) -> Future<decltype(func())> {
+  typedef decltype(func()) R;
+  std::shared_ptr<Promise<R>> promise = std::make_shared<Promise<R>>();
+  Future<R> result = promise->GetFuture();
+  Add(FunctionRunner::Create([promise, func]() mutable {
+    detail::Fulfill<R>::Call(promise.get(), func);
+  }));
+  return result;
+}
+
+} // namespace threading
+#endif // THREADING_FUTURE_H_
@@ -0,0 +1,126 @@
+#include "threading/future.h"
+#include "threading/thread_manager.h"
+#include "threading/thread_factory.h"
+#include "threading/time_util.h"
+
+#include <stdexcept>
+#include <string>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+using namespace threading;
+
+class FutureTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    executor_ = ThreadManager::NewSimpleThreadManager(4);
+    executor_->SetThreadFactory(std::make_shared<PosixThreadFactory>());
+    executor_->Start();
+  }
+
+  void TearDown() override {
+    executor_->Join();
+  }
+
+  std::shared_ptr<ThreadManager> executor_;
+};
+
+TEST_F(FutureTest, Promise_Set_Value) {
+  Promise<int> promise;
+  Future<int> future = promise.GetFuture();
+  EXPECT_TRUE(future.Valid());
+  EXPECT_FALSE(future.IsReady());
+  EXPECT_FALSE(future.WaitFor(10));
+
+  promise.SetValue(42);
+  EXPECT_TRUE(future.IsReady());
+  EXPECT_EQ(42, future.Get());
+  EXPECT_THROW(promise.SetValue(1), IllegalStateException);
+}
+
+TEST_F(FutureTest, Broken_Promise) {
+  Future<std::string> future;
+  {
+    Promise<std::string> promise;
+    future = promise.GetFuture();
+  }
+  EXPECT_TRUE(future.HasException());
+  EXPECT_THROW(future.Get(), BrokenPromiseException);
+}
+
+TEST_F(FutureTest, Add_Function) {
+  Future<int> future = executor_->Add([] { return 6 * 7; });
+  EXPECT_EQ(42, future.Get());
+
+  Future<void> done = executor_->Add([] { usleep(1000); });
+  done.Wait();
+  EXPECT_TRUE(done.IsReady());
+  EXPECT_FALSE(done.HasException());
+}
+
+TEST_F(FutureTest, Add_Function_Exception) {
+  Future<int> future = executor_->Add([]() -> int {
+    throw std::runtime_error("boom");
+  });
+  EXPECT_THROW(future.Get(), std::runtime_error);
+}
+
+TEST_F(FutureTest, Then_Chain) {
+  Future<std::string> future = executor_->Add([] { return 20; })
+      .Then([](Future<int> f) { return f.Get() + 1; }, executor_)
+      .Then([](Future<int> f) { return std::to_string(f.Get() * 2); });
+  EXPECT_EQ("42", future.Get());
+}
+
+TEST_F(FutureTest, Then_Sees_Exception) {
+  Promise<int> promise;
+  Future<bool> failed = promise.GetFuture().Then([](Future<int> f) {
+    return f.HasException();
+  }, executor_);
+  promise.SetException(std::make_exception_ptr(std::runtime_error("boom")));
+  EXPECT_TRUE(failed.Get());
+}
+
+TEST_F(FutureTest, Then_On_Ready_Future) {
+  Future<int> future = MakeReadyFuture(1).Then([](Future<int> f) {
+    return f.Get() + 1;
+  });
+  EXPECT_TRUE(future.IsReady());
+  EXPECT_EQ(2, future.Get());
+}
+
+TEST_F(FutureTest, When_All) {
+  const int kSegments = 64;
+  std::vector<Future<int>> segments;
+  for (int i = 0; i < kSegments; ++i) {
+    segments.push_back(executor_->Add([i] { return i; }));
+  }
+
+  Future<int> total = WhenAll(segments).Then(
+      [](Future<std::vector<Future<int>>> all) {
+        int sum = 0;
+        for (const auto& segment : all.Get()) {
+          sum += segment.Get();
+        }
+        return sum;
+      }, executor_);
+  EXPECT_EQ(kSegments * (kSegments - 1) / 2, total.Get());
+
+  EXPECT_TRUE(WhenAll(std::vector<Future<int>>()).IsReady());
+}
+
+TEST_F(FutureTest, When_Any) {
+  Promise<int> slow;
+  Promise<int> fast;
+  std::vector<Future<int>> futures = { slow.GetFuture(), fast.GetFuture() };
+
+  Future<WhenAnyResult<int>> any = WhenAny(futures);
+  EXPECT_FALSE(any.IsReady());
+  fast.SetValue(7);
+
+  WhenAnyResult<int> result = any.Get();
+  EXPECT_EQ(1u, result.index);
+  EXPECT_EQ(7, result.futures[result.index].Get());
+  slow.SetValue(0);
+}
@@ -3,6 +3,7 @@
 
 #include "base/macros.h"
 #include "threading/mutex.h"
+#include "threading/futex_monitor.h"
 
 namespace threading {
 
@@ -56,6 +57,8 @@ class Synchronized {
  public:
  explicit Synchronized(const Monitor* monitor) : g(monitor->mutex()) { }
  explicit Synchronized(const Monitor& monitor) : g(monitor.mutex()) { }
+ explicit Synchronized(const FutexMonitor* monitor) : g(monitor->mutex()) { }
+ explicit Synchronized(const FutexMonitor& monitor) : g(monitor.mutex()) { }
 
  private:
   Guard g;
@@ -0,0 +1,138 @@
+#ifndef THREADING_MPMC_QUEUE_H_
+#define THREADING_MPMC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "base/macros.h"
+
+namespace threading {
+
+/**
+ * Bounded multi-producer multi-consumer queue without locks (Dmitry
+ * Vyukov's array queue).
+ *
+ * Every cell carries a sequence number telling producers and consumers
+ * whose turn it is, so a push or a pop is one compare-and-swap on the
+ * shared position plus a release store on the cell. TryPush() fails when
+ * the queue is full and TryPop() when it is empty; nothing ever blocks.
+ * Pair the queue with an EventCount to wait for either condition.
+ *
+ * The capacity is rounded up to a power of two.
+ */
+template <typename T>
+class MpmcQueue {
+ public:
+  explicit MpmcQueue(size_t capacity)
+      : mask_(RoundUpToPowerOfTwo(capacity < 2 ? 2 : capacity) - 1),
+        cells_(new Cell[mask_ + 1]),
+        enqueue_pos_(0),
+        dequeue_pos_(0) {
+    for (size_t i = 0; i <= mask_; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~MpmcQueue() {
+    T value;
+    while (TryPop(&value)) {
+    }
+  }
+
+  bool TryPush(const T& value) { return Emplace(value); }
+  // `value` is only moved from when the push succeeds.
+  bool TryPush(T&& value) { return Emplace(std::move(value)); }
+
+  bool TryPop(T* value) {
+    Cell* cell;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;  // empty
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    T* stored = reinterpret_cast<T*>(&cell->storage);
+    *value = std::move(*stored);
+    stored->~T();
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  /**
+   * Approximate while other threads push or pop.
+   */
+  size_t SizeGuess() const {
+    size_t enqueued = enqueue_pos_.load(std::memory_order_relaxed);
+    size_t dequeued = dequeue_pos_.load(std::memory_order_relaxed);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+  }
+
+ private:
+  static const size_t kCacheLineSize = 64;
+
+  template <typename U>
+  bool Emplace(U&& value) {
+    Cell* cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    new (&cell->storage) T(std::forward<U>(value));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  static size_t RoundUpToPowerOfTwo(size_t n) {
+    size_t power = 1;
+    while (power < n) {
+      power <<= 1;
+    }
+    return power;
+  }
+
+  const size_t mask_;
+  const std::unique_ptr<Cell[]> cells_;
+  // Producers and consumers each hammer their own position; keep them on
+  // separate cache lines.
+  alignas(kCacheLineSize) std::atomic<size_t> enqueue_pos_;
+  alignas(kCacheLineSize) std::atomic<size_t> dequeue_pos_;
+
+  DISALLOW_COPY_AND_ASSIGN(MpmcQueue);
+};
+
+} // namespace threading
+#endif // THREADING_MPMC_QUEUE_H_
@@ -0,0 +1,72 @@
+#include "threading/mpmc_queue.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST(MpmcQueueTest, Fifo_And_Bounded) {
+  threading::MpmcQueue<std::string> queue(3);
+  EXPECT_EQ(4u, queue.capacity());
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(queue.TryPush(std::to_string(i)));
+  }
+  EXPECT_FALSE(queue.TryPush("full"));
+  EXPECT_EQ(4u, queue.SizeGuess());
+
+  std::string value;
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(queue.TryPop(&value));
+    EXPECT_EQ(std::to_string(i), value);
+  }
+  EXPECT_FALSE(queue.TryPop(&value));
+}
+
+TEST(MpmcQueueTest, Destroys_Remaining_Values) {
+  std::shared_ptr<int> counted = std::make_shared<int>(0);
+  {
+    threading::MpmcQueue<std::shared_ptr<int>> queue(8);
+    queue.TryPush(counted);
+    queue.TryPush(counted);
+    EXPECT_EQ(3, counted.use_count());
+  }
+  EXPECT_EQ(1, counted.use_count());
+}
+
+TEST(MpmcQueueTest, Producers_Consumers) {
+  const int kThreads = 4;
+  const int kPerThread = 100000;
+  threading::MpmcQueue<int> queue(64);
+  std::atomic<int64_t> sum(0);
+  std::atomic<int> popped(0);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&queue] {
+      for (int i = 1; i <= kPerThread; ++i) {
+        while (!queue.TryPush(i)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+    threads.emplace_back([&queue, &sum, &popped] {
+      int value;
+      while (popped.load() < kThreads * kPerThread) {
+        if (queue.TryPop(&value)) {
+          sum += value;
+          popped++;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(static_cast<int64_t>(kThreads) * kPerThread * (kPerThread + 1) / 2,
+            sum.load());
+}
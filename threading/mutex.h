@@ -5,6 +5,7 @@
 #include <memory>
 
 #include "base/macros.h"
+#include "threading/futex_mutex.h"
 
 namespace threading {
 
@@ -69,6 +70,20 @@ class Guard {
       }
     }
   }
+  explicit Guard(const FutexMutex& value, int64_t timeout = 0)
+      : futex_mutex_(&value) {
+    if (timeout == 0) {
+      value.Lock();
+    } else if (timeout < 0) {
+      if (!value.TryLock()) {
+        futex_mutex_ = nullptr;
+      }
+    } else {
+      if (!value.TimedLock(timeout)) {
+        futex_mutex_ = nullptr;
+      }
+    }
+  }
   ~Guard() {
     release();
   }
@@ -82,11 +97,17 @@ class Guard {
       release();
       using std::swap;
       swap(mutex_, other.mutex_);
+      swap(futex_mutex_, other.futex_mutex_);
     }
     return *this;
   }
 
   bool release() {
+    if (futex_mutex_) {
+      futex_mutex_->Unlock();
+      futex_mutex_ = nullptr;
+      return true;
+    }
     if (!mutex_) {
       return false;
     }
@@ -96,11 +117,12 @@ class Guard {
   }
 
   explicit operator bool() const {
-    return mutex_ != nullptr;
+    return mutex_ != nullptr || futex_mutex_ != nullptr;
   }
 
  private:
   const Mutex* mutex_ = nullptr;
+  const FutexMutex* futex_mutex_ = nullptr;
 
   DISALLOW_COPY_AND_ASSIGN(Guard);
 };
@@ -1,8 +1,14 @@
 #include "threading/mutex.h"
+#include "threading/monitor.h"
+#include "threading/exception.h"
+#include "threading/event_count.h"
 #include "threading/time_util.h"
 
+#include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
 #include <thread>
 #include <condition_variable>
 #include <vector>
@@ -169,3 +175,147 @@ TEST(MutexTest, Recursive_Holders) {
   threading::Guard g2(mutex);
 }
 
+TEST(FutexMutexTest, Try_Lock) {
+  threading::FutexMutex mutex;
+  EXPECT_FALSE(mutex.IsLocked());
+  EXPECT_TRUE(mutex.TryLock());
+  EXPECT_TRUE(mutex.IsLocked());
+  EXPECT_FALSE(mutex.TryLock());
+  mutex.Unlock();
+  EXPECT_FALSE(mutex.IsLocked());
+}
+
+TEST(FutexMutexTest, Timed_Lock) {
+  threading::FutexMutex mutex;
+  threading::Guard g(mutex);
+  EXPECT_TRUE(g);
+
+  std::thread waiter([&mutex] {
+    threading::Guard timed(mutex, kTimeoutMs);
+    EXPECT_FALSE(timed);
+    threading::Guard attempt(mutex, -1);
+    EXPECT_FALSE(attempt);
+  });
+  waiter.join();
+
+  std::thread locker([&mutex] {
+    threading::Guard timed(mutex, 1.5 * kOpTimeInMs);
+    EXPECT_TRUE(timed);
+  });
+  usleep(kOpTimeInMs * kMicroSecInMilliSec / 2);
+  g.release();
+  locker.join();
+  EXPECT_FALSE(mutex.IsLocked());
+}
+
+TEST(FutexMonitorTest, Wait_Timeout) {
+  threading::FutexMonitor monitor;
+  threading::Synchronized s(monitor);
+  EXPECT_THROW(monitor.Wait(kTimeoutMs), threading::TimedOutException);
+  EXPECT_EQ(ETIMEDOUT, monitor.WaitForTimeRelative(kTimeoutMs));
+  EXPECT_TRUE(monitor.mutex().IsLocked());
+}
+
+TEST(FutexMonitorTest, Notify_Wakes_Waiters) {
+  threading::FutexMonitor monitor;
+  const int kWaiters = 4;
+  int ready = 0;
+  bool go = false;
+  int woken = 0;
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kWaiters; ++i) {
+    threads.push_back(std::thread([&] {
+      threading::Synchronized s(monitor);
+      ++ready;
+      monitor.NotifyAll();
+      while (!go) {
+        monitor.Wait();
+      }
+      ++woken;
+    }));
+  }
+
+  {
+    threading::Synchronized s(monitor);
+    while (ready != kWaiters) {
+      monitor.Wait();
+    }
+    go = true;
+    monitor.NotifyAll();
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(kWaiters, woken);
+}
+
+TEST(EventCountTest, Producer_Consumer) {
+  const int kItems = 100000;
+  threading::EventCount ec;
+  std::atomic<int> produced(0);
+  int consumed = 0;
+
+  std::thread consumer([&] {
+    while (consumed < kItems) {
+      int available = produced.load();
+      if (available > consumed) {
+        consumed = available;
+        continue;
+      }
+      threading::EventCount::Key key = ec.PrepareWait();
+      if (produced.load() > consumed) {
+        ec.CancelWait();
+        continue;
+      }
+      ec.Wait(key);
+    }
+  });
+
+  for (int i = 0; i < kItems; ++i) {
+    produced.fetch_add(1);
+    ec.Notify();
+  }
+  consumer.join();
+  EXPECT_EQ(kItems, consumed);
+}
+
+// Contention benchmark: N threads hammering one short critical section.
+template <typename MutexType>
+static int64_t ContendedLoopUsec(int num_threads, int iterations) {
+  MutexType mutex;
+  int64_t counter = 0;
+  std::vector<std::thread> threads;
+
+  int64_t start = threading::TimeUtil::MonotonicTimeUsec();
+  for (int i = 0; i < num_threads; ++i) {
+    threads.push_back(std::thread([&mutex, &counter, iterations] {
+      for (int n = 0; n < iterations; ++n) {
+        threading::Guard g(mutex);
+        ++counter;
+      }
+    }));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  int64_t elapsed = threading::TimeUtil::MonotonicTimeUsec() - start;
+
+  EXPECT_EQ(static_cast<int64_t>(num_threads) * iterations, counter);
+  return elapsed;
+}
+
+TEST(MutexBenchmark, Pthread_Vs_Futex) {
+  const int kIterations = 200000;
+  const int kThreadCounts[] = { 1, 2, 4, 8 };
+
+  for (int num_threads : kThreadCounts) {
+    int64_t pthread_usec =
+        ContendedLoopUsec<threading::Mutex>(num_threads, kIterations);
+    int64_t futex_usec =
+        ContendedLoopUsec<threading::FutexMutex>(num_threads, kIterations);
+    LOG(INFO) << "threads=" << num_threads
+              << " pthread Mutex: " << pthread_usec << "us"
+              << ", FutexMutex: " << futex_usec << "us";
+  }
+}
@@ -0,0 +1,113 @@
+#include "threading/thread_local.h"
+#include "threading/exception.h"
+#include "threading/futex_mutex.h"
+#include "threading/mutex.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <vector>
+
+namespace threading {
+namespace detail {
+
+__thread ThreadLocalSlot* tls_slots = nullptr;
+__thread uint32_t tls_slot_count = 0;
+
+namespace {
+
+struct SlotRegistry {
+  SlotRegistry() : next_id(0) {
+    int ret = pthread_key_create(&exit_key, &OnThreadExit);
+    if (ret != 0) {
+      throw SystemResourceException("failed to allocate thread-local exit key");
+    }
+  }
+
+  // Destroys every object the exiting thread still holds. Destructors may
+  // touch other ThreadLocals and refill slots, so repeat until clean.
+  static void OnThreadExit(void* /* arg */) {
+    bool again = true;
+    while (again) {
+      again = false;
+      for (uint32_t i = 0; i < tls_slot_count; ++i) {
+        ThreadLocalSlot* slot = &tls_slots[i];
+        if (slot->ptr != nullptr) {
+          void* ptr = slot->ptr;
+          slot->ptr = nullptr;
+          slot->destroy(ptr);
+          again = true;
+        }
+      }
+    }
+    ::free(tls_slots);
+    tls_slots = nullptr;
+    tls_slot_count = 0;
+  }
+
+  FutexMutex lock;
+  pthread_key_t exit_key;
+  uint32_t next_id;
+  std::vector<uint32_t> free_ids;
+  std::vector<uint32_t> generations;
+};
+
+// Never destroyed: ThreadLocal statics may outlive any other global.
+SlotRegistry* Registry() {
+  static SlotRegistry* registry = new SlotRegistry;
+  return registry;
+}
+
+} // namespace
+
+uint32_t AllocateThreadLocalSlot(uint32_t* generation) {
+  SlotRegistry* registry = Registry();
+  Guard g(registry->lock);
+  uint32_t id;
+  if (!registry->free_ids.empty()) {
+    id = registry->free_ids.back();
+    registry->free_ids.pop_back();
+  } else {
+    id = registry->next_id++;
+    // Generation 0 marks an empty slot, so live ids start at 1.
+    registry->generations.push_back(1);
+  }
+  *generation = registry->generations[id];
+  return id;
+}
+
+void ReleaseThreadLocalSlot(uint32_t id) {
+  SlotRegistry* registry = Registry();
+  Guard g(registry->lock);
+  uint32_t& generation = registry->generations[id];
+  if (++generation == 0) {
+    generation = 1;
+  }
+  registry->free_ids.push_back(id);
+}
+
+ThreadLocalSlot* GrowThreadLocalSlots(uint32_t id) {
+  uint32_t old_count = tls_slot_count;
+  uint32_t new_count = old_count == 0 ? 16 : old_count;
+  while (new_count <= id) {
+    new_count *= 2;
+  }
+  ThreadLocalSlot* slots = static_cast<ThreadLocalSlot*>(
+      ::realloc(tls_slots, new_count * sizeof(ThreadLocalSlot)));
+  if (slots == nullptr) {
+    throw SystemResourceException("failed to grow thread-local slots");
+  }
+  ::memset(slots + old_count, 0,
+           (new_count - old_count) * sizeof(ThreadLocalSlot));
+  if (old_count == 0) {
+    // Any non-null value makes pthread run OnThreadExit for this thread.
+    pthread_setspecific(Registry()->exit_key, slots);
+  }
+  tls_slots = slots;
+  tls_slot_count = new_count;
+  return &tls_slots[id];
+}
+
+} // namespace detail
+} // namespace threading
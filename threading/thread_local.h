@@ -1,23 +1,56 @@
 #ifndef THRIFT_CONCURRENCY_THREADLOCAL_H_
 #define THRIFT_CONCURRENCY_THREADLOCAL_H_ 1
 
-#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "base/macros.h"
 
 namespace threading {
 
 template <typename T>
 class DefaultThreadLocalManager;
 
+namespace detail {
+
+/**
+ * One entry of a thread's slot table. `generation` identifies which
+ * ThreadLocal instance the entry belongs to, so a slot id recycled after a
+ * ThreadLocal is destroyed never hands out the previous owner's object.
+ */
+struct ThreadLocalSlot {
+  void* ptr;
+  void (*destroy)(void*);
+  uint32_t generation;
+};
+
+// The calling thread's slot table, indexed by ThreadLocal id. Plain native
+// TLS: reading an entry is a couple of loads, with no pthread_getspecific()
+// call.
+extern __thread ThreadLocalSlot* tls_slots;
+extern __thread uint32_t tls_slot_count;
+
+// Reserves a slot id and returns it with its current generation.
+uint32_t AllocateThreadLocalSlot(uint32_t* generation);
+// Returns a slot id to the free list and bumps its generation.
+void ReleaseThreadLocalSlot(uint32_t id);
+// Grows the calling thread's slot table to hold `id`, registering the
+// thread-exit hook on first use.
+ThreadLocalSlot* GrowThreadLocalSlots(uint32_t id);
+
+} // namespace detail
+
 /**
  * ThreadLocal manages thread-local storage for a particular object type.
  *
  * Each ThreadLocal object contains a separate instance of an object for each
  * thread that accesses the ThreadLocal object.
  *
- * Note that you should avoid creating too many ThreadLocal objects (e.g., such
- * as keeping a ThreadLocal member variable in commonly allocated objects).
- * The number of ThreadLocal objects cannot be larger than the value of
- * PTHREAD_KEYS_MAX, which is 1024 on many systems.
+ * Instances live in a per-thread table held in native (__thread) storage,
+ * so get() on a thread that already has its instance costs an index check
+ * and two loads. A single pthread key is only used to run Manager::destroy()
+ * for every ThreadLocal when a thread exits; the number of ThreadLocal
+ * objects is therefore not limited by PTHREAD_KEYS_MAX.
  *
  * The ManagerT template parameter controls how object allocation and
  * deallocation should be performed.  When get() is called from a thread that
@@ -35,14 +68,11 @@ class ThreadLocal {
    * Create a new ThreadLocal object.
    */
   ThreadLocal() {
-    int ret = pthread_key_create(&key_, &ThreadLocal::onThreadExit);
-    if (ret != 0) {
-//      throw TLibraryException("failed to allocate new thread-local key", ret);
-    }
+    id_ = detail::AllocateThreadLocalSlot(&generation_);
   }
 
   ~ThreadLocal() {
-    pthread_key_delete(key_);
+    detail::ReleaseThreadLocalSlot(id_);
   }
 
   /**
@@ -55,7 +85,7 @@ class ThreadLocal {
    */
   T *get() const {
     T *obj = getNoAlloc();
-    if (obj == nullptr) {
+    if (PREDICT_FALSE(obj == nullptr)) {
       Manager m;
       obj = m.allocate();
       if (obj != nullptr) {
@@ -72,7 +102,13 @@ class ThreadLocal {
    * returned.  Manager::allocate() will never be called.
    */
   T *getNoAlloc() const {
-    return static_cast<T*>(pthread_getspecific(key_));
+    if (PREDICT_TRUE(id_ < detail::tls_slot_count)) {
+      const detail::ThreadLocalSlot& slot = detail::tls_slots[id_];
+      if (PREDICT_TRUE(slot.generation == generation_)) {
+        return static_cast<T*>(slot.ptr);
+      }
+    }
+    return nullptr;
   }
 
   /**
@@ -115,10 +151,19 @@ class ThreadLocal {
 
  private:
   void setImpl(T* obj) const {
-    int ret = pthread_setspecific(key_, obj);
-    if (ret != 0) {
- //     throw TLibraryException("failed to update thread-local key", ret);
+    detail::ThreadLocalSlot* slot;
+    if (PREDICT_TRUE(id_ < detail::tls_slot_count)) {
+      slot = &detail::tls_slots[id_];
+    } else {
+      slot = detail::GrowThreadLocalSlots(id_);
+    }
+    if (slot->generation != generation_ && slot->ptr != nullptr) {
+      // Left behind by a destroyed ThreadLocal that used the same id.
+      slot->destroy(slot->ptr);
     }
+    slot->ptr = obj;
+    slot->destroy = &ThreadLocal::onThreadExit;
+    slot->generation = generation_;
   }
 
   static void onThreadExit(void* arg) {
@@ -129,17 +174,16 @@ class ThreadLocal {
     }
   }
 
-  pthread_key_t key_;
+  uint32_t id_;
+  uint32_t generation_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadLocal);
 };
 
 /*
- * WARNING: Any threadlocalmanager that depends on destruction of the
- * thread-local object is broken with thrift::concurrency::ThreadLocal.
- * The ThreadLocal destructor does _not_ destroy any currently allocated
- * objects.
- *
- * Instead, please use folly::ThreadLocal if you are depending on
- * the destruction of your object.
+ * WARNING: The ThreadLocal destructor does _not_ destroy the objects other
+ * threads still hold. They are destroyed when those threads exit, or when
+ * a later ThreadLocal reusing the same slot stores a value on that thread.
  */
 
 template <typename T>
@@ -192,6 +236,29 @@ class NoopThreadLocalManager {
   }
 };
 
+/**
+ * Allocates a default-constructed T on first use and deletes it when the
+ * thread exits. Unlike DefaultThreadLocalManager, allocate() is not
+ * deprecated: use it when lazily created per-thread state is intended.
+ */
+template <typename T>
+class CreateOnDemandThreadLocalManager {
+ public:
+  T* allocate() {
+    return new T;
+  }
+
+  void destroy(T* t) {
+    delete t;
+  }
+
+  void replace(T* oldObj, T* newObj) {
+    if (oldObj != newObj) {
+      delete oldObj;
+    }
+  }
+};
+
 } // namespace threading
 
 #endif // THRIFT_CONCURRENCY_THREADLOCAL_H_
@@ -0,0 +1,134 @@
+#ifndef THREADING_THREAD_LOCAL_CACHE_H_
+#define THREADING_THREAD_LOCAL_CACHE_H_
+
+#include <stddef.h>
+#include <vector>
+
+#include "base/macros.h"
+#include "threading/thread_local.h"
+
+namespace threading {
+
+/**
+ * Reset policies run when an object goes back to a ThreadLocalObjectCache.
+ * They must leave the object equivalent to a freshly constructed one while
+ * keeping whatever capacity it has grown.
+ */
+template <typename T>
+struct NoopObjectReset {
+  void operator()(T*) const {}
+};
+
+// Protobuf messages, and anything else with a Clear() method.
+template <typename T>
+struct ClearObjectReset {
+  void operator()(T* obj) const { obj->Clear(); }
+};
+
+/**
+ * A per-thread free list of reusable objects.
+ *
+ * Hot handler paths Acquire() an object (a parse document, a protobuf
+ * message, an ostringstream...) instead of constructing one per message;
+ * the Handle puts it back, reset, when it goes out of scope. Each thread
+ * keeps at most `max_cached_per_thread` idle objects, so the cache never
+ * pins more than that per thread; extra ones are simply deleted.
+ *
+ *   static ThreadLocalObjectCache<GetEpubCatalogRequest,
+ *                                 ClearObjectReset<GetEpubCatalogRequest>> cache;
+ *   auto request = cache.Acquire();
+ *   request->set_book_id(id);
+ *
+ * A Handle may be released on another thread; the object then joins that
+ * thread's free list. The cache must outlive all of its handles.
+ */
+template <typename T, typename ResetT = NoopObjectReset<T> >
+class ThreadLocalObjectCache {
+ public:
+  static const size_t kDefaultMaxCachedPerThread = 4;
+
+  class Handle {
+   public:
+    Handle(Handle&& other) : cache_(other.cache_), obj_(other.obj_) {
+      other.obj_ = nullptr;
+    }
+
+    ~Handle() {
+      if (obj_ != nullptr) {
+        cache_->Release(obj_);
+      }
+    }
+
+    T* get() const { return obj_; }
+    T* operator->() const { return obj_; }
+    T& operator*() const { return *obj_; }
+
+   private:
+    friend class ThreadLocalObjectCache;
+
+    Handle(ThreadLocalObjectCache* cache, T* obj) : cache_(cache), obj_(obj) {}
+
+    ThreadLocalObjectCache* cache_;
+    T* obj_;
+
+    DISALLOW_COPY_AND_ASSIGN(Handle);
+  };
+
+  explicit ThreadLocalObjectCache(
+      size_t max_cached_per_thread = kDefaultMaxCachedPerThread)
+      : max_cached_per_thread_(max_cached_per_thread) {}
+
+  /**
+   * Returns an idle object of this thread, or a new one if there is none.
+   */
+  Handle Acquire() {
+    std::vector<T*>& free_list = free_lists_->objects;
+    if (free_list.empty()) {
+      return Handle(this, new T());
+    }
+    T* obj = free_list.back();
+    free_list.pop_back();
+    return Handle(this, obj);
+  }
+
+  /**
+   * Number of idle objects cached by the calling thread.
+   */
+  size_t CachedCount() const {
+    FreeList* free_list = free_lists_.getNoAlloc();
+    return free_list == nullptr ? 0 : free_list->objects.size();
+  }
+
+ private:
+  struct FreeList {
+    ~FreeList() {
+      for (T* obj : objects) {
+        delete obj;
+      }
+    }
+
+    std::vector<T*> objects;
+  };
+
+  void Release(T* obj) {
+    std::vector<T*>& free_list = free_lists_->objects;
+    if (free_list.size() >= max_cached_per_thread_) {
+      delete obj;
+      return;
+    }
+    ResetT reset;
+    reset(obj);
+    free_list.push_back(obj);
+  }
+
+  const size_t max_cached_per_thread_;
+  ThreadLocal<FreeList, CreateOnDemandThreadLocalManager<FreeList> > free_lists_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadLocalObjectCache);
+};
+
+template <typename T, typename ResetT>
+const size_t ThreadLocalObjectCache<T, ResetT>::kDefaultMaxCachedPerThread;
+
+} // namespace threading
+#endif // THREADING_THREAD_LOCAL_CACHE_H_
@@ -0,0 +1,166 @@
+#include "threading/thread_local.h"
+#include "threading/thread_local_cache.h"
+#include "threading/time_util.h"
+
+#include <atomic>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <limits.h>
+#include <pthread.h>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+using namespace threading;
+
+namespace {
+
+struct Counted {
+  static std::atomic<int> live;
+
+  Counted() : value(0) { ++live; }
+  ~Counted() { --live; }
+
+  int value;
+};
+
+std::atomic<int> Counted::live(0);
+
+typedef CreateOnDemandThreadLocalManager<Counted> CountedManager;
+
+} // namespace
+
+TEST(ThreadLocalTest, Per_Thread_Instances) {
+  ThreadLocal<Counted, CountedManager> local;
+  local->value = 1;
+
+  int other_value = -1;
+  std::thread other([&] {
+    other_value = local->value;
+    local->value = 2;
+  });
+  other.join();
+
+  EXPECT_EQ(0, other_value);
+  EXPECT_EQ(1, local->value);
+  // The other thread's instance was destroyed when it exited.
+  EXPECT_EQ(1, Counted::live.load());
+
+  local.clear();
+  EXPECT_EQ(nullptr, local.getNoAlloc());
+  EXPECT_EQ(0, Counted::live.load());
+}
+
+TEST(ThreadLocalTest, Set_Replaces_And_Destroys) {
+  ThreadLocal<Counted, CountedManager> local;
+  EXPECT_EQ(nullptr, local.getNoAlloc());
+  local.set(new Counted);
+  local.set(new Counted);
+  EXPECT_EQ(1, Counted::live.load());
+  local.clear();
+  EXPECT_EQ(0, Counted::live.load());
+}
+
+TEST(ThreadLocalTest, Recycled_Slot_Does_Not_Leak_Old_Value) {
+  std::unique_ptr<ThreadLocal<Counted, CountedManager> > first(
+      new ThreadLocal<Counted, CountedManager>);
+  (*first)->value = 42;
+  first.reset();
+  EXPECT_EQ(1, Counted::live.load());
+
+  // Very likely reuses the slot id of `first`.
+  ThreadLocal<Counted, CountedManager> second;
+  EXPECT_EQ(nullptr, second.getNoAlloc());
+  EXPECT_EQ(0, second->value);
+  // The stale object was destroyed when the slot was taken over.
+  EXPECT_EQ(1, Counted::live.load());
+  second.clear();
+  EXPECT_EQ(0, Counted::live.load());
+}
+
+TEST(ThreadLocalTest, More_Than_Pthread_Keys_Max) {
+  const int kLocals = PTHREAD_KEYS_MAX + 100;
+  std::vector<std::unique_ptr<ThreadLocal<int, CreateOnDemandThreadLocalManager<int> > > > locals;
+  for (int i = 0; i < kLocals; ++i) {
+    locals.emplace_back(new ThreadLocal<int, CreateOnDemandThreadLocalManager<int> >);
+    **locals.back() = i;
+  }
+  for (int i = 0; i < kLocals; ++i) {
+    EXPECT_EQ(i, **locals[i]);
+    locals[i]->clear();
+  }
+}
+
+TEST(ThreadLocalObjectCacheTest, Reuses_Objects) {
+  ThreadLocalObjectCache<std::ostringstream> cache;
+  std::ostringstream* first;
+  {
+    auto os = cache.Acquire();
+    first = os.get();
+    *os << "hello";
+  }
+  EXPECT_EQ(1u, cache.CachedCount());
+  {
+    auto os = cache.Acquire();
+    EXPECT_EQ(first, os.get());
+    EXPECT_EQ(0u, cache.CachedCount());
+  }
+}
+
+namespace {
+
+struct Resettable {
+  Resettable() : cleared(0) {}
+  void Clear() { ++cleared; }
+  int cleared;
+};
+
+} // namespace
+
+TEST(ThreadLocalObjectCacheTest, Resets_And_Bounds_Idle_Objects) {
+  ThreadLocalObjectCache<Resettable, ClearObjectReset<Resettable> > cache(2);
+  {
+    auto a = cache.Acquire();
+    auto b = cache.Acquire();
+    auto c = cache.Acquire();
+  }
+  EXPECT_EQ(2u, cache.CachedCount());
+  auto d = cache.Acquire();
+  EXPECT_EQ(1, d->cleared);
+
+  size_t other_count = 1;
+  std::thread other([&] { other_count = cache.CachedCount(); });
+  other.join();
+  EXPECT_EQ(0u, other_count);
+}
+
+TEST(ThreadLocalBenchmark, Native_Vs_Pthread_Key) {
+  const int kIterations = 20 * 1000 * 1000;
+  ThreadLocal<int, CreateOnDemandThreadLocalManager<int> > local;
+  *local = 1;
+  pthread_key_t key;
+  ASSERT_EQ(0, pthread_key_create(&key, nullptr));
+  int value = 1;
+  pthread_setspecific(key, &value);
+
+  int64_t start = TimeUtil::MonotonicTime();
+  int64_t sum = 0;
+  for (int i = 0; i < kIterations; ++i) {
+    sum += *static_cast<volatile int*>(local.get());
+  }
+  int64_t native_ms = TimeUtil::MonotonicTime() - start;
+
+  start = TimeUtil::MonotonicTime();
+  for (int i = 0; i < kIterations; ++i) {
+    sum += *static_cast<volatile int*>(pthread_getspecific(key));
+  }
+  int64_t pthread_ms = TimeUtil::MonotonicTime() - start;
+
+  EXPECT_EQ(2 * kIterations, sum);
+  LOG(INFO) << "ThreadLocal::get(): " << native_ms << "ms, "
+            << "pthread_getspecific(): " << pthread_ms << "ms";
+  pthread_key_delete(key);
+}
@@ -113,10 +113,10 @@ private:
 
   friend class ThreadManager::Task;
   std::queue<shared_ptr<Task> > tasks_;
-  Mutex mutex_;
-  Monitor monitor_;
-  Monitor max_monitor_;
-  Monitor worker_monitor_;
+  FutexMutex mutex_;
+  FutexMonitor monitor_;
+  FutexMonitor max_monitor_;
+  FutexMonitor worker_monitor_;
 
   friend class ThreadManager::Worker;
   std::set<shared_ptr<Thread> > workers_;
@@ -429,9 +429,7 @@ void ThreadManager::Impl::Add(shared_ptr<Runnable> value,
       while (pending_task_count_max_ > 0 && 
 	     tasks_.size() >= pending_task_count_max_) {
         // This is thread safe because the mutex is shared between monitors.
-  LOG(INFO) << "------y";
         max_monitor_.Wait(timeout);
-  LOG(INFO) << "------z";
       }
     } else {
       throw TooManyPendingTasksException();
@@ -13,6 +13,8 @@ namespace threading {
  */
 class ThreadManager;
 
+template <typename T> class Future;
+
 /**
  * ThreadManager class
  *
@@ -132,6 +134,16 @@ public:
                    int64_t timeout = 0LL,
                    int64_t expiration = 0LL) = 0;
 
+  /**
+   * Adds a function to be executed by a worker thread and returns a Future
+   * for its result (or exception). Blocks like Add() above when the pending
+   * task queue is full.
+   *
+   * Defined in threading/future.h; include it to use this overload.
+   */
+  template <typename Func>
+  auto Add(Func func) -> Future<decltype(func())>;
+
   /**
    * Removes a pending task
    */
@@ -0,0 +1,47 @@
+#include "threading/thread_manager_metrics.h"
+
+namespace threading {
+
+namespace {
+
+// Reads `stat` of the manager while it is alive, 0 afterwards.
+template <typename Stat>
+std::function<double()> Sample(std::weak_ptr<ThreadManager> manager, Stat stat) {
+  return [manager, stat]() -> double {
+    std::shared_ptr<ThreadManager> locked = manager.lock();
+    return locked ? static_cast<double>(stat(locked.get())) : 0;
+  };
+}
+
+} // namespace
+
+ThreadManagerMetrics::ThreadManagerMetrics(const std::string& pool,
+                                           const std::shared_ptr<ThreadManager>& manager,
+                                           base::MetricsRegistry* registry)
+    : registry_(registry) {
+  const base::MetricLabels labels = {{"pool", pool}};
+  callbacks_.push_back(registry_->AddCallback(
+      base::MetricsRegistry::GAUGE, "thread_manager_workers",
+      "Worker threads of the pool.", labels,
+      Sample(manager, [](ThreadManager* m) { return m->WorkerCount(); })));
+  callbacks_.push_back(registry_->AddCallback(
+      base::MetricsRegistry::GAUGE, "thread_manager_idle_workers",
+      "Workers of the pool waiting for a task.", labels,
+      Sample(manager, [](ThreadManager* m) { return m->IdleWorkerCount(); })));
+  callbacks_.push_back(registry_->AddCallback(
+      base::MetricsRegistry::GAUGE, "thread_manager_pending_tasks",
+      "Tasks queued in the pool, not yet running.", labels,
+      Sample(manager, [](ThreadManager* m) { return m->PendingTaskCount(); })));
+  callbacks_.push_back(registry_->AddCallback(
+      base::MetricsRegistry::COUNTER, "thread_manager_expired_tasks_total",
+      "Tasks dropped after their expiration without running.", labels,
+      Sample(manager, [](ThreadManager* m) { return m->ExpiredTaskCount(); })));
+}
+
+ThreadManagerMetrics::~ThreadManagerMetrics() {
+  for (int id : callbacks_) {
+    registry_->RemoveCallback(id);
+  }
+}
+
+} // namespace threading
@@ -0,0 +1,41 @@
+#ifndef THREADING_THREAD_MANAGER_METRICS_H_
+#define THREADING_THREAD_MANAGER_METRICS_H_
+#include "base/macros.h"
+#include "base/metrics.h"
+#include "threading/thread_manager.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace threading {
+
+/**
+ * Exports the statistics of a ThreadManager, labelled pool=<pool>, for as
+ * long as it lives:
+ *
+ *   thread_manager_workers          worker threads
+ *   thread_manager_idle_workers     workers waiting for a task
+ *   thread_manager_pending_tasks    tasks queued, not yet running
+ *   thread_manager_expired_tasks_total
+ *                                   tasks dropped after their expiration
+ *
+ * The values are read when the registry is exported. The manager is only
+ * weakly referenced; a released one reports nothing.
+ */
+class ThreadManagerMetrics {
+ public:
+  ThreadManagerMetrics(const std::string& pool,
+                       const std::shared_ptr<ThreadManager>& manager,
+                       base::MetricsRegistry* registry = base::MetricsRegistry::GetInstance());
+  ~ThreadManagerMetrics();
+
+ private:
+  base::MetricsRegistry* const registry_;
+  std::vector<int> callbacks_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadManagerMetrics);
+};
+
+} // namespace threading
+#endif // THREADING_THREAD_MANAGER_METRICS_H_
@@ -1,4 +1,5 @@
 #include "threading/thread_manager.h"
+#include "threading/thread_manager_metrics.h"
 #include "threading/thread_factory.h"
 #include "threading/monitor.h"
 #include "threading/time_util.h"
@@ -141,6 +142,23 @@ TEST(ThreadManagerTest, LoadTest) {
   LoadTest(num_tasks, timeout, num_workers);
 }
 
+TEST(ThreadManagerTest, Metrics) {
+  base::MetricsRegistry registry;
+  auto thread_manager = ThreadManager::NewSimpleThreadManager(3);
+  thread_manager->SetThreadFactory(std::make_shared<PosixThreadFactory>());
+  thread_manager->Start();
+  {
+    ThreadManagerMetrics metrics("workers", thread_manager, &registry);
+    std::string text = registry.ExportText();
+    EXPECT_NE(std::string::npos, text.find("thread_manager_workers{pool=\"workers\"} 3\n"));
+    EXPECT_NE(std::string::npos, text.find("thread_manager_pending_tasks{pool=\"workers\"} 0\n"));
+    EXPECT_NE(std::string::npos,
+              text.find("# TYPE thread_manager_expired_tasks_total counter\n"));
+  }
+  EXPECT_EQ(std::string::npos, registry.ExportText().find("thread_manager_workers"));
+  thread_manager->Stop();
+}
+
 #if 0
 ////////////////
 class BlockTask : public Runnable {
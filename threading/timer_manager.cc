@@ -0,0 +1,323 @@
+#include "threading/timer_manager.h"
+#include "threading/function_runner.h"
+#include "threading/monitor.h"
+#include "threading/thread_factory.h"
+#include "threading/time_util.h"
+
+#include <exception>
+
+#include <glog/logging.h>
+
+namespace threading {
+
+using std::shared_ptr;
+
+const TimerManager::TimerId TimerManager::kInvalidTimerId;
+const int64_t TimerManager::kDefaultTickMs;
+const int64_t TimerManager::kMaxTicks;
+
+class TimerManager::Ticker : public Runnable {
+ public:
+  explicit Ticker(TimerManager* manager) : manager_(manager) {}
+
+  void Run() override {
+    manager_->Loop();
+  }
+
+ private:
+  TimerManager* manager_;
+};
+
+TimerManager::TimerManager(shared_ptr<ThreadManager> executor,
+                           int64_t tick_ms)
+    : executor_(executor),
+      tick_ms_(tick_ms > 0 ? tick_ms : kDefaultTickMs),
+      start_ms_(TimeUtil::MonotonicTime()),
+      running_(false),
+      next_tick_(0),
+      next_id_(kInvalidTimerId + 1) {
+  for (int i = 0; i < kRootSize; ++i) {
+    root_[i].prev = root_[i].next = &root_[i];
+  }
+  for (int l = 0; l < kLevels; ++l) {
+    for (int i = 0; i < kLevelSize; ++i) {
+      levels_[l][i].prev = levels_[l][i].next = &levels_[l][i];
+    }
+  }
+}
+
+TimerManager::~TimerManager() {
+  Stop();
+  for (auto& entry : timers_) {
+    delete entry.second;
+  }
+}
+
+void TimerManager::Start() {
+  Synchronized s(monitor_);
+  if (running_) {
+    return;
+  }
+  running_ = true;
+  PosixThreadFactory factory(ThreadFactory::ATTACHED);
+  thread_ = factory.NewThread(std::make_shared<Ticker>(this));
+  thread_->SetName("timer_manager");
+  thread_->Start();
+}
+
+void TimerManager::Stop() {
+  {
+    Synchronized s(monitor_);
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+    monitor_.NotifyAll();
+  }
+  thread_->Join();
+  thread_.reset();
+
+  Synchronized s(monitor_);
+  for (auto& entry : timers_) {
+    Unlink(entry.second);
+    delete entry.second;
+  }
+  timers_.clear();
+}
+
+int64_t TimerManager::NowTick() const {
+  return (TimeUtil::MonotonicTime() - start_ms_) / tick_ms_;
+}
+
+int64_t TimerManager::MsToTicks(int64_t ms) const {
+  return ms <= 0 ? 0 : (ms + tick_ms_ - 1) / tick_ms_;
+}
+
+TimerManager::TimerId TimerManager::ScheduleAfter(shared_ptr<Runnable> task,
+                                                  int64_t delay_ms) {
+  return Schedule(task, delay_ms, 0);
+}
+
+TimerManager::TimerId TimerManager::ScheduleAfter(const Callback& callback,
+                                                  int64_t delay_ms) {
+  return Schedule(FunctionRunner::Create(callback), delay_ms, 0);
+}
+
+TimerManager::TimerId TimerManager::ScheduleAt(shared_ptr<Runnable> task,
+                                               int64_t time_ms) {
+  return Schedule(task, time_ms - TimeUtil::CurrentTime(), 0);
+}
+
+TimerManager::TimerId TimerManager::ScheduleAt(const Callback& callback,
+                                               int64_t time_ms) {
+  return ScheduleAt(FunctionRunner::Create(callback), time_ms);
+}
+
+TimerManager::TimerId TimerManager::ScheduleRepeating(
+    shared_ptr<Runnable> task, int64_t interval_ms) {
+  return Schedule(task, interval_ms, interval_ms > 0 ? interval_ms : 1);
+}
+
+TimerManager::TimerId TimerManager::ScheduleRepeating(
+    const Callback& callback, int64_t interval_ms) {
+  return ScheduleRepeating(FunctionRunner::Create(callback), interval_ms);
+}
+
+TimerManager::TimerId TimerManager::Schedule(shared_ptr<Runnable> task,
+                                             int64_t delay_ms,
+                                             int64_t interval_ms) {
+  const int64_t elapsed_ms = TimeUtil::MonotonicTime() - start_ms_;
+
+  Synchronized s(monitor_);
+  if (timers_.empty()) {
+    // Nothing is armed, so the wheel can jump straight to the present
+    // instead of grinding through the ticks it slept over.
+    int64_t now = elapsed_ms / tick_ms_;
+    if (now > next_tick_) {
+      next_tick_ = now;
+    }
+  }
+
+  Timer* timer = new Timer();
+  timer->id = next_id_++;
+  timer->expires = MsToTicks(elapsed_ms + (delay_ms > 0 ? delay_ms : 0));
+  timer->interval = MsToTicks(interval_ms);
+  timer->task = task;
+
+  timers_[timer->id] = timer;
+  AddTimer(timer);
+  monitor_.Notify();
+  return timer->id;
+}
+
+bool TimerManager::Cancel(TimerId id) {
+  Synchronized s(monitor_);
+  auto it = timers_.find(id);
+  if (it == timers_.end()) {
+    return false;
+  }
+  Unlink(it->second);
+  delete it->second;
+  timers_.erase(it);
+  return true;
+}
+
+size_t TimerManager::PendingTimerCount() const {
+  Synchronized s(monitor_);
+  return timers_.size();
+}
+
+void TimerManager::AddTimer(Timer* timer) {
+  int64_t expires = timer->expires;
+  int64_t idx = expires - next_tick_;
+  Node* head = nullptr;
+
+  if (idx < 0) {
+    // Already due: fire on the next processed tick.
+    head = &root_[next_tick_ & kRootMask];
+  } else if (idx < kRootSize) {
+    head = &root_[expires & kRootMask];
+  } else {
+    if (idx > kMaxTicks) {
+      // Out of range: park it in the coarsest slot, cascading will place
+      // it again using the real expiry.
+      idx = kMaxTicks;
+      expires = next_tick_ + idx;
+    }
+    for (int l = 0; l < kLevels; ++l) {
+      int shift = kRootBits + l * kLevelBits;
+      if (idx < (1LL << (shift + kLevelBits))) {
+        head = &levels_[l][(expires >> shift) & kLevelMask];
+        break;
+      }
+    }
+  }
+  DCHECK(head != nullptr);
+
+  timer->prev = head->prev;
+  timer->next = head;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+// static
+void TimerManager::Unlink(Timer* timer) {
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->prev = timer->next = timer;
+}
+
+void TimerManager::Cascade(int level, int index) {
+  Node* head = &levels_[level][index];
+  Node* node = head->next;
+  head->prev = head->next = head;
+  while (node != head) {
+    Node* next = node->next;
+    AddTimer(static_cast<Timer*>(node));
+    node = next;
+  }
+}
+
+void TimerManager::Advance(std::vector<shared_ptr<Runnable>>* expired) {
+  const int64_t now = NowTick();
+  if (timers_.empty()) {
+    if (now >= next_tick_) {
+      next_tick_ = now + 1;
+    }
+    return;
+  }
+
+  while (next_tick_ <= now) {
+    const int index = next_tick_ & kRootMask;
+    if (index == 0) {
+      for (int l = 0; l < kLevels; ++l) {
+        int slot = (next_tick_ >> (kRootBits + l * kLevelBits)) & kLevelMask;
+        Cascade(l, slot);
+        if (slot != 0) {
+          break;
+        }
+      }
+    }
+    ++next_tick_;
+
+    // Detach the slot first: a repeating timer may be re-armed into it.
+    Node due;
+    Node* head = &root_[index];
+    if (head->next == head) {
+      continue;
+    }
+    due.next = head->next;
+    due.prev = head->prev;
+    due.next->prev = &due;
+    due.prev->next = &due;
+    head->prev = head->next = head;
+
+    Node* node = due.next;
+    while (node != &due) {
+      Timer* timer = static_cast<Timer*>(node);
+      node = node->next;
+
+      expired->push_back(timer->task);
+      if (timer->interval > 0) {
+        timer->expires += timer->interval;
+        if (timer->expires < next_tick_) {
+          timer->expires = next_tick_;
+        }
+        AddTimer(timer);
+      } else {
+        timers_.erase(timer->id);
+        delete timer;
+      }
+    }
+  }
+}
+
+void TimerManager::Dispatch(const std::vector<shared_ptr<Runnable>>& expired) {
+  for (const auto& task : expired) {
+    try {
+      executor_->Add(task);
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "TimerManager failed to dispatch a task: " << e.what();
+    }
+  }
+}
+
+void TimerManager::Loop() {
+  std::vector<shared_ptr<Runnable>> expired;
+  for (;;) {
+    {
+      Synchronized s(monitor_);
+      for (;;) {
+        if (!running_) {
+          return;
+        }
+        Advance(&expired);
+        if (!expired.empty()) {
+          break;
+        }
+        if (timers_.empty()) {
+          monitor_.WaitForever();
+          continue;
+        }
+
+        // Sleep until the next non-empty root slot, or the next cascade.
+        int64_t wake_tick = next_tick_;
+        while (root_[wake_tick & kRootMask].next == &root_[wake_tick & kRootMask]) {
+          ++wake_tick;
+          if ((wake_tick & kRootMask) == 0) {
+            break;
+          }
+        }
+        int64_t wait_ms = start_ms_ + wake_tick * tick_ms_
+                          - TimeUtil::MonotonicTime();
+        if (wait_ms > 0) {
+          monitor_.WaitForTimeRelative(wait_ms);
+        }
+      }
+    }
+    Dispatch(expired);
+    expired.clear();
+  }
+}
+
+} // namespace threading
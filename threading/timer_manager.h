@@ -0,0 +1,148 @@
+#ifndef THREADING_TIMER_MANAGER_H_
+#define THREADING_TIMER_MANAGER_H_
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "base/macros.h"
+#include "threading/futex_monitor.h"
+#include "threading/thread.h"
+#include "threading/thread_manager.h"
+
+namespace threading {
+
+/**
+ * TimerManager runs tasks later without dedicating a thread per timer.
+ *
+ * Timers live in a hierarchical timing wheel (the classic Linux kernel
+ * layout: one 256-slot wheel of single ticks followed by three 64-slot
+ * wheels of increasingly coarse granularity), so scheduling and cancelling
+ * are O(1). A single ticker thread advances the wheel once per tick and
+ * hands every expired task to the ThreadManager given at construction; no
+ * user code ever runs on the ticker thread.
+ *
+ * Times are in milliseconds and are rounded up to the tick granularity.
+ * Delays beyond the wheel range (2^26 ticks, about 7.7 days at 10ms) are
+ * clamped to the range and re-cascaded, so they still fire on time.
+ */
+class TimerManager {
+ public:
+  typedef uint64_t TimerId;
+  typedef std::function<void()> Callback;
+
+  static const TimerId kInvalidTimerId = 0;
+  static const int64_t kDefaultTickMs = 10;
+
+  explicit TimerManager(std::shared_ptr<ThreadManager> executor,
+                        int64_t tick_ms = kDefaultTickMs);
+  ~TimerManager();
+
+  /**
+   * Starts the ticker thread. Timers may be scheduled before Start(); they
+   * will not fire until it is called.
+   */
+  void Start();
+
+  /**
+   * Stops the ticker thread and drops every pending timer.
+   */
+  void Stop();
+
+  /**
+   * Runs `task` once, `delay_ms` milliseconds from now.
+   */
+  TimerId ScheduleAfter(std::shared_ptr<Runnable> task, int64_t delay_ms);
+  TimerId ScheduleAfter(const Callback& callback, int64_t delay_ms);
+
+  /**
+   * Runs `task` once at `time_ms`, in the TimeUtil::CurrentTime() clock.
+   * Times in the past fire on the next tick.
+   */
+  TimerId ScheduleAt(std::shared_ptr<Runnable> task, int64_t time_ms);
+  TimerId ScheduleAt(const Callback& callback, int64_t time_ms);
+
+  /**
+   * Runs `task` every `interval_ms` milliseconds, the first time after
+   * `interval_ms`, until cancelled. Runs never overlap on the ticker side,
+   * but a slow task may still be running on the executor when the next one
+   * is dispatched.
+   */
+  TimerId ScheduleRepeating(std::shared_ptr<Runnable> task,
+                            int64_t interval_ms);
+  TimerId ScheduleRepeating(const Callback& callback, int64_t interval_ms);
+
+  /**
+   * Cancels a pending timer. Returns false if it already fired (one-shot)
+   * or was never scheduled. A task that has already been handed to the
+   * executor is not interrupted.
+   */
+  bool Cancel(TimerId id);
+
+  /**
+   * Number of timers currently armed.
+   */
+  size_t PendingTimerCount() const;
+
+  class Ticker;
+
+ private:
+  struct Node {
+    Node* prev;
+    Node* next;
+  };
+
+  struct Timer : public Node {
+    TimerId id;
+    int64_t expires;      // absolute tick
+    int64_t interval;     // ticks, 0 for one-shot timers
+    std::shared_ptr<Runnable> task;
+  };
+
+  static const int kRootBits = 8;
+  static const int kLevelBits = 6;
+  static const int kRootSize = 1 << kRootBits;
+  static const int kLevelSize = 1 << kLevelBits;
+  static const int kRootMask = kRootSize - 1;
+  static const int kLevelMask = kLevelSize - 1;
+  static const int kLevels = 3;
+  static const int64_t kMaxTicks =
+      (1LL << (kRootBits + kLevels * kLevelBits)) - 1;
+
+  TimerId Schedule(std::shared_ptr<Runnable> task,
+                   int64_t delay_ms,
+                   int64_t interval_ms);
+
+  int64_t NowTick() const;
+  int64_t MsToTicks(int64_t ms) const;
+
+  void AddTimer(Timer* timer);
+  static void Unlink(Timer* timer);
+  void Cascade(int level, int index);
+
+  // Advances the wheel up to the current time and collects due tasks.
+  void Advance(std::vector<std::shared_ptr<Runnable>>* expired);
+  void Dispatch(const std::vector<std::shared_ptr<Runnable>>& expired);
+  void Loop();
+
+  const std::shared_ptr<ThreadManager> executor_;
+  const int64_t tick_ms_;
+  const int64_t start_ms_;
+
+  FutexMonitor monitor_;
+  bool running_;
+  int64_t next_tick_;     // the next tick the wheel will process
+  TimerId next_id_;
+
+  Node root_[kRootSize];
+  Node levels_[kLevels][kLevelSize];
+  std::unordered_map<TimerId, Timer*> timers_;
+
+  std::shared_ptr<Thread> thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimerManager);
+};
+
+} // namespace threading
+#endif // THREADING_TIMER_MANAGER_H_
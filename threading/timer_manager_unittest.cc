@@ -0,0 +1,137 @@
+#include "threading/timer_manager.h"
+#include "threading/thread_manager.h"
+#include "threading/thread_factory.h"
+#include "threading/monitor.h"
+#include "threading/time_util.h"
+
+#include <atomic>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+using namespace threading;
+
+class TimerManagerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    executor_ = ThreadManager::NewSimpleThreadManager(2);
+    executor_->SetThreadFactory(std::make_shared<PosixThreadFactory>());
+    executor_->Start();
+  }
+
+  void TearDown() override {
+    executor_->Join();
+  }
+
+  // Waits until `count` reaches `expected` or `timeout_ms` elapses.
+  bool WaitFor(const std::atomic<int>& count, int expected, int64_t timeout_ms) {
+    int64_t end = TimeUtil::MonotonicTime() + timeout_ms;
+    while (count.load() < expected) {
+      if (TimeUtil::MonotonicTime() > end) {
+        return false;
+      }
+      usleep(1000);
+    }
+    return true;
+  }
+
+  std::shared_ptr<ThreadManager> executor_;
+};
+
+TEST_F(TimerManagerTest, Schedule_After) {
+  TimerManager timers(executor_, 1);
+  timers.Start();
+
+  std::atomic<int> fired(0);
+  int64_t start = TimeUtil::MonotonicTime();
+  int64_t fired_at = 0;
+  timers.ScheduleAfter([&] {
+    fired_at = TimeUtil::MonotonicTime();
+    fired++;
+  }, 50);
+
+  EXPECT_TRUE(WaitFor(fired, 1, 1000));
+  EXPECT_GE(fired_at - start, 50);
+  EXPECT_EQ(0u, timers.PendingTimerCount());
+}
+
+TEST_F(TimerManagerTest, Cascade_Beyond_Root_Wheel) {
+  // 300 ticks does not fit in the 256-slot root wheel.
+  TimerManager timers(executor_, 1);
+  timers.Start();
+
+  std::atomic<int> fired(0);
+  int64_t start = TimeUtil::MonotonicTime();
+  int64_t fired_at = 0;
+  timers.ScheduleAfter([&] {
+    fired_at = TimeUtil::MonotonicTime();
+    fired++;
+  }, 300);
+
+  EXPECT_TRUE(WaitFor(fired, 1, 2000));
+  EXPECT_GE(fired_at - start, 300);
+  EXPECT_LT(fired_at - start, 600);
+}
+
+TEST_F(TimerManagerTest, Schedule_At_Past) {
+  TimerManager timers(executor_);
+  timers.Start();
+
+  std::atomic<int> fired(0);
+  timers.ScheduleAt([&] { fired++; }, TimeUtil::CurrentTime() - 1000);
+  EXPECT_TRUE(WaitFor(fired, 1, 1000));
+}
+
+TEST_F(TimerManagerTest, Cancel) {
+  TimerManager timers(executor_, 1);
+  timers.Start();
+
+  std::atomic<int> fired(0);
+  TimerManager::TimerId id = timers.ScheduleAfter([&] { fired++; }, 50);
+  EXPECT_EQ(1u, timers.PendingTimerCount());
+  EXPECT_TRUE(timers.Cancel(id));
+  EXPECT_FALSE(timers.Cancel(id));
+  EXPECT_EQ(0u, timers.PendingTimerCount());
+
+  usleep(100 * TimeUtil::US_PER_MS);
+  EXPECT_EQ(0, fired.load());
+}
+
+TEST_F(TimerManagerTest, Repeating) {
+  TimerManager timers(executor_, 1);
+  timers.Start();
+
+  std::atomic<int> fired(0);
+  TimerManager::TimerId id = timers.ScheduleRepeating([&] { fired++; }, 10);
+  EXPECT_TRUE(WaitFor(fired, 5, 1000));
+  EXPECT_TRUE(timers.Cancel(id));
+
+  usleep(50 * TimeUtil::US_PER_MS);
+  int after_cancel = fired.load();
+  usleep(50 * TimeUtil::US_PER_MS);
+  EXPECT_EQ(after_cancel, fired.load());
+}
+
+TEST_F(TimerManagerTest, Many_Timers) {
+  const int kTimers = 10000;
+  TimerManager timers(executor_, 1);
+  timers.Start();
+
+  std::atomic<int> fired(0);
+  for (int i = 0; i < kTimers; ++i) {
+    timers.ScheduleAfter([&] { fired++; }, i % 500);
+  }
+  EXPECT_TRUE(WaitFor(fired, kTimers, 5000));
+  EXPECT_EQ(0u, timers.PendingTimerCount());
+}
+
+TEST_F(TimerManagerTest, Stop_Drops_Pending) {
+  TimerManager timers(executor_);
+  timers.Start();
+
+  std::atomic<int> fired(0);
+  timers.ScheduleAfter([&] { fired++; }, 60 * 1000);
+  timers.Stop();
+  EXPECT_EQ(0u, timers.PendingTimerCount());
+  EXPECT_EQ(0, fired.load());
+}